@@ -47,6 +47,28 @@
 #define vsnprintf simple_vsnprintf
 #define snprintf simple_snprintf
 #define sprintf simple_sprintf
+
+// ACPICA's own string functions go byte by byte, so everything but utclib.c (which defines ACPI_CLIBRARY and has those versions)
+// uses the vectorized ones in startup/avxmem.c instead
+#ifdef ACPI_CLIBRARY
+#define strlen simple_strlen
+#define strcmp simple_strcmp
+#define strncmp simple_strncmp
+#define strchr simple_strchr
+#define strstr simple_strstr
+#else
+#define strlen AVXmem_strlen
+#define strcmp AVXmem_strcmp
+#define strncmp AVXmem_strncmp
+#define strchr AVXmem_strchr
+#define strstr AVXmem_strstr
+#endif
+
+// AcpiTbChecksum() (tbprint.c), which validates every table, uses the vectorized 8-bit sum in startup/checksum.c
+#include <stddef.h>
+unsigned char AVX_sum8(const void *data, size_t numbytes);
+#define ACPI_USE_NATIVE_TABLE_CHECKSUM
+#define AcpiOsTableChecksum(Buffer, Length) AVX_sum8((Buffer), (Length))
 // For now...
 #define ACPI_SINGLE_THREADED
 
@@ -367,6 +367,11 @@ AcpiTbChecksum (
     UINT8                   *Buffer,
     UINT32                  Length)
 {
+#ifdef ACPI_USE_NATIVE_TABLE_CHECKSUM
+
+    return ((UINT8) AcpiOsTableChecksum (Buffer, Length));
+
+#else
     UINT8                   Sum = 0;
     UINT8                   *End = Buffer + Length;
 
@@ -377,4 +382,5 @@ AcpiTbChecksum (
     }
 
     return (Sum);
+#endif
 }
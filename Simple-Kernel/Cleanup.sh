@@ -36,6 +36,7 @@ cd ../Backend
 rm Kernel64.elf
 rm Kernel64-Sandybridge.elf
 rm Kernel64-Ryzen.elf
+rm Kernel64-Generic.elf
 rm output.map
 rm objects.list
 
@@ -73,6 +74,34 @@ rm *.o
 rm *.d
 rm *.out
 
+#
+# Move into host benchmark directory (see Compile-Hostbench.sh)
+#
+
+cd $CurDir/hostbench
+
+#
+# Delete compiled object files and the benchmark
+#
+
+rm *.o
+rm Hostbench
+
+#
+# Move into host memory test directory (see Compile-Memtest.sh)
+#
+
+cd $CurDir/hostbench/memtest
+
+#
+# Delete compiled object files, the generated no-buddy copy of Memory.c, and the tests
+#
+
+rm *.o
+rm Memory_NoBuddy.c
+rm Memtest
+rm Memtest-NoBuddy
+
 #
 # Return to folder started from
 #
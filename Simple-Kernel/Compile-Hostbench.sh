@@ -0,0 +1,76 @@
+#!/bin/bash
+#
+# =================================
+#
+# GCC AVX_mem* Host Benchmark Linux Compile Script
+#
+# =================================
+#
+# Builds hostbench/Hostbench, a regular Linux program that times the startup/
+# memory functions against glibc's (see hostbench/hostbench.c for what it
+# measures and how). The startup/ files are compiled unchanged with the same
+# optimization flags as Compile.sh, but with memcpy, memmove, memset, and
+# memcmp renamed so that they don't replace glibc's for the whole program.
+#
+# The default build is made for -march=nehalem like Compile-Generic.sh, so the
+# AVX/AVX2/AVX512 builds get picked at runtime just like in the kernel. Set
+# MARCH to benchmark a different default build, e.g. MARCH=skylake for the one
+# Compile.sh makes (the CPU running it then needs to support that, too).
+#
+
+#
+# set +v disables displaying all of the code you see here in the command line
+#
+
+set +v
+
+#
+# Set various paths needed for compilation
+#
+
+CurDir=$PWD
+GCC_FOLDER_NAME=/usr
+MARCH=${MARCH:-nehalem}
+OutDir=$CurDir/hostbench
+
+RENAMES="-Dmemcpy=hostbench_memcpy -Dmemmove=hostbench_memmove -Dmemset=hostbench_memset -Dmemcmp=hostbench_memcmp"
+CFLAGS="-march=$MARCH -mtune=generic -m64 -O3 -ffreestanding -fno-strict-aliasing --std=gnu11 -I$CurDir/startup/ -Wall -Wextra -Wdouble-promotion -Wpedantic -fmessage-length=0"
+
+#
+# Compile the memory library from the startup folder, plus its runtime dispatch.
+# The avxmem_<isa>.c builds already rename everything with a suffix of their own.
+#
+
+set -v
+for f in memcpy memmove memset memcmp memstr avxmem; do
+  "$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/$f.o" "$CurDir/startup/$f.c" &
+done
+for f in avxmem_avx avxmem_avx2 avxmem_avx512; do
+  "$GCC_FOLDER_NAME/bin/gcc" $CFLAGS -c -o "$OutDir/$f.o" "$CurDir/startup/$f.c" &
+done
+set +v
+
+#
+# Compile the benchmark itself. glibc_mem.c is the only file that gets the real
+# glibc names.
+#
+
+set -v
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -U__STRICT_ANSI__ -fno-builtin -c -o "$OutDir/hostbench.o" "$OutDir/hostbench.c" &
+"$GCC_FOLDER_NAME/bin/gcc" -march=$MARCH -mtune=generic -m64 -O2 -fno-builtin --std=gnu11 -Wall -Wextra -c -o "$OutDir/glibc_mem.o" "$OutDir/glibc_mem.c" &
+set +v
+
+#
+# Wait for compilation to finish, then link
+#
+
+wait
+echo "Done compiling. Linking..."
+
+set -v
+"$GCC_FOLDER_NAME/bin/gcc" -o "$OutDir/Hostbench" "$OutDir"/*.o
+set +v
+
+echo
+echo "Built $OutDir/Hostbench. Run it with -h to see the options."
+echo
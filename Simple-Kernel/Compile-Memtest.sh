@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# =================================
+#
+# GCC Memory Allocator Host Test Linux Compile Script
+#
+# =================================
+#
+# Builds hostbench/memtest/Memtest, a regular Linux program that runs the
+# src/Memory.c allocators on fake RAM and checks them after every call (see
+# hostbench/memtest/memtest.c for the tests). Memory.c and Global_Vars.c are
+# compiled unchanged, but afterwards malloc, calloc, realloc, and free get
+# renamed in the object files so that glibc keeps its own. (A -D rename would
+# also hit __attribute__((malloc)).) The startup/ memory library gets the same
+# renames Compile-Hostbench.sh uses.
+#
+# Also builds hostbench/memtest/Memtest-NoBuddy from a copy of Memory.c with
+# BUDDY_ALLOCATOR commented out, so both ways of getting pages get tested.
+#
+
+#
+# set +v disables displaying all of the code you see here in the command line
+#
+
+set +v
+
+#
+# Set various paths needed for compilation
+#
+
+CurDir=$PWD
+GCC_FOLDER_NAME=/usr
+OutDir=$CurDir/hostbench/memtest
+
+RENAMES="-Dmemcpy=hostbench_memcpy -Dmemmove=hostbench_memmove -Dmemset=hostbench_memset -Dmemcmp=hostbench_memcmp"
+KRENAMES="--redefine-sym malloc=kernel_malloc --redefine-sym calloc=kernel_calloc --redefine-sym realloc=kernel_realloc --redefine-sym free=kernel_free"
+CFLAGS="-march=nehalem -mtune=generic -m64 -O2 -g -fno-builtin -fno-strict-aliasing --std=gnu11 -I$CurDir/inc/ -I$CurDir/startup/ -I$OutDir/ -Wall -Wextra -Wno-unused-parameter -fmessage-length=0"
+
+#
+# Compile the memory library from the startup folder, plus its runtime dispatch
+#
+
+set -v
+for f in memcpy memmove memset memcmp memstr avxmem avxmem_parallel; do
+  "$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/$f.o" "$CurDir/startup/$f.c" &
+done
+for f in avxmem_avx avxmem_avx2 avxmem_avx512; do
+  "$GCC_FOLDER_NAME/bin/gcc" $CFLAGS -c -o "$OutDir/$f.o" "$CurDir/startup/$f.c" &
+done
+set +v
+
+#
+# Compile the allocators, both ways, and the test itself
+#
+
+sed 's|^#define BUDDY_ALLOCATOR|//#define BUDDY_ALLOCATOR|' "$CurDir/src/Memory.c" > "$OutDir/Memory_NoBuddy.c"
+
+set -v
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/Memory.o" "$CurDir/src/Memory.c" &
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/Memory_NoBuddy.o" "$OutDir/Memory_NoBuddy.c" &
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/Global_Vars.o" "$CurDir/src/Global_Vars.c" &
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/memtest_env.o" "$OutDir/memtest_env.c" &
+"$GCC_FOLDER_NAME/bin/gcc" $CFLAGS $RENAMES -c -o "$OutDir/memtest.o" "$OutDir/memtest.c" &
+set +v
+
+#
+# Wait for compilation to finish, then link
+#
+
+wait
+echo "Done compiling. Linking..."
+
+for f in Memory Memory_NoBuddy Global_Vars memtest_env memtest; do
+  "$GCC_FOLDER_NAME/bin/objcopy" $KRENAMES "$OutDir/$f.o"
+done
+
+LIBOBJS="$OutDir/memcpy.o $OutDir/memmove.o $OutDir/memset.o $OutDir/memcmp.o $OutDir/memstr.o $OutDir/avxmem.o $OutDir/avxmem_parallel.o $OutDir/avxmem_avx.o $OutDir/avxmem_avx2.o $OutDir/avxmem_avx512.o"
+TESTOBJS="$OutDir/Global_Vars.o $OutDir/memtest_env.o $OutDir/memtest.o"
+
+set -v
+"$GCC_FOLDER_NAME/bin/gcc" -o "$OutDir/Memtest" "$OutDir/Memory.o" $TESTOBJS $LIBOBJS
+"$GCC_FOLDER_NAME/bin/gcc" -o "$OutDir/Memtest-NoBuddy" "$OutDir/Memory_NoBuddy.o" $TESTOBJS $LIBOBJS
+set +v
+
+echo
+echo "Built $OutDir/Memtest and $OutDir/Memtest-NoBuddy. Run them with -h to see the options."
+echo
@@ -0,0 +1,31 @@
+//==================================================================================================================================
+//  Host Benchmark: glibc Reference Functions
+//==================================================================================================================================
+//
+// The library's files get built with memcpy, memmove, memset, and memcmp renamed (see Compile-Hostbench.sh) so they don't take over
+// glibc's, which means hostbench.c can't include string.h. These wrappers live in their own file so it can call the real ones, and
+// -fno-builtin keeps GCC from swapping the calls for inline code that wouldn't be what programs actually get.
+//
+
+#include <stddef.h>
+#include <string.h>
+
+void * glibc_memcpy(void *dest, void *src, size_t numbytes)
+{
+  return memcpy(dest, src, numbytes);
+}
+
+void * glibc_memmove(void *dest, void *src, size_t numbytes)
+{
+  return memmove(dest, src, numbytes);
+}
+
+void * glibc_memset(void *dest, const unsigned char val, size_t numbytes)
+{
+  return memset(dest, val, numbytes);
+}
+
+int glibc_memcmp(const void *str1, const void *str2, size_t numbytes)
+{
+  return memcmp(str1, str2, numbytes);
+}
@@ -0,0 +1,554 @@
+//==================================================================================================================================
+//  Host Benchmark: AVX_mem* vs. glibc
+//==================================================================================================================================
+//
+// A Linux program for timing the kernel's AVX_memcpy, AVX_memmove, AVX_memset, and AVX_memcmp without booting anything. It links
+// against the same startup/ sources the kernel uses, unchanged, and picks a build through AVXmem_Select() the same way Enable_AVX()
+// does, so the numbers are for exactly what the kernel would run on this CPU. Build it with Compile-Hostbench.sh.
+//
+// Each function is timed at sizes from 1 byte up to the maximum (1GB by default), at powers of 2 and halfway between them, both with
+// everything 64-byte aligned and across a sweep of misaligned offsets, and then the same again for glibc's version. Results are in
+// GB/s (bytes of dest per nanosecond, so a 1GB copy that takes 0.1s is 10 GB/s) and cycles per byte, for the fastest of 3 runs.
+// Cycles are TSC ticks, which count at a fixed rate no matter what the core clock is doing.
+//
+// Offset sweeps (-o):
+//  none:     Aligned only
+//  relative: Aligned, then dest offset 1-63 with src aligned and src offset 1-63 with dest aligned (the default)
+//  full:     Every combination of dest and src offsets 0-63
+// Above 1MB, only offsets 0, 1, 15, 16, 31, 32, and 63 are used, or the sweep would take hours.
+//
+// memmove is timed with dest above src and overlapping it by half, which is the case that can't just be a forward copy. memcmp
+// compares two equal buffers, so it always reads all the way to the end.
+//
+// Before timing memmove, check_memmove() makes sure moves above the non-temporal threshold come out right, since those go through
+// block functions that the timings alone would never catch skipping part of the range.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <cpuid.h>
+#include <x86intrin.h>
+#include "avxmem.h"
+
+void * glibc_memcpy(void *dest, void *src, size_t numbytes);
+void * glibc_memmove(void *dest, void *src, size_t numbytes);
+void * glibc_memset(void *dest, const unsigned char val, size_t numbytes);
+int glibc_memcmp(const void *str1, const void *str2, size_t numbytes);
+
+#define FUNC_MEMCPY  0
+#define FUNC_MEMMOVE 1
+#define FUNC_MEMSET  2
+#define FUNC_MEMCMP  3
+#define NUM_FUNCS    4
+
+#define OFFSETS_NONE     0
+#define OFFSETS_RELATIVE 1
+#define OFFSETS_FULL     2
+
+#define LARGE_SIZE (1ULL << 20) // Sizes above this get the shorter offset list
+#define REP_BYTES (1ULL << 18) // Small sizes get called enough times per run to cover about this much
+#define MAX_REPS 4096
+#define NUM_RUNS 3
+
+static const char * Func_Names[NUM_FUNCS] = {"memcpy", "memmove", "memset", "memcmp"};
+static const char * Level_Names[4] = {"SSE4.2", "AVX", "AVX2", "AVX512"};
+
+static const size_t Large_Offsets[] = {0, 1, 15, 16, 31, 32, 63};
+#define NUM_LARGE_OFFSETS (sizeof(Large_Offsets) / sizeof(Large_Offsets[0]))
+
+// Buf_A is the source (and, for memmove, also the destination), Buf_B is the destination. Both are 64-byte aligned.
+static uint8_t * Buf_A;
+static uint8_t * Buf_B;
+
+static volatile int Sink; // Keeps memcmp results alive
+
+typedef struct {
+  double Aligned_GBps;
+  double Aligned_CPB; // Cycles per byte
+  double Worst_GBps; // Slowest offset pair
+} RESULT;
+
+static int streq(const char *a, const char *b);
+static size_t parse_size(const char *str);
+static uint32_t detect_level(uint32_t *erms, uint32_t *fsrm);
+static size_t memmove_shift(size_t size);
+static uint8_t check_pattern(size_t index);
+static int check_memmove(size_t max_size);
+static void measure(int func, int glibc, size_t size, size_t dest_off, size_t src_off, double *ticks, double *ns);
+static RESULT sweep(int func, int glibc, size_t size, int offsets);
+static void usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+  int func_mask = (1 << NUM_FUNCS) - 1;
+  size_t max_size = 1ULL << 30;
+  int offsets = OFFSETS_RELATIVE;
+  int forced_level = -1;
+  int erms_off = 0;
+  size_t nt_threshold = 0;
+
+  for(int arg = 1; arg < argc; arg++)
+  {
+    if(streq(argv[arg], "-f") && (arg + 1 < argc))
+    {
+      arg++;
+      func_mask = 0;
+      for(int func = 0; func < NUM_FUNCS; func++)
+      {
+        if(streq(argv[arg], Func_Names[func]))
+        {
+          func_mask = 1 << func;
+        }
+      }
+      if(streq(argv[arg], "all"))
+      {
+        func_mask = (1 << NUM_FUNCS) - 1;
+      }
+      if(!func_mask)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if(streq(argv[arg], "-m") && (arg + 1 < argc))
+    {
+      max_size = parse_size(argv[++arg]);
+    }
+    else if(streq(argv[arg], "-o") && (arg + 1 < argc))
+    {
+      arg++;
+      if(streq(argv[arg], "none"))
+      {
+        offsets = OFFSETS_NONE;
+      }
+      else if(streq(argv[arg], "relative"))
+      {
+        offsets = OFFSETS_RELATIVE;
+      }
+      else if(streq(argv[arg], "full"))
+      {
+        offsets = OFFSETS_FULL;
+      }
+      else
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if(streq(argv[arg], "-l") && (arg + 1 < argc))
+    {
+      arg++;
+      for(int level = 0; level < 4; level++)
+      {
+        if(streq(argv[arg], Level_Names[level]))
+        {
+          forced_level = level;
+        }
+      }
+      if(forced_level < 0)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if(streq(argv[arg], "-e"))
+    {
+      erms_off = 1;
+    }
+    else if(streq(argv[arg], "-t") && (arg + 1 < argc))
+    {
+      nt_threshold = parse_size(argv[++arg]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(max_size == 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Same choices Enable_AVX() makes
+  uint32_t erms = 0;
+  uint32_t fsrm = 0;
+  uint32_t level = detect_level(&erms, &fsrm);
+
+  if(forced_level >= 0)
+  {
+    if((uint32_t)forced_level > level)
+    {
+      printf("This CPU can't run the %s build.\n", Level_Names[forced_level]);
+      return 1;
+    }
+    level = (uint32_t)forced_level;
+  }
+  if(erms_off)
+  {
+    erms = 0;
+  }
+
+  AVXmem_Select(level, erms, fsrm);
+
+  if(nt_threshold == 0)
+  {
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if(llc <= 0)
+    {
+      llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+    nt_threshold = (llc > 0) ? ((size_t)llc >> 1) : CACHESIZELIMIT;
+  }
+  AVXmem_Dispatch.NT_Threshold = nt_threshold;
+
+  // memmove needs room for dest to sit above src by about half the size, and everything needs 64 bytes of slack for the offsets
+  while(max_size)
+  {
+    Buf_A = aligned_alloc(64, ((max_size + memmove_shift(max_size) + 128 + 63) & ~63ULL));
+    Buf_B = aligned_alloc(64, ((max_size + 128 + 63) & ~63ULL));
+    if(Buf_A && Buf_B)
+    {
+      break;
+    }
+    free(Buf_A);
+    free(Buf_B);
+    max_size >>= 1;
+    printf("Not enough memory, trying a maximum size of %zu bytes instead.\n", max_size);
+  }
+  if(!max_size)
+  {
+    return 1;
+  }
+
+  // Fault everything in up front so page faults don't end up in the timings
+  glibc_memset(Buf_A, 0x5A, max_size + memmove_shift(max_size) + 128);
+  glibc_memset(Buf_B, 0x5A, max_size + 128);
+
+  printf("Build: %s, ERMS: %s, FSRM: %s, NT threshold: %zu bytes\n", Level_Names[AVXmem_Dispatch.Level], AVXmem_Dispatch.ERMS ? "on" : "off", AVXmem_Dispatch.FSRM ? "on" : "off", AVXmem_Dispatch.NT_Threshold);
+  printf("GB/s and cycles (TSC ticks) per byte, best of %d runs; worst is the slowest misaligned offset pair\n", NUM_RUNS);
+
+  if((func_mask & (1 << FUNC_MEMMOVE)) && check_memmove(max_size))
+  {
+    free(Buf_A);
+    free(Buf_B);
+    return 1;
+  }
+
+  for(int func = 0; func < NUM_FUNCS; func++)
+  {
+    if(!(func_mask & (1 << func)))
+    {
+      continue;
+    }
+
+    printf("\n%s\n", Func_Names[func]);
+    printf("      Size |  AVX GB/s   c/B   Worst |  glibc GB/s   c/B   Worst | AVX/glibc\n");
+
+    // 1, 2, 3, 4, 6, 8, 12, 16, 24, ...
+    for(size_t power = 1; power <= max_size; power <<= 1)
+    {
+      for(size_t size = power; (size <= max_size) && (size < (power << 1)); size += ((power >= 2) ? (power >> 1) : power))
+      {
+        RESULT Ours = sweep(func, 0, size, offsets);
+        RESULT Glibc = sweep(func, 1, size, offsets);
+
+        printf("%10zu | %9.2f %5.3f %7.2f | %11.2f %5.3f %7.2f | %9.2f\n", size, Ours.Aligned_GBps, Ours.Aligned_CPB, Ours.Worst_GBps, Glibc.Aligned_GBps, Glibc.Aligned_CPB, Glibc.Worst_GBps, Ours.Aligned_GBps / Glibc.Aligned_GBps);
+        fflush(stdout);
+      }
+    }
+  }
+
+  free(Buf_A);
+  free(Buf_B);
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  check_memmove: Check Moves Above the Non-Temporal Threshold
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Moves a range a little over the threshold (and not a multiple of any block size) by half its size, down and then up, with dest
+// both aligned and not, and checks every byte against check_pattern(). The pattern doesn't repeat, so a block that got skipped or
+// landed in the wrong place can't happen to hold the right values. Returns 1 if anything came out wrong, 0 otherwise.
+//
+
+static int check_memmove(size_t max_size)
+{
+  size_t size = AVXmem_Dispatch.NT_Threshold + 4096 + 4096 + 192 + 7;
+
+  if(size > max_size)
+  {
+    printf("\nSkipping the memmove check, since it needs a maximum size of at least %zu bytes.\n", size);
+    return 0;
+  }
+
+  size_t shift = memmove_shift(size);
+
+  for(size_t dest_off = 0; dest_off < 64; dest_off += 33)
+  {
+    for(int up = 0; up < 2; up++)
+    {
+      uint8_t * low = Buf_A + dest_off;
+      uint8_t * high = Buf_A + shift;
+
+      for(size_t index = 0; index < size + shift; index++)
+      {
+        Buf_A[index] = check_pattern(index);
+      }
+
+      // Up is dest above src, so it has to go in reverse
+      uint8_t * dest = up ? high : low;
+      uint8_t * src = up ? low : high;
+      size_t src_index = (size_t)(src - Buf_A);
+
+      AVX_memmove(dest, src, size);
+
+      for(size_t index = 0; index < size; index++)
+      {
+        if(dest[index] != check_pattern(src_index + index))
+        {
+          printf("\nmemmove check failed: %zu bytes %s by %zu, dest offset %zu, first wrong byte at %zu.\n", size, up ? "up" : "down", shift - dest_off, dest_off, index);
+          return 1;
+        }
+      }
+    }
+  }
+
+  glibc_memset(Buf_A, 0x5A, size + shift);
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  sweep: Time One Function at One Size Across the Offsets
+//----------------------------------------------------------------------------------------------------------------------------------
+
+static RESULT sweep(int func, int glibc, size_t size, int offsets)
+{
+  RESULT Result;
+  double ticks;
+  double ns;
+
+  measure(func, glibc, size, 0, 0, &ticks, &ns);
+  Result.Aligned_GBps = (double)size / ns;
+  Result.Aligned_CPB = ticks / (double)size;
+  Result.Worst_GBps = Result.Aligned_GBps;
+
+  if(offsets == OFFSETS_NONE)
+  {
+    return Result;
+  }
+
+  size_t num_offsets = (size > LARGE_SIZE) ? NUM_LARGE_OFFSETS : 64;
+
+  for(size_t dest_index = 0; dest_index < num_offsets; dest_index++)
+  {
+    for(size_t src_index = 0; src_index < num_offsets; src_index++)
+    {
+      size_t dest_off = (size > LARGE_SIZE) ? Large_Offsets[dest_index] : dest_index;
+      size_t src_off = (size > LARGE_SIZE) ? Large_Offsets[src_index] : src_index;
+
+      if(
+          ((dest_off == 0) && (src_off == 0)) // Already done
+          ||
+          ((offsets == OFFSETS_RELATIVE) && dest_off && src_off)
+          ||
+          ((func == FUNC_MEMSET) && src_off) // No src
+        )
+      {
+        continue;
+      }
+
+      measure(func, glibc, size, dest_off, src_off, &ticks, &ns);
+
+      double GBps = (double)size / ns;
+      if(GBps < Result.Worst_GBps)
+      {
+        Result.Worst_GBps = GBps;
+      }
+    }
+  }
+
+  return Result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  measure: Time One Function at One Size and Offset Pair
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// ticks and ns get the fastest of NUM_RUNS runs, per call.
+//
+
+static void measure(int func, int glibc, size_t size, size_t dest_off, size_t src_off, double *ticks, double *ns)
+{
+  size_t reps = REP_BYTES / size;
+  if(reps == 0)
+  {
+    reps = 1;
+  }
+  else if(reps > MAX_REPS)
+  {
+    reps = MAX_REPS;
+  }
+
+  uint8_t * src = Buf_A + src_off;
+  uint8_t * dest = (func == FUNC_MEMMOVE) ? (Buf_A + memmove_shift(size) + dest_off) : (Buf_B + dest_off);
+
+  *ticks = 1e300;
+  *ns = 1e300;
+
+  for(int run = 0; run < NUM_RUNS; run++)
+  {
+    struct timespec start_time, end_time;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    uint64_t start_tick = __rdtsc();
+
+    for(size_t rep = 0; rep < reps; rep++)
+    {
+      switch(func)
+      {
+        case FUNC_MEMCPY:
+          glibc ? glibc_memcpy(dest, src, size) : AVX_memcpy(dest, src, size);
+          break;
+        case FUNC_MEMMOVE:
+          glibc ? glibc_memmove(dest, src, size) : AVX_memmove(dest, src, size);
+          break;
+        case FUNC_MEMSET:
+          glibc ? glibc_memset(dest, (uint8_t)rep, size) : AVX_memset(dest, (uint8_t)rep, size);
+          break;
+        case FUNC_MEMCMP:
+          Sink = glibc ? glibc_memcmp(dest, src, size) : AVX_memcmp(dest, src, size, 1);
+          break;
+      }
+    }
+
+    uint64_t end_tick = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    double run_ns = (double)(end_time.tv_sec - start_time.tv_sec) * 1e9 + (double)(end_time.tv_nsec - start_time.tv_nsec);
+    double run_ticks = (double)(end_tick - start_tick);
+
+    // At least 1ns so that a run too short for the clock doesn't divide by 0
+    if(run_ns < 1.0)
+    {
+      run_ns = 1.0;
+    }
+
+    if(run_ticks / (double)reps < *ticks)
+    {
+      *ticks = run_ticks / (double)reps;
+    }
+    if(run_ns / (double)reps < *ns)
+    {
+      *ns = run_ns / (double)reps;
+    }
+  }
+
+  // Put memcmp's buffers back to equal, since memset and memmove leave Buf_B and the top of Buf_A holding other values
+  if((func == FUNC_MEMSET) || (func == FUNC_MEMMOVE))
+  {
+    glibc_memset(dest, 0x5A, size);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Helpers
+//----------------------------------------------------------------------------------------------------------------------------------
+
+// How far above src memmove's dest goes: half the size, rounded to 64 bytes, plus 64 so small sizes don't fully overlap
+static size_t memmove_shift(size_t size)
+{
+  return ((size >> 1) & ~63ULL) + 64;
+}
+
+// Byte at index in check_memmove()'s buffer: the top byte of index times 2^64 over the golden ratio, which has no period
+static uint8_t check_pattern(size_t index)
+{
+  return (uint8_t)((index * 0x9E3779B97F4A7C15ULL) >> 56);
+}
+
+// Picks the AVXMEM_LEVEL_* that Enable_AVX() would. GCC's checks already make sure the OS saves the wider registers.
+static uint32_t detect_level(uint32_t *erms, uint32_t *fsrm)
+{
+  uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+  uint32_t level = AVXMEM_LEVEL_SSE;
+
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl"))
+  {
+    level = AVXMEM_LEVEL_AVX512;
+  }
+  else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma"))
+  {
+    level = AVXMEM_LEVEL_AVX2;
+  }
+  else if(__builtin_cpu_supports("avx"))
+  {
+    level = AVXMEM_LEVEL_AVX;
+  }
+
+  *erms = 0;
+  *fsrm = 0;
+  if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+  {
+    *erms = (ebx >> 9) & 1;
+    *fsrm = (edx >> 4) & 1;
+  }
+
+  return level;
+}
+
+static int streq(const char *a, const char *b)
+{
+  while(*a && (*a == *b))
+  {
+    a++;
+    b++;
+  }
+
+  return *a == *b;
+}
+
+// Takes plain numbers or ones ending in k, M, or G (powers of 1024)
+static size_t parse_size(const char *str)
+{
+  char * end;
+  size_t size = strtoull(str, &end, 0);
+
+  switch(*end)
+  {
+    case 'k':
+    case 'K':
+      size <<= 10;
+      break;
+    case 'm':
+    case 'M':
+      size <<= 20;
+      break;
+    case 'g':
+    case 'G':
+      size <<= 30;
+      break;
+  }
+
+  return size;
+}
+
+static void usage(const char *name)
+{
+  printf("Usage: %s [-f memcpy|memmove|memset|memcmp|all] [-m max_size] [-o none|relative|full] [-l SSE4.2|AVX|AVX2|AVX512] [-e] [-t nt_threshold]\n", name);
+  printf("  -f  Function to time (default: all)\n");
+  printf("  -m  Largest size, e.g. 64M (default: 1G)\n");
+  printf("  -o  Misaligned offsets to sweep (default: relative)\n");
+  printf("  -l  Use this build instead of the best one for the CPU\n");
+  printf("  -e  Don't use rep movsb/stosb even if the CPU has ERMS\n");
+  printf("  -t  Non-temporal threshold (default: half the last level cache, like the kernel)\n");
+}
@@ -0,0 +1,704 @@
+//==================================================================================================================================
+//  Host Memory Test: Randomized Allocator Checks
+//==================================================================================================================================
+//
+// A Linux program that runs src/Memory.c's allocators on fake RAM (see memtest_env.h) and checks them after every call. Build it with
+// Compile-Memtest.sh, which also makes a build with BUDDY_ALLOCATOR turned off.
+//
+// Tests (-t):
+//  realloc: Random malloc(), malloc2MB(), realloc(), and free() calls on up to MEMTEST_SLOTS live allocations, 2kB to 4MB each.
+//           New memory has to be zeroed and can't overlap anything live; realloc() has to keep the old contents and zero whatever it
+//           adds, no matter which path it took. Every MEMTEST_CHECK_INTERVAL calls, the memory map, the free region index, and the
+//           buddy allocator's arenas and free lists get checked against each other.
+//  demand:  vmalloc() reservations from Setup_DemandPaging()'s window, touched one page at a time the way the page fault handler
+//           would, then grown, moved, shrunk, and freed. Touched pages have to come in zeroed, a full 2MB range has to get promoted
+//           to a 2MB page, a move has to keep every byte without copying, and vfree() has to give the RAM back.
+//  demand-oom: A vrealloc() move with all but one page of RAM used up, so it fails partway through building page tables for the
+//           new range. The old reservation has to be untouched and every page the attempt took has to come back.
+//
+// A failure prints what went wrong and at which call, and exits with 1. The same seed (-s) always makes the same calls.
+//
+// Like hostbench.c, this can't include string.h: memset and friends are the kernel's here (see Compile-Memtest.sh).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "avxmem.h"
+#include "memtest_env.h"
+
+#define MEMTEST_SLOTS 256
+#define MEMTEST_CHECK_INTERVAL 250
+
+typedef struct {
+  uint8_t * Address;
+  size_t Size;
+} SLOT;
+
+static SLOT Slots[MEMTEST_SLOTS];
+static uint64_t Call; // Number of the allocator call being checked, for error messages
+
+static int streq(const char *a, const char *b);
+static void fail(const char *what);
+static uint8_t slot_pattern(uint64_t slot);
+static int is_zero(const uint8_t *start, size_t numbytes);
+static void check_overlap(uint64_t slot, const uint8_t *address, size_t numbytes);
+static void check_memmap(void);
+static void check_free_index_node(FREE_INDEX_NODE *Node, EFI_PHYSICAL_ADDRESS *previous, uint64_t *count);
+static void check_buddy(void);
+static int test_realloc(uint64_t iterations);
+static uint8_t * demand_touch(EFI_VIRTUAL_ADDRESS address);
+static uint64_t demand_region_mapped(EFI_VIRTUAL_ADDRESS address);
+static int test_demand(void);
+static int test_demand_oom(void);
+static void usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+  const char *test = "realloc";
+  uint64_t iterations = 100000;
+  uint64_t seed = 1;
+  uint64_t holes = 64;
+  int deferred_zeroing = 0;
+  int magazines = 0;
+
+  for(int arg = 1; arg < argc; arg++)
+  {
+    if(streq(argv[arg], "-t") && (arg + 1 < argc))
+    {
+      test = argv[++arg];
+    }
+    else if(streq(argv[arg], "-n") && (arg + 1 < argc))
+    {
+      iterations = strtoull(argv[++arg], NULL, 0);
+    }
+    else if(streq(argv[arg], "-s") && (arg + 1 < argc))
+    {
+      seed = strtoull(argv[++arg], NULL, 0);
+    }
+    else if(streq(argv[arg], "-m") && (arg + 1 < argc))
+    {
+      holes = strtoull(argv[++arg], NULL, 0);
+    }
+    else if(streq(argv[arg], "-z"))
+    {
+      deferred_zeroing = 1;
+    }
+    else if(streq(argv[arg], "-g"))
+    {
+      magazines = 1;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  setvbuf(stdout, NULL, _IONBF, 0);
+  AVXmem_Select(AVXMEM_LEVEL_SSE, 0, 0);
+  memtest_setup(holes);
+  srand((unsigned int)seed);
+
+  if(deferred_zeroing)
+  {
+    EnableDeferredZeroing();
+  }
+  if(magazines)
+  {
+    Setup_Magazines();
+  }
+
+  printf("Test: %s, %llu calls, seed %llu, %llu memory map regions, deferred zeroing %s, magazines %s\n", test, iterations, seed, holes, deferred_zeroing ? "on" : "off", magazines ? "on" : "off");
+
+  int result;
+  if(streq(test, "realloc"))
+  {
+    result = test_realloc(iterations);
+  }
+  else if(streq(test, "demand"))
+  {
+    result = test_demand();
+  }
+  else if(streq(test, "demand-oom"))
+  {
+    result = test_demand_oom();
+  }
+  else
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(!result)
+  {
+    printf("Passed.\n");
+  }
+
+  return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  test_realloc: Random malloc()/realloc()/free() Calls
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// See the top of this file. Each slot's allocation is filled with its own byte pattern, so a realloc() that copied the wrong range or
+// an allocation that ended up on top of another one shows up as a wrong byte.
+//
+
+static int test_realloc(uint64_t iterations)
+{
+  for(Call = 0; Call < iterations; Call++)
+  {
+    uint64_t slot = (uint64_t)rand() % MEMTEST_SLOTS;
+    SLOT * Slot = &Slots[slot];
+
+    if(!Slot->Address)
+    {
+      // Mostly slab and small buddy sizes, some page multiples, a few 1-4MB
+      uint64_t kind = (uint64_t)rand() % 8;
+      size_t size = (kind < 4) ? (2049 + (size_t)rand() % (64 << 10)) : (kind < 7) ? (4096 + ((size_t)rand() % 128) * 4096) : (((size_t)rand() % 4 + 1) << 20);
+      int huge = ((rand() % 4) == 0);
+      uint8_t * address = huge ? malloc2MB(size) : malloc(size);
+
+      if((uint64_t)address == ~0ULL)
+      {
+        continue; // Out of memory is allowed
+      }
+      if(huge && ((uint64_t)address & ((2ULL << 20) - 1)))
+      {
+        fail("malloc2MB() returned an address that isn't 2MB-aligned");
+      }
+      if(!is_zero(address, size))
+      {
+        fail("New allocation isn't zeroed");
+      }
+      check_overlap(slot, address, size);
+
+      memset(address, slot_pattern(slot), size);
+      Slot->Address = address;
+      Slot->Size = size;
+    }
+    else if((rand() % 3) == 0)
+    {
+      size_t size = (rand() % 2) ? (Slot->Size / 2 + 1) : (Slot->Size + ((size_t)rand() % 64) * 4096);
+      uint8_t * address = realloc(Slot->Address, size);
+
+      if((uint64_t)address == ~0ULL)
+      {
+        continue; // The old allocation is still there
+      }
+
+      size_t kept = (size < Slot->Size) ? size : Slot->Size;
+      for(size_t byte = 0; byte < kept; byte++)
+      {
+        if(address[byte] != slot_pattern(slot))
+        {
+          fail("realloc() lost data");
+        }
+      }
+      if((size > Slot->Size) && !is_zero(address + Slot->Size, size - Slot->Size))
+      {
+        fail(address == Slot->Address ? "realloc() grew in place without zeroing the new part" : "realloc() moved without zeroing the new part");
+      }
+      check_overlap(slot, address, size);
+
+      memset(address, slot_pattern(slot), size);
+      Slot->Address = address;
+      Slot->Size = size;
+    }
+    else
+    {
+      free(Slot->Address);
+      Slot->Address = NULL;
+    }
+
+    if((Call % MEMTEST_CHECK_INTERVAL) == 0)
+    {
+      check_memmap();
+      check_buddy();
+    }
+  }
+
+  check_memmap();
+  check_buddy();
+  realloc_stats();
+
+  for(uint64_t slot = 0; slot < MEMTEST_SLOTS; slot++)
+  {
+    if(Slots[slot].Address)
+    {
+      free(Slots[slot].Address);
+      Slots[slot].Address = NULL;
+    }
+  }
+
+  check_memmap();
+  check_buddy();
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  test_demand: Demand-Paged vmalloc() Reservations
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// See the top of this file. There's no page fault handler here, so demand_touch() calls demand_page_fault() itself for anything that
+// isn't mapped yet. "Call" counts the steps, for error messages.
+//
+
+static int test_demand(void)
+{
+  Setup_DemandPaging();
+  uint64_t free_ram = GetFreeSystemRam();
+
+  // A reservation far bigger than the RAM, which costs nothing until it's touched
+  Call = 1;
+  EFI_VIRTUAL_ADDRESS big = (EFI_VIRTUAL_ADDRESS)vmalloc(100ULL << 30);
+  if((big != Global_Demand_Paging.WindowStart) || (big & ((1ULL << 30) - 1)))
+  {
+    fail("100GB vmalloc() didn't come from the start of the window");
+  }
+  if(GetFreeSystemRam() != free_ram)
+  {
+    fail("Reserving address space used RAM");
+  }
+  *demand_touch(big) = 1;
+  *demand_touch(big + (50ULL << 30) + 123) = 2;
+  *demand_touch(big + (100ULL << 30) - 1) = 3;
+  if(!demand_page_fault(big + (100ULL << 30)) || !demand_page_fault(big - 1))
+  {
+    fail("A fault outside of the reservation was handled");
+  }
+
+  // Filling a 2MB range promotes it
+  Call = 2;
+  EFI_VIRTUAL_ADDRESS small = (EFI_VIRTUAL_ADDRESS)vmalloc(4ULL << 20);
+  if((small < big + (100ULL << 30)) || (small & ((2ULL << 20) - 1)))
+  {
+    fail("4MB vmalloc() isn't 2MB-aligned after the first reservation");
+  }
+  for(uint64_t page = 0; page < 512; page++)
+  {
+    *demand_touch(small + (page << EFI_PAGE_SHIFT) + 7) = (uint8_t)(page | 1);
+  }
+  if(Global_Demand_Paging.Promotions != 1)
+  {
+    fail("A fully touched 2MB range wasn't promoted");
+  }
+  for(uint64_t page = 0; page < 512; page++)
+  {
+    if(*memtest_translate(small + (page << EFI_PAGE_SHIFT) + 7) != (uint8_t)(page | 1))
+    {
+      fail("Promotion lost data");
+    }
+  }
+  *demand_touch(small + (2ULL << 20) + 5) = 0x55;
+
+  // Growing with free space above stays put
+  Call = 3;
+  if((EFI_VIRTUAL_ADDRESS)vrealloc((void*)small, 8ULL << 20) != small)
+  {
+    fail("vrealloc() moved a reservation that could grow in place");
+  }
+  *demand_touch(small + (7ULL << 20)) = 0x66;
+
+  // Growing into another reservation moves it, page tables and all
+  Call = 4;
+  EFI_VIRTUAL_ADDRESS blocker = (EFI_VIRTUAL_ADDRESS)vmalloc(4ULL << 20);
+  *demand_touch(blocker) = 0x77;
+  uint64_t mapped = demand_region_mapped(small);
+
+  EFI_VIRTUAL_ADDRESS moved = (EFI_VIRTUAL_ADDRESS)vrealloc((void*)small, 64ULL << 20);
+  if((moved == small) || (moved <= blocker))
+  {
+    fail("vrealloc() didn't move a reservation that couldn't grow in place");
+  }
+  for(uint64_t page = 0; page < 512; page++)
+  {
+    if(*memtest_translate(moved + (page << EFI_PAGE_SHIFT) + 7) != (uint8_t)(page | 1))
+    {
+      fail("Moving lost data from the promoted 2MB page");
+    }
+  }
+  if((*memtest_translate(moved + (2ULL << 20) + 5) != 0x55) || (*memtest_translate(moved + (7ULL << 20)) != 0x66))
+  {
+    fail("Moving lost data from 4kB pages");
+  }
+  if(memtest_translate(small + 7))
+  {
+    fail("The old range is still mapped after moving");
+  }
+  if(demand_region_mapped(moved) != mapped)
+  {
+    fail("Moving changed the number of mapped pages");
+  }
+  if(Global_Demand_Paging.NumRegions != 3)
+  {
+    fail("Wrong number of reservations after moving");
+  }
+
+  // The hole left behind gets reused, with nothing mapped in it
+  Call = 5;
+  EFI_VIRTUAL_ADDRESS reused = (EFI_VIRTUAL_ADDRESS)vmalloc(2ULL << 20);
+  if(reused != small)
+  {
+    fail("The space left by a move wasn't reused");
+  }
+  if(memtest_translate(reused))
+  {
+    fail("Reused space still has a mapping in it");
+  }
+
+  // Shrinking into the promoted page zeroes the rest of it and unmaps everything past it
+  Call = 6;
+  if((EFI_VIRTUAL_ADDRESS)vrealloc((void*)moved, (1ULL << 20) + 100) != moved)
+  {
+    fail("vrealloc() moved a reservation to shrink it");
+  }
+  if(!is_zero(memtest_translate(moved + (1ULL << 20) + 100), (1ULL << 20) - 100))
+  {
+    fail("Shrinking didn't zero the rest of the last 2MB page");
+  }
+  if(memtest_translate(moved + (2ULL << 20) + 5) || memtest_translate(moved + (7ULL << 20)))
+  {
+    fail("Shrinking left pages mapped past the new end");
+  }
+  if(!demand_page_fault(moved + (2ULL << 20)))
+  {
+    fail("A fault past the shrunk end was handled");
+  }
+
+  demand_paging_stats();
+
+  // Everything comes back, except for page tables above the page directories, which stay around for the next reservation
+  Call = 7;
+  vfree((void*)big);
+  vfree((void*)moved);
+  vfree((void*)blocker);
+  vfree((void*)reused);
+  if(Global_Demand_Paging.NumRegions)
+  {
+    fail("vfree() left reservations behind");
+  }
+  if(free_ram - GetFreeSystemRam() > 16 * EFI_PAGE_SIZE)
+  {
+    fail("vfree() didn't give the RAM back");
+  }
+
+  printf("%llu bytes still used for page tables, %llu TLB flushes\n", free_ram - GetFreeSystemRam(), Memtest_CR3_Writes);
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  test_demand_oom: vrealloc() Running Out of RAM Partway Through a Move
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// See the top of this file. The first reservation's page tables only cover the first 512GB of the window, so moving it above a
+// second, 600GB reservation needs a new page directory pointer table and then a page directory. With one free page, the first
+// allocation works and the second doesn't.
+//
+
+static int test_demand_oom(void)
+{
+  static void * Pages[MEMTEST_RAM_SIZE >> EFI_PAGE_SHIFT];
+  uint64_t num_pages = 0;
+
+  Setup_DemandPaging();
+
+  Call = 1;
+  EFI_VIRTUAL_ADDRESS small = (EFI_VIRTUAL_ADDRESS)vmalloc(4ULL << 20);
+  *demand_touch(small + EFI_PAGE_SIZE) = 1;
+  EFI_VIRTUAL_ADDRESS big = (EFI_VIRTUAL_ADDRESS)vmalloc(600ULL << 30);
+  if(big <= small)
+  {
+    fail("600GB vmalloc() didn't go above the 4MB one");
+  }
+
+  // Use up all of the RAM but one page
+  Call = 2;
+  while(num_pages < (MEMTEST_RAM_SIZE >> EFI_PAGE_SHIFT))
+  {
+    void * page = malloc4KB(EFI_PAGE_SIZE);
+    if((uint64_t)page == ~0ULL)
+    {
+      break;
+    }
+    Pages[num_pages++] = page;
+  }
+  free(Pages[--num_pages]);
+
+  Call = 3;
+  uint64_t regions = Global_Demand_Paging.NumRegions;
+  if((uint64_t)vrealloc((void*)small, 600ULL << 30) != ~0ULL)
+  {
+    fail("vrealloc() didn't run out of memory");
+  }
+  if(Global_Demand_Paging.NumRegions != regions)
+  {
+    fail("The failed vrealloc() left a reservation behind");
+  }
+  if(*memtest_translate(small + EFI_PAGE_SIZE) != 1)
+  {
+    fail("The failed vrealloc() changed the old reservation");
+  }
+
+  uint64_t available = 0;
+  while((uint64_t)malloc4KB(EFI_PAGE_SIZE) != ~0ULL)
+  {
+    available++;
+  }
+  if(available != 1)
+  {
+    fail("The failed vrealloc() kept the page it took for a page table");
+  }
+
+  return 0;
+}
+
+// Touches an address in a reservation the way a program would: if it isn't mapped yet, fault it in and make sure it's zeroed
+static uint8_t * demand_touch(EFI_VIRTUAL_ADDRESS address)
+{
+  uint8_t * ram = memtest_translate(address);
+
+  if(!ram)
+  {
+    if(demand_page_fault(address))
+    {
+      fail("A fault in a reservation wasn't handled");
+    }
+    ram = memtest_translate(address);
+    if(!ram)
+    {
+      fail("demand_page_fault() didn't map anything");
+    }
+    if(!is_zero((uint8_t*)((uint64_t)ram & ~(EFI_PAGE_SIZE - 1)), EFI_PAGE_SIZE))
+    {
+      fail("A faulted-in page isn't zeroed");
+    }
+  }
+
+  return ram;
+}
+
+static uint64_t demand_region_mapped(EFI_VIRTUAL_ADDRESS address)
+{
+  for(uint64_t region = 0; region < Global_Demand_Paging.NumRegions; region++)
+  {
+    if(Global_Demand_Paging.Region[region].VirtualStart == address)
+    {
+      return Global_Demand_Paging.Region[region].MappedPages;
+    }
+  }
+
+  fail("Reservation not found");
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Checks
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// These all call fail() instead of returning if something's wrong
+//
+
+static void fail(const char *what)
+{
+  printf("FAILED at call %llu: %s\n", Call, what);
+  exit(1);
+}
+
+static uint8_t slot_pattern(uint64_t slot)
+{
+  return (uint8_t)(slot | 1);
+}
+
+static int is_zero(const uint8_t *start, size_t numbytes)
+{
+  for(size_t byte = 0; byte < numbytes; byte++)
+  {
+    if(start[byte])
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// The range can't overlap any live allocation except the one in its own slot
+static void check_overlap(uint64_t slot, const uint8_t *address, size_t numbytes)
+{
+  for(uint64_t other = 0; other < MEMTEST_SLOTS; other++)
+  {
+    if((other != slot) && Slots[other].Address && (address < Slots[other].Address + Slots[other].Size) && (Slots[other].Address < address + numbytes))
+    {
+      fail("Allocation overlaps another live one");
+    }
+  }
+}
+
+// No two descriptors in the fake RAM overlap, and the free region index has exactly the map's nonempty conventional memory regions
+static void check_memmap(void)
+{
+  uint8_t * MapStart = (uint8_t*)Global_Memory_Info.MemMap;
+  uint8_t * MapEnd = MapStart + Global_Memory_Info.MemMapSize;
+  uint64_t conventional = 0;
+
+  for(uint8_t * A = MapStart; A < MapEnd; A += Global_Memory_Info.MemMapDescriptorSize)
+  {
+    EFI_MEMORY_DESCRIPTOR * Piece = (EFI_MEMORY_DESCRIPTOR*)A;
+
+    if((Piece->Type == EfiConventionalMemory) && Piece->NumberOfPages)
+    {
+      conventional++;
+    }
+    if((Piece->PhysicalStart < MEMTEST_RAM_BASE) || !Piece->NumberOfPages)
+    {
+      continue;
+    }
+
+    for(uint8_t * B = A + Global_Memory_Info.MemMapDescriptorSize; B < MapEnd; B += Global_Memory_Info.MemMapDescriptorSize)
+    {
+      EFI_MEMORY_DESCRIPTOR * Other = (EFI_MEMORY_DESCRIPTOR*)B;
+
+      if(Other->NumberOfPages && (Piece->PhysicalStart < Other->PhysicalStart + (Other->NumberOfPages << EFI_PAGE_SHIFT)) && (Other->PhysicalStart < Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT)))
+      {
+        fail("Memory map descriptors overlap");
+      }
+    }
+  }
+
+  if(Global_Free_Index.Valid)
+  {
+    EFI_PHYSICAL_ADDRESS previous = 0;
+    uint64_t count = 0;
+
+    check_free_index_node(Global_Free_Index.Root, &previous, &count);
+    if((count != conventional) || (count != Global_Free_Index.NumNodes))
+    {
+      fail("Free region index doesn't match the memory map");
+    }
+  }
+}
+
+static void check_free_index_node(FREE_INDEX_NODE *Node, EFI_PHYSICAL_ADDRESS *previous, uint64_t *count)
+{
+  if(!Node)
+  {
+    return;
+  }
+
+  check_free_index_node(Node->Left, previous, count);
+
+  if(*count && (Node->PhysicalStart <= *previous))
+  {
+    fail("Free region index is out of order");
+  }
+  *previous = Node->PhysicalStart;
+
+  uint64_t found = 0;
+  for(uint8_t * A = (uint8_t*)Global_Memory_Info.MemMap; A < (uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize; A += Global_Memory_Info.MemMapDescriptorSize)
+  {
+    EFI_MEMORY_DESCRIPTOR * Piece = (EFI_MEMORY_DESCRIPTOR*)A;
+    if((Piece->Type == EfiConventionalMemory) && (Piece->PhysicalStart == Node->PhysicalStart) && (Piece->NumberOfPages == Node->NumberOfPages))
+    {
+      found = 1;
+    }
+  }
+  if(!found)
+  {
+    fail("Free region index has a region that isn't in the memory map");
+  }
+  (*count)++;
+
+  check_free_index_node(Node->Right, previous, count);
+}
+
+// Every arena is tiled by naturally-aligned blocks, free blocks are on their list, and free blocks not marked dirty are all zeroes
+static void check_buddy(void)
+{
+  for(BUDDY_ARENA * Arena = Global_Buddy_Info.ArenaList; Arena; Arena = Arena->Next)
+  {
+    uint64_t frames = 1ULL << (Arena->Order - BUDDY_MIN_ORDER);
+
+    if(Arena->Base & ((1ULL << Arena->Order) - 1))
+    {
+      fail("Buddy arena isn't aligned to its size");
+    }
+
+    for(uint64_t frame = 0; frame < frames; )
+    {
+      uint8_t entry = Arena->Frame[frame];
+      if(!entry)
+      {
+        fail("Buddy arena has a frame that isn't covered by a block");
+      }
+
+      uint64_t order = (entry & ~(BUDDY_FRAME_FREE | BUDDY_FRAME_DIRTY)) - 1 + BUDDY_MIN_ORDER;
+      uint64_t block_frames = 1ULL << (order - BUDDY_MIN_ORDER);
+
+      if(frame & (block_frames - 1))
+      {
+        fail("Buddy block isn't aligned to its size");
+      }
+      for(uint64_t inner = frame + 1; inner < frame + block_frames; inner++)
+      {
+        if(Arena->Frame[inner])
+        {
+          fail("Buddy block has another block starting inside it");
+        }
+      }
+
+      if(entry & BUDDY_FRAME_FREE)
+      {
+        uint8_t * Block = (uint8_t*)(Arena->Base + (frame << EFI_PAGE_SHIFT));
+        uint64_t listed = 0;
+
+        for(BUDDY_BLOCK * Free = Global_Buddy_Info.FreeList[order - BUDDY_MIN_ORDER]; Free; Free = Free->Next)
+        {
+          if((uint8_t*)Free == Block)
+          {
+            listed = 1;
+          }
+          if(Free->Next && (Free->Next->Prev != Free))
+          {
+            fail("Buddy free list is broken");
+          }
+        }
+        if(!listed)
+        {
+          fail("Free buddy block isn't on its free list");
+        }
+        if(!(entry & BUDDY_FRAME_DIRTY) && !is_zero(Block + sizeof(BUDDY_BLOCK), (block_frames << EFI_PAGE_SHIFT) - sizeof(BUDDY_BLOCK)))
+        {
+          fail("Free buddy block isn't zeroed");
+        }
+      }
+
+      frame += block_frames;
+    }
+  }
+}
+
+static int streq(const char *a, const char *b)
+{
+  while(*a && (*a == *b))
+  {
+    a++;
+    b++;
+  }
+
+  return (*a == *b);
+}
+
+static void usage(const char *name)
+{
+  printf("Usage: %s [-t test] [-n calls] [-s seed] [-m regions] [-z] [-g]\n", name);
+  printf("  -t  Test to run: realloc (the default), demand, or demand-oom\n");
+  printf("  -n  Number of allocator calls to make in the realloc test (default 100000)\n");
+  printf("  -s  Random seed (default 1)\n");
+  printf("  -m  Number of memory map regions to split the fake RAM into, alternating conventional and reserved (default 64)\n");
+  printf("  -z  Turn on deferred zeroing (EnableDeferredZeroing())\n");
+  printf("  -g  Set up per-core magazines (Setup_Magazines())\n");
+}
@@ -0,0 +1,216 @@
+//==================================================================================================================================
+//  Host Memory Test: Fake Machine
+//==================================================================================================================================
+//
+// The parts of the kernel that Memory.c calls into, done with Linux system calls instead of hardware. See memtest_env.h.
+//
+// %gs works like it does in the kernel: msr_rw() on IA32_GS_BASE sets it through arch_prctl(), so the per-core magazines and the
+// allocator lock find their CPU_MAGAZINES the same way. Memtest only has the one thread, so that's always core 0.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <asm/prctl.h>
+#include <x86intrin.h>
+#include "memtest_env.h"
+
+#define MEMTEST_DESCRIPTOR_SIZE 48 // What most firmware uses, which is bigger than sizeof(EFI_MEMORY_DESCRIPTOR)
+#define MEMTEST_MAX_DESCRIPTORS 1024
+
+long syscall(long number, ...); // unistd.h would also declare usleep(), which Kernel64.h has its own version of
+
+uint64_t Memtest_CR3_Writes = 0;
+
+static uint64_t Memtest_CR3 = 0;
+static uint8_t Memtest_MemMap[MEMTEST_DESCRIPTOR_SIZE * MEMTEST_MAX_DESCRIPTORS]; // Outside of the fake RAM, like the loader's copy
+
+static void memtest_add_descriptor(uint64_t index, uint32_t type, EFI_PHYSICAL_ADDRESS start, uint64_t pages);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memtest_setup: Map Fake RAM and Set Up the Memory Map
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// See memtest_env.h
+//
+
+void memtest_setup(uint64_t holes)
+{
+  if(mmap((void*)MEMTEST_RAM_BASE, MEMTEST_RAM_SIZE, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) != (void*)MEMTEST_RAM_BASE)
+  {
+    perror("memtest_setup: mmap");
+    exit(1);
+  }
+
+  if(holes > MEMTEST_MAX_DESCRIPTORS - 1)
+  {
+    holes = MEMTEST_MAX_DESCRIPTORS - 1;
+  }
+
+  uint64_t num_descriptors = 0;
+  memtest_add_descriptor(num_descriptors++, EfiReservedMemoryType, 0, MEMTEST_RAM_BASE >> EFI_PAGE_SHIFT);
+
+  if(holes < 2)
+  {
+    memtest_add_descriptor(num_descriptors++, EfiConventionalMemory, MEMTEST_RAM_BASE, MEMTEST_RAM_SIZE >> EFI_PAGE_SHIFT);
+  }
+  else
+  {
+    uint64_t pages_per_region = (MEMTEST_RAM_SIZE >> EFI_PAGE_SHIFT) / holes;
+
+    for(uint64_t region = 0; region < holes; region++)
+    {
+      memtest_add_descriptor(num_descriptors++, (region & 1) ? EfiACPIReclaimMemory : EfiConventionalMemory, MEMTEST_RAM_BASE + ((region * pages_per_region) << EFI_PAGE_SHIFT), pages_per_region);
+    }
+  }
+
+  Global_Memory_Info.MemMap = (EFI_MEMORY_DESCRIPTOR*)Memtest_MemMap;
+  Global_Memory_Info.MemMapSize = num_descriptors * MEMTEST_DESCRIPTOR_SIZE;
+  Global_Memory_Info.MemMapDescriptorSize = MEMTEST_DESCRIPTOR_SIZE;
+  Global_Memory_Info.MemMapDescriptorVersion = 1;
+
+  Setup_MemMap();
+
+  // An empty top-level page table, for the demand paging window to build on
+  Memtest_CR3 = (uint64_t)malloc4KB(EFI_PAGE_SIZE);
+  if(Memtest_CR3 == ~0ULL)
+  {
+    printf("memtest_setup: No memory for a page table.\n");
+    exit(1);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memtest_translate: Walk the Page Tables
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// See memtest_env.h. Handles 2MB pages, which is all demand paging makes besides 4kB ones.
+//
+
+uint8_t * memtest_translate(EFI_VIRTUAL_ADDRESS address)
+{
+  uint64_t levels = Global_Demand_Paging.PagingLevels ? Global_Demand_Paging.PagingLevels : 4;
+  uint64_t * table = (uint64_t*)(Memtest_CR3 & PAGE_ENTRY_ADDRESS_MASK);
+
+  for(uint64_t shift = 9*levels + 3; shift > EFI_PAGE_SHIFT; shift -= 9)
+  {
+    uint64_t entry = table[(address >> shift) & 511];
+
+    if(!(entry & 1)) // Present
+    {
+      return NULL;
+    }
+    if((shift == 21) && (entry & 0x80)) // 2MB page
+    {
+      return (uint8_t*)((entry & PAGE_ENTRY_ADDRESS_MASK & ~0x1FFFFFULL) + (address & 0x1FFFFF));
+    }
+
+    table = (uint64_t*)(entry & PAGE_ENTRY_ADDRESS_MASK);
+  }
+
+  uint64_t entry = table[(address >> EFI_PAGE_SHIFT) & 511];
+  if(!(entry & 1))
+  {
+    return NULL;
+  }
+
+  return (uint8_t*)((entry & PAGE_ENTRY_ADDRESS_MASK) + (address & (EFI_PAGE_SIZE - 1)));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memtest_add_descriptor: Fill In a Memory Map Entry
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Writes the index-th descriptor of Memtest_MemMap
+//
+
+static void memtest_add_descriptor(uint64_t index, uint32_t type, EFI_PHYSICAL_ADDRESS start, uint64_t pages)
+{
+  EFI_MEMORY_DESCRIPTOR * Descriptor = (EFI_MEMORY_DESCRIPTOR*)(Memtest_MemMap + index * MEMTEST_DESCRIPTOR_SIZE);
+
+  Descriptor->Type = type;
+  Descriptor->PhysicalStart = start;
+  Descriptor->VirtualStart = start;
+  Descriptor->NumberOfPages = pages;
+  Descriptor->Attribute = EFI_MEMORY_UC | EFI_MEMORY_WC | EFI_MEMORY_WT | EFI_MEMORY_WB;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Kernel Stand-Ins
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same names and prototypes as in Kernel64.h
+//
+
+int error_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  printf("Error: ");
+  int ret = vprintf(fmt, args);
+  va_end(args);
+
+  return ret;
+}
+
+int warning_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  printf("Warning: ");
+  int ret = vprintf(fmt, args);
+  va_end(args);
+
+  return ret;
+}
+
+int info_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  int ret = vprintf(fmt, args);
+  va_end(args);
+
+  return ret;
+}
+
+void HaCF(void)
+{
+  printf("HaCF() called, stopping.\n");
+  abort();
+}
+
+uint64_t get_tick(void)
+{
+  return __rdtsc();
+}
+
+uint64_t msr_rw(uint64_t msr, uint64_t data, uint8_t rw)
+{
+  if((msr == IA32_GS_BASE) && rw)
+  {
+    syscall(SYS_arch_prctl, ARCH_SET_GS, data);
+  }
+
+  return 0;
+}
+
+uint64_t control_register_rw(int crX, uint64_t in_out, uint8_t rw)
+{
+  if(crX == 3)
+  {
+    if(rw)
+    {
+      Memtest_CR3 = in_out;
+      Memtest_CR3_Writes++;
+    }
+    return Memtest_CR3;
+  }
+
+  return 0;
+}
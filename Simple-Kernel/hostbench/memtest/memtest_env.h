@@ -0,0 +1,34 @@
+//==================================================================================================================================
+//  Host Memory Test: Fake Machine
+//==================================================================================================================================
+//
+// Memtest runs src/Memory.c as a regular Linux program, so the allocators can be hammered with millions of random requests and
+// checked after every one of them without booting anything. Memory.c gets compiled unchanged, except that malloc, calloc, realloc,
+// and free are renamed to kernel_malloc and so on (see Compile-Memtest.sh) to keep them away from glibc's. In the test files the
+// same renames apply, so malloc() there is the kernel's.
+//
+// memtest_env.c stands in for the rest of the kernel: "physical" RAM is an anonymous mapping at MEMTEST_RAM_BASE, the UEFI memory
+// map describes it as conventional memory, the *_printf() functions print to stdout, and CR3 points at a page table that only the
+// demand paging code ever looks at. Addresses are identity mapped the same way they are in the kernel, so a pointer from malloc()
+// can be used directly.
+//
+
+#ifndef _memtest_env_H
+#define _memtest_env_H
+
+#include "Kernel64.h"
+
+#define MEMTEST_RAM_BASE 0x40000000ULL // 1GB, so everything below it can be described as reserved
+#define MEMTEST_RAM_SIZE (1ULL << 30)
+
+// Number of times control_register_rw() has been asked to write CR3, i.e. TLB flushes
+extern uint64_t Memtest_CR3_Writes;
+
+// Maps the fake RAM, builds a memory map for it, and runs Setup_MemMap(). With holes > 1, the RAM is described as that many regions,
+// alternating between conventional memory and ACPI reclaim memory, to give the allocators something to fragment.
+void memtest_setup(uint64_t holes);
+
+// Returns the RAM behind a virtual address according to the page tables CR3 points to, or NULL if nothing is mapped there
+uint8_t * memtest_translate(EFI_VIRTUAL_ADDRESS address);
+
+#endif /* _memtest_env_H */
@@ -433,8 +433,192 @@ typedef struct {
   EFI_MEMORY_DESCRIPTOR  *MemMap;                  // Pointer to memory map (LP->Memory_Map)
   UINT32                  MemMapDescriptorVersion; // Memory map descriptor version
   UINT32                  Pad;                     // Pad to multiple of 64 bits
+  UINTN                   MemMapCapacity;          // Size of the region holding the map, in bytes (a multiple of 4kB, >= MemMapSize)
+  UINT64                  MemMapRelocations;       // Number of times MemMap_Prep() has had to move the map
+  UINT64                  MemMapBytesMoved;        // Total bytes of descriptors copied by those moves
 } GLOBAL_MEMORY_INFO_STRUCT;
 
+// For the small-object slab allocator underneath malloc() in Memory.c
+#define SLAB_MIN_OBJECT_SHIFT 4                                               // Smallest size class is 16 bytes
+#define SLAB_MAX_OBJECT_SHIFT 11                                              // Largest size class is 2kB
+#define SLAB_MAX_OBJECT_SIZE (1ULL << SLAB_MAX_OBJECT_SHIFT)
+#define SLAB_NUM_CLASSES (SLAB_MAX_OBJECT_SHIFT - SLAB_MIN_OBJECT_SHIFT + 1) // 16, 32, 64, 128, 256, 512, 1024, 2048
+#define SLAB_CHUNK_SIZE (2ULL << 20)                                          // Slabs are carved from 2MB regions obtained via malloc2MB()
+#define SLAB_PAGES_PER_CHUNK (SLAB_CHUNK_SIZE >> EFI_PAGE_SHIFT)              // 512 4kB pages per chunk
+#define SLAB_CHUNK_SIGNATURE 0x4B4E484342414C53ULL                            // "SLABCHNK", stored XORed with the chunk's address
+#define SLAB_PAGE_UNUSED 0xFF                                                 // SizeClass value for a page that hasn't been given to a class
+
+// Per-page bookkeeping. Each 4kB page in a chunk holds objects of exactly one size class.
+typedef struct SLAB_PAGE_STRUCT {
+  void                    *FreeList;  // Singly-linked list of freed objects in this page (link is stored in each object's first 8 bytes)
+  struct SLAB_PAGE_STRUCT *Next;      // Next page in this size class's partial list
+  struct SLAB_PAGE_STRUCT *Prev;      // Previous page in this size class's partial list
+  UINT16                   InUse;     // Number of allocated objects in this page
+  UINT16                   Bump;      // Objects at or above this index have never been handed out
+  UINT16                   Capacity;  // Number of objects this page can hold
+  UINT8                    SizeClass; // Index into the size classes, or SLAB_PAGE_UNUSED
+  UINT8                    Pad;       // Pad to multiple of 64 bits
+} SLAB_PAGE_STRUCT;
+
+// Lives at the base of every 2MB slab chunk. The first few pages of each chunk are taken up by this header.
+typedef struct SLAB_CHUNK_STRUCT {
+  UINT64                    Signature;                        // SLAB_CHUNK_SIGNATURE ^ the chunk's own address, 0 once the chunk is released
+  struct SLAB_CHUNK_STRUCT *Next;                             // Next chunk in Global_Slab_Info.ChunkList
+  UINT64                    FreePageCount;                    // Number of entries in FreePages
+  UINT16                    FreePages[SLAB_PAGES_PER_CHUNK];  // Stack of page indices not currently assigned to a size class
+  SLAB_PAGE_STRUCT          Page[SLAB_PAGES_PER_CHUNK];       // Bookkeeping for each 4kB page of the chunk
+} SLAB_CHUNK_STRUCT;
+
+typedef struct {
+  SLAB_CHUNK_STRUCT      *ChunkList;                  // All slab chunks currently owned by the slab allocator
+  SLAB_PAGE_STRUCT       *Partial[SLAB_NUM_CLASSES];  // Per-size-class list of pages that still have room for objects
+  UINT64                  NumChunks;                  // Number of 2MB chunks in ChunkList
+  UINT64                  ChunksStart;                // Every chunk there has ever been is within [ChunksStart, ChunksEnd)
+  UINT64                  ChunksEnd;
+} GLOBAL_SLAB_INFO_STRUCT;
+
+// For the EfiConventionalMemory index in Memory.c
+#define FREE_INDEX_MAX_NODES 4096 // Max number of EfiConventionalMemory descriptors the index can track before falling back to map scans
+
+// One node per EfiConventionalMemory descriptor, in an AVL tree ordered by PhysicalStart
+typedef struct FREE_INDEX_NODE_STRUCT {
+  EFI_PHYSICAL_ADDRESS           PhysicalStart; // Same as the descriptor's PhysicalStart
+  UINT64                         NumberOfPages; // Same as the descriptor's NumberOfPages
+  UINT64                         MaxPages;      // Largest NumberOfPages in the subtree rooted here
+  struct FREE_INDEX_NODE_STRUCT *Left;          // Lower addresses
+  struct FREE_INDEX_NODE_STRUCT *Right;         // Higher addresses
+  UINT64                         Height;        // AVL height of the subtree rooted here (a leaf is 1)
+} FREE_INDEX_NODE;
+
+typedef struct {
+  FREE_INDEX_NODE        *Root;     // Root of the address-ordered tree
+  FREE_INDEX_NODE        *Spare;    // Unused nodes, linked through Right
+  FREE_INDEX_NODE        *Pool;     // FREE_INDEX_MAX_NODES nodes allocated by Setup_MemMap()
+  UINT64                  NumNodes; // Number of nodes in the tree
+  UINT64                  Valid;    // 1 if the tree matches the memory map, 0 if lookups need to scan the map instead
+} GLOBAL_FREE_INDEX_STRUCT;
+
+// For deferred page zeroing in Memory.c
+#define ZERO_POOL_MAX_RANGES 256 // Max number of ranges on each of the dirty and clean lists
+#define ZERO_POOL_IDLE_BYTES (256ULL << 10) // Most ssleep() and msleep() zero per pass of their wait loops (see ZeroDirtyPages())
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS    PhysicalStart; // Page-aligned start of the range
+  UINT64                  NumberOfPages; // Size of the range in pages
+} ZERO_POOL_RANGE;
+
+typedef struct {
+  ZERO_POOL_RANGE         Dirty[ZERO_POOL_MAX_RANGES]; // Freed EfiConventionalMemory that still holds old data
+  ZERO_POOL_RANGE         Clean[ZERO_POOL_MAX_RANGES]; // Free EfiConventionalMemory already zeroed by ZeroDirtyPages()
+  UINT64                  NumDirty;                    // Number of ranges in Dirty
+  UINT64                  NumClean;                    // Number of ranges in Clean
+  UINT64                  DirtyBytes;                  // Total size of the ranges in Dirty
+  UINT64                  CleanBytes;                  // Total size of the ranges in Clean
+  UINT64                  ZeroedInlineBytes;           // Running total of bytes the allocators had to zero themselves because they weren't clean
+  UINT64                  Enabled;                     // 1 if free() defers zeroing to the pool, 0 if it zeroes right away
+} GLOBAL_ZERO_POOL_STRUCT;
+
+// For realloc() in Memory.c: how many times each path was taken
+typedef struct {
+  UINT64                  Unchanged;               // The allocation already fit the new size (apart from zeroing the tail)
+  UINT64                  GrownInPlace;            // Grew into free memory right after it
+  UINT64                  ShrunkInPlace;           // Gave back its upper part without moving
+  UINT64                  Moved;                   // Had to be copied to a new allocation
+} GLOBAL_REALLOC_STATS_STRUCT;
+
+// For the buddy allocator in Memory.c
+#define BUDDY_MIN_ORDER EFI_PAGE_SHIFT                           // Smallest block is 4kB
+#define BUDDY_MAX_ORDER 30                                       // Largest block is 1GB
+#define BUDDY_NUM_ORDERS (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER + 1) // 4kB, 8kB, ..., 2MB, ..., 1GB
+#define BUDDY_ARENA_ORDER 25                                     // Arenas are taken from the memory map 32MB at a time, or bigger for bigger blocks
+#define BUDDY_WASTE_SHIFT 2                                      // Blocks bigger than an arena can't waste more than 1/(2^this) of themselves to rounding
+#define BUDDY_FRAME_FREE 0x80                                    // Set in a block's Frame entry while the block is free
+#define BUDDY_FRAME_DIRTY 0x40                                   // Also set while a free block still holds old data (see EnableDeferredZeroing())
+
+// Lives in the first 16 bytes of each free block
+typedef struct BUDDY_BLOCK_STRUCT {
+  struct BUDDY_BLOCK_STRUCT *Next; // Next free block of the same order
+  struct BUDDY_BLOCK_STRUCT *Prev; // Previous free block of the same order
+} BUDDY_BLOCK;
+
+// One naturally-aligned region of physical memory that the buddy allocator splits into blocks
+typedef struct BUDDY_ARENA_STRUCT {
+  EFI_PHYSICAL_ADDRESS       Base;    // Aligned to the arena's size, so every block in it is aligned to its own size
+  UINT64                     Order;   // The arena is 1 << Order bytes, i.e. one block of this order when it's all free
+  struct BUDDY_ARENA_STRUCT *Next;    // Next arena in Global_Buddy_Info.ArenaList
+  UINT8                      Frame[]; // One per 4kB frame: 0 if no block starts there, else (order - BUDDY_MIN_ORDER + 1), | BUDDY_FRAME_FREE if free, | BUDDY_FRAME_DIRTY if not zeroed yet
+} BUDDY_ARENA;
+
+typedef struct {
+  BUDDY_BLOCK            *FreeList[BUDDY_NUM_ORDERS]; // Per-order lists of free blocks, index 0 is 4kB
+  BUDDY_ARENA            *ArenaList;                  // All arenas currently owned by the buddy allocator
+  UINT64                  NumArenas;                  // Number of arenas in ArenaList
+  UINT64                  DirtyBytes;                 // Total size of the free blocks marked BUDDY_FRAME_DIRTY
+} GLOBAL_BUDDY_INFO_STRUCT;
+
+// For the per-core malloc() caches in Memory.c
+#define MAGAZINE_MAX_CPUS 256                       // Max number of cores that can call Setup_Magazines()
+#define MAGAZINE_SIZE 32                            // Max objects cached per class per core
+#define MAGAZINE_BATCH (MAGAZINE_SIZE >> 1)         // Objects moved between a magazine and the shared allocators at a time
+#define MAGAZINE_PAGE_CLASS SLAB_NUM_CLASSES        // Magazine index for single 4kB buddy blocks, after the slab size classes
+#define MAGAZINE_NUM_CLASSES (SLAB_NUM_CLASSES + 1)
+#define IA32_GS_BASE 0xC0000101                     // Each core's GS base points to its own CPU_MAGAZINES
+
+// One core's cache of free, zeroed objects. Only that core ever touches it.
+typedef struct CPU_MAGAZINES_STRUCT {
+  struct CPU_MAGAZINES_STRUCT *Self;                                       // Must be first: %gs:0 reads this to find the current core's magazines
+  UINT64                       CpuIndex;                                   // Must be second: %gs:8 reads this to take the allocator lock
+  UINT64                       Count[MAGAZINE_NUM_CLASSES];                // Number of objects in each class's magazine
+  void                        *Rounds[MAGAZINE_NUM_CLASSES][MAGAZINE_SIZE]; // Stack of cached objects per class, most recently freed on top
+  UINT64                       Hits;                                       // Allocations served straight from a magazine
+  UINT64                       Refills;                                    // Times a magazine had to go to the shared allocators for more
+  UINT64                       Drains;                                     // Times a full magazine handed objects back to the shared allocators
+} CPU_MAGAZINES;
+
+// What IA32_GS_BASE points to on a core that couldn't get magazines. It starts like CPU_MAGAZINES, but Self is NULL.
+typedef struct {
+  CPU_MAGAZINES               *Self;                                       // Always NULL, so the core uses the shared allocators directly
+  UINT64                       CpuIndex;                                   // Still needed to take the allocator lock
+} CPU_NO_MAGAZINES;
+
+typedef struct {
+  CPU_MAGAZINES          *Cpu[MAGAZINE_MAX_CPUS]; // Each core's magazines, in the order the cores called Setup_Magazines()
+  UINT64                  NumCpus;                // Number of cores with magazines
+  volatile UINT64         LockOwner;              // CpuIndex + 1 of the core holding the allocator lock, 0 if nobody has it
+  UINT64                  LockDepth;              // The allocator lock is recursive, since e.g. slab_alloc() calls malloc2MB()
+  UINT64                  Enabled;                // 1 once the first core has called Setup_Magazines()
+  CPU_NO_MAGAZINES        NoMagazines[MAGAZINE_MAX_CPUS]; // Stand-ins for cores that Setup_Magazines() couldn't give magazines to
+} GLOBAL_MAGAZINE_INFO_STRUCT;
+
+// For demand-paged vmalloc() reservations in Memory.c
+#define DEMAND_PAGING_MAX_REGIONS 256                 // Max number of reservations that can exist at once
+#define DEMAND_PAGING_MIN_SIZE (2ULL << 20)           // vmalloc() requests at least this big get a reservation instead of memory map pages
+#define DEMAND_PAGING_GUARD_SIZE (2ULL << 20)         // Unmapped address space left between reservations, so overruns fault
+#define DEMAND_PAGING_FLUSH_PAGES 64                  // Unmapping more 4kB pages than this reloads CR3 instead of using invlpg on each
+#define DEMAND_PDE_COUNT_SHIFT 52                     // Bits 61:52 of a PDE that points to a page table are ignored by the CPU...
+#define DEMAND_PDE_COUNT_MASK (0x3FFULL << DEMAND_PDE_COUNT_SHIFT) // ...so they hold how many of its 512 entries are present
+
+// One reservation. Only [VirtualStart, VirtualStart + NumberOfPages * 4kB) is demand-faulted; the rest of its last 2MB is not.
+typedef struct {
+  EFI_VIRTUAL_ADDRESS     VirtualStart;  // Base of the reservation, aligned to Alignment
+  UINT64                  NumberOfPages; // Size of the reservation in 4kB pages
+  UINT64                  Alignment;     // Alignment the reservation was made with (at least 2MB), kept for when vrealloc() moves it
+  UINT64                  MappedPages;   // 4kB pages currently backed by RAM (a promoted 2MB page counts as 512)
+  UINT64                  Promote;       // 1 if fully-populated 2MB ranges get remapped as single 2MB pages
+} DEMAND_PAGING_REGION;
+
+typedef struct {
+  DEMAND_PAGING_REGION    Region[DEMAND_PAGING_MAX_REGIONS]; // Ordered by VirtualStart
+  UINT64                  NumRegions;                        // Number of entries in Region
+  EFI_VIRTUAL_ADDRESS     WindowStart;                       // Reservations come from [WindowStart, WindowEnd), which the identity map doesn't touch
+  EFI_VIRTUAL_ADDRESS     WindowEnd;                         // End of the lower canonical half
+  UINT64                  PagingLevels;                      // 4 or 5, depending on CR4.LA57
+  UINT64                  Faults;                            // Page faults resolved by mapping in a zeroed 4kB page
+  UINT64                  Promotions;                        // 2MB ranges remapped as a single 2MB page
+  UINT64                  Promote;                           // Promote setting vmalloc() gives its reservations, set by Setup_DemandPaging()
+  UINT64                  Enabled;                           // 1 once Setup_DemandPaging() has run
+} GLOBAL_DEMAND_PAGING_STRUCT;
+
 // For printf
 typedef struct {
 	EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE  defaultGPU;       // Default EFI GOP output device from GPUArray (should be GPUArray[0] if there's only 1)
@@ -452,6 +636,75 @@ typedef struct {
   UINT32                             textscrollmode;   // What to do when a newline goes off the bottom of the screen: 0 = scroll entire screen, 1 = wrap around to the top
 } GLOBAL_PRINT_INFO_STRUCT;
 
+// For shadow framebuffers in Display.c
+#define SHADOW_MAX_BUFFERS 4  // Max number of GPUs that can have a shadow framebuffer at once
+#define SHADOW_MAX_RECTS 32   // Dirty rectangles kept per shadow framebuffer; past this, new ones get merged into existing ones
+#define SHADOW_FLUSH_HZ 60    // How often Shadow_tick() flushes by default
+
+// One dirty area, in pixels. x_end and y_end are exclusive.
+typedef struct {
+  UINT32                  x;
+  UINT32                  y;
+  UINT32                  x_end;
+  UINT32                  y_end;
+} SHADOW_RECT;
+
+// One GPU's shadow framebuffer
+typedef struct {
+  EFI_PHYSICAL_ADDRESS    FrameBufferBase;         // The GPU's real framebuffer
+  UINTN                   FrameBufferSize;         // The GPU's real FrameBufferSize
+  EFI_PHYSICAL_ADDRESS    ShadowBase;              // The copy in write-back RAM that gets drawn to instead, laid out the same way
+  UINT64                  Size;                    // Bytes in the copy (VerticalResolution * PixelsPerScanLine * 4)
+  UINT32                  HorizontalResolution;
+  UINT32                  VerticalResolution;
+  UINT32                  PixelsPerScanLine;
+  UINT32                  NumDirty;                // Number of entries in Dirty
+  SHADOW_RECT             Dirty[SHADOW_MAX_RECTS]; // Areas drawn to since the last flush
+} SHADOW_BUFFER;
+
+typedef struct {
+  SHADOW_BUFFER           Buffer[SHADOW_MAX_BUFFERS]; // One per GPU with a shadow framebuffer
+  UINT64                  NumBuffers;                 // Number of entries in Buffer
+  UINT64                  FlushInterval;              // TSC ticks Shadow_tick() waits between flushes (0 = set from SHADOW_FLUSH_HZ)
+  UINT64                  LastFlush;                  // get_tick() as of the last Shadow_flush_all()
+  UINT64                  Flushes;                    // Flushes that had anything to copy
+  UINT64                  BytesFlushed;               // Total bytes those copied to framebuffers
+} GLOBAL_SHADOW_INFO_STRUCT;
+
+// For the glyph cache in Display.c
+#define GLYPH_CACHE_ENTRIES 256     // Expanded glyphs kept at once; past this, the least recently used one gets replaced
+#define GLYPH_CACHE_BUCKET_BITS 9   // log2 of the number of hash buckets
+#define GLYPH_CACHE_BUCKETS (1 << GLYPH_CACHE_BUCKET_BITS)
+#define GLYPH_CACHE_SLOT_SIZE 4096  // Bytes of expanded pixels per entry (an 8x8 glyph fits up to xscale = 16)
+#define GLYPH_CACHE_MAX_BITMAP 32   // Bytes of bitmap each entry keeps a copy of (enough for 16x16)
+
+// One expanded glyph. Its pixels are slot (its index in Entry) of GLOBAL_GLYPH_CACHE_STRUCT.Pixels.
+typedef struct {
+  const unsigned char *   Bitmap;                             // What Output_render_bitmap() was given
+  UINT8                   BitmapCopy[GLYPH_CACHE_MAX_BITMAP]; // Its contents when it was expanded
+  UINT32                  Width;
+  UINT32                  Height;
+  UINT32                  FontColor;
+  UINT32                  HighlightColor;
+  UINT32                  XScale;
+  UINT32                  YScale;
+  UINT32                  PixelFormat;                        // GPU.Info->PixelFormat
+  UINT32                  RowPitch;                           // Bytes from one expanded row to the next
+  UINT32                  Bucket;                             // Hash bucket it's in
+  INT32                   Next;                               // Next entry in the same bucket, or -1
+  UINT64                  LastUsed;                           // UseCount as of the last time it was drawn
+} GLYPH_CACHE_ENTRY;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS    Pixels;                       // GLYPH_CACHE_ENTRIES slots of GLYPH_CACHE_SLOT_SIZE bytes (0 until Setup_GlyphCache())
+  UINT64                  NumEntries;                   // Entries in use
+  UINT64                  UseCount;                     // Goes up by one every time a glyph is drawn from the cache
+  UINT64                  Hits;                         // Glyphs drawn that were already expanded
+  UINT64                  Misses;                       // Glyphs that had to be expanded first
+  INT32                   Buckets[GLYPH_CACHE_BUCKETS]; // First entry in each hash bucket, or -1
+  GLYPH_CACHE_ENTRY       Entry[GLYPH_CACHE_ENTRIES];
+} GLOBAL_GLYPH_CACHE_STRUCT;
+
 typedef struct {
   UINT64 CyclesPerSecond;
   UINT64 CyclesPerMillisecond;
@@ -600,6 +853,31 @@ typedef struct {
   void             *Context; // This is a pointer
 } ACPI_INTERRUPT_STRUCT;
 
+// For ACPICA's heap in acKernel64.c
+#define ACPI_HEAP_CHUNK_SIZE (2ULL << 20)                                          // The heap grows one malloc2MB() chunk at a time
+#define ACPI_HEAP_HEADER_SIZE 8                                                    // Each block starts with (requested size << 8) | size class
+#define ACPI_HEAP_SMALL_STEP 16                                                    // Size classes go up 16 bytes at a time to ACPI_HEAP_SMALL_MAX...
+#define ACPI_HEAP_SMALL_MAX 512
+#define ACPI_HEAP_NUM_CLASSES ((ACPI_HEAP_SMALL_MAX / ACPI_HEAP_SMALL_STEP) + 3)   // ...then there's 1kB, 2kB, and 4kB
+#define ACPI_HEAP_MAX_BLOCK_SIZE 4096                                              // Bigger blocks (header included) come from malloc() instead
+#define ACPI_HEAP_LARGE_CLASS 0xFF                                                 // Size class recorded for those
+
+typedef struct {
+  void                   *FreeList[ACPI_HEAP_NUM_CLASSES]; // Per-class lists of freed blocks, linked through the 8 bytes after each header
+  EFI_PHYSICAL_ADDRESS    Bump;                            // Next never-used byte of the current chunk
+  EFI_PHYSICAL_ADDRESS    BumpEnd;                         // End of the current chunk
+  UINT64                  NumChunks;                       // Chunks taken so far (they're kept for good, like ACPICA's namespace)
+  UINT64                  LargePages;                      // 4kB pages currently held by blocks too big for the size classes
+  UINT64                  PeakPages;                       // Most pages (chunks and big blocks) held at once
+  UINT64                  LiveBytes;                       // Bytes ACPICA currently has allocated, as requested
+  UINT64                  PeakBytes;                       // Most bytes ACPICA has had allocated at once
+  UINT64                  Allocations;                     // Calls to AcpiOsAllocate() and AcpiOsAllocateZeroed()
+  UINT64                  Frees;                           // Calls to AcpiOsFree()
+  UINT64                  InitTicks;                       // How long InitializeFullAcpi() took, in TSC ticks
+  INT64                   InitDescriptorsAdded;            // Memory map descriptors InitializeFullAcpi() added
+  INT64                   InitBytesUsed;                   // Free RAM InitializeFullAcpi() used up
+} GLOBAL_ACPI_HEAP_STRUCT;
+
 // ACPI Specification 6.2A, section 5.2.5 (Root System Description Pointer (RSDP))
 typedef struct __attribute__((packed)) {
   char      Signature[8]; // "RSD PTR " with trailing space
@@ -643,9 +921,19 @@ typedef struct __attribute__((packed)) {
 
 extern EFI_PHYSICAL_ADDRESS Global_RSDP_Address;
 extern ACPI_INTERRUPT_STRUCT Global_ACPI_Interrupt_Table[256];
+extern GLOBAL_ACPI_HEAP_STRUCT Global_ACPI_Heap;
 extern TSC_FREQUENCY_STRUCT Global_TSC_frequency;
 extern GLOBAL_MEMORY_INFO_STRUCT Global_Memory_Info;
+extern GLOBAL_SLAB_INFO_STRUCT Global_Slab_Info;
+extern GLOBAL_FREE_INDEX_STRUCT Global_Free_Index;
+extern GLOBAL_ZERO_POOL_STRUCT Global_Zero_Pool;
+extern GLOBAL_BUDDY_INFO_STRUCT Global_Buddy_Info;
+extern GLOBAL_MAGAZINE_INFO_STRUCT Global_Magazine_Info;
+extern GLOBAL_REALLOC_STATS_STRUCT Global_Realloc_Stats;
+extern GLOBAL_DEMAND_PAGING_STRUCT Global_Demand_Paging;
 extern GLOBAL_PRINT_INFO_STRUCT Global_Print_Info;
+extern GLOBAL_SHADOW_INFO_STRUCT Global_Shadow_Info;
+extern GLOBAL_GLYPH_CACHE_STRUCT Global_Glyph_Cache;
 extern uint64_t Numcores;
 extern EFI_PHYSICAL_ADDRESS LapicAddress;
 
@@ -672,6 +960,10 @@ void System_Init(LOADER_PARAMS * LP);
 uint64_t get_tick(void);
 void HaCF(void); // Note: this is at the very bottom of System.c
 void Enable_AVX(void);
+void nt_threshold_calibrate(void);
+void erms_cutoff_calibrate(void);
+void memmove_calibrate(void);
+void scroll_benchmark(void);
 void Enable_Local_x2APIC(void);
 void Enable_Maskable_Interrupts(void); // Exceptions and Non-Maskable Interrupts are always enabled.
 void Enable_HWP(void);
@@ -703,7 +995,8 @@ void set_tsr(uint16_t tsr_data);
 
 void Setup_MinimalGDT(void);
 void Setup_IDT(void);
-void Setup_Paging(void);
+void Setup_Paging(LOADER_PARAMS * LP);
+void Setup_PAT(void);
 
 char * Get_Brandstring(uint32_t * brandstring); // "brandstring" must be a 48-byte array
 char * Get_Manufacturer_ID(char * Manufacturer_ID); // "Manufacturer_ID" must be a 13-byte array
@@ -760,6 +1053,7 @@ void AVX_regdump(XSAVE_AREA_LAYOUT * layout_area);
 void Print_All_CRs_and_Some_Major_CPU_Features(void);
 void Print_Loader_Params(LOADER_PARAMS * LP);
 void Print_Segment_Registers(void);
+void run_benchmarks(LOADER_PARAMS * LP);
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // Memory-related functions (Memory.c)
@@ -778,8 +1072,15 @@ void Setup_MemMap(void);
 void ReclaimEfiBootServicesMemory(void);
 void ReclaimEfiLoaderCodeMemory(void);
 void MergeContiguousConventionalMemory(void);
+void RebuildFreeIndex(void);
+void free_latency_benchmark(uint64_t max_descriptors);
 EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void);
+void EnableDeferredZeroing(void);
+void DisableDeferredZeroing(void);
+uint64_t ZeroDirtyPages(uint64_t max_bytes);
+void zero_pool_stats(void);
 uint64_t MemMap_Prep(uint64_t num_additional_descriptors);
+void memmap_stats(void);
 EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size);
 EFI_PHYSICAL_ADDRESS null_alloc(void);
 
@@ -788,6 +1089,7 @@ __attribute__((malloc)) void * malloc(size_t numbytes);
 void * calloc(size_t elements, size_t size);
 void * realloc(void * allocated_address, size_t size);
 void free(void * allocated_address);
+void realloc_stats(void);
 PAGE_ENTRY_INFO_STRUCT get_page(void * hw_page_base_addr);
 uint8_t set_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint64_t attributes, uint8_t flags_or_entry);
 
@@ -803,6 +1105,18 @@ EFI_PHYSICAL_ADDRESS ActuallyAlignedFreeAddress(size_t pages, EFI_PHYSICAL_ADDRE
 
 EFI_PHYSICAL_ADDRESS AllocateFreeAddress(size_t numbytes, EFI_PHYSICAL_ADDRESS OldAddress, uintmax_t byte_alignment);
 
+  // Small-object slab allocator (sits underneath malloc() for sizes <= SLAB_MAX_OBJECT_SIZE)
+void kmalloc_stats(void);
+
+  // Buddy allocator for page-granular blocks up to 1GB (sits underneath malloc4KB(), malloc2MB(), and malloc1GB() if BUDDY_ALLOCATOR is defined in Memory.c)
+void buddy_stats(void);
+
+  // Per-core caches in front of the slab and buddy allocators (each core calls Setup_Magazines() once)
+void Setup_Magazines(void);
+void magazine_stats(void);
+void malloc_stress_benchmark(uint64_t iterations);
+uint64_t malloc_stress_worker(uint64_t iterations);
+
   // For virtual addresses
 __attribute__((malloc)) void * vmalloc(size_t numbytes);
 void * vcalloc(size_t elements, size_t size);
@@ -823,6 +1137,12 @@ EFI_VIRTUAL_ADDRESS VActuallyAlignedFreeAddress(size_t pages, EFI_VIRTUAL_ADDRES
 
 EFI_VIRTUAL_ADDRESS VAllocateFreeAddress(size_t numbytes, EFI_VIRTUAL_ADDRESS OldAddress, uintmax_t byte_alignment);
 
+  // Demand-paged reservations behind vmalloc() (pages are mapped in by PF_EXC_handler() on first touch)
+void Setup_DemandPaging(void);
+__attribute__((malloc)) void * vreserve(size_t numbytes, uint64_t byte_alignment, uint8_t promote);
+uint8_t demand_page_fault(EFI_VIRTUAL_ADDRESS fault_address);
+void demand_paging_stats(void);
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Drawing-related functions (Display.c)
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -857,6 +1177,19 @@ void bitmap_bitswap(const unsigned char * bitmap, UINT32 height, UINT32 width, u
 void bitmap_bitreverse(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output);
 void bitmap_bytemirror(const unsigned char * bitmap, UINT32 height, UINT32 width, unsigned char * output);
 
+  // Shadow framebuffers in RAM, flushed to the real ones with streaming stores (see Shadow_enable())
+EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE Shadow_enable(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE Shadow_disable(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+void Shadow_mark_dirty(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, INT64 x, INT64 y, INT64 width, INT64 height);
+void Shadow_flush(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+void Shadow_flush_all(void);
+void Shadow_tick(void);
+
+  // Expanded copies of recently drawn glyphs for Output_render_bitmap() (see Setup_GlyphCache())
+void Setup_GlyphCache(void);
+void glyph_render_benchmark(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+void raster_benchmark(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU);
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Text-related functions (Display.c)
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -905,6 +1238,7 @@ ACPI_STATUS Quit_ACPI(void);
 ACPI_STATUS InitializeAcpiTablesOnly(void);
 ACPI_STATUS InitializeAcpiAfterTables(void);
 void Set_ACPI_APIC_Mode(void);
+void acpi_heap_stats(void);
 
 // Shutdown and restart via ACPI
 void ACPI_Shutdown(void);
@@ -20,7 +20,19 @@
 // Set the default font with this
 #define SYSTEMFONT font8x8_basic // Must be set up in UTF-8
 
+// Which of font and highlight get drawn, for output_render_bitmap_avx2()
+#define OUTPUT_RENDER_OPAQUE 0
+#define OUTPUT_RENDER_FONT_ONLY 1      // Highlight is transparent
+#define OUTPUT_RENDER_HIGHLIGHT_ONLY 2 // Font is transparent
+
+// Widest scale output_render_bitmap_avx2() handles; anything wider goes to output_render_bitmap_ctz()
+#define OUTPUT_RENDER_AVX2_MAX_XSCALE 8
+
 static inline uint32_t output_render_ctz_32(uint32_t input);
+static void output_render_bitmap_ctz(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 xscale, UINT32 yscale, UINT32 index);
+#ifdef __AVX2__
+static void output_render_bitmap_avx2(const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, EFI_PHYSICAL_ADDRESS pixel_address_base, uint64_t BytesPerScanline, UINT32 xscale, UINT32 yscale, uint8_t mode);
+#endif
 static inline int64_t int_abs(int64_t x);
 
 // Don't use these trig functions for anything important. FSIN and FCOS have accuracy problems:
@@ -36,6 +48,15 @@ static inline double quick_sin_rad(double x);
 static inline double quick_tan_rad(double x);
 static inline double * quick_sincos_rad(double * two_x);
 
+static void shadow_flush_buffer(SHADOW_BUFFER * Shadow);
+static SHADOW_BUFFER * shadow_find(EFI_PHYSICAL_ADDRESS base);
+static inline SHADOW_RECT shadow_union(SHADOW_RECT a, SHADOW_RECT b);
+static inline uint64_t shadow_area(SHADOW_RECT a);
+static uint8_t * glyph_cache_get(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, UINT32 xscale, UINT32 yscale, uint32_t * row_pitch);
+static void glyph_cache_draw(const uint8_t * pixels, uint32_t row_pitch, EFI_PHYSICAL_ADDRESS dest, uint64_t BytesPerScanline, UINT32 width, UINT32 height, UINT32 xscale, UINT32 yscale);
+static void fill_polygon(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const int64_t * x, const int64_t * y, uint32_t num_points, UINT32 color, int64_t * crossings, int8_t * windings);
+static void draw_filled_triangle_vectors(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1, UINT32 x2, UINT32 y2, UINT32 x3, UINT32 y3, UINT32 color);
+
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // Initialize_Global_Printf_Defaults: Set Up Printf
@@ -206,6 +227,7 @@ void Colorscreen(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 color)
   Global_Print_Info.background_color = color;
 
   AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)GPU.FrameBufferBase, color, GPU.Info->VerticalResolution * GPU.Info->PixelsPerScanLine);
+  Shadow_mark_dirty(GPU, 0, 0, GPU.Info->HorizontalResolution, GPU.Info->VerticalResolution);
 /*  // This could work, too, if writing to the offscreen area is undesired. It'll probably be a little slower than a contiguous AVX_memset_4B, however.
   for (row = 0; row < GPU.Info->VerticalResolution; row++)
   {
@@ -265,6 +287,7 @@ void single_pixel(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x, UINT32 y, UIN
   if( !(color & transparency_color) )
   {
     *(UINT32*)(GPU.FrameBufferBase + (y * GPU.Info->PixelsPerScanLine + x) * 4) = color;
+    Shadow_mark_dirty(GPU, x, y, 1, 1);
   }
 }
 
@@ -523,9 +546,61 @@ void bitmap_anywhere_scaled(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigne
 //
 // Note that single_char_anywhere_scaled() takes 'a' or 'b', this would take something like character_array['a'] instead.
 //
+// When neither color is transparent, this draws from the glyph cache if it can (see Setup_GlyphCache()). Otherwise, AVX2 builds use
+// output_render_bitmap_avx2() for scales up to OUTPUT_RENDER_AVX2_MAX_XSCALE, and everything else goes to output_render_bitmap_ctz().
+// See glyph_render_benchmark() for how those two compare.
+//
 
-// "Unwrapped" Version
 void Output_render_bitmap(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 xscale, UINT32 yscale, UINT32 index)
+{
+  uint32_t transparency_color = 0xFF000000;
+  if(GPU.Info->PixelFormat == PixelBitMask)
+  {
+    transparency_color = GPU.Info->PixelInformation.ReservedMask;
+  }
+  uint64_t BytesPerScanline = GPU.Info->PixelsPerScanLine * 4;
+  EFI_PHYSICAL_ADDRESS pixel_address_base = GPU.FrameBufferBase + ( (y * GPU.Info->PixelsPerScanLine + x + xscale * index * width) * 4 );
+
+  Shadow_mark_dirty(GPU, (INT64)x + (INT64)xscale * index * width, y, (INT64)xscale * width, (INT64)yscale * height);
+
+  if( !((font_color | highlight_color) & transparency_color) ) // Neither font nor highlight are transparent
+  {
+    uint32_t row_pitch = 0;
+    uint8_t * glyph = glyph_cache_get(GPU, bitmap, width, height, font_color, highlight_color, xscale, yscale, &row_pitch);
+    if(glyph)
+    {
+      glyph_cache_draw(glyph, row_pitch, pixel_address_base, BytesPerScanline, width, height, xscale, yscale);
+      return;
+    }
+  }
+
+#ifdef __AVX2__
+  if(xscale <= OUTPUT_RENDER_AVX2_MAX_XSCALE)
+  {
+    uint8_t mode;
+    if(!(font_color & transparency_color))
+    {
+      mode = (highlight_color & transparency_color) ? OUTPUT_RENDER_FONT_ONLY : OUTPUT_RENDER_OPAQUE;
+    }
+    else if(!(highlight_color & transparency_color))
+    {
+      mode = OUTPUT_RENDER_HIGHLIGHT_ONLY;
+    }
+    else
+    {
+      return; // Both are transparent, nothing to draw
+    }
+
+    output_render_bitmap_avx2(bitmap, width, height, font_color, highlight_color, pixel_address_base, BytesPerScanline, xscale, yscale, mode);
+    return;
+  }
+#endif
+
+  output_render_bitmap_ctz(GPU, bitmap, width, height, font_color, highlight_color, x, y, xscale, yscale, index);
+}
+
+// "Unwrapped" Version, which finds runs of font and highlight pixels with tzcnt
+static void output_render_bitmap_ctz(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, UINT32 x, UINT32 y, UINT32 xscale, UINT32 yscale, UINT32 index)
 {
   // Compact ceiling function, so that size doesn't need to be passed in
   uint32_t row_iterator = (width >> 3); // How many bytes are in a row
@@ -871,6 +946,185 @@ static inline uint32_t output_render_ctz_32(uint32_t input)
   return output;
 }
 
+#ifdef __AVX2__
+//----------------------------------------------------------------------------------------------------------------------------------
+// output_render_bitmap_avx2: Vectorized Output_render_bitmap
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Expands each byte of a bitmap into 8 pixels at once: broadcast the byte to all 8 lanes, AND it with a different bit in each lane,
+// compare, and blend between the font and highlight colors with the result. For xscale > 1, each 8-pixel vector gets spread over
+// xscale vectors with permutes (vector k, lane j gets pixel (8k + j) / xscale), and each finished row is just stored yscale times.
+//
+// mode is one of the OUTPUT_RENDER_* values. In the transparent ones, the compare result (or its inverse) doubles as the write mask
+// for masked stores, so transparent pixels are never touched. The last byte of a row also gets masked to width, like the ctz version.
+//
+// pixel_address_base is the address of the top left pixel. xscale can't be more than OUTPUT_RENDER_AVX2_MAX_XSCALE.
+//
+
+static void output_render_bitmap_avx2(const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, EFI_PHYSICAL_ADDRESS pixel_address_base, uint64_t BytesPerScanline, UINT32 xscale, UINT32 yscale, uint8_t mode)
+{
+  uint32_t row_bytes = (width + 7) >> 3;
+  uint32_t last_byte = row_bytes - 1;
+  uint32_t last_byte_pixels = (width - (last_byte * 8)) * xscale; // Output pixels the last byte of each row covers
+
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i bit_select = _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80); // Bit 0 is the leftmost pixel
+  const __m256i font = _mm256_set1_epi32((int)font_color);
+  const __m256i highlight = _mm256_set1_epi32((int)highlight_color);
+
+  __m256i scale_permute[OUTPUT_RENDER_AVX2_MAX_XSCALE];
+  __m256i last_byte_lanes[OUTPUT_RENDER_AVX2_MAX_XSCALE];
+
+  for(uint32_t k = 0; k < xscale; k++)
+  {
+    int32_t permute[8];
+    for(uint32_t j = 0; j < 8; j++)
+    {
+      permute[j] = (int32_t)((8 * k + j) / xscale);
+    }
+    scale_permute[k] = _mm256_loadu_si256((const __m256i*)permute);
+    last_byte_lanes[k] = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)last_byte_pixels), _mm256_add_epi32(lanes, _mm256_set1_epi32((int)(8 * k))));
+  }
+
+  uint64_t PixelByteScale = xscale * 4;
+  EFI_PHYSICAL_ADDRESS pixel_row = pixel_address_base;
+
+  for(uint32_t row = 0; row < height; row++)
+  {
+    for(uint32_t byte = 0; byte < row_bytes; byte++)
+    {
+      __m256i bits = _mm256_set1_epi32(bitmap[row * row_bytes + byte]);
+      __m256i is_font = _mm256_cmpeq_epi32(_mm256_and_si256(bits, bit_select), bit_select);
+      __m256i pixels = _mm256_blendv_epi8(highlight, font, is_font);
+
+      __m256i write;
+      if(mode == OUTPUT_RENDER_FONT_ONLY)
+      {
+        write = is_font;
+      }
+      else if(mode == OUTPUT_RENDER_HIGHLIGHT_ONLY)
+      {
+        write = _mm256_xor_si256(is_font, _mm256_set1_epi32(-1));
+      }
+      else
+      {
+        write = _mm256_set1_epi32(-1);
+      }
+
+      EFI_PHYSICAL_ADDRESS pixel_column = pixel_row + (PixelByteScale * 8 * byte);
+
+      for(uint32_t k = 0; k < xscale; k++)
+      {
+        __m256i scaled = _mm256_permutevar8x32_epi32(pixels, scale_permute[k]);
+        EFI_PHYSICAL_ADDRESS scale_column = pixel_column + 32 * k;
+
+        if((mode == OUTPUT_RENDER_OPAQUE) && (byte != last_byte))
+        {
+          for(uint32_t b = 0; b < yscale; b++)
+          {
+            _mm256_storeu_si256((__m256i*)(scale_column + b * BytesPerScanline), scaled);
+          }
+        }
+        else
+        {
+          __m256i scaled_write = _mm256_permutevar8x32_epi32(write, scale_permute[k]);
+          if(byte == last_byte)
+          {
+            scaled_write = _mm256_and_si256(scaled_write, last_byte_lanes[k]);
+          }
+
+          for(uint32_t b = 0; b < yscale; b++)
+          {
+            _mm256_maskstore_epi32((int*)(scale_column + b * BytesPerScanline), scaled_write, scaled);
+          }
+        }
+      }
+    }
+
+    pixel_row += yscale * BytesPerScanline;
+  }
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// glyph_render_benchmark: Time the ctz and AVX2 Bitmap Renderers
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Draws all 95 printable characters of the system font with output_render_bitmap_ctz() and then output_render_bitmap_avx2(), at
+// scales of 1, 2, 4, and 8, in each of the three modes (opaque, transparent highlight, transparent font), and prints how long each
+// took. Neither one goes through the glyph cache. They draw to a buffer in RAM laid out like GPU's framebuffer, so the framebuffer's
+// memory type doesn't drown out the difference and nothing on screen changes. Results are in TSC ticks (see get_tick()) for the
+// fastest of 4 runs after a warm-up.
+//
+
+void glyph_render_benchmark(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+{
+#ifdef __AVX2__
+  const UINT32 scales[4] = {1, 2, 4, 8};
+  const char * mode_names[3] = {"opaque", "transparent highlight", "transparent font"};
+
+  uint32_t transparency_color = 0xFF000000;
+  if(GPU.Info->PixelFormat == PixelBitMask)
+  {
+    transparency_color = GPU.Info->PixelInformation.ReservedMask;
+  }
+  const UINT32 font_colors[3] = {0x00FFFFFF, 0x00FFFFFF, transparency_color};
+  const UINT32 highlight_colors[3] = {0x00000000, transparency_color, 0x00000000};
+
+  // The biggest glyph is 8 * 8 pixels wide and 8 * 8 rows tall
+  uint64_t BytesPerScanline = GPU.Info->PixelsPerScanLine * 4;
+  void * buffer = malloc(BytesPerScanline * 64);
+  if((EFI_PHYSICAL_ADDRESS)buffer == ~0ULL)
+  {
+    error_printf("glyph_render_benchmark: Not enough memory for the drawing buffer.\r\n");
+    return;
+  }
+  GPU.FrameBufferBase = (EFI_PHYSICAL_ADDRESS)buffer;
+
+  for(uint8_t mode = 0; mode < 3; mode++)
+  {
+    for(uint32_t scale = 0; scale < 4; scale++)
+    {
+      uint64_t best[2] = {~0ULL, ~0ULL};
+
+      for(uint32_t run = 0; run < 5; run++) // Run 0 is the warm-up
+      {
+        uint64_t start_tick = get_tick();
+        for(uint32_t character = 32; character < 127; character++)
+        {
+          output_render_bitmap_ctz(GPU, SYSTEMFONT[character], 8, 8, font_colors[mode], highlight_colors[mode], 0, 0, scales[scale], scales[scale], 0);
+        }
+        uint64_t mid_tick = get_tick();
+        for(uint32_t character = 32; character < 127; character++)
+        {
+          output_render_bitmap_avx2(SYSTEMFONT[character], 8, 8, font_colors[mode], highlight_colors[mode], GPU.FrameBufferBase, BytesPerScanline, scales[scale], scales[scale], mode);
+        }
+        uint64_t end_tick = get_tick();
+
+        if(run)
+        {
+          if((mid_tick - start_tick) < best[0])
+          {
+            best[0] = mid_tick - start_tick;
+          }
+          if((end_tick - mid_tick) < best[1])
+          {
+            best[1] = end_tick - mid_tick;
+          }
+        }
+      }
+
+      printf("Scale %u, %s: ctz %llu ticks, AVX2 %llu ticks\r\n", scales[scale], mode_names[mode], best[0], best[1]);
+    }
+  }
+
+  free(buffer);
+#else
+  (void)GPU;
+  info_printf("glyph_render_benchmark: This build doesn't have AVX2, so there's only the ctz renderer.\r\n");
+#endif
+}
+
 //
 // Extra bitmap rendering method notes:
 //
@@ -1188,6 +1442,8 @@ void Draw_vector(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init, UINT32 y_
 
   if( !(color & transparency_color) )
   {
+    Shadow_mark_dirty(GPU, (x_init < x_final) ? x_init : x_final, (y_init < y_final) ? y_init : y_final, (INT64)int_abs((int64_t)x_final - (int64_t)x_init) + 1, (INT64)int_abs((int64_t)y_final - (int64_t)y_init) + 1);
+
     if(y_final == y_init) // Horizontal line
     {
       if(x_final == x_init) // Dot
@@ -1664,6 +1920,10 @@ void Draw_arc(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init, UINT32 y_ini
   // The error checks at the end before printing should not be a problem.
   if( !(color & transparency_color) )
   {
+    // The radius goes from r to r + r_diff, so every point is within the larger of the two (plus a pixel for rounding) of the center
+    int64_t r_max = ((int_abs(r) > int_abs((int64_t)r + r_diff)) ? int_abs(r) : int_abs((int64_t)r + r_diff)) + 1;
+    Shadow_mark_dirty(GPU, (INT64)x_init - r_max, (INT64)y_init - r_max, 2 * r_max + 1, 2 * r_max + 1);
+
     double sincos_array[2] = {180, 0}; // Reminder that first member is the input
 
     if(theta_diff < 0) // 2's comp sign check for negative, clockwise sweep direction
@@ -1814,7 +2074,10 @@ void Draw_arc(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init, UINT32 y_ini
 // Draw_filled_arc: Draw An Arc in Polar Coordinates And Fill It In
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// This works exactly the same way as Draw_arc(), but it fills in the arc.
+// This works exactly the same way as Draw_arc(), but it fills in the arc: the points Draw_arc() would draw, joined by straight lines and
+// closed off by a straight line from the last point back to the first, get filled by fill_polygon(). So a 360-degree arc is a disc,
+// anything less is the part of one cut off by a chord, and a spiral is filled out to its last turn. Edge pixels follow the top-left
+// rule (see fill_polygon()).
 //
 // GPU: GPU to output, e.g. Global_Print_Info.defaultGPU or LP->GPU_Configs->GPUArray[k]
 // x_init and y_init: (x,y) coordinates on the screen of the arc's coordinate system's origin, relative to the top left corner ((0,0))
@@ -1841,184 +2104,47 @@ void Draw_filled_arc(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init, UINT3
     return ;
   }
 
-  // Calculating any more sophisticated bounds requires precomputing sine and cosine for the longest point in the arc/circle/spiral.
-  // Needless to say, this can take a while. By sticking checks that accomplish the same thing in the for loop and using the
-  // "__builtin_expect()" macro, we can tell the compiler to optimize for a specific branch. Doing this means that, in total, the
-  // conditional branches in the for loop take up many fewer instructions since the compiler ccan reasonably expect what will happen.
-  // In this case, using __builtin_expect makes the conditional branch sanity checks take about 2-3 cycles max after micro-op fusion.
-  // Looking at the asm output, GCC appears to be plenty smart enough to figure out the branch probabilities itself, but in this specific
-  // case it doesn't hurt to be explicit in case something ever changes in the future. In any event, I'll pay the 2-3 cycles to prevent major
-  // overflow and memory corruption problems, especially when the loop at best is already in the ~50-100 cycle range per iteration.
-
   uint32_t transparency_color = 0xFF000000;
   if(GPU.Info->PixelFormat == PixelBitMask)
   {
     transparency_color = GPU.Info->PixelInformation.ReservedMask;
   }
 
-  // You know what?
-  // I think this is actually faster than doing an iterative method that involves conditional branches inside for loops.
-  // The error checks at the end before printing should not be a problem.
   if( !(color & transparency_color) )
   {
-    double sincos_array[2] = {180, 0}; // Reminder that first member is the input
-    int32_t theta_last = theta_init + theta_diff;
+    // One point per degree, plus the starting one
+    uint32_t num_points = (uint32_t)int_abs(theta_diff) + 1;
 
-    if(theta_diff < 0)
+    int64_t * points_x = (int64_t*)malloc(num_points * (3 * sizeof(int64_t) + sizeof(int8_t)));
+    if((EFI_PHYSICAL_ADDRESS)points_x == ~0ULL)
     {
-      int32_t theta_end = theta_diff >> 1; // theta_dff / 2, with odds rounded up one (an odd's half needs to be the same as the even above its half)
-      // For negative numbers the bit shift rounds towards negative infinity.
-      // This is OK on x86, but not very portable.
-
-      if(r_step)
-      {
-        int32_t this_r_step = 0;
-        int32_t prev_r_step = 0;
-        double r_div = ((double)r_diff) / ((double)r_step);
-        int32_t last_r = (int32_t)(r_div * (double)(-theta_diff));
-
-        for(int32_t theta_diff_iter = 0, theta_iter = 0; theta_iter >= theta_end; r += (this_r_step - prev_r_step), last_r -= (this_r_step - prev_r_step), theta_iter--, theta_diff_iter++)
-        {
-          sincos_array[0] = (double)(theta_init + theta_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final = (uint32_t) ((int64_t)x_init + x_offset);
-          uint32_t y_final = (uint32_t) ((int64_t)y_init - y_offset); // Because (+) is down
-
-          // Now get the parallel pixel
-
-          sincos_array[0] = (double)(theta_last + theta_diff_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset2 = (int64_t) ((double)last_r * sincos_array[0]); // cosine
-          int64_t y_offset2 = (int64_t) ((double)last_r * sincos_array[1]); // sine
-
-          uint32_t x_final2 = (uint32_t) ((int64_t)x_init + x_offset2);
-          uint32_t y_final2 = (uint32_t) ((int64_t)y_init - y_offset2); // Because (+) is down
-
-          // Draw vector has error checks
-
-          // TODO: Something needs to be done here about the gap between pixels
-
-          Draw_vector(GPU, x_final, y_final, x_final2, y_final2, color);
-
-          prev_r_step = this_r_step;
-          this_r_step = (int32_t)(r_div * ((double)(-theta_iter)));
-        }
-      }
-      else
-      {
-
-        for(int32_t theta_diff_iter = 0, theta_iter = 0; theta_iter >= theta_end; theta_iter--, theta_diff_iter++)
-        {
-          sincos_array[0] = (double)(theta_init + theta_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final = (uint32_t) ((int64_t)x_init + x_offset);
-          uint32_t y_final = (uint32_t) ((int64_t)y_init - y_offset); // Because (+) is down
-
-          // Now get the parallel pixel
-
-          sincos_array[0] = (double)(theta_last + theta_diff_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset2 = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset2 = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final2 = (uint32_t) ((int64_t)x_init + x_offset2);
-          uint32_t y_final2 = (uint32_t) ((int64_t)y_init - y_offset2); // Because (+) is down
-
-          // Draw vector has error checks
-
-          // TODO: Something needs to be done here about the gap between pixels
-
-          Draw_vector(GPU, x_final, y_final, x_final2, y_final2, color);
-        }
-      }
+      error_printf("Draw_filled_arc error: Not enough memory for %u points.\r\n", num_points);
+      return ;
     }
-    else // positive, counterclockwise sweep direction
-    {
-      int32_t theta_end = (theta_diff + 1) >> 1; // theta_dff / 2, with odds rounded up one (an odd's half needs to be the same as the even above its half)
-
-      if(r_step)
-      {
-        int32_t this_r_step = 0;
-        int32_t prev_r_step = 0;
-        double r_div = ((double)r_diff) / ((double)r_step);
-        int32_t last_r = (int32_t)(r_div * (double)theta_diff);
-
-        for(int32_t theta_diff_iter = 0, theta_iter = 0; theta_iter <= theta_end; r += (this_r_step - prev_r_step), last_r -= (this_r_step - prev_r_step), theta_iter++, theta_diff_iter--)
-        {
-          sincos_array[0] = (double)(theta_init + theta_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final = (uint32_t) ((int64_t)x_init + x_offset);
-          uint32_t y_final = (uint32_t) ((int64_t)y_init - y_offset); // Because (+) is down
-
-          // Now get the parallel pixel
-
-          sincos_array[0] = (double)(theta_last + theta_diff_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset2 = (int64_t) ((double)last_r * sincos_array[0]); // cosine
-          int64_t y_offset2 = (int64_t) ((double)last_r * sincos_array[1]); // sine
-
-          uint32_t x_final2 = (uint32_t) ((int64_t)x_init + x_offset2);
-          uint32_t y_final2 = (uint32_t) ((int64_t)y_init - y_offset2); // Because (+) is down
-
-          // Draw vector has error checks
-
-          // TODO: Something needs to be done here about the gap between pixels
+    int64_t * points_y = points_x + num_points;
+    int64_t * crossings = points_y + num_points;
+    int8_t * windings = (int8_t*)(crossings + num_points);
 
-          Draw_vector(GPU, x_final, y_final, x_final2, y_final2, color);
-          prev_r_step = this_r_step;
-          this_r_step = (int32_t)(r_div * ((double)theta_iter));
-          // This is faster than using % or /.
-        }
-      }
-      else
-      {
-
-        for(int32_t theta_diff_iter = 0, theta_iter = 0; theta_iter <= theta_end; theta_iter++, theta_diff_iter--)
-        {
-          sincos_array[0] = (double)(theta_init + theta_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final = (uint32_t) ((int64_t)x_init + x_offset);
-          uint32_t y_final = (uint32_t) ((int64_t)y_init - y_offset); // Because (+) is down
-
-          // Now get the parallel pixel
-
-          sincos_array[0] = (double)(theta_last + theta_diff_iter);
-          quick_sincos_deg(sincos_array);
-
-          int64_t x_offset2 = (int64_t) ((double)r * sincos_array[0]); // cosine
-          int64_t y_offset2 = (int64_t) ((double)r * sincos_array[1]); // sine
-
-          uint32_t x_final2 = (uint32_t) ((int64_t)x_init + x_offset2);
-          uint32_t y_final2 = (uint32_t) ((int64_t)y_init - y_offset2); // Because (+) is down
+    double sincos_array[2] = {180, 0}; // Reminder that first member is the input
+    double r_div = r_step ? (((double)r_diff) / ((double)r_step)) : 0;
+    int32_t theta_sign = (theta_diff < 0) ? -1 : 1;
 
-          // Draw vector has error checks
+    for(uint32_t point = 0; point < num_points; point++)
+    {
+      // These are the same points Draw_arc() draws, where the radius lags one step behind the angle
+      int64_t radius = (int64_t)r + ((point && r_step) ? (int32_t)(r_div * (double)(point - 1)) : 0);
 
-          // TODO: Something needs to be done here about the gap between pixels
+      sincos_array[0] = (double)(theta_init + theta_sign * (int32_t)point);
+      quick_sincos_deg(sincos_array);
 
-          Draw_vector(GPU, x_final, y_final, x_final2, y_final2, color);
-        }
-      }
+      points_x[point] = (int64_t)x_init + (int64_t)((double)radius * sincos_array[0]); // cosine
+      points_y[point] = (int64_t)y_init - (int64_t)((double)radius * sincos_array[1]); // sine, and (+) is down
     }
 
+    // The arc, closed off by a straight line from its last point back to its first
+    fill_polygon(GPU, points_x, points_y, num_points, color, crossings, windings);
+
+    free(points_x);
   } // end transparency check
 }
 
@@ -2075,6 +2201,8 @@ void Draw_filled_rectangle(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x_init,
   EFI_PHYSICAL_ADDRESS corner_address = GPU.FrameBufferBase + (y_init * GPU.Info->PixelsPerScanLine + x_init) * 4;
   uint64_t BytesPerScanline = GPU.Info->PixelsPerScanLine * 4;
 
+  Shadow_mark_dirty(GPU, x_init, y_init, (INT64)x_length + 1, (INT64)y_length + 1); // Include initial point
+
   for(uint32_t y = 0; y <= y_length; y++) // Include initial point
   {
     AVX_memset_4B((UINT32*)(corner_address + y*BytesPerScanline), color, x_length + 1); // Include initial point
@@ -2132,6 +2260,9 @@ void Draw_quad(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1, UINT
 //
 // If (x1,y1) and (x3,y3) are not opposite points, unexpected shapes may occur, like a triangle or a quint (|_V_|).
 //
+// The two triangles share the (x1,y1)-(x3,y3) edge, and since Draw_filled_triangle() follows the top-left rule, every pixel along it
+// gets drawn by exactly one of them.
+//
 
 void Draw_filled_quad(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1, UINT32 x2, UINT32 y2, UINT32 x3, UINT32 y3, UINT32 x4, UINT32 y4, UINT32 color)
 {
@@ -2182,10 +2313,156 @@ void Draw_triangle(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1,
 // x1,y1, x2,y2, and x3,y3: (x,y) coordinates on the screen of each vertex of the triangle, relative to the top left corner of the screen (which is (0,0))
 // color: triangle's color
 //
+// This is a scanline fill (see fill_polygon()), so each pixel gets drawn once. Pixels exactly on an edge follow the top-left rule,
+// meaning they're drawn for top and left edges but not bottom or right ones: that way triangles sharing an edge never overlap or
+// leave a gap, in whatever order they're drawn. It also means a triangle with no area, like a line, draws nothing. Use Draw_vector()
+// for lines, and Draw_triangle() for the outline.
+//
 
 void Draw_filled_triangle(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1, UINT32 x2, UINT32 y2, UINT32 x3, UINT32 y3, UINT32 color)
 {
-  // Draw vector has out-of-bounds checks in it already
+  uint32_t transparency_color = 0xFF000000;
+  if(GPU.Info->PixelFormat == PixelBitMask)
+  {
+    transparency_color = GPU.Info->PixelInformation.ReservedMask;
+  }
+
+  if( !(color & transparency_color) )
+  {
+    int64_t points_x[3] = {x1, x2, x3};
+    int64_t points_y[3] = {y1, y2, y3};
+    int64_t crossings[3];
+    int8_t windings[3];
+
+    fill_polygon(GPU, points_x, points_y, 3, color, crossings, windings);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// fill_polygon: Fill a Polygon One Scanline at a Time
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fills the polygon with vertices (x[0], y[0]) ... (x[num_points - 1], y[num_points - 1]), closed back to the first one, by sampling
+// the center of each pixel. On each row, every edge that crosses it gets its crossing point computed exactly (with integer math,
+// rounded up), the crossings get sorted, and the spans between them are filled with AVX_memset_4B(). Overlapping or self-intersecting
+// parts are filled once (nonzero winding rule).
+//
+// Pixels exactly on an edge follow the top-left rule: they're filled if the edge is a top or left edge, and not if it's a bottom or
+// right edge. So two polygons that share an edge never both draw a pixel on it and never both skip one, no matter which is drawn
+// first, and a polygon with no area draws nothing. Since rounding is exact, an edge crosses each row at the same place whichever
+// direction it goes, which is what makes that work.
+//
+// crossings and windings are scratch space with num_points entries each. Vertices can be off the screen; the fill gets clipped.
+//
+
+static void fill_polygon(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const int64_t * x, const int64_t * y, uint32_t num_points, UINT32 color, int64_t * crossings, int8_t * windings)
+{
+  int64_t x_min = x[0], x_max = x[0], y_min = y[0], y_max = y[0];
+  for(uint32_t point = 1; point < num_points; point++)
+  {
+    x_min = (x[point] < x_min) ? x[point] : x_min;
+    x_max = (x[point] > x_max) ? x[point] : x_max;
+    y_min = (y[point] < y_min) ? y[point] : y_min;
+    y_max = (y[point] > y_max) ? y[point] : y_max;
+  }
+
+  // Bottom and right edges aren't drawn, so neither are y_max and x_max
+  int64_t row_start = (y_min > 0) ? y_min : 0;
+  int64_t row_end = (y_max < (int64_t)GPU.Info->VerticalResolution) ? y_max : (int64_t)GPU.Info->VerticalResolution;
+  int64_t column_start = (x_min > 0) ? x_min : 0;
+  int64_t column_end = (x_max < (int64_t)GPU.Info->HorizontalResolution) ? x_max : (int64_t)GPU.Info->HorizontalResolution;
+
+  if((row_start >= row_end) || (column_start >= column_end))
+  {
+    return;
+  }
+
+  Shadow_mark_dirty(GPU, column_start, row_start, column_end - column_start, row_end - row_start);
+
+  uint64_t BytesPerScanline = GPU.Info->PixelsPerScanLine * 4;
+
+  for(int64_t row = row_start; row < row_end; row++)
+  {
+    uint32_t num_crossings = 0;
+
+    for(uint32_t point = 0; point < num_points; point++)
+    {
+      uint32_t next = (point + 1 == num_points) ? 0 : point + 1;
+      int64_t x_top = x[point], y_top = y[point], x_bottom = x[next], y_bottom = y[next];
+      int8_t winding = 1;
+
+      if(y_top == y_bottom) // Horizontal edges don't cross any rows
+      {
+        continue;
+      }
+      if(y_top > y_bottom)
+      {
+        x_top = x[next];
+        y_top = y[next];
+        x_bottom = x[point];
+        y_bottom = y[point];
+        winding = -1;
+      }
+      if((row < y_top) || (row >= y_bottom)) // Top end counts, bottom end doesn't
+      {
+        continue;
+      }
+
+      // The first pixel at or right of where the edge crosses this row
+      int64_t numerator = (row - y_top) * (x_bottom - x_top);
+      int64_t denominator = y_bottom - y_top;
+      int64_t crossing = x_top + ((numerator >= 0) ? ((numerator + denominator - 1) / denominator) : -((-numerator) / denominator));
+
+      // Insertion sort: there are only ever a few crossings per row
+      uint32_t slot = num_crossings++;
+      while(slot && (crossings[slot - 1] > crossing))
+      {
+        crossings[slot] = crossings[slot - 1];
+        windings[slot] = windings[slot - 1];
+        slot--;
+      }
+      crossings[slot] = crossing;
+      windings[slot] = winding;
+    }
+
+    EFI_PHYSICAL_ADDRESS row_address = GPU.FrameBufferBase + (uint64_t)row * BytesPerScanline;
+    int32_t winding = 0;
+    int64_t span_start = 0;
+
+    for(uint32_t crossing = 0; crossing < num_crossings; crossing++)
+    {
+      int32_t prev_winding = winding;
+      winding += windings[crossing];
+
+      if(!prev_winding && winding)
+      {
+        span_start = crossings[crossing];
+      }
+      else if(prev_winding && !winding)
+      {
+        int64_t span_first = (span_start > column_start) ? span_start : column_start;
+        int64_t span_end = (crossings[crossing] < column_end) ? crossings[crossing] : column_end;
+
+        if(span_first < span_end)
+        {
+          AVX_memset_4B((UINT32*)(row_address + (uint64_t)span_first * 4), color, (size_t)(span_end - span_first));
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// draw_filled_triangle_vectors: Old Draw_filled_triangle()
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// This is how Draw_filled_triangle() used to work, by drawing vectors from each point of the (x1,y1)->(x2,y2) edge to (x3,y3). It's
+// only kept around for raster_benchmark() to compare against.
+//
+
+static void draw_filled_triangle_vectors(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT32 y1, UINT32 x2, UINT32 y2, UINT32 x3, UINT32 y3, UINT32 color)
+{
+  // Draw vector has out-of-bounds checks in it already
 
   //
   // In a nutshell, triangle fill does something like this:
@@ -2539,6 +2816,98 @@ void Draw_filled_triangle(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, UINT32 x1, UINT
   }
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+// raster_benchmark: Compare the Scanline and Vector-Fan Triangle Fills
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fills 256 pseudo-random quads, each as two triangles sharing the (x1,y1)-(x3,y3) edge like Draw_filled_quad() does, with both the
+// scanline rasterizer (Draw_filled_triangle()) and the old way of drawing a fan of vectors (draw_filled_triangle_vectors()). Each quad
+// gets drawn twice per method in a 256x256 buffer in RAM, once in each order and with a different color per triangle, and this prints
+// the totals of:
+//
+// - TSC ticks (see get_tick()) spent drawing in the first order
+// - Pixels covered
+// - Pixels both triangles drew over, found by where the two orders differ. The scanline fill should always have 0.
+//
+// GPU only supplies the pixel format; nothing is drawn to its framebuffer.
+//
+
+void raster_benchmark(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+{
+  EFI_GRAPHICS_OUTPUT_MODE_INFORMATION Info = *GPU.Info;
+  Info.HorizontalResolution = 256;
+  Info.VerticalResolution = 256;
+  Info.PixelsPerScanLine = 256;
+  GPU.Info = &Info;
+  GPU.FrameBufferSize = 256 * 256 * 4;
+
+  UINT32 * buffer = (UINT32*)malloc(2 * GPU.FrameBufferSize);
+  if((EFI_PHYSICAL_ADDRESS)buffer == ~0ULL)
+  {
+    error_printf("raster_benchmark: Not enough memory for the drawing buffers.\r\n");
+    return;
+  }
+  UINT32 * buffer2 = buffer + 256 * 256;
+
+  const char * method_names[2] = {"Vector fan", "Scanline"};
+
+  for(uint32_t method = 0; method < 2; method++)
+  {
+    uint64_t ticks = 0, covered = 0, overlap = 0;
+    uint32_t seed = 12345; // Same quads for both methods
+
+    for(uint32_t quad = 0; quad < 256; quad++)
+    {
+      UINT32 px[4], py[4];
+      for(uint32_t point = 0; point < 4; point++)
+      {
+        seed = seed * 1103515245 + 12345;
+        px[point] = (seed >> 8) & 0xFF;
+        seed = seed * 1103515245 + 12345;
+        py[point] = (seed >> 8) & 0xFF;
+      }
+
+      AVX_memset(buffer, 0, 2 * GPU.FrameBufferSize);
+
+      GPU.FrameBufferBase = (EFI_PHYSICAL_ADDRESS)buffer;
+      uint64_t start_tick = get_tick();
+      if(method)
+      {
+        Draw_filled_triangle(GPU, px[0], py[0], px[1], py[1], px[2], py[2], 0x00FF0000);
+        Draw_filled_triangle(GPU, px[0], py[0], px[2], py[2], px[3], py[3], 0x000000FF);
+      }
+      else
+      {
+        draw_filled_triangle_vectors(GPU, px[0], py[0], px[1], py[1], px[2], py[2], 0x00FF0000);
+        draw_filled_triangle_vectors(GPU, px[0], py[0], px[2], py[2], px[3], py[3], 0x000000FF);
+      }
+      ticks += get_tick() - start_tick;
+
+      GPU.FrameBufferBase = (EFI_PHYSICAL_ADDRESS)buffer2;
+      if(method)
+      {
+        Draw_filled_triangle(GPU, px[0], py[0], px[2], py[2], px[3], py[3], 0x000000FF);
+        Draw_filled_triangle(GPU, px[0], py[0], px[1], py[1], px[2], py[2], 0x00FF0000);
+      }
+      else
+      {
+        draw_filled_triangle_vectors(GPU, px[0], py[0], px[2], py[2], px[3], py[3], 0x000000FF);
+        draw_filled_triangle_vectors(GPU, px[0], py[0], px[1], py[1], px[2], py[2], 0x00FF0000);
+      }
+
+      for(uint32_t pixel = 0; pixel < 256 * 256; pixel++)
+      {
+        covered += (buffer[pixel] != 0);
+        overlap += (buffer[pixel] != buffer2[pixel]);
+      }
+    }
+
+    printf("%s: %llu ticks, %llu pixels covered, %llu drawn by both triangles\r\n", method_names[method], ticks, covered, overlap);
+  }
+
+  free(buffer);
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // bitmap_bitswap: Swap Bitmap Bits
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -2645,3 +3014,531 @@ void bitmap_bytemirror(const unsigned char * bitmap, UINT32 width, UINT32 height
     }
   }
 }
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_enable: Draw to a Copy of the Framebuffer in RAM
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Framebuffers are mapped uncacheable or write-combining, so anything that reads from one (like scrolling) is very slow, and so are
+// lots of small, scattered writes (like drawing text one glyph row at a time). This gives a GPU a shadow framebuffer: a copy of it in
+// normal write-back RAM, laid out the same way. Drawing goes to the copy instead, the drawing functions in this file and printf note
+// which rectangles they touched (see Shadow_mark_dirty()), and Shadow_flush() copies just those over to the real framebuffer with
+// streaming stores.
+//
+// Returns a copy of GPU whose FrameBufferBase points to the shadow framebuffer; pass that to the drawing functions. If GPU is the one
+// printf uses, printf gets switched over to it too. If GPU already has a shadow, this returns it. If there isn't enough memory or
+// SHADOW_MAX_BUFFERS GPUs already have one, GPU gets returned as-is and drawing keeps going straight to the framebuffer.
+//
+// Nothing shows up on screen until a flush. printf calls Shadow_tick(), so its output appears within 1/SHADOW_FLUSH_HZ seconds as long
+// as something keeps printing, and HaCF() flushes everything before halting. Otherwise, call Shadow_flush() after drawing, or
+// Shadow_tick() from a periodic timer. Anything drawn straight to the real framebuffer gets overwritten by the next flush of that area.
+//
+
+EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE Shadow_enable(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+{
+  SHADOW_BUFFER * Shadow = shadow_find(GPU.FrameBufferBase);
+  if(Shadow)
+  {
+    GPU.FrameBufferBase = Shadow->ShadowBase;
+    GPU.FrameBufferSize = Shadow->Size;
+    return GPU;
+  }
+
+  if(Global_Shadow_Info.NumBuffers >= SHADOW_MAX_BUFFERS)
+  {
+    warning_printf("Shadow_enable: Already at %u shadow framebuffers, drawing directly.\r\n", SHADOW_MAX_BUFFERS);
+    return GPU;
+  }
+
+  uint64_t size = (uint64_t)GPU.Info->VerticalResolution * GPU.Info->PixelsPerScanLine * 4;
+
+  // Anything this size is at least 4kB-aligned, which the streaming loads in Shadow_flush() need
+  void * shadow_base = malloc(size);
+  if((EFI_PHYSICAL_ADDRESS)shadow_base == ~0ULL)
+  {
+    warning_printf("Shadow_enable: Not enough memory for a %llu-byte shadow framebuffer, drawing directly.\r\n", size);
+    return GPU;
+  }
+
+  // Start out with what's on screen, which is what makes it OK for flushes to copy a little past the edges of dirty areas
+  memcpy_from_wc(shadow_base, (void*)GPU.FrameBufferBase, size);
+
+  Shadow = &Global_Shadow_Info.Buffer[Global_Shadow_Info.NumBuffers];
+  Shadow->FrameBufferBase = GPU.FrameBufferBase;
+  Shadow->FrameBufferSize = GPU.FrameBufferSize;
+  Shadow->ShadowBase = (EFI_PHYSICAL_ADDRESS)shadow_base;
+  Shadow->Size = size;
+  Shadow->HorizontalResolution = GPU.Info->HorizontalResolution;
+  Shadow->VerticalResolution = GPU.Info->VerticalResolution;
+  Shadow->PixelsPerScanLine = GPU.Info->PixelsPerScanLine;
+  Shadow->NumDirty = 0;
+
+  if(!Global_Shadow_Info.NumBuffers)
+  {
+    if(!Global_Shadow_Info.FlushInterval)
+    {
+      Global_Shadow_Info.FlushInterval = Global_TSC_frequency.CyclesPerSecond / SHADOW_FLUSH_HZ;
+    }
+    Global_Shadow_Info.LastFlush = get_tick();
+  }
+  Global_Shadow_Info.NumBuffers++;
+
+  GPU.FrameBufferBase = Shadow->ShadowBase;
+  GPU.FrameBufferSize = Shadow->Size;
+
+  if(Global_Print_Info.defaultGPU.FrameBufferBase == Shadow->FrameBufferBase)
+  {
+    Global_Print_Info.defaultGPU = GPU;
+  }
+
+  return GPU;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_disable: Go Back to Drawing Directly
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Flushes and frees GPU's shadow framebuffer. GPU can be either the shadowed copy from Shadow_enable() or the original. Returns the
+// original, whose FrameBufferBase is the real framebuffer again. If GPU is the one printf uses, printf gets switched back too.
+//
+
+EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE Shadow_disable(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+{
+  SHADOW_BUFFER * Shadow = shadow_find(GPU.FrameBufferBase);
+  if(!Shadow)
+  {
+    return GPU;
+  }
+
+  shadow_flush_buffer(Shadow);
+
+  EFI_PHYSICAL_ADDRESS shadow_base = Shadow->ShadowBase;
+  GPU.FrameBufferBase = Shadow->FrameBufferBase;
+  GPU.FrameBufferSize = Shadow->FrameBufferSize;
+
+  if(Global_Print_Info.defaultGPU.FrameBufferBase == shadow_base)
+  {
+    Global_Print_Info.defaultGPU = GPU;
+  }
+
+  // Order doesn't matter, so the last one just takes its place
+  Global_Shadow_Info.NumBuffers--;
+  *Shadow = Global_Shadow_Info.Buffer[Global_Shadow_Info.NumBuffers];
+
+  free((void*)shadow_base);
+
+  return GPU;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_mark_dirty: Note an Area That Needs Flushing
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Every function that draws to GPU.FrameBufferBase calls this with the area it drew to, in pixels. It does nothing unless that's a
+// shadow framebuffer. The area can hang off the edges of the screen; it just gets clipped.
+//
+// Each shadow framebuffer keeps up to SHADOW_MAX_RECTS rectangles. A new one gets merged into an existing one if the two together
+// aren't any bigger than they are apart, like the next glyph in a line of text, or anything inside an area already marked. Past
+// SHADOW_MAX_RECTS, a new one gets merged into whichever existing one that grows the least. Either way, nothing ever gets missed; the
+// worst case is just copying some pixels that didn't change.
+//
+
+void Shadow_mark_dirty(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, INT64 x, INT64 y, INT64 width, INT64 height)
+{
+  if(!Global_Shadow_Info.NumBuffers || (width <= 0) || (height <= 0))
+  {
+    return;
+  }
+
+  SHADOW_BUFFER * Shadow = NULL;
+  for(uint64_t buffer = 0; buffer < Global_Shadow_Info.NumBuffers; buffer++)
+  {
+    if(Global_Shadow_Info.Buffer[buffer].ShadowBase == GPU.FrameBufferBase)
+    {
+      Shadow = &Global_Shadow_Info.Buffer[buffer];
+      break;
+    }
+  }
+
+  if(!Shadow)
+  {
+    return;
+  }
+
+  INT64 x_end = x + width;
+  INT64 y_end = y + height;
+
+  if(x < 0)
+  {
+    x = 0;
+  }
+  if(y < 0)
+  {
+    y = 0;
+  }
+  if(x_end > Shadow->HorizontalResolution)
+  {
+    x_end = Shadow->HorizontalResolution;
+  }
+  if(y_end > Shadow->VerticalResolution)
+  {
+    y_end = Shadow->VerticalResolution;
+  }
+
+  if((x >= x_end) || (y >= y_end))
+  {
+    return;
+  }
+
+  SHADOW_RECT New = {(UINT32)x, (UINT32)y, (UINT32)x_end, (UINT32)y_end};
+  uint32_t best = 0;
+  uint64_t best_growth = ~0ULL;
+
+  for(uint32_t rect = 0; rect < Shadow->NumDirty; rect++)
+  {
+    SHADOW_RECT Union = shadow_union(Shadow->Dirty[rect], New);
+
+    if(shadow_area(Union) <= (shadow_area(Shadow->Dirty[rect]) + shadow_area(New)))
+    {
+      Shadow->Dirty[rect] = Union;
+      return;
+    }
+
+    if((shadow_area(Union) - shadow_area(Shadow->Dirty[rect])) < best_growth)
+    {
+      best_growth = shadow_area(Union) - shadow_area(Shadow->Dirty[rect]);
+      best = rect;
+    }
+  }
+
+  if(Shadow->NumDirty < SHADOW_MAX_RECTS)
+  {
+    Shadow->Dirty[Shadow->NumDirty] = New;
+    Shadow->NumDirty++;
+  }
+  else
+  {
+    Shadow->Dirty[best] = shadow_union(Shadow->Dirty[best], New);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_flush: Copy a Shadow Framebuffer's Dirty Areas to the Screen
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// GPU can be either the shadowed copy from Shadow_enable() or the original. Does nothing if it doesn't have a shadow framebuffer.
+//
+
+void Shadow_flush(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU)
+{
+  SHADOW_BUFFER * Shadow = shadow_find(GPU.FrameBufferBase);
+  if(Shadow)
+  {
+    shadow_flush_buffer(Shadow);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_flush_all: Flush Every Shadow Framebuffer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same as calling Shadow_flush() on each GPU with a shadow framebuffer.
+//
+
+void Shadow_flush_all(void)
+{
+  for(uint64_t buffer = 0; buffer < Global_Shadow_Info.NumBuffers; buffer++)
+  {
+    shadow_flush_buffer(&Global_Shadow_Info.Buffer[buffer]);
+  }
+
+  Global_Shadow_Info.LastFlush = get_tick();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Shadow_tick: Flush Every Shadow Framebuffer Every So Often
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Calls Shadow_flush_all() if it's been at least Global_Shadow_Info.FlushInterval TSC ticks since the last time, so it's cheap to call
+// as often as convenient. Meant for a periodic timer interrupt, or anything that draws a lot in small pieces (printf calls it).
+//
+
+void Shadow_tick(void)
+{
+  if(Global_Shadow_Info.NumBuffers && ((get_tick() - Global_Shadow_Info.LastFlush) >= Global_Shadow_Info.FlushInterval))
+  {
+    Shadow_flush_all();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// shadow_flush_buffer: Copy Dirty Areas Out With Streaming Stores
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Copies each dirty rectangle over one row at a time, or all at once if it's full-width, then clears the list. Each span is rounded
+// out to whole 64-byte lines, so the streaming stores are aligned and each one fills a write-combining buffer completely. That means
+// a few pixels on either side get copied too, but those are the same in both places anyway.
+//
+
+static void shadow_flush_buffer(SHADOW_BUFFER * Shadow)
+{
+  if(!Shadow->NumDirty)
+  {
+    return;
+  }
+
+  // The shadow framebuffer is always aligned, but the real one doesn't have to be
+  void * (*copy)(void *dest, void *src, size_t numbytes) = (Shadow->FrameBufferBase & 63) ? AVX_memcpy : AVXmem_Dispatch.Memcpy_Stream;
+  uint64_t BytesPerScanline = (uint64_t)Shadow->PixelsPerScanLine * 4;
+  uint64_t bytes_flushed = 0;
+
+  for(uint32_t rect = 0; rect < Shadow->NumDirty; rect++)
+  {
+    SHADOW_RECT Dirty = Shadow->Dirty[rect];
+    uint64_t offset = Dirty.y * BytesPerScanline + Dirty.x * 4;
+    uint64_t span = (uint64_t)(Dirty.x_end - Dirty.x) * 4;
+    uint64_t rows = Dirty.y_end - Dirty.y;
+
+    if((Dirty.x == 0) && (Dirty.x_end == Shadow->HorizontalResolution)) // Full-width rows are contiguous, save for any padding
+    {
+      span += (rows - 1) * BytesPerScanline;
+      rows = 1;
+    }
+
+    for(uint64_t row = 0; row < rows; row++, offset += BytesPerScanline)
+    {
+      uint64_t start = offset & ~63ULL;
+      uint64_t end = (offset + span + 63) & ~63ULL;
+      if(end > Shadow->Size)
+      {
+        end = Shadow->Size;
+      }
+
+      copy((void*)(Shadow->FrameBufferBase + start), (void*)(Shadow->ShadowBase + start), end - start);
+      bytes_flushed += end - start;
+    }
+  }
+
+  _mm_sfence();
+
+  Shadow->NumDirty = 0;
+  Global_Shadow_Info.Flushes++;
+  Global_Shadow_Info.BytesFlushed += bytes_flushed;
+}
+
+// Returns the shadow framebuffer that base is either the real or shadow address of, or NULL if there isn't one
+static SHADOW_BUFFER * shadow_find(EFI_PHYSICAL_ADDRESS base)
+{
+  for(uint64_t buffer = 0; buffer < Global_Shadow_Info.NumBuffers; buffer++)
+  {
+    if((Global_Shadow_Info.Buffer[buffer].ShadowBase == base) || (Global_Shadow_Info.Buffer[buffer].FrameBufferBase == base))
+    {
+      return &Global_Shadow_Info.Buffer[buffer];
+    }
+  }
+
+  return NULL;
+}
+
+// Smallest rectangle containing both a and b
+static inline SHADOW_RECT shadow_union(SHADOW_RECT a, SHADOW_RECT b)
+{
+  SHADOW_RECT Union = {
+    (a.x < b.x) ? a.x : b.x,
+    (a.y < b.y) ? a.y : b.y,
+    (a.x_end > b.x_end) ? a.x_end : b.x_end,
+    (a.y_end > b.y_end) ? a.y_end : b.y_end
+  };
+  return Union;
+}
+
+static inline uint64_t shadow_area(SHADOW_RECT a)
+{
+  return (uint64_t)(a.x_end - a.x) * (a.y_end - a.y);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_GlyphCache: Keep Expanded Copies of Recently Drawn Glyphs
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Output_render_bitmap() has to walk a bitmap bit by bit and write each pixel xscale * yscale times, one UINT32 at a time. Nearly all of
+// what it draws is printf's text, though, which is the same hundred or so characters over and over in the same couple of colors. The
+// glyph cache keeps the fully expanded pixel rows of the last GLYPH_CACHE_ENTRIES glyphs drawn with an opaque font and highlight
+// color, keyed by bitmap, size, colors, scale, and pixel format. Drawing a cached glyph is just height * yscale copies of one
+// width * xscale pixel row with vector stores. When the cache is full, the glyph that was drawn least recently gets replaced, so lots
+// of different color combinations can't make it grow.
+//
+// Each entry also keeps a copy of its bitmap's contents, so a buffer that's reused for a different image (like with
+// bitmap_anywhere_scaled()) just gets re-expanded instead of drawing the old one. Glyphs whose bitmap is more than
+// GLYPH_CACHE_MAX_BITMAP bytes or whose expanded rows don't fit in GLYPH_CACHE_SLOT_SIZE bytes, and anything drawn before this runs,
+// are drawn without the cache.
+//
+// This needs malloc(), so it has to run after Setup_MemMap().
+//
+
+void Setup_GlyphCache(void)
+{
+  if(Global_Glyph_Cache.Pixels)
+  {
+    return;
+  }
+
+  void * pixels = malloc(GLYPH_CACHE_ENTRIES * GLYPH_CACHE_SLOT_SIZE);
+  if((EFI_PHYSICAL_ADDRESS)pixels == ~0ULL)
+  {
+    warning_printf("Setup_GlyphCache: Not enough memory for the glyph cache, text will be drawn without it.\r\n");
+    return;
+  }
+
+  for(uint64_t bucket = 0; bucket < GLYPH_CACHE_BUCKETS; bucket++)
+  {
+    Global_Glyph_Cache.Buckets[bucket] = -1;
+  }
+  Global_Glyph_Cache.NumEntries = 0;
+  Global_Glyph_Cache.Pixels = (EFI_PHYSICAL_ADDRESS)pixels;
+}
+
+// Returns the expanded pixels for this glyph, expanding it first if it isn't cached, or NULL if it can't be cached
+static uint8_t * glyph_cache_get(EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU, const unsigned char * bitmap, UINT32 width, UINT32 height, UINT32 font_color, UINT32 highlight_color, UINT32 xscale, UINT32 yscale, uint32_t * row_pitch)
+{
+  uint32_t row_bytes = (width + 7) >> 3;
+  uint32_t bitmap_bytes = row_bytes * height;
+  uint32_t pitch = (width * xscale * 4 + 31) & ~31U; // Keep each row 32-byte aligned
+
+  if((!Global_Glyph_Cache.Pixels) || (bitmap_bytes > GLYPH_CACHE_MAX_BITMAP) || (((uint64_t)pitch * height) > GLYPH_CACHE_SLOT_SIZE))
+  {
+    return NULL;
+  }
+
+  uint64_t hash = (uint64_t)bitmap ^ (((uint64_t)font_color << 32) | highlight_color) ^ ((uint64_t)((xscale << 16) | yscale) << 8) ^ GPU.Info->PixelFormat;
+  uint32_t bucket = (uint32_t)((hash * 0x9E3779B97F4A7C15ULL) >> (64 - GLYPH_CACHE_BUCKET_BITS));
+
+  GLYPH_CACHE_ENTRY * Glyph = NULL;
+  int32_t index = Global_Glyph_Cache.Buckets[bucket];
+
+  for( ; index >= 0; index = Global_Glyph_Cache.Entry[index].Next)
+  {
+    Glyph = &Global_Glyph_Cache.Entry[index];
+    if((Glyph->Bitmap == bitmap) && (Glyph->Width == width) && (Glyph->Height == height) && (Glyph->FontColor == font_color) && (Glyph->HighlightColor == highlight_color)
+      && (Glyph->XScale == xscale) && (Glyph->YScale == yscale) && (Glyph->PixelFormat == (UINT32)GPU.Info->PixelFormat))
+    {
+      break;
+    }
+  }
+
+  uint8_t * pixels;
+
+  if(index >= 0)
+  {
+    pixels = (uint8_t*)(Global_Glyph_Cache.Pixels + (uint64_t)index * GLYPH_CACHE_SLOT_SIZE);
+    Glyph->LastUsed = ++Global_Glyph_Cache.UseCount;
+    *row_pitch = Glyph->RowPitch;
+
+    if(!AVX_memcmp(Glyph->BitmapCopy, bitmap, bitmap_bytes, 1))
+    {
+      Global_Glyph_Cache.Hits++;
+      return pixels;
+    }
+    // Same buffer, different image: fall through and re-expand it in place
+  }
+  else
+  {
+    if(Global_Glyph_Cache.NumEntries < GLYPH_CACHE_ENTRIES)
+    {
+      index = (int32_t)Global_Glyph_Cache.NumEntries++;
+    }
+    else
+    {
+      // Replace the least recently used entry
+      index = 0;
+      for(int32_t entry = 1; entry < GLYPH_CACHE_ENTRIES; entry++)
+      {
+        if(Global_Glyph_Cache.Entry[entry].LastUsed < Global_Glyph_Cache.Entry[index].LastUsed)
+        {
+          index = entry;
+        }
+      }
+
+      // Take it out of its old bucket
+      int32_t * link = &Global_Glyph_Cache.Buckets[Global_Glyph_Cache.Entry[index].Bucket];
+      while(*link != index)
+      {
+        link = &Global_Glyph_Cache.Entry[*link].Next;
+      }
+      *link = Global_Glyph_Cache.Entry[index].Next;
+    }
+
+    Glyph = &Global_Glyph_Cache.Entry[index];
+    Glyph->Bitmap = bitmap;
+    Glyph->Width = width;
+    Glyph->Height = height;
+    Glyph->FontColor = font_color;
+    Glyph->HighlightColor = highlight_color;
+    Glyph->XScale = xscale;
+    Glyph->YScale = yscale;
+    Glyph->PixelFormat = (UINT32)GPU.Info->PixelFormat;
+    Glyph->RowPitch = pitch;
+    Glyph->Bucket = bucket;
+    Glyph->LastUsed = ++Global_Glyph_Cache.UseCount;
+    Glyph->Next = Global_Glyph_Cache.Buckets[bucket];
+    Global_Glyph_Cache.Buckets[bucket] = index;
+
+    pixels = (uint8_t*)(Global_Glyph_Cache.Pixels + (uint64_t)index * GLYPH_CACHE_SLOT_SIZE);
+    *row_pitch = pitch;
+  }
+
+  Global_Glyph_Cache.Misses++;
+  AVX_memcpy(Glyph->BitmapCopy, (void*)bitmap, bitmap_bytes);
+
+  // Expand it: bit 0 of each byte is the leftmost pixel
+  for(uint32_t row = 0; row < height; row++)
+  {
+    UINT32 * out = (UINT32*)(pixels + (uint64_t)row * pitch);
+    const unsigned char * bitmap_row = bitmap + row * row_bytes;
+
+    for(uint32_t bit = 0; bit < width; bit++)
+    {
+      UINT32 color = ((bitmap_row[bit >> 3] >> (bit & 0x7)) & 0x1) ? font_color : highlight_color;
+      for(uint32_t a = 0; a < xscale; a++)
+      {
+        *out++ = color;
+      }
+    }
+  }
+
+  return pixels;
+}
+
+// Draws an expanded glyph from glyph_cache_get(), with the top left pixel at dest
+static void glyph_cache_draw(const uint8_t * pixels, uint32_t row_pitch, EFI_PHYSICAL_ADDRESS dest, uint64_t BytesPerScanline, UINT32 width, UINT32 height, UINT32 xscale, UINT32 yscale)
+{
+  uint64_t row_bytes = (uint64_t)width * xscale * 4;
+
+  for(uint32_t row = 0; row < height; row++)
+  {
+    for(uint32_t b = 0; b < yscale; b++)
+    {
+      const uint8_t * src = pixels;
+      uint8_t * out = (uint8_t*)dest;
+      uint64_t numbytes = row_bytes;
+
+#ifdef __AVX__
+      for( ; numbytes >= 32; numbytes -= 32, src += 32, out += 32)
+      {
+        _mm256_storeu_si256((__m256i*)out, _mm256_load_si256((const __m256i*)src));
+      }
+#endif
+      for( ; numbytes >= 16; numbytes -= 16, src += 16, out += 16)
+      {
+        _mm_storeu_si128((__m128i*)out, _mm_load_si128((const __m128i*)src));
+      }
+      for( ; numbytes; numbytes -= 4, src += 4, out += 4)
+      {
+        *(UINT32*)out = *(const UINT32*)src;
+      }
+
+      dest += BytesPerScanline;
+    }
+    pixels += row_pitch;
+  }
+}
@@ -67,6 +67,9 @@ EFI_PHYSICAL_ADDRESS Global_RSDP_Address = ~0ULL;
 // Array to keep track of GSIs
 ACPI_INTERRUPT_STRUCT Global_ACPI_Interrupt_Table[256] = {0};
 
+// ACPICA's own heap, and how much InitializeFullAcpi() cost
+GLOBAL_ACPI_HEAP_STRUCT Global_ACPI_Heap = {{NULL}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
 // TSC frequency scales for timing
 TSC_FREQUENCY_STRUCT Global_TSC_frequency = {TSC_FALLBACK_CYCLES_PER_SEC, TSC_FALLBACK_CYCLES_PER_MSEC, TSC_FALLBACK_CYCLES_PER_USEC, TSC_FALLBACK_CYCLES_PER_100NSEC, TSC_FALLBACK_CYCLES_PER_10NSEC};
 
@@ -135,6 +138,37 @@ typedef struct {
 // Structure to keep track of printf invocations
 GLOBAL_PRINT_INFO_STRUCT Global_Print_Info = {{1, 1, NULL, 1, 1, 1}, 8, 8, 0x0, 0x0, 0x0, 0, 0, 1, 1, 0, 0, 0};
 
+/*
+// For shadow framebuffers in Display.c
+typedef struct {
+  SHADOW_BUFFER           Buffer[SHADOW_MAX_BUFFERS]; // One per GPU with a shadow framebuffer
+  UINT64                  NumBuffers;                 // Number of entries in Buffer
+  UINT64                  FlushInterval;              // TSC ticks Shadow_tick() waits between flushes (0 = set from SHADOW_FLUSH_HZ)
+  UINT64                  LastFlush;                  // get_tick() as of the last Shadow_flush_all()
+  UINT64                  Flushes;                    // Flushes that had anything to copy
+  UINT64                  BytesFlushed;               // Total bytes those copied to framebuffers
+} GLOBAL_SHADOW_INFO_STRUCT;
+*/
+
+// Structure to keep track of shadow framebuffers and their dirty areas
+GLOBAL_SHADOW_INFO_STRUCT Global_Shadow_Info = {{{0, 0, 0, 0, 0, 0, 0, 0, {{0, 0, 0, 0}}}}, 0, 0, 0, 0, 0};
+
+/*
+// For the glyph cache in Display.c
+typedef struct {
+  EFI_PHYSICAL_ADDRESS    Pixels;                       // GLYPH_CACHE_ENTRIES slots of GLYPH_CACHE_SLOT_SIZE bytes (0 until Setup_GlyphCache())
+  UINT64                  NumEntries;                   // Entries in use
+  UINT64                  UseCount;                     // Goes up by one every time a glyph is drawn from the cache
+  UINT64                  Hits;                         // Glyphs drawn that were already expanded
+  UINT64                  Misses;                       // Glyphs that had to be expanded first
+  INT32                   Buckets[GLYPH_CACHE_BUCKETS]; // First entry in each hash bucket, or -1
+  GLYPH_CACHE_ENTRY       Entry[GLYPH_CACHE_ENTRIES];
+} GLOBAL_GLYPH_CACHE_STRUCT;
+*/
+
+// Structure to keep track of expanded glyphs (Setup_GlyphCache() sets up the buckets)
+GLOBAL_GLYPH_CACHE_STRUCT Global_Glyph_Cache = {0, 0, 0, 0, 0, {0}, {{NULL, {0}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}}};
+
 //----------------------------------------------------------------------------------------------------------------------------------
 // Memory
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -146,11 +180,118 @@ typedef struct {
   EFI_MEMORY_DESCRIPTOR  *MemMap;                  // Pointer to memory map (LP->Memory_Map)
   UINT32                  MemMapDescriptorVersion; // Memory map descriptor version
   UINT32                  Pad;                     // Pad to multiple of 64 bits
+  UINTN                   MemMapCapacity;          // Size of the region holding the map, in bytes (a multiple of 4kB, >= MemMapSize)
+  UINT64                  MemMapRelocations;       // Number of times MemMap_Prep() has had to move the map
+  UINT64                  MemMapBytesMoved;        // Total bytes of descriptors copied by those moves
 } GLOBAL_MEMORY_INFO_STRUCT;
 */
 
 // Structure to keep track of memory map information
-GLOBAL_MEMORY_INFO_STRUCT Global_Memory_Info = {1, 1, NULL, 1, 0};
+GLOBAL_MEMORY_INFO_STRUCT Global_Memory_Info = {1, 1, NULL, 1, 0, 0, 0, 0};
+
+/*
+// For the small-object slab allocator underneath malloc() in Memory.c
+typedef struct {
+  SLAB_CHUNK_STRUCT      *ChunkList;                  // All slab chunks currently owned by the slab allocator
+  SLAB_PAGE_STRUCT       *Partial[SLAB_NUM_CLASSES];  // Per-size-class list of pages that still have room for objects
+  UINT64                  NumChunks;                  // Number of 2MB chunks in ChunkList
+  UINT64                  ChunksStart;                // Every chunk there has ever been is within [ChunksStart, ChunksEnd)
+  UINT64                  ChunksEnd;
+} GLOBAL_SLAB_INFO_STRUCT;
+*/
+
+// Structure to keep track of small-object slabs
+GLOBAL_SLAB_INFO_STRUCT Global_Slab_Info = {NULL, {NULL}, 0, 0, 0};
+
+/*
+// For the EfiConventionalMemory index in Memory.c
+typedef struct {
+  FREE_INDEX_NODE        *Root;     // Root of the address-ordered tree
+  FREE_INDEX_NODE        *Spare;    // Unused nodes, linked through Right
+  FREE_INDEX_NODE        *Pool;     // FREE_INDEX_MAX_NODES nodes allocated by Setup_MemMap()
+  UINT64                  NumNodes; // Number of nodes in the tree
+  UINT64                  Valid;    // 1 if the tree matches the memory map, 0 if lookups need to scan the map instead
+} GLOBAL_FREE_INDEX_STRUCT;
+*/
+
+// Structure to keep track of free (EfiConventionalMemory) regions
+GLOBAL_FREE_INDEX_STRUCT Global_Free_Index = {NULL, NULL, NULL, 0, 0};
+
+/*
+// For deferred page zeroing in Memory.c
+typedef struct {
+  ZERO_POOL_RANGE         Dirty[ZERO_POOL_MAX_RANGES]; // Freed EfiConventionalMemory that still holds old data
+  ZERO_POOL_RANGE         Clean[ZERO_POOL_MAX_RANGES]; // Free EfiConventionalMemory already zeroed by ZeroDirtyPages()
+  UINT64                  NumDirty;                    // Number of ranges in Dirty
+  UINT64                  NumClean;                    // Number of ranges in Clean
+  UINT64                  DirtyBytes;                  // Total size of the ranges in Dirty
+  UINT64                  CleanBytes;                  // Total size of the ranges in Clean
+  UINT64                  ZeroedInlineBytes;           // Running total of bytes the allocators had to zero themselves because they weren't clean
+  UINT64                  Enabled;                     // 1 if free() defers zeroing to the pool, 0 if it zeroes right away
+} GLOBAL_ZERO_POOL_STRUCT;
+*/
+
+// Structure to keep track of freed pages that haven't been zeroed yet, and free pages that have
+GLOBAL_ZERO_POOL_STRUCT Global_Zero_Pool = {{{0, 0}}, {{0, 0}}, 0, 0, 0, 0, 0, 0};
+
+/*
+// For the buddy allocator in Memory.c
+typedef struct {
+  BUDDY_BLOCK            *FreeList[BUDDY_NUM_ORDERS]; // Per-order lists of free blocks, index 0 is 4kB
+  BUDDY_ARENA            *ArenaList;                  // All arenas currently owned by the buddy allocator
+  UINT64                  NumArenas;                  // Number of arenas in ArenaList
+  UINT64                  DirtyBytes;                 // Total size of the free blocks marked BUDDY_FRAME_DIRTY
+} GLOBAL_BUDDY_INFO_STRUCT;
+*/
+
+// Structure to keep track of buddy allocator arenas and free blocks
+GLOBAL_BUDDY_INFO_STRUCT Global_Buddy_Info = {{NULL}, NULL, 0, 0};
+
+/*
+// For the per-core malloc() caches in Memory.c
+typedef struct {
+  CPU_MAGAZINES          *Cpu[MAGAZINE_MAX_CPUS]; // Each core's magazines, in the order the cores called Setup_Magazines()
+  UINT64                  NumCpus;                // Number of cores with magazines
+  volatile UINT64         LockOwner;              // CpuIndex + 1 of the core holding the allocator lock, 0 if nobody has it
+  UINT64                  LockDepth;              // The allocator lock is recursive, since e.g. slab_alloc() calls malloc2MB()
+  UINT64                  Enabled;                // 1 once the first core has called Setup_Magazines()
+  CPU_NO_MAGAZINES        NoMagazines[MAGAZINE_MAX_CPUS]; // Stand-ins for cores that Setup_Magazines() couldn't give magazines to
+} GLOBAL_MAGAZINE_INFO_STRUCT;
+*/
+
+// Structure to keep track of each core's malloc() caches and the lock on the shared allocators behind them
+GLOBAL_MAGAZINE_INFO_STRUCT Global_Magazine_Info = {{NULL}, 0, 0, 0, 0, {{NULL, 0}}};
+
+/*
+// For realloc() in Memory.c: how many times each path was taken
+typedef struct {
+  UINT64                  Unchanged;               // The allocation already fit the new size (apart from zeroing the tail)
+  UINT64                  GrownInPlace;            // Grew into free memory right after it
+  UINT64                  ShrunkInPlace;           // Gave back its upper part without moving
+  UINT64                  Moved;                   // Had to be copied to a new allocation
+} GLOBAL_REALLOC_STATS_STRUCT;
+*/
+
+// Structure to count which way realloc() handled each request
+GLOBAL_REALLOC_STATS_STRUCT Global_Realloc_Stats = {0, 0, 0, 0};
+
+/*
+// For demand-paged vmalloc() reservations in Memory.c
+typedef struct {
+  DEMAND_PAGING_REGION    Region[DEMAND_PAGING_MAX_REGIONS]; // Ordered by VirtualStart
+  UINT64                  NumRegions;                        // Number of entries in Region
+  EFI_VIRTUAL_ADDRESS     WindowStart;                       // Reservations come from [WindowStart, WindowEnd), which the identity map doesn't touch
+  EFI_VIRTUAL_ADDRESS     WindowEnd;                         // End of the lower canonical half
+  UINT64                  PagingLevels;                      // 4 or 5, depending on CR4.LA57
+  UINT64                  Faults;                            // Page faults resolved by mapping in a zeroed 4kB page
+  UINT64                  Promotions;                        // 2MB ranges remapped as a single 2MB page
+  UINT64                  Promote;                           // Promote setting vmalloc() gives its reservations, set by Setup_DemandPaging()
+  UINT64                  Enabled;                           // 1 once Setup_DemandPaging() has run
+} GLOBAL_DEMAND_PAGING_STRUCT;
+*/
+
+// Structure to keep track of vmalloc() reservations whose pages get mapped in on first touch
+GLOBAL_DEMAND_PAGING_STRUCT Global_Demand_Paging = {{{0, 0, 0, 0, 0}}, 0, 0, 0, 4, 0, 0, 0, 0};
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // Misc
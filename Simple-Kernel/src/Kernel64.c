@@ -66,6 +66,8 @@
 
 // Stack size defined in number of bytes, e.g. (1 << 12) is 4kiB, (1 << 20) is 1MiB
 #define STACK_SIZE (1ULL << 20)
+// Uncomment to have kernel_main() call run_benchmarks()
+//#define RUN_BENCHMARKS
 // This might allow for occasional slight performance increases. Not guaranteed to always happen, but aligning this to 64 bytes increases the probability.
 __attribute__((aligned(64))) static volatile unsigned char kernel_stack[STACK_SIZE] = {0};
 
@@ -216,6 +218,10 @@ void kernel_main(LOADER_PARAMS * LP) // Loader Parameters
 
 //  print_system_memmap();
 
+#ifdef RUN_BENCHMARKS
+  run_benchmarks(LP);
+#endif
+
   uint64_t end_time = get_tick();
   printf("Result: start: %qu end: %qu diff: %qu\r\n", start_time, end_time, end_time - start_time);
 
@@ -649,6 +655,34 @@ void Print_Segment_Registers(void)
   printf("CS: %#qx\r\n", cs);
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+// run_benchmarks: Run the Benchmarks and Print Allocator Stats
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Runs the memory, allocator, and graphics benchmarks, prints what the allocators have been up to, and calibrates the memory
+// function cutoffs, all in one go. Comment out whatever isn't of interest. kernel_main() only calls this with RUN_BENCHMARKS defined.
+//
+
+void run_benchmarks(LOADER_PARAMS * LP)
+{
+  free_latency_benchmark(1024);
+  kmalloc_stats();
+  buddy_stats();
+  malloc_stress_benchmark(100000);
+  magazine_stats();
+  memmap_stats();
+  realloc_stats();
+  demand_paging_stats();
+  zero_pool_stats();
+  acpi_heap_stats();
+  nt_threshold_calibrate();
+  erms_cutoff_calibrate();
+  memmove_calibrate();
+  scroll_benchmark();
+  glyph_render_benchmark(LP->GPU_Configs->GPUArray[0]);
+  raster_benchmark(LP->GPU_Configs->GPUArray[0]);
+}
+
 ////////////////////////////////////////////////////
 
 // TODO: keyboard driver (PS/2 for starters, then USB)
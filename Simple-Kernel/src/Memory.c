@@ -17,10 +17,62 @@
 #include "avxmem.h"
 
 #define MEMORY_CHECK_INFO
+#define BUDDY_ALLOCATOR // Comment this out to have malloc4KB(), malloc2MB(), and malloc1GB() search the memory map directly instead
+#define DEMAND_PAGING_PROMOTE // Comment this out to keep vmalloc()'s demand-paged reservations in 4kB pages (see Setup_DemandPaging())
 
 // AVX_memcmp and related functions in memcmp.c take care of memory comparisons now.
 // AVX_memset zeroes things.
 
+static void * realloc_locked(void * allocated_address, size_t size);
+static void * slab_alloc(size_t numbytes);
+static void slab_free(SLAB_CHUNK_STRUCT * Chunk, void * allocated_address);
+static SLAB_CHUNK_STRUCT * slab_find_chunk(void * allocated_address);
+static void freeindex_insert(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages);
+static void freeindex_remove(EFI_PHYSICAL_ADDRESS PhysicalStart);
+static void freeindex_carve(EFI_PHYSICAL_ADDRESS Address, uint64_t NumberOfPages);
+static void coalesce_conventional(EFI_MEMORY_DESCRIPTOR * Piece);
+static uint8_t zeropool_add(ZERO_POOL_RANGE * List, uint64_t * NumRanges, EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages);
+static void zeropool_release(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages);
+static void zeropool_claim(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages, uint8_t zero_all);
+static EFI_PHYSICAL_ADDRESS zeropool_clean_fit(uint64_t NumberOfPages, EFI_PHYSICAL_ADDRESS OldAddress, uintmax_t byte_alignment);
+static EFI_PHYSICAL_ADDRESS freeindex_aligned_fit(uint64_t pages, EFI_PHYSICAL_ADDRESS OldAddress, uintmax_t byte_alignment);
+static size_t memmap_target_pages(size_t needed_bytes);
+#ifdef BUDDY_ALLOCATOR
+static void * buddy_alloc(size_t numbytes, uint64_t byte_alignment);
+static void buddy_free(BUDDY_ARENA * Arena, void * allocated_address, uint8_t zeroed);
+static void buddy_shrink(BUDDY_ARENA * Arena, void * allocated_address, size_t numbytes);
+static uint8_t buddy_extend(BUDDY_ARENA * Arena, void * allocated_address, size_t numbytes);
+static BUDDY_ARENA * buddy_find_arena(void * allocated_address);
+static uint64_t buddy_block_order(BUDDY_ARENA * Arena, void * allocated_address);
+static uint64_t buddy_containing_block(void * address, EFI_PHYSICAL_ADDRESS * BlockBase);
+static void buddy_push(BUDDY_ARENA * Arena, BUDDY_BLOCK * Block, uint64_t order, uint8_t dirty);
+static uint8_t buddy_unlink(BUDDY_ARENA * Arena, BUDDY_BLOCK * Block, uint64_t order);
+static uint8_t buddy_grow(uint64_t order);
+static uint64_t buddy_zero_dirty(uint64_t max_bytes);
+#endif
+static uint64_t slab_size_class(size_t numbytes);
+static void * magazine_alloc(uint64_t class_index);
+static uint8_t magazine_free(uint64_t class_index, void * allocated_address);
+static CPU_MAGAZINES * magazine_this_cpu(void);
+static uint64_t magazine_this_cpu_index(void);
+static void * magazine_shared_alloc(uint64_t class_index);
+static void magazine_shared_free(uint64_t class_index, void * allocated_address);
+static void allocator_lock(void);
+static void allocator_unlock(void);
+static void allocator_lock_as(uint64_t owner);
+static void allocator_release(void);
+
+static void demand_promote(uint64_t * pd_entry, EFI_VIRTUAL_ADDRESS range_base);
+static uint64_t * demand_pd_entry(EFI_VIRTUAL_ADDRESS virtual_address, uint8_t create);
+static EFI_PHYSICAL_ADDRESS demand_translate(EFI_VIRTUAL_ADDRESS virtual_address);
+static void demand_flush(EFI_VIRTUAL_ADDRESS virtual_address, uint64_t pages);
+static uint8_t demand_tables_trim(uint64_t * table, EFI_VIRTUAL_ADDRESS table_base, uint64_t shift, EFI_VIRTUAL_ADDRESS start, EFI_VIRTUAL_ADDRESS end);
+static uint64_t demand_region_find(EFI_VIRTUAL_ADDRESS virtual_address);
+static EFI_VIRTUAL_ADDRESS demand_region_end(uint64_t index);
+static void demand_region_unmap(uint64_t index, uint64_t first_page);
+static void demand_region_forget(uint64_t index);
+static void * demand_region_resize(uint64_t index, size_t size);
+
 //----------------------------------------------------------------------------------------------------------------------------------
 //  malloc: Allocate Physical Memory with Alignment
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -29,15 +81,16 @@
 //
 // IMPORTANT NOTE: This implementation of malloc behaves more like the standard "calloc(3)" in that returned memory is always both
 // contiguous and zeroed. Large sizes are also supported; the limit is just how much contiguous memory the system has. A size of 0
-// will return 1 UEFI page (4kB) instead of NULL, however, because 0x0 here is actually a valid address that can be used like any
-// other (and calloc() will do the same). Also, because the UEFI memory map is quantized in 4kB pages, all allocated regions are
-// rounded up to the next 4kB unit (see the description of AllocateFreeAddress() or VAllocateFreeAddress() for more details about
-// this).
+// will return a 16-byte object from the smallest slab size class instead of NULL, however, because 0x0 here is actually a valid
+// address that can be used like any other (and calloc() will do the same).
 //
-// Don't worry: something like void * ptr = malloc(256) will still work as expected--it's just that the pointer returned will always
-// be for at least 4kB or a multiple of 4kB. Doing something like ptr = realloc(ptr, 512) on that will work fine, too. In fact, the
-// only syntactical quirk requiring different treatment than "good ol' fashioned malloc/calloc/realloc" is the aformentioned handling
-// of NULL. Instead of NULL, this malloc series returns addresses like ~0ULL, ~1ULL, ~2ULL that will guarantee a page fault if used.
+// Requests of up to 2kB get a slab object from the smallest power-of-2 size class that fits (16 bytes to 2kB, see below), so
+// something like void * ptr = malloc(256) gets exactly 256 bytes aligned to 256. Anything bigger gets whole pages: a power-of-2
+// buddy block, or a region of the UEFI memory map, which is quantized in 4kB pages and so rounds every region up to the next 4kB unit
+// (see the description of AllocateFreeAddress() or VAllocateFreeAddress() for more details about this). Doing something like
+// ptr = realloc(ptr, 512) works the same on all of them. In fact, the only syntactical quirk requiring different treatment than
+// "good ol' fashioned malloc/calloc/realloc" is the aformentioned handling of NULL. Instead of NULL, this malloc series returns
+// addresses like ~0ULL, ~1ULL, ~2ULL that will guarantee a page fault if used.
 //
 // Return values of ~0ULL mean "out of memory" and ~1ULL mean "invalid byte alignment" (~1ULL will only occur if this function is
 // modified in certain ways. As coded by default, this malloc will not naturally produce this return code on x86). A value of ~2ULL
@@ -46,7 +99,7 @@
 //
 // If one desires a specific alignment for a given amount of memory (like 1GB alignment for 512GB memory), call that mallocX function
 // (for example malloc1GB()) directly instead of using "plain" malloc(). The plain malloc() changes the alignment used based on size.
-// The size-alignment thresholds of the plain, automatic malloc are 4KB, 2MB, 1GB, 512GB, and 256TB.
+// Above 2kB, the size-alignment thresholds of the plain, automatic malloc are 4KB, 2MB, 1GB, 512GB, and 256TB.
 //
 // Also note that these available alignments match the sizes that x86-64 hardware pages can be. This is to facilitate coupling between
 // memory allocation and hardware paging regions, should that be desired (i.e. if a region of dynamically allocated memory ought to
@@ -56,12 +109,30 @@
 // to be portable across UEFI-supporting architectures that do not all support the same hardware paging sizes--including ones that
 // do not support paging at all.
 //
-// In order to couple an allocated region to a hardware page, see set_region_hwpages().
+// In order to couple an allocated region to a hardware page, see set_region_hwpages(), which also handles the buddy blocks described
+// below.
+//
+// Small requests (<= SLAB_MAX_OBJECT_SIZE, i.e. 2kB) don't go to any of the above: they are served from size-class slabs carved
+// out of 2MB malloc2MB() regions, so they cost O(1) and don't add descriptors to the memory map. Such pointers are aligned to
+// their size class (16 bytes to 2kB) and are still zeroed. Use malloc4KB() directly if a whole, page-aligned 4kB region is needed.
+// Slab memory is released the same way as everything else: with free().
+//
+// With BUDDY_ALLOCATOR defined (the default), malloc4KB(), malloc2MB(), and malloc1GB() requests of up to 1GB are served by a binary
+// buddy allocator instead (see buddy_alloc()), which rounds them up to the next power of 2 but finds and aligns them in O(log n).
+// Anything bigger, anything over 32MB that rounding would waste too much of, or anything the buddy allocator can't find an arena
+// for goes to the memory map as described above.
+//
+// Once Setup_Magazines() has run on a core, slab objects and single 4kB buddy blocks come out of (and free() puts them back into)
+// that core's own magazines first, and only an empty or full magazine takes the allocator lock. See Setup_Magazines().
 //
 
 void * malloc(size_t numbytes)
 {
-  if(numbytes < (2ULL << 20)) // < 2MB
+  if(numbytes <= SLAB_MAX_OBJECT_SIZE) // <= 2kB
+  {
+    return magazine_alloc(slab_size_class(numbytes)); // Aligned to size class
+  }
+  else if(numbytes < (2ULL << 20)) // < 2MB
   {
     return malloc4KB(numbytes); // 4kB-aligned
   }
@@ -94,7 +165,29 @@ void * malloc4KB(size_t numbytes)
 {
   EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
+#ifdef BUDDY_ALLOCATOR
+  void * block;
+  if(numbytes <= EFI_PAGE_SIZE)
+  {
+    // Single pages are common enough to get their own magazine
+    block = magazine_alloc(MAGAZINE_PAGE_CLASS);
+  }
+  else
+  {
+    allocator_lock();
+    block = buddy_alloc(numbytes, (4ULL << 10));
+    allocator_unlock();
+  }
+
+  if((EFI_PHYSICAL_ADDRESS)block != ~0ULL)
+  {
+    return block;
+  }
+#endif
+
+  allocator_lock();
   new_buffer = AllocateFreeAddress(numbytes, new_buffer, (4ULL << 10));
+  allocator_unlock();
 
   return (void*)new_buffer;
 }
@@ -103,7 +196,19 @@ void * malloc2MB(size_t numbytes)
 {
   EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
+  allocator_lock();
+
+#ifdef BUDDY_ALLOCATOR
+  void * block = buddy_alloc(numbytes, (2ULL << 20));
+  if((EFI_PHYSICAL_ADDRESS)block != ~0ULL)
+  {
+    allocator_unlock();
+    return block;
+  }
+#endif
+
   new_buffer = AllocateFreeAddress(numbytes, new_buffer, (2ULL << 20));
+  allocator_unlock();
 
   return (void*)new_buffer;
 }
@@ -112,7 +217,19 @@ void * malloc1GB(size_t numbytes)
 {
   EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
+  allocator_lock();
+
+#ifdef BUDDY_ALLOCATOR
+  void * block = buddy_alloc(numbytes, (1ULL << 30));
+  if((EFI_PHYSICAL_ADDRESS)block != ~0ULL)
+  {
+    allocator_unlock();
+    return block;
+  }
+#endif
+
   new_buffer = AllocateFreeAddress(numbytes, new_buffer, (1ULL << 30));
+  allocator_unlock();
 
   return (void*)new_buffer;
 }
@@ -121,7 +238,9 @@ void * malloc512GB(size_t numbytes)
 {
   EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
+  allocator_lock();
   new_buffer = AllocateFreeAddress(numbytes, new_buffer, (512ULL << 30));
+  allocator_unlock();
 
   return (void*)new_buffer;
 }
@@ -130,7 +249,9 @@ void * malloc256TB(size_t numbytes)
 {
   EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
+  allocator_lock();
   new_buffer = AllocateFreeAddress(numbytes, new_buffer, (256ULL << 40));
+  allocator_unlock();
 
   return (void*)new_buffer;
 }
@@ -164,6 +285,10 @@ void * calloc(size_t elements, size_t size)
 // allocated_address: The pointer allocated from malloc
 // size: The new desired size
 //
+// Copying is the last resort: memory map regions grow into a free region right after them and shrink by splitting off their upper
+// pages, and buddy blocks grow by absorbing free buddies above them and shrink by halving. Only when none of that works is the data
+// moved to a new allocation. Global_Realloc_Stats counts which of these happened (see realloc_stats()).
+//
 // NOTE: Unlike realloc(3), NULL pointer here is actually a valid address at 0x0. Therefore passing in a NULL pointer as
 // allocated_address is the same as passing in address 0x0, which could be an actual allocated region. So don't do it.
 // Passing in a size of 0, however, will cause free() to be run and will result in a return address of ~2ULL.
@@ -177,6 +302,105 @@ void * realloc(void * allocated_address, size_t size)
     return ((void*) ~2ULL);
   }
 
+  // Every path below looks up or changes slab, buddy, or memory map state that other cores' malloc() and free() use
+  allocator_lock();
+  void * new_address = realloc_locked(allocated_address, size);
+  allocator_unlock();
+
+  return new_address;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  realloc_locked: The Body of realloc()
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Does everything realloc() describes for a nonzero size. The allocator lock must be held. It's recursive, so the malloc() and free()
+// calls in here are fine.
+//
+
+static void * realloc_locked(void * allocated_address, size_t size)
+{
+  // Slab objects don't have descriptors, so they're handled separately
+  SLAB_CHUNK_STRUCT * Chunk = slab_find_chunk(allocated_address);
+  if(Chunk != NULL)
+  {
+    SLAB_PAGE_STRUCT * SlabPage = &Chunk->Page[((uint64_t)allocated_address - (uint64_t)Chunk) >> EFI_PAGE_SHIFT];
+    size_t object_size = 1ULL << (SlabPage->SizeClass + SLAB_MIN_OBJECT_SHIFT);
+
+    if(size <= object_size) // Still fits
+    {
+      // Keep the "unused bytes are zero" guarantee when shrinking
+      AVX_memset((uint8_t*)allocated_address + size, 0, object_size - size);
+      Global_Realloc_Stats.Unchanged++;
+      return allocated_address;
+    }
+
+    void * new_address = malloc(size);
+    if((EFI_PHYSICAL_ADDRESS)new_address == ~0ULL)
+    {
+      error_printf("realloc: Insufficient free memory, could not reallocate slab object.\r\n");
+      return new_address;
+    }
+
+    AVX_memmove(new_address, allocated_address, (size < object_size) ? size : object_size);
+    free(allocated_address); // Goes back through this core's magazine, like any other free
+    Global_Realloc_Stats.Moved++;
+
+    return new_address;
+  }
+
+#ifdef BUDDY_ALLOCATOR
+  // Buddy blocks shrink in place by halving, and grow in place by absorbing free buddies above them
+  BUDDY_ARENA * Arena = buddy_find_arena(allocated_address);
+  if(Arena != NULL)
+  {
+    uint64_t order = buddy_block_order(Arena, allocated_address);
+    if(order == 0)
+    {
+      error_printf("realloc: %#qx is not an allocated buddy block.\r\n", (EFI_PHYSICAL_ADDRESS)allocated_address);
+      return ((void*) ~3ULL);
+    }
+
+    size_t block_size = 1ULL << order;
+
+    if(size <= block_size) // Still fits
+    {
+      // Keep the "unused bytes are zero" guarantee, then hand back whatever halves aren't needed anymore
+      AVX_memset((uint8_t*)allocated_address + size, 0, block_size - size);
+      buddy_shrink(Arena, allocated_address, size);
+
+      if(buddy_block_order(Arena, allocated_address) < order)
+      {
+        Global_Realloc_Stats.ShrunkInPlace++;
+      }
+      else
+      {
+        Global_Realloc_Stats.Unchanged++;
+      }
+      return allocated_address;
+    }
+
+    if(buddy_extend(Arena, allocated_address, size))
+    {
+      Global_Realloc_Stats.GrownInPlace++;
+      return allocated_address;
+    }
+
+    void * new_address = malloc(size);
+    if((EFI_PHYSICAL_ADDRESS)new_address == ~0ULL)
+    {
+      error_printf("realloc: Insufficient free memory, could not reallocate buddy block.\r\n");
+      return new_address;
+    }
+
+    AVX_memmove(new_address, allocated_address, block_size);
+    free(allocated_address); // A single 4kB block goes back through this core's magazine
+    Global_Realloc_Stats.Moved++;
+
+    return new_address;
+  }
+#endif
+
   EFI_MEMORY_DESCRIPTOR * Piece;
 
   size_t numpages = EFI_SIZE_TO_PAGES(size);
@@ -228,6 +452,10 @@ void * realloc(void * allocated_address, size_t size)
             ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
           ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
         {
+          // The bottom of the next piece is about to be taken
+          freeindex_carve(Next_Piece->PhysicalStart, additional_numpages);
+          zeropool_claim(Next_Piece->PhysicalStart, additional_numpages, 0);
+
           if(Next_Piece->NumberOfPages > additional_numpages)
           {
             // Modify MemMap's entry
@@ -267,6 +495,8 @@ void * realloc(void * allocated_address, size_t size)
             // And also probably MemMap_Prep()...
             HaCF();
           }
+
+          Global_Realloc_Stats.GrownInPlace++;
         }
         else // Nope, need to move it altogether. But that's really easy to do for malloc. :)
         {
@@ -288,6 +518,7 @@ void * realloc(void * allocated_address, size_t size)
 
           // Free the old address
           free(allocated_address);
+          Global_Realloc_Stats.Moved++;
 
           // Done
           return new_address; // This is one of the few times an early return is used instead of break outside of an error
@@ -299,6 +530,11 @@ void * realloc(void * allocated_address, size_t size)
         // Is the next piece an EfiConventionalMemory region?
         // If the area right after the malloc region is EfiConventionalMemory, we might be able to just give it the freed pages
         size_t freedpages = orig_numpages - numpages;
+        void * freed_address = (uint8_t*)allocated_address + (numpages << EFI_PAGE_SHIFT);
+
+        // Keep the "unused bytes are zero" guarantee for the rest of the last page kept. The freed pages are dealt with once they're
+        // actually free.
+        AVX_memset((uint8_t*)allocated_address + size, 0, (numpages << EFI_PAGE_SHIFT) - size);
 
         // Check if there's an EfiConventionalMemory region adjacent in memory to the malloc region
         EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
@@ -335,16 +571,25 @@ void * realloc(void * allocated_address, size_t size)
           Piece->NumberOfPages = numpages;
 
           // Modify adjacent EfiConventionalMemory's entry
+          freeindex_remove(Next_Piece->PhysicalStart);
           Next_Piece->NumberOfPages += freedpages;
           Next_Piece->PhysicalStart -= (freedpages << EFI_PAGE_SHIFT);
           Next_Piece->VirtualStart -= (freedpages << EFI_PAGE_SHIFT);
+          freeindex_insert(Next_Piece->PhysicalStart, Next_Piece->NumberOfPages);
 
           // Done. Nice.
         }
-        // No, we need a new memmap entry, which will require a new page if the last entry is on a page edge or would spill over a page edge. Better to be safe then sorry!
-        // First, maybe there's room for another descriptor in the last page
-        else if((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) <= (numpages << EFI_PAGE_SHIFT))
-        { // Yes, we can reclaim and fit in another descriptor
+        // No, we need a new memmap entry. MemMap_Prep() will make room for it, but it might move the map in the process.
+        else if(MemMap_Prep(1) == 0)
+        {
+          // Re-find the malloc area's entry, since the map may have moved
+          for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+          {
+            if((Piece->Type == (EfiMaxMemoryType + 1)) && ((uint8_t*)Piece->PhysicalStart == (uint8_t*)allocated_address))
+            {
+              break;
+            }
+          }
 
           // Make a temporary descriptor to hold current malloc entry's values
           EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
@@ -362,6 +607,7 @@ void * realloc(void * allocated_address, size_t size)
           Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
           Piece->NumberOfPages = freedpages;
           // No attribute change
+          freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
 
           // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
           AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
@@ -378,56 +624,39 @@ void * realloc(void * allocated_address, size_t size)
           // Update Global_Memory_Info MemMap size
           Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
 
+          // If MemMap_Prep() moved the map, the old map's pages may have just become a free neighbor
+          coalesce_conventional((EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize));
+
           // Done
         }
-        // No, it would spill over to a new page
+        // No room for another descriptor at all, so don't do anything then and hang on to the extra page(s), zeroed.
         else
         {
-          // Do we have more than a descriptor's worth of pages reclaimable?
-          size_t pages_per_memory_descriptor = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapDescriptorSize);
-
-          if((numpages + pages_per_memory_descriptor) < orig_numpages)
-          { // Yes, so we can hang on to one [set] of them and make a new EfiConventionalMemory entry for the rest.
-            freedpages -= pages_per_memory_descriptor;
-
-            // Make a temporary descriptor to hold current malloc entry's values
-            EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-            new_descriptor_temp.Type = Piece->Type; // Special malloc type
-            new_descriptor_temp.Pad = Piece->Pad;
-            new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-            new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-            new_descriptor_temp.NumberOfPages = numpages + pages_per_memory_descriptor; // New size of malloc entry
-            new_descriptor_temp.Attribute = Piece->Attribute;
-
-            // Modify the descriptor-to-move
-            Piece->Type = EfiConventionalMemory;
-            // No pad change
-            Piece->PhysicalStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->VirtualStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->NumberOfPages = freedpages;
-            // No attribute change
-
-            // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-            AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
-
-            // Insert the new piece (by overwriting the now-duplicated entry with new values)
-            // I.e. turn this piece into what was stored in the temporary descriptor above
-            Piece->Type = new_descriptor_temp.Type;
-            Piece->Pad = new_descriptor_temp.Pad;
-            Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-            Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-            Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-            Piece->Attribute = new_descriptor_temp.Attribute;
+          AVX_memset_parallel(freed_address, 0, freedpages << EFI_PAGE_SHIFT);
+          warning_printf("realloc: Could not give back %llu pages, keeping them allocated.\r\n", freedpages);
+          Global_Realloc_Stats.Unchanged++;
+          return allocated_address;
+        }
 
-            // Update Global_Memory_Info MemMap size
-            Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-          }
-          // No, only 1 [set of] page(s) was reclaimable and adding another entry would spill over. So don't do anything then and hang on to the extra empty page(s).
+        // The freed pages are EfiConventionalMemory now and still hold old data, so zero them the same way free() would
+        if(Global_Zero_Pool.Enabled)
+        {
+          zeropool_release((EFI_PHYSICAL_ADDRESS)freed_address, freedpages);
+        }
+        else
+        {
+          AVX_memset_parallel(freed_address, 0, freedpages << EFI_PAGE_SHIFT);
         }
+
+        Global_Realloc_Stats.ShrunkInPlace++;
         // Shrink done
       }
-      // else:
-      // Nothing to be done if equal.
+      else // Same number of pages
+      {
+        // Keep the "unused bytes are zero" guarantee when shrinking within the last page
+        AVX_memset((uint8_t*)allocated_address + size, 0, (orig_numpages << EFI_PAGE_SHIFT) - size);
+        Global_Realloc_Stats.Unchanged++;
+      }
 
       break;
     } // End "found it"
@@ -444,6 +673,18 @@ void * realloc(void * allocated_address, size_t size)
   return allocated_address;
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+//  realloc_stats: Print How realloc() Handled Its Requests
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Shows how many realloc() calls fit as-is, grew in place, shrank in place, or had to copy to a new allocation.
+//
+
+void realloc_stats(void)
+{
+  printf("realloc: unchanged: %llu, grown in place: %llu, shrunk in place: %llu, moved: %llu\r\n", Global_Realloc_Stats.Unchanged, Global_Realloc_Stats.GrownInPlace, Global_Realloc_Stats.ShrunkInPlace, Global_Realloc_Stats.Moved);
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 //  free: Free A Physical Memory Address from AllocateFreeAddress (malloc)
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -455,6 +696,49 @@ void * realloc(void * allocated_address, size_t size)
 
 void free(void * allocated_address)
 {
+  // Chunks and arenas can be released by other cores' frees, so they're only looked up under the lock. Whatever turns up can
+  // be used after unlocking, though: a chunk or arena isn't released while it still holds an allocated object like this one.
+  allocator_lock();
+
+  // Slab objects don't have descriptors of their own
+  SLAB_CHUNK_STRUCT * Chunk = slab_find_chunk(allocated_address);
+  if(Chunk != NULL)
+  {
+    uint64_t class_index = Chunk->Page[((uint64_t)allocated_address - (uint64_t)Chunk) >> EFI_PAGE_SHIFT].SizeClass;
+    allocator_unlock();
+
+    if(!magazine_free(class_index, allocated_address))
+    {
+      allocator_lock();
+      slab_free(Chunk, allocated_address);
+      allocator_unlock();
+    }
+    return;
+  }
+
+#ifdef BUDDY_ALLOCATOR
+  // Neither do buddy blocks
+  BUDDY_ARENA * Arena = buddy_find_arena(allocated_address);
+  if(Arena != NULL)
+  {
+    if(buddy_block_order(Arena, allocated_address) == BUDDY_MIN_ORDER)
+    {
+      allocator_unlock();
+
+      if(magazine_free(MAGAZINE_PAGE_CLASS, allocated_address))
+      {
+        return;
+      }
+
+      allocator_lock();
+    }
+
+    buddy_free(Arena, allocated_address, 0);
+    allocator_unlock();
+    return;
+  }
+#endif
+
   // Locate area
   EFI_MEMORY_DESCRIPTOR * Piece;
 
@@ -463,1210 +747,1262 @@ void free(void * allocated_address)
   {
     if((Piece->Type == (EfiMaxMemoryType + 1)) && (Piece->PhysicalStart == (uint64_t)allocated_address))
     { // Found it, Piece holds the spot now.
-
-      // Zero out the destination
-      AVX_memset(allocated_address, 0, Piece->NumberOfPages << EFI_PAGE_SHIFT); // allocated_address is already a pointer
-
-      // Reclaim as EfiConventionalMemory
-      Piece->Type = EfiConventionalMemory;
-
-      // Merge conventional memory if possible
-      MergeContiguousConventionalMemory();
-
-      // Done
       break;
     }
   }
 
-#ifdef MEMORY_CHECK_INFO
   if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
   {
+#ifdef MEMORY_CHECK_INFO
     error_printf("free: Piece not found.\r\n");
-  }
 #endif
+    allocator_unlock();
+    return;
+  }
+
+  if(Global_Zero_Pool.Enabled)
+  {
+    // Leave the zeroing to ZeroDirtyPages() or to whatever allocates this next
+    zeropool_release(Piece->PhysicalStart, Piece->NumberOfPages);
+  }
+  else
+  {
+    // Zero out the destination
+    AVX_memset_parallel(allocated_address, 0, Piece->NumberOfPages << EFI_PAGE_SHIFT); // allocated_address is already a pointer
+  }
+
+  // Reclaim as EfiConventionalMemory
+  Piece->Type = EfiConventionalMemory;
+  freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+
+  // Merge with free neighbors, if there are any
+  coalesce_conventional(Piece);
+
+  allocator_unlock();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  get_page: Read the Page Table Entry of a Hardware Page
+//  slab_size_class: Size Class for a Small Object
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Reads a page table entry corresponding to a hardware page base address, and returns a structure containing the entry's data,
-// the memory map descriptor information of the mapped region in which the page base address is located, the hardware page's size
-// (in bytes) and whether or not the entire hardware page fits in the region.
-//
-// hw_page_base_addr: The base address of the hardware page in pointer form (e.g. as returned by malloc)
-//
-// The return struct is described as below:
-//
-// typedef struct {
-//   uint64_t               PageTableEntryData;  // The page table entry, which contains the hardware page base address and that page's flags.
-//   uint64_t               HWPageSize;          // The size of the hardware page (4kB, 2MB, 1GB, 512GB, 256TB, etc.)
-//   uint64_t               HWPageShift;         // The shift factor to get the hardware page size (useful to determine how many hardware pages a given region crosses)
-//   uint64_t               HWPageBase;          // If the page exists, the base page address. This will contain ~0ULL if the page does not exist in the memory map.
-//   uint64_t               WholePageInRegion;   // 1 if the whole hardware page fits in the region described by MemoryMapRegionData, 0 otherwise
-//   EFI_MEMORY_DESCRIPTOR  MemoryMapRegionData; // The memory map entry describing the region that contains the page base address
-// } PAGE_ENTRY_INFO_STRUCT;
+// Returns the index of the smallest slab size class that fits numbytes (which must be <= SLAB_MAX_OBJECT_SIZE), i.e. 0 for 16 bytes
+// up to SLAB_NUM_CLASSES - 1 for 2kB.
 //
-// Mask for 2MB-256TB entry's flags: 0xFFF0000000001FFF
-// Mask for 4kB entry's flags: 0xFFF0000000000FFF
-// (These do include PKRU bits 62:59)
+
+static uint64_t slab_size_class(size_t numbytes)
+{
+  if(numbytes > (1ULL << SLAB_MIN_OBJECT_SHIFT))
+  {
+    return (64 - __builtin_clzll(numbytes - 1)) - SLAB_MIN_OBJECT_SHIFT; // ceil(log2(numbytes)) - 4
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  slab_alloc: Allocate a Small Object from the Size-Class Slabs
+//----------------------------------------------------------------------------------------------------------------------------------
 //
-// The address masks depend on the paging level:
-//  256TB: 0x000F000000000000
-//  512GB: 0x000FFF8000000000
-//  1GB:   0x000FFFFFC0000000
-//  2MB:   0x000FFFFFFFE00000
-//  4kB:   0x000FFFFFFFFFF000
+// Returns a zeroed object from the smallest size class (16 bytes to 2kB, powers of 2) that fits numbytes. Every 4kB page of a slab
+// chunk belongs to one size class, and pages with room left in them sit on that class's partial list, so this is O(1). The only
+// time it isn't is when the class needs a fresh page, which comes from a 2MB chunk obtained via malloc2MB().
 //
-// NOTE: It is true that this function could easily take a non-page-base-address and return info for the corresponding page base.
-// However, implmenenting this instead of the error message on non-page-base-address would risk hiding issues in code and encourage
-// poor programming practice (or at least enable it). Doing it the current way means that users need to be sure they always know what
-// their program is doing and how their memory is laid out, and may even help find some hard-to-spot pointer issues.
+// Returns ~0ULL if out of memory, just like malloc.
 //
 
-PAGE_ENTRY_INFO_STRUCT get_page(void * hw_page_base_addr)
+static void * slab_alloc(size_t numbytes)
 {
-  uint64_t page_base_address = (uint64_t)hw_page_base_addr;
-  PAGE_ENTRY_INFO_STRUCT page_data = {0};
+  uint64_t size_class = slab_size_class(numbytes);
+  uint64_t object_size = 1ULL << (size_class + SLAB_MIN_OBJECT_SHIFT);
 
-  if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
-  {
-    error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nget_page() failed.\r\n");
-    return page_data;
-  }
-  else
+  SLAB_PAGE_STRUCT * SlabPage = Global_Slab_Info.Partial[size_class];
+  SLAB_CHUNK_STRUCT * Chunk;
+
+  if(SlabPage == NULL) // This size class needs a fresh page
   {
-    EFI_MEMORY_DESCRIPTOR * Piece;
+    // Find a chunk with a page to spare
+    for(Chunk = Global_Slab_Info.ChunkList; Chunk != NULL; Chunk = Chunk->Next)
+    {
+      if(Chunk->FreePageCount)
+      {
+        break;
+      }
+    }
 
-    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    if(Chunk == NULL) // Nope, need a new chunk
     {
-      EFI_PHYSICAL_ADDRESS PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+      Chunk = (SLAB_CHUNK_STRUCT*)malloc2MB(SLAB_CHUNK_SIZE);
+      if((EFI_PHYSICAL_ADDRESS)Chunk == ~0ULL)
+      {
+        error_printf("slab_alloc: Could not get a new slab chunk.\r\n");
+        return (void*)Chunk;
+      }
+      // malloc2MB() zeroed it already
 
-      // Found it
-      if((Piece->PhysicalStart <= page_base_address) && (PhysicalEnd > page_base_address))
+      Chunk->Signature = SLAB_CHUNK_SIGNATURE ^ (uint64_t)Chunk;
+
+      if((Global_Slab_Info.ChunksEnd == 0) || ((uint64_t)Chunk < Global_Slab_Info.ChunksStart))
       {
-        uint64_t size_above_page_base_in_region = PhysicalEnd - page_base_address;
+        Global_Slab_Info.ChunksStart = (uint64_t)Chunk;
+      }
+      if(((uint64_t)Chunk + SLAB_CHUNK_SIZE) > Global_Slab_Info.ChunksEnd)
+      {
+        Global_Slab_Info.ChunksEnd = (uint64_t)Chunk + SLAB_CHUNK_SIZE;
+      }
 
-        uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
-        uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
+      // The chunk header takes up the first few pages, so those are never handed out.
+      // Push the rest on in reverse so that the lowest page index gets used first.
+      uint64_t header_pages = EFI_SIZE_TO_PAGES(sizeof(SLAB_CHUNK_STRUCT));
+      for(uint64_t page_index = 0; page_index < SLAB_PAGES_PER_CHUNK; page_index++)
+      {
+        Chunk->Page[page_index].SizeClass = SLAB_PAGE_UNUSED;
+      }
+      for(uint64_t page_index = SLAB_PAGES_PER_CHUNK - 1; page_index >= header_pages; page_index--)
+      {
+        Chunk->FreePages[Chunk->FreePageCount] = (UINT16)page_index;
+        Chunk->FreePageCount++;
+      }
 
-        uint64_t cr4 = control_register_rw(4, 0, 0);
-        if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
-        {
-          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+      Chunk->Next = Global_Slab_Info.ChunkList;
+      Global_Slab_Info.ChunkList = Chunk;
+      Global_Slab_Info.NumChunks++;
+    }
 
-          // Need to remove the sign extension
-          uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
-
-          // PML5: 256TB pages
-          if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
-          {
-            page_data.HWPageSize = (256ULL << 40);
-            page_data.HWPageShift = PML5_SHIFT;
-            page_data.PageTableEntryData = ((uint64_t*)base_pml_addr)[pml5_part];
+    Chunk->FreePageCount--;
+    SlabPage = &Chunk->Page[Chunk->FreePages[Chunk->FreePageCount]];
 
-            uint64_t pml_base_address = page_data.PageTableEntryData & PML5_ADDRESS_MASK;
-            page_data.HWPageBase = pml_base_address;
-            if(page_base_address != pml_base_address)
-            {
-              warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-              return page_data; // return get_page(pml_base_address);
-            }
+    SlabPage->FreeList = NULL;
+    SlabPage->Next = NULL;
+    SlabPage->Prev = NULL;
+    SlabPage->InUse = 0;
+    SlabPage->Bump = 0;
+    SlabPage->Capacity = (UINT16)(EFI_PAGE_SIZE / object_size);
+    SlabPage->SizeClass = (UINT8)size_class;
 
-            if(size_above_page_base_in_region >= page_data.HWPageSize)
-            {
-              page_data.WholePageInRegion = 1;
-            }
+    // It's the only page on the partial list now
+    Global_Slab_Info.Partial[size_class] = SlabPage;
+  }
+  else
+  {
+    // Chunks are 2MB-aligned and their headers sit at the base, so the page struct's address gives its chunk away
+    Chunk = (SLAB_CHUNK_STRUCT*)((uint64_t)SlabPage & ~(SLAB_CHUNK_SIZE - 1));
+  }
 
-          }
-          else
-          {
-            // Find the page_base_address entry...
-            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+  uint8_t * page_base = (uint8_t*)Chunk + ((uint64_t)(SlabPage - Chunk->Page) << EFI_PAGE_SHIFT);
+  void * object;
 
-            // PML4: 512GB
-            if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
-            {
-              page_data.HWPageSize = (512ULL << 30);
-              page_data.HWPageShift = PML4_SHIFT;
-              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml4_part];
+  if(SlabPage->FreeList != NULL) // Reuse a freed object first
+  {
+    object = SlabPage->FreeList;
+    SlabPage->FreeList = *(void**)object;
+    *(void**)object = NULL; // Freed objects are already zeroed except for their link
+  }
+  else // Otherwise take the next never-used one
+  {
+    object = page_base + SlabPage->Bump * object_size;
+    SlabPage->Bump++;
+  }
+  SlabPage->InUse++;
 
-              uint64_t pml_base_address = page_data.PageTableEntryData & PML4_ADDRESS_MASK;
-              page_data.HWPageBase = pml_base_address;
-              if(page_base_address != pml_base_address)
-              {
-                warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                return page_data;
-              }
+  // Full pages come off the partial list. This page is always the list head here.
+  if((SlabPage->FreeList == NULL) && (SlabPage->Bump == SlabPage->Capacity))
+  {
+    Global_Slab_Info.Partial[size_class] = SlabPage->Next;
+    if(SlabPage->Next != NULL)
+    {
+      SlabPage->Next->Prev = NULL;
+    }
+    SlabPage->Next = NULL;
+  }
 
-              if(size_above_page_base_in_region >= page_data.HWPageSize)
-              {
-                page_data.WholePageInRegion = 1;
-              }
+  return object;
+}
 
-            }
-            else
-            {
-              // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+//----------------------------------------------------------------------------------------------------------------------------------
+//  slab_free: Free a Small Object back to Its Slab
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Zeroes the object and puts it on its page's free list. A page that empties out goes back to its chunk so any size class can use
+// it, and a chunk that empties out is returned to the memory map with free() (as long as it isn't the last one).
+//
+// Chunk: the chunk containing allocated_address, as found by slab_find_chunk()
+// allocated_address: pointer from slab_alloc (therefore also malloc...)
+//
 
-              // PML3: 1GB
-              if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
-              {
-                page_data.HWPageSize = (1ULL << 30);
-                page_data.HWPageShift = PML3_SHIFT;
-                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+static void slab_free(SLAB_CHUNK_STRUCT * Chunk, void * allocated_address)
+{
+  uint64_t page_index = ((uint64_t)allocated_address - (uint64_t)Chunk) >> EFI_PAGE_SHIFT;
+  SLAB_PAGE_STRUCT * SlabPage = &Chunk->Page[page_index];
+  uint8_t * page_base = (uint8_t*)Chunk + (page_index << EFI_PAGE_SHIFT);
 
-                uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
-                page_data.HWPageBase = pml_base_address;
-                if(page_base_address != pml_base_address)
-                {
-                  warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                  return page_data;
-                }
+  if(SlabPage->SizeClass == SLAB_PAGE_UNUSED)
+  {
+    error_printf("free: %#qx is in a slab page that isn't in use.\r\n", allocated_address);
+    return;
+  }
 
-                if(size_above_page_base_in_region >= page_data.HWPageSize)
-                {
-                  page_data.WholePageInRegion = 1;
-                }
+  uint64_t size_class = SlabPage->SizeClass;
+  uint64_t object_size = 1ULL << (size_class + SLAB_MIN_OBJECT_SHIFT);
 
-              }
-              else
-              {
-                // Find the page_base_address entry...
-                next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-                uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+#ifdef MEMORY_CHECK_INFO
+  if( (((uint8_t*)allocated_address - page_base) & (object_size - 1)) || (SlabPage->InUse == 0) )
+  {
+    error_printf("free: %#qx is not an allocated slab object.\r\n", allocated_address);
+    return;
+  }
+#endif
 
-                // PML2: 2MB
-                if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
-                {
-                  page_data.HWPageSize = (2ULL << 20);
-                  page_data.HWPageShift = PML2_SHIFT;
-                  page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+  uint8_t was_full = (SlabPage->FreeList == NULL) && (SlabPage->Bump == SlabPage->Capacity);
 
-                  uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
-                  page_data.HWPageBase = pml_base_address;
-                  if(page_base_address != pml_base_address)
-                  {
-                    warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                    return page_data;
-                  }
+  // Zero it, then link it in
+  AVX_memset(allocated_address, 0, object_size);
+  *(void**)allocated_address = SlabPage->FreeList;
+  SlabPage->FreeList = allocated_address;
+  SlabPage->InUse--;
 
-                  if(size_above_page_base_in_region >= page_data.HWPageSize)
-                  {
-                    page_data.WholePageInRegion = 1;
-                  }
+  if(SlabPage->InUse == 0) // Page is empty, give it back to the chunk
+  {
+    if(!was_full) // Full pages weren't on the partial list
+    {
+      if(SlabPage->Prev != NULL)
+      {
+        SlabPage->Prev->Next = SlabPage->Next;
+      }
+      else
+      {
+        Global_Slab_Info.Partial[size_class] = SlabPage->Next;
+      }
 
-                }
-                else
-                {
-                  // Find the page_base_address entry...
-                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-                  uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+      if(SlabPage->Next != NULL)
+      {
+        SlabPage->Next->Prev = SlabPage->Prev;
+      }
+    }
 
-                  // PML1: 4kB
-                  page_data.HWPageSize = (4ULL << 10);
-                  page_data.HWPageShift = PML1_SHIFT;
-                  page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+    // Clear out the free list links so the page is all zeroes again
+    AVX_memset(page_base, 0, SlabPage->Bump * object_size);
 
-                  uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
-                  page_data.HWPageBase = pml_base_address;
+    SlabPage->FreeList = NULL;
+    SlabPage->Next = NULL;
+    SlabPage->Prev = NULL;
+    SlabPage->Bump = 0;
+    SlabPage->Capacity = 0;
+    SlabPage->SizeClass = SLAB_PAGE_UNUSED;
 
-                  // It's not possible to both get here and trigger a page base address error
+    Chunk->FreePages[Chunk->FreePageCount] = (UINT16)page_index;
+    Chunk->FreePageCount++;
 
-                  if(size_above_page_base_in_region >= page_data.HWPageSize)
-                  {
-                    page_data.WholePageInRegion = 1;
-                  }
+    // Hang on to the last chunk so that alloc/free of a single small object doesn't thrash the memory map
+    if( (Chunk->FreePageCount == (SLAB_PAGES_PER_CHUNK - EFI_SIZE_TO_PAGES(sizeof(SLAB_CHUNK_STRUCT)))) && (Global_Slab_Info.NumChunks > 1) )
+    {
+      SLAB_CHUNK_STRUCT ** Link;
+      for(Link = &Global_Slab_Info.ChunkList; *Link != Chunk; Link = &(*Link)->Next); // It's definitely in there, slab_find_chunk() found it
 
-                }
-              }
-            }
-          }
-        } // end 5-level
-        else // 4-level paging
-        {
-          // Need to remove the sign extension
-          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+      *Link = Chunk->Next;
+      Global_Slab_Info.NumChunks--;
 
-          // 4-level paging doesn't have 512GB paging sizes
+      // Without its signature, slab_find_chunk() won't take it for a chunk anymore, so this is freed like any other page-granular allocation
+      Chunk->Signature = 0;
+      free(Chunk);
+    }
+  }
+  else if(was_full) // Page has room again, put it back on the partial list
+  {
+    SlabPage->Prev = NULL;
+    SlabPage->Next = Global_Slab_Info.Partial[size_class];
+    if(SlabPage->Next != NULL)
+    {
+      SlabPage->Next->Prev = SlabPage;
+    }
+    Global_Slab_Info.Partial[size_class] = SlabPage;
+  }
+}
 
-          // Find the page_base_address entry...
-          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-          uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+//----------------------------------------------------------------------------------------------------------------------------------
+//  slab_find_chunk: Check if an Address Belongs to a Slab Chunk
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the slab chunk containing allocated_address, or NULL if allocated_address isn't slab memory. Chunks are 2MB-aligned, so
+// this only has to check the signature at the base of the 2MB frame that allocated_address is in. The signature is XORed with the
+// chunk's address, so a copy of a chunk header somewhere else in memory doesn't count. Addresses outside the range chunks have been
+// in are turned away without reading anything, so this is safe to call on any address (even ~0ULL).
+//
 
-          // PML3/PDP: 1GB
-          if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
-          {
-            page_data.HWPageSize = (1ULL << 30);
-            page_data.HWPageShift = PML3_SHIFT;
-            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+static SLAB_CHUNK_STRUCT * slab_find_chunk(void * allocated_address)
+{
+  uint64_t chunk_base = (uint64_t)allocated_address & ~(SLAB_CHUNK_SIZE - 1);
 
-            uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
-            page_data.HWPageBase = pml_base_address;
-            if(page_base_address != pml_base_address)
-            {
-              warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-              return page_data;
-            }
+  if((chunk_base < Global_Slab_Info.ChunksStart) || (chunk_base >= Global_Slab_Info.ChunksEnd))
+  {
+    return NULL;
+  }
 
-            if(size_above_page_base_in_region >= page_data.HWPageSize)
-            {
-              page_data.WholePageInRegion = 1;
-            }
+  SLAB_CHUNK_STRUCT * Chunk = (SLAB_CHUNK_STRUCT*)chunk_base;
+  if(Chunk->Signature != (SLAB_CHUNK_SIGNATURE ^ chunk_base))
+  {
+    return NULL;
+  }
 
-          }
-          else
-          {
-            // Find the page_base_address entry...
-            next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+  return Chunk;
+}
 
-            // PML2/PD: 2MB
-            if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
-            {
-              page_data.HWPageSize = (2ULL << 20);
-              page_data.HWPageShift = PML2_SHIFT;
-              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+//----------------------------------------------------------------------------------------------------------------------------------
+//  kmalloc_stats: Print Slab Occupancy
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Prints, for each small-object size class, how many 4kB pages it holds, how many objects are allocated out of how many would fit,
+// and the resulting occupancy. Low occupancy with many pages means the class is fragmented.
+//
 
-              uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
-              page_data.HWPageBase = pml_base_address;
-              if(page_base_address != pml_base_address)
-              {
-                warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                return page_data;
-              }
+void kmalloc_stats(void)
+{
+  SLAB_CHUNK_STRUCT * Chunk;
+  uint64_t free_pages = 0;
 
-              if(size_above_page_base_in_region >= page_data.HWPageSize)
-              {
-                page_data.WholePageInRegion = 1;
-              }
+  for(Chunk = Global_Slab_Info.ChunkList; Chunk != NULL; Chunk = Chunk->Next)
+  {
+    free_pages += Chunk->FreePageCount;
+  }
 
-            }
-            else
-            {
-              // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+  printf("Slab chunks: %llu (%llu kB), unassigned pages: %llu\r\n", Global_Slab_Info.NumChunks, Global_Slab_Info.NumChunks * (SLAB_CHUNK_SIZE >> 10), free_pages);
+  printf("  Size  Pages   In Use  Capacity  Occupancy\r\n");
 
-              // PML1/PT: 4kB
-              page_data.HWPageSize = (4ULL << 10);
-              page_data.HWPageShift = PML1_SHIFT;
-              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+  for(uint64_t size_class = 0; size_class < SLAB_NUM_CLASSES; size_class++)
+  {
+    uint64_t pages = 0, in_use = 0, capacity = 0;
 
-              uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
-              page_data.HWPageBase = pml_base_address;
+    for(Chunk = Global_Slab_Info.ChunkList; Chunk != NULL; Chunk = Chunk->Next)
+    {
+      for(uint64_t page_index = 0; page_index < SLAB_PAGES_PER_CHUNK; page_index++)
+      {
+        if(Chunk->Page[page_index].SizeClass == size_class)
+        {
+          pages++;
+          in_use += Chunk->Page[page_index].InUse;
+          capacity += Chunk->Page[page_index].Capacity;
+        }
+      }
+    }
 
-              // It's not possible to both get here and trigger a page base address error
+    printf("%6llu %6llu %8llu %9llu %9llu%%\r\n", 1ULL << (size_class + SLAB_MIN_OBJECT_SHIFT), pages, in_use, capacity, capacity ? (in_use * 100) / capacity : 0);
+  }
+}
 
-              if(size_above_page_base_in_region >= page_data.HWPageSize)
-              {
-                page_data.WholePageInRegion = 1;
-              }
+#ifdef BUDDY_ALLOCATOR
+//----------------------------------------------------------------------------------------------------------------------------------
+//  buddy_alloc: Allocate a Naturally Aligned Block of Physical Pages
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns a zeroed block of 2^n bytes (4kB to 1GB) that is at least numbytes big and aligned to at least byte_alignment, or ~0ULL if
+// the request is bigger than BUDDY_MAX_ORDER or no arena could be found for it. Blocks are always aligned to their own size, so
+// malloc2MB() and malloc1GB() get their alignment for free, and finding a block is a walk over at most BUDDY_NUM_ORDERS free lists
+// instead of a search through the memory map. The price is that sizes are rounded up to the next power of 2, so blocks bigger than
+// a standard arena (BUDDY_ARENA_ORDER) are only handed out if that wastes no more than 1/(2^BUDDY_WASTE_SHIFT) of the block. Past
+// that, the memory map can allocate exactly what's needed instead, and ~0ULL is returned so the caller goes there.
+//
+// Free blocks are kept zeroed except for the BUDDY_BLOCK links in their first 16 bytes, unless they're marked BUDDY_FRAME_DIRTY (see
+// buddy_free()), in which case the part that gets handed out is zeroed here.
+//
+// numbytes: number of bytes needed
+// byte_alignment: the minimum alignment, which is one of the mallocX sizes
+//
 
-            }
-          }
-        } // end 4-level
+static void * buddy_alloc(size_t numbytes, uint64_t byte_alignment)
+{
+  uint64_t order = BUDDY_MIN_ORDER;
 
-        // Finally, get the memory map data
-        page_data.MemoryMapRegionData = *Piece;
+  while(((1ULL << order) < numbytes) || ((1ULL << order) < byte_alignment))
+  {
+    order++;
+    if(order > BUDDY_MAX_ORDER)
+    {
+      return (void*)~0ULL;
+    }
+  }
 
-        // Whew!
-        break;
-      }
+  if((order > BUDDY_ARENA_ORDER) && (((1ULL << order) - numbytes) > ((1ULL << order) >> BUDDY_WASTE_SHIFT)))
+  {
+    return (void*)~0ULL;
+  }
+
+  // Find the smallest free block that's big enough, getting another arena if there isn't one
+  uint64_t block_order = order;
+  while((block_order <= BUDDY_MAX_ORDER) && (Global_Buddy_Info.FreeList[block_order - BUDDY_MIN_ORDER] == NULL))
+  {
+    block_order++;
+  }
+
+  if(block_order > BUDDY_MAX_ORDER)
+  {
+    if(!buddy_grow(order))
+    {
+      return (void*)~0ULL;
     }
 
-    // Loop ended without a discovered address
-    if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+    block_order = order;
+    while(Global_Buddy_Info.FreeList[block_order - BUDDY_MIN_ORDER] == NULL)
     {
-      error_printf("get_page: Could not find page base address. It may not be aligned or allocated.\r\n");
-      page_data.HWPageBase = ~0ULL;
-      return page_data;
+      block_order++;
     }
   }
 
-  return page_data;
+  BUDDY_BLOCK * Block = Global_Buddy_Info.FreeList[block_order - BUDDY_MIN_ORDER];
+  BUDDY_ARENA * Arena = buddy_find_arena(Block);
+  uint8_t dirty = buddy_unlink(Arena, Block, block_order);
+
+  // Split it down to size, handing the upper halves back
+  while(block_order > order)
+  {
+    block_order--;
+    buddy_push(Arena, (BUDDY_BLOCK*)((uint8_t*)Block + (1ULL << block_order)), block_order, dirty);
+  }
+
+  Arena->Frame[((EFI_PHYSICAL_ADDRESS)Block - Arena->Base) >> EFI_PAGE_SHIFT] = (uint8_t)(order - BUDDY_MIN_ORDER + 1);
+
+  // buddy_unlink() cleared the links, so unless ZeroDirtyPages() hasn't gotten to it yet, the whole block is zero now
+  if(dirty)
+  {
+    AVX_memset_parallel(Block, 0, 1ULL << order); // Does its own AVXMEM_PARALLEL_MIN check
+    Global_Zero_Pool.ZeroedInlineBytes += 1ULL << order;
+  }
+
+  return Block;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  set_region_hwpages: Modify the Page Table Entries of All Hardware Pages in a Memory Map Region
+//  buddy_free: Free a Block from buddy_alloc
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// This takes a hardware page base address aligned to a memory region in the memory map and applies hardware paging flags (e.g.
-// NX, G, etc.) to all the hardware pages corresponding to that region. The input address MUST be that of a hardware page base that
-// coincides with the PhysicalStart of a memory region. This function only applies to physical addresses. There is a virtual address
-// variant, vset_region_hwpages(), but what it does is take a virtual address in order to find the address's corresponding
-// PhysicalStart in the system memory map (and that PhysicalStart still needs to be a hardware page base address!).
-//
-// NOTE: This function can be used to couple a malloc region to a hardware page or contiguous set of hardware pages. In this case it
-// is very important that the malloc-allocated address is a page base address (e.g. for 1GB paging, the address needs to be 1GB
-// aligned or else it won't be a page base address) and that the malloc region in question consumes the entire hardware page(s),
-// otherwise this will be setting flags that will impact other memory regions within those hardware page(s) (yikes!).
-//
-// hw_page_base_addr: the base address of the hardware page corresponding to the PhysicalStart of a region in the memory map, in pointer form (e.g. as returned by malloc)
-// entry_flags: the flags to set (a 64-bit value that is formatted like a page table entry)
-// attributes: attributes that will show up on the memory map
-// flags_or_entry: 0 = only flags & memory map attrbutes be set, 1 = the whole page table entry gets replaced (both flags and address in the 'entry_flags' variable, plus memory map attributes)
-//
-// Returns 0 on success, 1 on failure, 2 on "region too small, some parts of region may have already been set" error, 3 on wrong alignment
+// Merges the block with its buddy for as long as the buddy is free too. If that makes the whole arena free and it isn't the only
+// arena, the arena is given back to the memory map, and free() zeroes it from there. Otherwise the block is zeroed, or, with deferred
+// zeroing on (see EnableDeferredZeroing()), just marked BUDDY_FRAME_DIRTY for buddy_alloc() or ZeroDirtyPages() to zero later.
 //
-// If the "PK" bits are not active (CR4.PKE == 0, this is true by default in this framework) then bits 62:59 in 'entry_flags' should
-// be 0.
+// Arena: the arena containing allocated_address (see buddy_find_arena())
+// allocated_address: pointer from buddy_alloc()
+// zeroed: 1 if the whole block is already zero (e.g. it's coming out of a magazine), 0 if it still holds data
 //
 
-uint8_t set_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint64_t attributes, uint8_t flags_or_entry)
+static void buddy_free(BUDDY_ARENA * Arena, void * allocated_address, uint8_t zeroed)
 {
-  uint64_t page_base_address = (uint64_t)hw_page_base_addr;
-  uint8_t isFirstPage = 1;
-
-  if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
+  uint64_t order = buddy_block_order(Arena, allocated_address);
+  if(order == 0)
   {
-    error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nset_region_hwpages() failed.\r\n");
-    return 3;
+    error_printf("free: %#qx is not an allocated buddy block.\r\n", (EFI_PHYSICAL_ADDRESS)allocated_address);
+    return;
   }
-  else
+
+  EFI_PHYSICAL_ADDRESS Block = (EFI_PHYSICAL_ADDRESS)allocated_address;
+  uint64_t freed_order = order;
+  uint8_t dirty = 0; // Whether the merged block is going to hold any old data
+
+  Arena->Frame[(Block - Arena->Base) >> EFI_PAGE_SHIFT] = 0;
+
+  while(order < Arena->Order)
   {
-    EFI_MEMORY_DESCRIPTOR * Piece;
+    // The base is aligned to the arena's size, so flipping the order bit gives the buddy
+    EFI_PHYSICAL_ADDRESS Buddy = Block ^ (1ULL << order);
 
-    // Check for page base address in the map, which should always be a PhysicalStart of some region.
-    // This can't just set some random section of EfiConventionalMemory to have certain attributes--that would be bad.
-    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    if((Arena->Frame[(Buddy - Arena->Base) >> EFI_PAGE_SHIFT] & ~BUDDY_FRAME_DIRTY) != ((order - BUDDY_MIN_ORDER + 1) | BUDDY_FRAME_FREE))
     {
-      // Found it
-      if(Piece->PhysicalStart == page_base_address)
-      {
-        uint64_t regionpages = Piece->NumberOfPages; // Piece->NumberOfPages contains the size of the region, so it can be compared against the PML level to ensure sizes match up correctly before making changes
+      break;
+    }
 
-        uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
-        uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK; // Bits 63:52 should be 0 anyway when CR3 is set, otherwise there would be crashes.
+    dirty |= buddy_unlink(Arena, (BUDDY_BLOCK*)Buddy, order);
+    Block &= ~(1ULL << order);
+    order++;
+  }
 
-        uint64_t cr4 = control_register_rw(4, 0, 0);
-        if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
-        {
-          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
-          while(regionpages)
-          {
-            // Need to remove the sign extension
-            uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB, physical addressing maxes out at 52-bit, which is only 16 PML5 entries. Page tables must always be located in physical address space.
+  if((order == Arena->Order) && (Global_Buddy_Info.NumArenas > 1))
+  {
+    // Hang on to the last arena so that alloc/free of a single block doesn't thrash the memory map
+    BUDDY_ARENA ** Link;
+    for(Link = &Global_Buddy_Info.ArenaList; *Link != Arena; Link = &(*Link)->Next); // It's definitely in there, buddy_find_arena() found it
 
-            // PML5: 256TB pages
-            if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
-            {
+    *Link = Arena->Next;
+    Global_Buddy_Info.NumArenas--;
 
-              if(isFirstPage)
-              {
-                // Check to make sure memory region start is hardware page base aligned to this size
-                uint64_t pml_base_address = ((uint64_t*)base_pml_addr)[pml5_part] & PML5_ADDRESS_MASK;
-                if(page_base_address != pml_base_address)
-                {
-                  warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                  return 3;
-                }
+    // Not on the arena list anymore, so these go to the memory map, which takes care of the zeroing
+    free((void*)Arena->Base);
+    free(Arena);
+    return;
+  }
 
-                isFirstPage = 0;
-              }
+  if(!zeroed)
+  {
+    if(Global_Zero_Pool.Enabled)
+    {
+      dirty = 1;
+    }
+    else
+    {
+      AVX_memset_parallel(allocated_address, 0, 1ULL << freed_order); // Large blocks get spread across idle cores, small ones don't
+    }
+  }
 
-              if(regionpages < (1ULL << 36))
-              {
-                warning_printf("Error: Region at base address %#qx does not cover entire 256TB page. (5-lvl)\r\n", page_base_address);
-                warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                return 2;
-              }
+  buddy_push(Arena, (BUDDY_BLOCK*)Block, order, dirty);
+}
 
-              if(flags_or_entry)
-              {
-                ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
-              }
-              else
-              {
-                entry_flags &= PAGE_ENTRY_FLAGS_MASK; // Remove any address bits
-                entry_flags |= (((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK);
-                ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
-              }
+//----------------------------------------------------------------------------------------------------------------------------------
+//  buddy_shrink: Give Back the Unneeded Upper Part of a Block
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Halves an allocated block until it's the smallest one that still holds numbytes, freeing the upper halves. Used by realloc().
+// The bytes past numbytes must already be zero.
+//
+// Arena: the arena containing allocated_address (see buddy_find_arena())
+// allocated_address: pointer from buddy_alloc()
+// numbytes: the number of bytes that need to stay allocated
+//
 
-              regionpages -= 1ULL << 36; // (1ULL << 48) >> 12
-              page_base_address += 1ULL << 48; // Get the next aligned address in the set
-            }
-            else
-            {
-              // Find the page_base_address entry...
-              uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+static void buddy_shrink(BUDDY_ARENA * Arena, void * allocated_address, size_t numbytes)
+{
+  uint64_t order = buddy_block_order(Arena, allocated_address);
 
-              // PML4: 512GB
-              if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
-              {
+  // The upper halves' buddies are the lower halves, which are still allocated, so there's nothing to merge with
+  while((order > BUDDY_MIN_ORDER) && ((1ULL << (order - 1)) >= numbytes))
+  {
+    order--;
+    buddy_push(Arena, (BUDDY_BLOCK*)((uint8_t*)allocated_address + (1ULL << order)), order, 0);
+  }
 
-                if(isFirstPage)
-                {
-                  // Check to make sure memory region start is hardware page base aligned to this size
-                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml4_part] & PML4_ADDRESS_MASK;
-                  if(page_base_address != pml_base_address)
-                  {
-                    warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                    return 3;
-                  }
+  Arena->Frame[((EFI_PHYSICAL_ADDRESS)allocated_address - Arena->Base) >> EFI_PAGE_SHIFT] = (uint8_t)(order - BUDDY_MIN_ORDER + 1);
+}
 
-                  isFirstPage = 0;
-                }
+//----------------------------------------------------------------------------------------------------------------------------------
+//  buddy_extend: Grow a Block in Place
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The reverse of buddy_shrink(): doubles an allocated block until it holds numbytes by absorbing its buddy each time, which only
+// works while the block is the lower half and the upper half is a whole free block. Used by realloc() to avoid a copy. Nothing is
+// changed unless the block can get all the way to the needed size. The absorbed blocks are already zeroed, apart from their free
+// list links, which get cleared when they're unlinked, and apart from dirty ones (see buddy_free()), which get zeroed here.
+//
+// Arena: the arena containing allocated_address (see buddy_find_arena())
+// allocated_address: pointer from buddy_alloc()
+// numbytes: the number of bytes the block needs to hold
+//
+// Returns 1 if the block now holds numbytes, 0 if it has to move instead.
+//
 
-                if(regionpages < (1ULL << 27))
-                {
-                  warning_printf("Error: Region at base address %#qx does not cover entire 512GB page. (5-lvl)\r\n", page_base_address);
-                  warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                  warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                  warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                  warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                  warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                  return 2;
-                }
+static uint8_t buddy_extend(BUDDY_ARENA * Arena, void * allocated_address, size_t numbytes)
+{
+  EFI_PHYSICAL_ADDRESS Block = (EFI_PHYSICAL_ADDRESS)allocated_address;
+  uint64_t order = buddy_block_order(Arena, allocated_address);
+  uint64_t new_order = order;
 
-                if(flags_or_entry)
-                {
-                  ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
-                }
-                else
-                {
-                  entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                  entry_flags |= (((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK);
-                  ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
-                }
+  // Make sure every buddy on the way up is free first
+  while((1ULL << new_order) < numbytes)
+  {
+    if((new_order == Arena->Order) || (Block & (1ULL << new_order))) // An upper half can't grow upwards
+    {
+      return 0;
+    }
 
-                regionpages -= 1ULL << 27; // (1ULL << 39) >> 12
-                page_base_address += 1ULL << 39; // Get the next aligned address in the set
-              }
-              else
-              {
-                // Find the page_base_address entry...
-                next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-                uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+    EFI_PHYSICAL_ADDRESS Buddy = Block + (1ULL << new_order);
+    if((Arena->Frame[(Buddy - Arena->Base) >> EFI_PAGE_SHIFT] & ~BUDDY_FRAME_DIRTY) != ((new_order - BUDDY_MIN_ORDER + 1) | BUDDY_FRAME_FREE))
+    {
+      return 0;
+    }
 
-                // PML3: 1GB
-                if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
-                {
+    new_order++;
+  }
 
-                  if(isFirstPage)
-                  {
-                    // Check to make sure memory region start is hardware page base aligned to this size
-                    uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
-                    if(page_base_address != pml_base_address)
-                    {
-                      warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                      return 3;
-                    }
+  for(; order < new_order; order++)
+  {
+    BUDDY_BLOCK * Absorbed = (BUDDY_BLOCK*)(Block + (1ULL << order));
 
-                    isFirstPage = 0;
-                  }
+    if(buddy_unlink(Arena, Absorbed, order))
+    {
+      AVX_memset(Absorbed, 0, 1ULL << order);
+      Global_Zero_Pool.ZeroedInlineBytes += 1ULL << order;
+    }
+  }
 
-                  if(regionpages < (1ULL << 18))
-                  {
-                    warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (5-lvl)\r\n", page_base_address);
-                    warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                    warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                    warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                    warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                    warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                    return 2;
-                  }
+  Arena->Frame[(Block - Arena->Base) >> EFI_PAGE_SHIFT] = (uint8_t)(new_order - BUDDY_MIN_ORDER + 1);
 
-                  if(flags_or_entry)
-                  {
-                    ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-                  }
-                  else
-                  {
-                    entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                    entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
-                    ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-                  }
+  return 1;
+}
 
-                  regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
-                  page_base_address += 1ULL << 30; // Get the next aligned address in the set
-                }
-                else
-                {
-                  // Find the page_base_address entry...
-                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-                  uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+//----------------------------------------------------------------------------------------------------------------------------------
+//  buddy_*: Buddy Allocator Internals
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Arenas come from the memory map via AllocateFreeAddress(), so they show up there as malloc regions, and each one has a Frame table
+// (also from the memory map) recording where blocks start, what order they are, and whether they're free.
+//
 
-                  // PML2: 2MB
-                  if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
-                  {
+// Returns the arena containing allocated_address, or NULL if it isn't buddy memory. Only the arena list is read, so this is safe to
+// call on any address.
+static BUDDY_ARENA * buddy_find_arena(void * allocated_address)
+{
+  BUDDY_ARENA * Arena;
 
-                    if(isFirstPage)
-                    {
-                      // Check to make sure memory region start is hardware page base aligned to this size
-                      uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
-                      if(page_base_address != pml_base_address)
-                      {
-                        warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                        return 3;
-                      }
+  for(Arena = Global_Buddy_Info.ArenaList; Arena != NULL; Arena = Arena->Next)
+  {
+    if(((EFI_PHYSICAL_ADDRESS)allocated_address >= Arena->Base) && ((EFI_PHYSICAL_ADDRESS)allocated_address < (Arena->Base + (1ULL << Arena->Order))))
+    {
+      break;
+    }
+  }
 
-                      isFirstPage = 0;
-                    }
+  return Arena;
+}
 
-                    if(regionpages < (1ULL << 9))
-                    {
-                      warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (5-lvl)\r\n", page_base_address);
-                      warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                      warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                      warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                      warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                      warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                      return 2;
-                    }
+// Returns the order of the allocated block starting at allocated_address, or 0 if no allocated block starts there
+static uint64_t buddy_block_order(BUDDY_ARENA * Arena, void * allocated_address)
+{
+  if((EFI_PHYSICAL_ADDRESS)allocated_address & EFI_PAGE_MASK)
+  {
+    return 0;
+  }
 
-                    if(flags_or_entry)
-                    {
-                      ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
-                    }
-                    else
-                    {
-                      entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                      entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
-                      ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
-                    }
+  uint8_t entry = Arena->Frame[((EFI_PHYSICAL_ADDRESS)allocated_address - Arena->Base) >> EFI_PAGE_SHIFT];
+  if((entry == 0) || (entry & BUDDY_FRAME_FREE))
+  {
+    return 0;
+  }
 
-                    regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
-                    page_base_address += 1ULL << 21; // Get the next aligned address in the set
-                  }
-                  else
-                  {
-                    // Find the page_base_address entry...
-                    next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-                    uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+  return entry - 1 + BUDDY_MIN_ORDER;
+}
 
-                    // PML1: 4kB
-                    // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
-                    // regionpages cannot be < 1, so no error message here
+// Returns the order of the allocated block containing address and puts its base in *BlockBase, or returns 0 if address isn't in an
+// allocated buddy block. Blocks are aligned to their size, so the block has to start at address rounded down to one of the orders.
+// This is for get_page() and set_region_hwpages(), since buddy blocks don't have memory map descriptors of their own.
+static uint64_t buddy_containing_block(void * address, EFI_PHYSICAL_ADDRESS * BlockBase)
+{
+  uint64_t block_order = 0;
 
-                    if(flags_or_entry)
-                    {
-                      ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-                    }
-                    else
-                    {
-                      entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
-                      entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
-                      ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-                    }
+  allocator_lock();
 
-                    regionpages -= 1ULL; // (1ULL << 12) >> 12
-                    page_base_address += 1ULL << 12; // Get the next aligned address in the set
-                  }
-                }
-              }
-            }
-          } // end while
-        } // end 5-level
-        else // 4-level paging
-        {
-          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
-          while(regionpages)
-          {
-            // Need to remove the sign extension
-            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+  BUDDY_ARENA * Arena = buddy_find_arena(address);
+  if(Arena != NULL)
+  {
+    for(uint64_t order = BUDDY_MIN_ORDER; order <= Arena->Order; order++)
+    {
+      EFI_PHYSICAL_ADDRESS Candidate = (EFI_PHYSICAL_ADDRESS)address & ~((1ULL << order) - 1);
+      if(buddy_block_order(Arena, (void*)Candidate) == order)
+      {
+        *BlockBase = Candidate;
+        block_order = order;
+        break;
+      }
+    }
+  }
 
-            // 4-level paging doesn't have 512GB paging sizes
+  allocator_unlock();
 
-            // Find the page_base_address entry...
-            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+  return block_order;
+}
 
-            // PML3/PDP: 1GB
-            if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
-            {
+// Put a block on its free list. dirty: 1 if the block holds old data past its links, 0 if it's all zero.
+static void buddy_push(BUDDY_ARENA * Arena, BUDDY_BLOCK * Block, uint64_t order, uint8_t dirty)
+{
+  BUDDY_BLOCK ** Head = &Global_Buddy_Info.FreeList[order - BUDDY_MIN_ORDER];
 
-              if(isFirstPage)
-              {
-                // Check to make sure memory region start is hardware page base aligned to this size
-                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
-                if(page_base_address != pml_base_address)
-                {
-                  warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                  return 3;
-                }
+  Block->Prev = NULL;
+  Block->Next = *Head;
+  if(Block->Next != NULL)
+  {
+    Block->Next->Prev = Block;
+  }
+  *Head = Block;
 
-                isFirstPage = 0;
-              }
+  Arena->Frame[((EFI_PHYSICAL_ADDRESS)Block - Arena->Base) >> EFI_PAGE_SHIFT] = (uint8_t)((order - BUDDY_MIN_ORDER + 1) | BUDDY_FRAME_FREE | (dirty ? BUDDY_FRAME_DIRTY : 0));
 
-              if(regionpages < (1ULL << 18))
-              {
-                warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (4-lvl)\r\n", page_base_address);
-                warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                return 2;
-              }
+  if(dirty)
+  {
+    Global_Buddy_Info.DirtyBytes += 1ULL << order;
+  }
+}
 
-              if(flags_or_entry)
-              {
-                ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-              }
-              else
-              {
-                entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
-                ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-              }
+// Take a block off its free list and clear its links. Returns 1 if it was dirty, so the rest of it still holds old data, or 0 if
+// it's all zero now.
+static uint8_t buddy_unlink(BUDDY_ARENA * Arena, BUDDY_BLOCK * Block, uint64_t order)
+{
+  uint8_t * Entry = &Arena->Frame[((EFI_PHYSICAL_ADDRESS)Block - Arena->Base) >> EFI_PAGE_SHIFT];
+  uint8_t dirty = (*Entry & BUDDY_FRAME_DIRTY) ? 1 : 0;
 
-              regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
-              page_base_address += 1ULL << 30; // Get the next aligned address in the set
-            }
-            else
-            {
-              // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+  if(Block->Prev != NULL)
+  {
+    Block->Prev->Next = Block->Next;
+  }
+  else
+  {
+    Global_Buddy_Info.FreeList[order - BUDDY_MIN_ORDER] = Block->Next;
+  }
 
-              // PML2/PD: 2MB
-              if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
-              {
+  if(Block->Next != NULL)
+  {
+    Block->Next->Prev = Block->Prev;
+  }
 
-                if(isFirstPage)
-                {
-                  // Check to make sure memory region start is hardware page base aligned to this size
-                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
-                  if(page_base_address != pml_base_address)
-                  {
-                    warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                    return 3;
-                  }
+  Block->Next = NULL;
+  Block->Prev = NULL;
 
-                  isFirstPage = 0;
-                }
+  *Entry = 0;
 
-                if(regionpages < (1ULL << 9))
-                {
-                  warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (4-lvl)\r\n", page_base_address);
-                  warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
-                  warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
-                  warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-                  warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-                  warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-                  return 2;
-                }
+  if(dirty)
+  {
+    Global_Buddy_Info.DirtyBytes -= 1ULL << order;
+  }
 
-                if(flags_or_entry)
-                {
-                  ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
-                }
-                else
-                {
-                  entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                  entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
-                  ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
-                }
+  return dirty;
+}
 
-                regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
-                page_base_address += 1ULL << 21; // Get the next aligned address in the set
-              }
-              else
-              {
-                // Find the page_base_address entry...
-                next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-                uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+// Get a new arena from the memory map with room for a block of the given order. Returns 0 if there isn't one.
+static uint8_t buddy_grow(uint64_t order)
+{
+  // Never smaller than a standard arena, so that small blocks don't each cost a trip to the memory map and an arena of their own
+  uint64_t arena_order = (order > BUDDY_ARENA_ORDER) ? order : BUDDY_ARENA_ORDER;
 
-                // PML1/PT: 4kB
-                // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
-                // regionpages cannot be < 1, so no error message here
+  if(Global_Free_Index.Valid && (freeindex_aligned_fit(1ULL << (arena_order - EFI_PAGE_SHIFT), 0x1, 1ULL << arena_order) == ~0ULL))
+  {
+    // Not without splitting up some smaller aligned region, which the memory map can do itself
+    return 0;
+  }
 
-                if(flags_or_entry)
-                {
-                  ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-                }
-                else
-                {
-                  entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
-                  entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
-                  ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-                }
+  BUDDY_ARENA * Arena = (BUDDY_ARENA*)AllocateFreeAddress(sizeof(BUDDY_ARENA) + (1ULL << (arena_order - EFI_PAGE_SHIFT)), 0x1, EFI_PAGE_SIZE);
+  if((EFI_PHYSICAL_ADDRESS)Arena >= ~3ULL)
+  {
+    return 0;
+  }
 
-                regionpages -= 1ULL; // (1ULL << 12) >> 12
-                page_base_address += 1ULL << 12; // Get the next aligned address in the set
-              }
-            }
-          } // end while
-        } // end 4-level
+  EFI_PHYSICAL_ADDRESS arena_base = AllocateFreeAddress(1ULL << arena_order, 0x1, 1ULL << arena_order); // Already zeroed
+  if(arena_base >= ~3ULL)
+  {
+    free(Arena);
+    return 0;
+  }
 
-        // Finally, set the memory map attributes
-        Piece->Attribute = attributes;
+  // AllocateFreeAddress() zeroed the Frame table
+  Arena->Base = arena_base;
+  Arena->Order = arena_order;
+  Arena->Next = Global_Buddy_Info.ArenaList;
+  Global_Buddy_Info.ArenaList = Arena;
+  Global_Buddy_Info.NumArenas++;
 
-        // Whew!
-        break;
-      }
-    }
+  buddy_push(Arena, (BUDDY_BLOCK*)arena_base, arena_order, 0);
 
-    // Loop ended without a discovered address
-    if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  return 1;
+}
+
+// Zero dirty free blocks with non-temporal stores, smallest first, until max_bytes have been zeroed or there aren't any left. Whole
+// blocks get zeroed, so this can go over max_bytes by up to one block. Returns the number of bytes zeroed.
+static uint64_t buddy_zero_dirty(uint64_t max_bytes)
+{
+  uint64_t zeroed_bytes = 0;
+
+  for(uint64_t order = BUDDY_MIN_ORDER; (order <= BUDDY_MAX_ORDER) && Global_Buddy_Info.DirtyBytes && (zeroed_bytes < max_bytes); order++)
+  {
+    for(BUDDY_BLOCK * Block = Global_Buddy_Info.FreeList[order - BUDDY_MIN_ORDER]; (Block != NULL) && (zeroed_bytes < max_bytes); Block = Block->Next)
     {
-      error_printf("set_region_hwpages: Could not find page base address. It may not be aligned or allocated.\r\n");
-      return 1;
+      BUDDY_ARENA * Arena = buddy_find_arena(Block);
+      uint8_t * Entry = &Arena->Frame[((EFI_PHYSICAL_ADDRESS)Block - Arena->Base) >> EFI_PAGE_SHIFT];
+
+      if(*Entry & BUDDY_FRAME_DIRTY)
+      {
+        // The links have to survive
+        BUDDY_BLOCK Links = *Block;
+        memset_zeroes_as(Block, 1ULL << order);
+        *Block = Links;
+
+        *Entry &= (uint8_t)~BUDDY_FRAME_DIRTY;
+        Global_Buddy_Info.DirtyBytes -= 1ULL << order;
+        zeroed_bytes += 1ULL << order;
+      }
     }
   }
 
-  return 0;
+  return zeroed_bytes;
 }
+#endif
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vmalloc: Allocate Virtual Memory with Alignment
+//  buddy_stats: Print Buddy Allocator Free Lists
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Dynamically allocate virtual memory aligned to the nearest suitable address alignment value
-//
-// See malloc() for a more detailed description. This is the same as malloc, but for virtual addresses in the memory map instead of
-// physical ones.
+// Prints how many arenas the buddy allocator holds and how many free blocks there are of each order. Memory in arenas counts as
+// malloc memory in the memory map (and to GetFreeSystemRam()), even while it's free here.
 //
 
-void * vmalloc(size_t numbytes)
+void buddy_stats(void)
 {
-  if(numbytes < (2ULL << 20)) // < 2MB
+  BUDDY_ARENA * Arena;
+  uint64_t arena_bytes = 0;
+
+  for(Arena = Global_Buddy_Info.ArenaList; Arena != NULL; Arena = Arena->Next)
   {
-    return vmalloc4KB(numbytes); // 4kB-aligned
+    arena_bytes += 1ULL << Arena->Order;
   }
-  else if(numbytes < (1ULL << 30)) // < 1GB
+
+  printf("Buddy arenas: %llu (%llu kB)\r\n", Global_Buddy_Info.NumArenas, arena_bytes >> 10);
+  printf("    Block kB  Free\r\n");
+
+  for(uint64_t order_index = 0; order_index < BUDDY_NUM_ORDERS; order_index++)
   {
-    return vmalloc2MB(numbytes); // 2MB-aligned
+    uint64_t free_blocks = 0;
+    for(BUDDY_BLOCK * Block = Global_Buddy_Info.FreeList[order_index]; Block != NULL; Block = Block->Next)
+    {
+      free_blocks++;
+    }
+
+    printf("%12llu %5llu\r\n", 1ULL << (order_index + BUDDY_MIN_ORDER - 10), free_blocks);
   }
-  else if(numbytes < (512ULL << 30)) // < 512GB
-  {
-    return vmalloc1GB(numbytes); // 1GB-aligned
-  }
-  else if(numbytes < (256ULL << 40)) // < 256TB
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Setup_Magazines: Give the Current Core Its Own malloc() Caches
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Each core that uses malloc() and free() should call this once: the BSP right after Setup_MemMap(), and every AP before it first
+// allocates anything. It gives the core a set of magazines, which are small stacks of free, zeroed objects, one per slab size class
+// plus one for single 4kB buddy blocks (only used with BUDDY_ALLOCATOR). malloc() pops from the calling core's magazine and free()
+// pushes onto it, so most small allocations never touch anything shared with other cores. Only an empty or full magazine goes to
+// the slab and buddy allocators, and when it does it moves MAGAZINE_BATCH objects while holding the allocator lock once.
+//
+// A core finds its magazines through IA32_GS_BASE, which this sets. Nothing else uses GS, but loading the GS segment register (as
+// cs_update() does) clears the base, so this has to run after Setup_MinimalGDT().
+//
+// NOTE: The allocator lock covers malloc(), mallocX(), realloc(), free(), and the magazines. The vmalloc() family and the rest of
+// the memory map code still assume they have the map to themselves (see the TODO in MemMap_Prep()). free() looks pointers up in the
+// slab chunk and buddy arena lists under the lock too, and only drops it to push onto a magazine.
+//
+// NOTE: This kernel doesn't start the APs yet, so for now the BSP is the only core that calls this, and everything written for
+// multiple cores (the magazines and allocator lock, malloc_stress_benchmark(), AVX_memset_parallel() and AVX_memcpy_parallel()) only
+// ever sees that one. Once APs are running, each one needs Enable_AVX(), Setup_PAT(), and this before it allocates anything, and can
+// then sit in AVXmem_Parallel_Worker() or malloc_stress_worker() when there's nothing else for it to do.
+//
+
+void Setup_Magazines(void)
+{
+  uint64_t cpu_index = __atomic_fetch_add(&Global_Magazine_Info.NumCpus, 1, __ATOMIC_RELAXED);
+  if(cpu_index >= MAGAZINE_MAX_CPUS)
   {
-    return vmalloc512GB(numbytes); // 512GB-aligned
+    // There's no CPU_NO_MAGAZINES for it either, so it has no way to take the allocator lock
+    error_printf("Setup_Magazines: Too many cores, only %llu can use malloc().\r\n", MAGAZINE_MAX_CPUS);
+    HaCF();
   }
-  else // > 256TB
+
+  // This core can't use allocator_lock() until its GS base is set
+  allocator_lock_as(cpu_index + 1);
+
+  CPU_MAGAZINES * Magazines = (CPU_MAGAZINES*)AllocateFreeAddress(sizeof(CPU_MAGAZINES), 0x1, EFI_PAGE_SIZE);
+  if((EFI_PHYSICAL_ADDRESS)Magazines == ~0ULL)
   {
-    return vmalloc256TB(numbytes); // 256TB-aligned
+    // Point GS at a stand-in instead, so this core still has an index for the allocator lock and just skips the magazines
+    Global_Magazine_Info.NoMagazines[cpu_index].CpuIndex = cpu_index;
+    msr_rw(IA32_GS_BASE, (uint64_t)&Global_Magazine_Info.NoMagazines[cpu_index], 1);
+    Global_Magazine_Info.Enabled = 1;
+
+    allocator_release();
+    error_printf("Setup_Magazines: Not enough memory for core %llu's magazines, it will go straight to the shared allocators.\r\n", cpu_index);
+    return;
   }
+
+  // AllocateFreeAddress() returns zeroed memory, so all the counts start at 0
+  Magazines->Self = Magazines;
+  Magazines->CpuIndex = cpu_index;
+  Global_Magazine_Info.Cpu[cpu_index] = Magazines;
+
+  msr_rw(IA32_GS_BASE, (uint64_t)Magazines, 1);
+  Global_Magazine_Info.Enabled = 1;
+
+  allocator_release();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vmallocX: Allocate Virtual Memory Aligned to X Bytes
+//  magazine_this_cpu: Get the Current Core's Magazines
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Each of these allocate bytes at virtual addresses aligned on X-byte boundaries (X in vmallocX). Otherwise, same rules as above.
+// Reads the Self pointer at the start of the CPU_MAGAZINES that IA32_GS_BASE points to. Only valid once Setup_Magazines() has run
+// on the calling core, and NULL if it couldn't give the core magazines (see CPU_NO_MAGAZINES). magazine_this_cpu_index() reads the
+// CpuIndex after it, which both structures have.
 //
 
-void * vmalloc4KB(size_t numbytes)
+static CPU_MAGAZINES * magazine_this_cpu(void)
 {
-  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
+  CPU_MAGAZINES * Magazines;
 
-  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (4ULL << 10));
+  asm volatile("movq %%gs:0, %[out]"
+               : [out] "=r" (Magazines)
+               : // no inputs
+               : // no clobbers
+              );
 
-  return (void*)new_buffer;
+  return Magazines;
 }
 
-void * vmalloc2MB(size_t numbytes)
+static uint64_t magazine_this_cpu_index(void)
 {
-  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
+  uint64_t cpu_index;
 
-  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (2ULL << 20));
+  asm volatile("movq %%gs:8, %[out]"
+               : [out] "=r" (cpu_index)
+               : // no inputs
+               : // no clobbers
+              );
 
-  return (void*)new_buffer;
+  return cpu_index;
 }
 
-void * vmalloc1GB(size_t numbytes)
-{
-  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
+//----------------------------------------------------------------------------------------------------------------------------------
+//  allocator_lock: Take the Lock on the Shared Allocators
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Spins until the calling core owns the lock on the slab allocator, the buddy allocator, and the memory map. The lock is recursive,
+// since those call into each other (e.g. slab_alloc() gets its chunks from malloc2MB(), and buddy_free() gives arenas back with
+// free()), so every allocator_lock() just needs a matching allocator_unlock().
+//
+// Before any core has called Setup_Magazines() there is only the one core, and these do nothing.
+//
 
-  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (1ULL << 30));
+static void allocator_lock(void)
+{
+  if(Global_Magazine_Info.Enabled)
+  {
+    allocator_lock_as(magazine_this_cpu_index() + 1);
+  }
+}
 
-  return (void*)new_buffer;
+static void allocator_unlock(void)
+{
+  if(Global_Magazine_Info.Enabled)
+  {
+    allocator_release();
+  }
 }
 
-void * vmalloc512GB(size_t numbytes)
+// owner: anything nonzero that's unique to the calling core
+static void allocator_lock_as(uint64_t owner)
 {
-  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
+  if(Global_Magazine_Info.LockOwner == owner)
+  {
+    Global_Magazine_Info.LockDepth++;
+    return;
+  }
 
-  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (512ULL << 30));
+  while(!__sync_bool_compare_and_swap(&Global_Magazine_Info.LockOwner, 0, owner))
+  {
+    asm volatile("pause" : : : "memory");
+  }
 
-  return (void*)new_buffer;
+  Global_Magazine_Info.LockDepth = 1;
 }
 
-void * vmalloc256TB(size_t numbytes)
+static void allocator_release(void)
 {
-  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
-
-  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (256ULL << 40));
-
-  return (void*)new_buffer;
+  if(--Global_Magazine_Info.LockDepth == 0)
+  {
+    __atomic_store_n(&Global_Magazine_Info.LockOwner, 0, __ATOMIC_RELEASE);
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vcalloc: Allocate Virtual Memory with Alignment
+//  magazine_alloc: Allocate an Object from the Current Core's Magazine
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Dynamically allocate virtual memory aligned to the nearest suitable address alignment value
+// Pops an object of the given class off the calling core's magazine. If the magazine is empty, this takes the allocator lock once to
+// get the object plus enough to fill the magazine halfway from the slab (or buddy) allocator. Without magazines it just goes to those
+// allocators directly.
 //
-// This is just an alias for vmalloc that takes the calloc(3) syntax. It's just the virtual memory version of calloc() above.
+// class_index: a slab size class, or MAGAZINE_PAGE_CLASS for one 4kB buddy block
 //
-// elements: number of elements in array
-// size: size of each element
+// Returns ~0ULL if out of memory, just like malloc.
 //
 
-void * vcalloc(size_t elements, size_t size)
+static void * magazine_alloc(uint64_t class_index)
 {
-  size_t total_size = elements * size; // This is fine if size_t is 64-bits, which is true of all intended targets of this framework.
-  void * new_buffer = vmalloc(total_size);
+  CPU_MAGAZINES * Magazines = Global_Magazine_Info.Enabled ? magazine_this_cpu() : NULL;
 
-  return new_buffer;
+  if((Magazines != NULL) && Magazines->Count[class_index])
+  {
+    Magazines->Hits++;
+    return Magazines->Rounds[class_index][--Magazines->Count[class_index]];
+  }
+
+  allocator_lock();
+
+  void * object = magazine_shared_alloc(class_index);
+
+  if((Magazines != NULL) && ((EFI_PHYSICAL_ADDRESS)object != ~0ULL))
+  {
+    Magazines->Refills++;
+
+    while(Magazines->Count[class_index] < (MAGAZINE_BATCH - 1))
+    {
+      void * extra = magazine_shared_alloc(class_index);
+      if((EFI_PHYSICAL_ADDRESS)extra == ~0ULL)
+      {
+        break;
+      }
+      Magazines->Rounds[class_index][Magazines->Count[class_index]++] = extra;
+    }
+  }
+
+  allocator_unlock();
+
+  return object;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vrealloc: Reallocate Virtual Memory with Alignment
+//  magazine_free: Put an Object into the Current Core's Magazine
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Dynamically reallocate memory for an existing pointer from vmalloc, and vfree the old region (if moved)
+// Zeroes the object and pushes it onto the calling core's magazine for its class. If the magazine is full, the bottom MAGAZINE_BATCH
+// objects (the ones freed longest ago) are first handed back to the slab or buddy allocator under one allocator lock.
 //
-// allocated_address: The pointer allocated from vmalloc
-// size: The new desired size
+// class_index: the object's slab size class, or MAGAZINE_PAGE_CLASS for a 4kB buddy block
+// allocated_address: the object
 //
-// NOTE: Unlike realloc(3), NULL pointer here is actually a valid address at 0x0. Therefore passing in a NULL pointer as
-// allocated_address is the same as passing in address 0x0, which could be an actual allocated region. So don't do it.
-// Passing in a size of 0, however, will cause vfree() to be run and will result in a return address of ~2ULL.
+// Returns 1 if the object went into a magazine, or 0 if the caller needs to free it the usual way (no magazines on this core, or an
+// invalid class_index).
 //
 
-void * vrealloc(void * allocated_address, size_t size)
+static uint8_t magazine_free(uint64_t class_index, void * allocated_address)
 {
-  if(size == 0)
+  if((!Global_Magazine_Info.Enabled) || (class_index >= MAGAZINE_NUM_CLASSES))
   {
-    vfree(allocated_address);
-    return ((void*) ~2ULL);
+    return 0;
   }
 
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  CPU_MAGAZINES * Magazines = magazine_this_cpu();
+  if(Magazines == NULL)
+  {
+    return 0;
+  }
 
-  size_t numpages = EFI_SIZE_TO_PAGES(size);
-  size_t orig_numpages = 0;
+  void ** Rounds = Magazines->Rounds[class_index];
 
-  // Check for vmalloc in the map, we need the old size
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(Magazines->Count[class_index] == MAGAZINE_SIZE)
   {
-    // Within each compatible vmalloc type, check the address
-    if((Piece->Type == (EfiMaxMemoryType + 2)) && ((uint8_t*)Piece->VirtualStart == (uint8_t*)allocated_address))
+    allocator_lock();
+    for(uint64_t round_index = 0; round_index < MAGAZINE_BATCH; round_index++)
     {
-      // Found it
-      orig_numpages = Piece->NumberOfPages;
+      magazine_shared_free(class_index, Rounds[round_index]);
+    }
+    allocator_unlock();
 
-      if(numpages > orig_numpages) // Grow
-      { // Can the vmalloc area be expanded into adjacent EfiConventionalMemory?
-        // Is the next piece an EfiConventionalMemory region?
+    AVX_memmove(Rounds, &Rounds[MAGAZINE_BATCH], (MAGAZINE_SIZE - MAGAZINE_BATCH) * sizeof(void*));
+    Magazines->Count[class_index] -= MAGAZINE_BATCH;
+    Magazines->Drains++;
+  }
 
-        size_t additional_numpages = numpages - orig_numpages;
-        // If the area right after the vmalloc region is EfiConventionalMemory, we might be able to just take some pages from there...
+  // malloc() hands these out as-is, so they have to be zeroed now
+  AVX_memset(allocated_address, 0, (class_index == MAGAZINE_PAGE_CLASS) ? EFI_PAGE_SIZE : (1ULL << (class_index + SLAB_MIN_OBJECT_SHIFT)));
+  Rounds[Magazines->Count[class_index]++] = allocated_address;
 
-        // Check if there's an EfiConventionalMemory region adjacent in memory to the memmap region
-        EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
-        EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+  return 1;
+}
 
-        // Quick check for adjacency that will skip scanning the whole memmap
-        // Can provide a little speed boost for ordered memory maps
-        if(
-            (Next_Piece->VirtualStart != VirtualEnd)
-            ||
-            ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-          ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
-        {
-          // See if VirtualEnd matches any VirtualStart for unordered maps
-          for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
-          {
-            if(VirtualEnd == Next_Piece->VirtualStart)
-            {
-              // Found one
-              break;
-            }
-          }
-        }
+//----------------------------------------------------------------------------------------------------------------------------------
+//  magazine_shared_alloc: Get One Object for a Magazine
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Where magazines get their objects from. The allocator lock must be held.
+//
+// class_index: a slab size class, or MAGAZINE_PAGE_CLASS for one 4kB buddy block
+//
+// Returns ~0ULL if out of memory (or for MAGAZINE_PAGE_CLASS without BUDDY_ALLOCATOR).
+//
 
-        // Is the next piece an EfiConventionalMemory type?
-        if(
-            (Next_Piece->Type == EfiConventionalMemory) && (Next_Piece->NumberOfPages >= additional_numpages)
-            &&
-            ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-          ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
-        {
-          if(Next_Piece->NumberOfPages > additional_numpages)
-          {
-            // Modify MemMap's entry
-            Piece->NumberOfPages = numpages;
+static void * magazine_shared_alloc(uint64_t class_index)
+{
+  if(class_index == MAGAZINE_PAGE_CLASS)
+  {
+#ifdef BUDDY_ALLOCATOR
+    return buddy_alloc(EFI_PAGE_SIZE, EFI_PAGE_SIZE);
+#else
+    return (void*)~0ULL;
+#endif
+  }
 
-            // Modify adjacent EfiConventionalMemory's entry
-            Next_Piece->NumberOfPages -= additional_numpages;
-            Next_Piece->PhysicalStart += (additional_numpages << EFI_PAGE_SHIFT);
-            Next_Piece->VirtualStart += (additional_numpages << EFI_PAGE_SHIFT);
+  return slab_alloc(1ULL << (class_index + SLAB_MIN_OBJECT_SHIFT));
+}
 
-            // Done
-          }
-          else if(Next_Piece->NumberOfPages == additional_numpages)
-          { // If the next piece is exactly the number of pages, we can claim it and reclaim a descriptor
-            // This just means that MemMap will have some wiggle room for the next time it needs to be modified.
+//----------------------------------------------------------------------------------------------------------------------------------
+//  magazine_shared_free: Give One Object Back from a Magazine
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The reverse of magazine_shared_alloc(). The allocator lock must be held.
+//
+// class_index: the class of the magazine the object came out of
+// allocated_address: the object
+//
 
-            // Modify MemMap's entry
-            Piece->NumberOfPages = numpages;
+static void magazine_shared_free(uint64_t class_index, void * allocated_address)
+{
+  if(class_index == MAGAZINE_PAGE_CLASS)
+  {
+#ifdef BUDDY_ALLOCATOR
+    buddy_free(buddy_find_arena(allocated_address), allocated_address, 1); // magazine_free() already zeroed it
+#endif
+    return;
+  }
 
-            // Erase the claimed descriptor
-            // Zero out the piece we just claimed
-            AVX_memset(Next_Piece, 0, Global_Memory_Info.MemMapDescriptorSize); // Next_Piece is a pointer
-            AVX_memmove(Next_Piece, (uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize));
+  slab_free(slab_find_chunk(allocated_address), allocated_address);
+}
 
-            // Update Global_Memory_Info
-            Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+//----------------------------------------------------------------------------------------------------------------------------------
+//  magazine_stats: Print Per-Core Magazine Usage
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Lists, for each core with magazines, how many allocations were served straight from a magazine, how many times a magazine was
+// refilled from or drained to the shared allocators, and how many objects it's holding right now. Objects sitting in magazines
+// count as in use as far as kmalloc_stats() and buddy_stats() are concerned.
+//
 
-            // Zero out the entry that used to be at the end of the map
-            AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+void magazine_stats(void)
+{
+  if(!Global_Magazine_Info.Enabled)
+  {
+    printf("Magazines are not set up (see Setup_Magazines()).\r\n");
+    return;
+  }
 
-            // Done
-          }
-          // There is no else, as there are only > and == cases.
-          else
-          {
-            error_printf("vrealloc: What kind of sorcery is this? Seeing this means there's a bug in vrealloc.\r\n");
-            // And also probably MemMap_Prep()...
-            HaCF();
-          }
-        }
-        else // Nope, need to move it altogether. But that's really easy to do for vmalloc. :)
-        {
-          // Get a new address
-          void * new_address = vmalloc(size);
-          if((EFI_VIRTUAL_ADDRESS)new_address == ~0ULL)
-          {
-            error_printf("vrealloc: Insufficient free memory, could not reallocate increased size.\r\n");
-            return new_address; // Better to return this invalid address than to return allocated_address
-          }
-          //
-          // NOTE: Any function call that includes a call to MemMap_Prep() renders "Piece" unusable afterwards.
-          // This is because it can no longer be guaranteed that the memory map is in the same place as before;
-          // MemMap_Prep() might have changed its location.
-          //
+  printf("Core        Hits   Refills    Drains  Cached\r\n");
 
-          // Move the old memory to the new area
-          AVX_memmove(new_address, allocated_address, (orig_numpages << EFI_PAGE_SHIFT)); // Need size in bytes
+  for(uint64_t cpu_index = 0; (cpu_index < Global_Magazine_Info.NumCpus) && (cpu_index < MAGAZINE_MAX_CPUS); cpu_index++)
+  {
+    CPU_MAGAZINES * Magazines = Global_Magazine_Info.Cpu[cpu_index];
+    if(Magazines == NULL)
+    {
+      continue;
+    }
 
-          // Free the old address
-          vfree(allocated_address);
+    uint64_t cached = 0;
+    for(uint64_t class_index = 0; class_index < MAGAZINE_NUM_CLASSES; class_index++)
+    {
+      cached += Magazines->Count[class_index];
+    }
 
-          // Done
-          return new_address; // This is one of the few times an early return is used instead of break outside of an error
-        }
-        // Grow done
-      }
-      else if(numpages < orig_numpages) // Shrink
-      {
-        // Is the next piece an EfiConventionalMemory region?
-        // If the area right after the vmalloc region is EfiConventionalMemory, we might be able to just give it the freed pages
-        size_t freedpages = orig_numpages - numpages;
+    printf("%4llu %11llu %9llu %9llu %7llu\r\n", cpu_index, Magazines->Hits, Magazines->Refills, Magazines->Drains, cached);
+  }
+}
 
-        // Check if there's an EfiConventionalMemory region adjacent in memory to the vmalloc region
-        EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
-        EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+//----------------------------------------------------------------------------------------------------------------------------------
+//  malloc_stress_benchmark: Measure Single-Core malloc()/free() Throughput
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Runs a mix of small allocations (16 bytes to 4kB, with 64 of them live at a time, freed in a scrambled order) on the calling core,
+// once with the magazines bypassed and once with them in use, and prints allocations per second for each.
+// All pointers are freed again at the end.
+//
+// iterations: allocations per run (e.g. 100000)
+//
+// NOTE: This is single-core only. Nothing runs alongside it, so it measures the magazines' fast path against the locked one, not how
+// either holds up under contention (see the NOTE in Setup_Magazines()). malloc_stress_worker() is the part each AP would run once
+// they're started.
+//
 
-        // Quick check for adjacency that will skip scanning the whole memmap
-        // Can provide a little speed boost for ordered memory maps
-        if(
-            (Next_Piece->VirtualStart != VirtualEnd)
-            ||
-            ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-          ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
-        {
-          // See if VirtualEnd matches any VirtualStart for unordered maps
-          for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
-          {
-            if(VirtualEnd == Next_Piece->VirtualStart)
-            {
-              // Found one
-              break;
-            }
-          }
-        }
-
-        // Is the next piece an EfiConventionalMemory type?
-        if(
-            (Next_Piece->Type == EfiConventionalMemory)
-            &&
-            ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-          ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
-        { // Yes, we can reclaim without requiring a new entry
-
-          // Modify vmalloc area's entry
-          Piece->NumberOfPages = numpages;
-
-          // Modify adjacent EfiConventionalMemory's entry
-          Next_Piece->NumberOfPages += freedpages;
-          Next_Piece->PhysicalStart -= (freedpages << EFI_PAGE_SHIFT);
-          Next_Piece->VirtualStart -= (freedpages << EFI_PAGE_SHIFT);
-
-          // Done. Nice.
-        }
-        // No, we need a new memmap entry, which will require a new page if the last entry is on a page edge or would spill over a page edge. Better to be safe then sorry!
-        // First, maybe there's room for another descriptor in the last page
-        else if((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) <= (numpages << EFI_PAGE_SHIFT))
-        { // Yes, we can reclaim and fit in another descriptor
-
-          // Make a temporary descriptor to hold current vmalloc entry's values
-          EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-          new_descriptor_temp.Type = Piece->Type; // Special vmalloc type
-          new_descriptor_temp.Pad = Piece->Pad;
-          new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-          new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-          new_descriptor_temp.NumberOfPages = numpages; // New size of vmalloc entry
-          new_descriptor_temp.Attribute = Piece->Attribute;
-
-          // Modify the descriptor-to-move
-          Piece->Type = EfiConventionalMemory;
-          // No pad change
-          Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-          Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
-          Piece->NumberOfPages = freedpages;
-          // No attribute change
-
-          // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-          AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
-
-          // Insert the new piece (by overwriting the now-duplicated entry with new values)
-          // I.e. turn this piece into what was stored in the temporary descriptor above
-          Piece->Type = new_descriptor_temp.Type;
-          Piece->Pad = new_descriptor_temp.Pad;
-          Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-          Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-          Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-          Piece->Attribute = new_descriptor_temp.Attribute;
-
-          // Update Global_Memory_Info MemMap size
-          Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-
-          // Done
-        }
-        // No, it would spill over to a new page
-        else
-        {
-          // Do we have more than a descriptor's worth of pages reclaimable?
-          size_t pages_per_memory_descriptor = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapDescriptorSize);
-
-          if((numpages + pages_per_memory_descriptor) < orig_numpages)
-          { // Yes, so we can hang on to one [set] of them and make a new EfiConventionalMemory entry for the rest.
-            freedpages -= pages_per_memory_descriptor;
+void malloc_stress_benchmark(uint64_t iterations)
+{
+  uint64_t running_cores = 1;
 
-            // Make a temporary descriptor to hold current vmalloc entry's values
-            EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-            new_descriptor_temp.Type = Piece->Type; // Special vmalloc type
-            new_descriptor_temp.Pad = Piece->Pad;
-            new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-            new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-            new_descriptor_temp.NumberOfPages = numpages + pages_per_memory_descriptor; // New size of vmalloc entry
-            new_descriptor_temp.Attribute = Piece->Attribute;
+  printf("malloc()/free() stress, %llu allocations per core:\r\n", iterations);
+  printf("Cores  Magazines  Allocations/sec\r\n");
 
-            // Modify the descriptor-to-move
-            Piece->Type = EfiConventionalMemory;
-            // No pad change
-            Piece->PhysicalStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->VirtualStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
-            Piece->NumberOfPages = freedpages;
-            // No attribute change
+  for(uint64_t use_magazines = 0; use_magazines < 2; use_magazines++)
+  {
+    uint64_t magazines_enabled = Global_Magazine_Info.Enabled;
+    if(!use_magazines)
+    {
+      Global_Magazine_Info.Enabled = 0;
+    }
 
-            // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-            AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+    uint64_t ticks = malloc_stress_worker(iterations);
 
-            // Insert the new piece (by overwriting the now-duplicated entry with new values)
-            // I.e. turn this piece into what was stored in the temporary descriptor above
-            Piece->Type = new_descriptor_temp.Type;
-            Piece->Pad = new_descriptor_temp.Pad;
-            Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-            Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-            Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-            Piece->Attribute = new_descriptor_temp.Attribute;
+    Global_Magazine_Info.Enabled = magazines_enabled;
 
-            // Update Global_Memory_Info MemMap size
-            Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-          }
-          // No, only 1 [set of] page(s) was reclaimable and adding another entry would spill over. So don't do anything then and hang on to the extra empty page(s).
-        }
-        // Shrink done
-      }
-      // else:
-      // Nothing to be done if equal.
+    if(ticks == ~0ULL)
+    {
+      error_printf("malloc_stress_benchmark: Not enough memory for the benchmark.\r\n");
+      return;
+    }
 
-      break;
-    } // End "found it"
-  } // End for
+    const char * magazines_state = use_magazines ? (magazines_enabled ? "on" : "n/a") : "off";
+    printf("%5llu  %9s  %15llu\r\n", running_cores, magazines_state, (running_cores * iterations * Global_TSC_frequency.CyclesPerSecond) / (ticks ? ticks : 1));
+  }
 
-#ifdef MEMORY_CHECK_INFO
-  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  if(Numcores > running_cores)
   {
-    error_printf("vrealloc: Piece not found.\r\n");
-    return (void*) ~3ULL;
+    printf("(APs are not running, so only %llu of %llu cores were measured.)\r\n", running_cores, Numcores);
   }
-#endif
-
-  return allocated_address;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vfree: Free A Virtual Memory Address from VAllocateFreeAddress (vmalloc)
+//  malloc_stress_worker: One Core's Share of malloc_stress_benchmark()
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Frees addresses allocated by VAllocateFreeAddress
+// Does iterations malloc()/free() pairs and returns how many TSC ticks that took, or ~0ULL if it couldn't allocate something.
 //
-// allocated_address: pointer from VAllocateFreeAddress (therefore also vmalloc...)
+// iterations: number of allocations to make
 //
 
-void vfree(void * allocated_address)
+uint64_t malloc_stress_worker(uint64_t iterations)
 {
-  // Locate area
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  void * live[64];
+  uint64_t rng = 0x9E3779B97F4A7C15ULL ^ get_tick();
 
-  // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
-  for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  for(uint64_t slot = 0; slot < 64; slot++)
   {
-    if((Piece->Type == (EfiMaxMemoryType + 2)) && (Piece->VirtualStart == (uint64_t)allocated_address))
-    { // Found it, Piece holds the spot now.
+    live[slot] = malloc(16);
+    if((EFI_PHYSICAL_ADDRESS)live[slot] == ~0ULL)
+    {
+      while(slot)
+      {
+        free(live[--slot]);
+      }
+      return ~0ULL;
+    }
+  }
 
-      // Zero out the destination
-      AVX_memset(allocated_address, 0, Piece->NumberOfPages << EFI_PAGE_SHIFT); // allocated_address is already a pointer
+  uint64_t start_tick = get_tick();
 
-      // Reclaim as EfiConventionalMemory
-      Piece->Type = EfiConventionalMemory;
+  for(uint64_t iteration = 0; iteration < iterations; iteration++)
+  {
+    // xorshift64 picks which pointer to replace and the new size
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
 
-      // Merge conventional memory if possible
-      MergeContiguousConventionalMemory();
+    uint64_t slot = rng & 63;
+    free(live[slot]);
 
-      // Done
-      break;
+    live[slot] = malloc(16ULL << ((rng >> 8) % 9)); // 16 bytes to 4kB
+    if((EFI_PHYSICAL_ADDRESS)live[slot] == ~0ULL)
+    {
+      // Everything but this slot still needs to be freed
+      for(uint64_t other_slot = 0; other_slot < 64; other_slot++)
+      {
+        if(other_slot != slot)
+        {
+          free(live[other_slot]);
+        }
+      }
+      return ~0ULL;
     }
   }
 
-#ifdef MEMORY_CHECK_INFO
-  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  uint64_t end_tick = get_tick();
+
+  for(uint64_t slot = 0; slot < 64; slot++)
   {
-    error_printf("vfree: Piece not found.\r\n");
+    free(live[slot]);
   }
-#endif
+
+  return end_tick - start_tick;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vget_page: Read the Page Table Entry of a Hardware Page (Virtual Address Version)
+//  get_page: Read the Page Table Entry of a Hardware Page
 //----------------------------------------------------------------------------------------------------------------------------------
 //
 // Reads a page table entry corresponding to a hardware page base address, and returns a structure containing the entry's data,
-// the memory map descriptor information of the mapped region in which the page base address is located, and whether or not the
-// entire hardware page fits in the region. This function uses virtual addresses in the memory map to locate corresponding physical
-// ones.
+// the memory map descriptor information of the mapped region in which the page base address is located, the hardware page's size
+// (in bytes) and whether or not the entire hardware page fits in the region. With BUDDY_ALLOCATOR, a page inside an allocated buddy
+// block gets the block as its region, described as though it had its own descriptor, instead of the arena's memory map entry.
 //
-// hw_page_base_addr: The base address of the hardware page in pointer form (e.g. as returned by vmalloc)
+// hw_page_base_addr: The base address of the hardware page in pointer form (e.g. as returned by malloc)
 //
 // The return struct is described as below:
 //
@@ -1696,91 +2032,64 @@ void vfree(void * allocated_address)
 // their program is doing and how their memory is laid out, and may even help find some hard-to-spot pointer issues.
 //
 
-PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
+PAGE_ENTRY_INFO_STRUCT get_page(void * hw_page_base_addr)
 {
   uint64_t page_base_address = (uint64_t)hw_page_base_addr;
   PAGE_ENTRY_INFO_STRUCT page_data = {0};
 
-  EFI_MEMORY_DESCRIPTOR * Piece;
-
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
   {
-    EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+    error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nget_page() failed.\r\n");
+    return page_data;
+  }
+  else
+  {
+    EFI_MEMORY_DESCRIPTOR * Piece;
 
-    // Found it
-    if((Piece->VirtualStart <= page_base_address) && (VirtualEnd > page_base_address))
+    for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
     {
+      EFI_PHYSICAL_ADDRESS PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
 
-      uint64_t size_above_page_base_in_region = VirtualEnd - page_base_address;
-
-      // Convert virtual address to physical address
-      if(Piece->VirtualStart >= Piece->PhysicalStart)
-      {
-        page_base_address -= (Piece->VirtualStart - Piece->PhysicalStart);
-      }
-      else
-      {
-        page_base_address += (Piece->PhysicalStart - Piece->VirtualStart);
-      }
-
-      if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
+      // Found it
+      if((Piece->PhysicalStart <= page_base_address) && (PhysicalEnd > page_base_address))
       {
-        error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nvget_page() failed.\r\n");
-        return page_data;
-      }
-
-      uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
-      uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
+#ifdef BUDDY_ALLOCATOR
+        // In a buddy arena, the region is the block containing the page rather than the whole arena
+        EFI_PHYSICAL_ADDRESS BlockBase = 0;
+        uint64_t block_order = buddy_containing_block(hw_page_base_addr, &BlockBase);
+        if(block_order)
+        {
+          PhysicalEnd = BlockBase + (1ULL << block_order);
+        }
+#endif
 
-      uint64_t cr4 = control_register_rw(4, 0, 0);
-      if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
-      {
-        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+        uint64_t size_above_page_base_in_region = PhysicalEnd - page_base_address;
 
-        // Need to remove the sign extension
-        uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
+        uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
+        uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
 
-        // PML5: 256TB pages
-        if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
+        uint64_t cr4 = control_register_rw(4, 0, 0);
+        if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
         {
-          page_data.HWPageSize = (256ULL << 40);
-          page_data.HWPageShift = PML5_SHIFT;
-          page_data.PageTableEntryData = ((uint64_t*)base_pml_addr)[pml5_part];
+          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
 
-          uint64_t pml_base_address = page_data.PageTableEntryData & PML5_ADDRESS_MASK;
-          page_data.HWPageBase = pml_base_address;
-          if(page_base_address != pml_base_address)
-          {
-            warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-            return page_data;
-          }
+          // Need to remove the sign extension
+          uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
 
-          if(size_above_page_base_in_region >= page_data.HWPageSize)
+          // PML5: 256TB pages
+          if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
           {
-            page_data.WholePageInRegion = 1;
-          }
-
-        }
-        else
-        {
-          // Find the page_base_address entry...
-          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
-          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+            page_data.HWPageSize = (256ULL << 40);
+            page_data.HWPageShift = PML5_SHIFT;
+            page_data.PageTableEntryData = ((uint64_t*)base_pml_addr)[pml5_part];
 
-          // PML4: 512GB
-          if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
-          {
-            page_data.HWPageSize = (512ULL << 30);
-            page_data.HWPageShift = PML4_SHIFT;
-            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml4_part];
-
-            uint64_t pml_base_address = page_data.PageTableEntryData & PML4_ADDRESS_MASK;
+            uint64_t pml_base_address = page_data.PageTableEntryData & PML5_ADDRESS_MASK;
             page_data.HWPageBase = pml_base_address;
             if(page_base_address != pml_base_address)
             {
-              warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-              return page_data;
+              warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+              return page_data; // return get_page(pml_base_address);
             }
 
             if(size_above_page_base_in_region >= page_data.HWPageSize)
@@ -1792,21 +2101,21 @@ PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
           else
           {
             // Find the page_base_address entry...
-            next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
 
-            // PML3: 1GB
-            if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+            // PML4: 512GB
+            if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
             {
-              page_data.HWPageSize = (1ULL << 30);
-              page_data.HWPageShift = PML3_SHIFT;
-              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+              page_data.HWPageSize = (512ULL << 30);
+              page_data.HWPageShift = PML4_SHIFT;
+              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml4_part];
 
-              uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
+              uint64_t pml_base_address = page_data.PageTableEntryData & PML4_ADDRESS_MASK;
               page_data.HWPageBase = pml_base_address;
               if(page_base_address != pml_base_address)
               {
-                warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                 return page_data;
               }
 
@@ -1819,21 +2128,21 @@ PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
             else
             {
               // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
 
-              // PML2: 2MB
-              if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+              // PML3: 1GB
+              if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
               {
-                page_data.HWPageSize = (2ULL << 20);
-                page_data.HWPageShift = PML2_SHIFT;
-                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+                page_data.HWPageSize = (1ULL << 30);
+                page_data.HWPageShift = PML3_SHIFT;
+                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
 
-                uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+                uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
                 page_data.HWPageBase = pml_base_address;
                 if(page_base_address != pml_base_address)
                 {
-                  warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                   return page_data;
                 }
 
@@ -1846,79 +2155,79 @@ PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
               else
               {
                 // Find the page_base_address entry...
-                next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-                uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+                next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+                uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
 
-                // PML1: 4kB
-                page_data.HWPageSize = (4ULL << 10);
-                page_data.HWPageShift = PML1_SHIFT;
-                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+                // PML2: 2MB
+                if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+                {
+                  page_data.HWPageSize = (2ULL << 20);
+                  page_data.HWPageShift = PML2_SHIFT;
+                  page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
 
-                uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
-                page_data.HWPageBase = pml_base_address;
+                  uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+                  page_data.HWPageBase = pml_base_address;
+                  if(page_base_address != pml_base_address)
+                  {
+                    warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                    return page_data;
+                  }
 
-                // It's not possible to both get here and trigger a page base address error
+                  if(size_above_page_base_in_region >= page_data.HWPageSize)
+                  {
+                    page_data.WholePageInRegion = 1;
+                  }
 
-                if(size_above_page_base_in_region >= page_data.HWPageSize)
-                {
-                  page_data.WholePageInRegion = 1;
                 }
+                else
+                {
+                  // Find the page_base_address entry...
+                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+                  uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
 
-              }
-            }
-          }
-        }
-      } // end 5-level
-      else // 4-level paging
-      {
-        // Need to remove the sign extension
-        uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+                  // PML1: 4kB
+                  page_data.HWPageSize = (4ULL << 10);
+                  page_data.HWPageShift = PML1_SHIFT;
+                  page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
 
-        // 4-level paging doesn't have 512GB paging sizes
+                  uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
+                  page_data.HWPageBase = pml_base_address;
 
-        // Find the page_base_address entry...
-        uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-        uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+                  // It's not possible to both get here and trigger a page base address error
 
-        // PML3/PDP: 1GB
-        if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
-        {
-          page_data.HWPageSize = (1ULL << 30);
-          page_data.HWPageShift = PML3_SHIFT;
-          page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+                  if(size_above_page_base_in_region >= page_data.HWPageSize)
+                  {
+                    page_data.WholePageInRegion = 1;
+                  }
 
-          uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
-          page_data.HWPageBase = pml_base_address;
-          if(page_base_address != pml_base_address)
-          {
-            warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-            return page_data;
+                }
+              }
+            }
           }
+        } // end 5-level
+        else // 4-level paging
+        {
+          // Need to remove the sign extension
+          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
 
-          if(size_above_page_base_in_region >= page_data.HWPageSize)
-          {
-            page_data.WholePageInRegion = 1;
-          }
+          // 4-level paging doesn't have 512GB paging sizes
 
-        }
-        else
-        {
           // Find the page_base_address entry...
-          next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-          uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+          uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
 
-          // PML2/PD: 2MB
-          if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+          // PML3/PDP: 1GB
+          if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
           {
-            page_data.HWPageSize = (2ULL << 20);
-            page_data.HWPageShift = PML2_SHIFT;
-            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+            page_data.HWPageSize = (1ULL << 30);
+            page_data.HWPageShift = PML3_SHIFT;
+            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
 
-            uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+            uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
             page_data.HWPageBase = pml_base_address;
             if(page_base_address != pml_base_address)
             {
-              warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+              warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
               return page_data;
             }
 
@@ -1931,180 +2240,189 @@ PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
           else
           {
             // Find the page_base_address entry...
-            next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+            next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
 
-            // PML1/PT: 4kB
-            page_data.HWPageSize = (4ULL << 10);
-            page_data.HWPageShift = PML1_SHIFT;
-            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+            // PML2/PD: 2MB
+            if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+            {
+              page_data.HWPageSize = (2ULL << 20);
+              page_data.HWPageShift = PML2_SHIFT;
+              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
 
-            uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
-            page_data.HWPageBase = pml_base_address;
+              uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+              page_data.HWPageBase = pml_base_address;
+              if(page_base_address != pml_base_address)
+              {
+                warning_printf("get_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                return page_data;
+              }
 
-            // It's not possible to both get here and trigger a page base address error
+              if(size_above_page_base_in_region >= page_data.HWPageSize)
+              {
+                page_data.WholePageInRegion = 1;
+              }
 
-            if(size_above_page_base_in_region >= page_data.HWPageSize)
-            {
-              page_data.WholePageInRegion = 1;
             }
+            else
+            {
+              // Find the page_base_address entry...
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+
+              // PML1/PT: 4kB
+              page_data.HWPageSize = (4ULL << 10);
+              page_data.HWPageShift = PML1_SHIFT;
+              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+
+              uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
+              page_data.HWPageBase = pml_base_address;
+
+              // It's not possible to both get here and trigger a page base address error
+
+              if(size_above_page_base_in_region >= page_data.HWPageSize)
+              {
+                page_data.WholePageInRegion = 1;
+              }
 
+            }
           }
-        }
-      } // end 4-level
+        } // end 4-level
 
-      // Finally, get the memory map data
-      page_data.MemoryMapRegionData = *Piece;
+        // Finally, get the memory map data
+        page_data.MemoryMapRegionData = *Piece;
+#ifdef BUDDY_ALLOCATOR
+        if(block_order)
+        {
+          page_data.MemoryMapRegionData.PhysicalStart = BlockBase;
+          page_data.MemoryMapRegionData.VirtualStart = Piece->VirtualStart + (BlockBase - Piece->PhysicalStart);
+          page_data.MemoryMapRegionData.NumberOfPages = 1ULL << (block_order - EFI_PAGE_SHIFT);
+        }
+#endif
 
-      // Whew!
-      break;
+        // Whew!
+        break;
+      }
     }
-  }
 
-  // Loop ended without a discovered address
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-  {
-    error_printf("vget_page: Could not find page base address. It may not be aligned or allocated.\r\n");
-    page_data.HWPageBase = ~0ULL;
-    return page_data;
+    // Loop ended without a discovered address
+    if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+    {
+      error_printf("get_page: Could not find page base address. It may not be aligned or allocated.\r\n");
+      page_data.HWPageBase = ~0ULL;
+      return page_data;
+    }
   }
 
   return page_data;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  vset_region_hwpages: Modify the Page Table Entries of All Hardware Pages in a Memory Map Region (Virtual Address Version)
+//  set_region_hwpages: Modify the Page Table Entries of All Hardware Pages in a Memory Map Region
 //----------------------------------------------------------------------------------------------------------------------------------
 //
 // This takes a hardware page base address aligned to a memory region in the memory map and applies hardware paging flags (e.g.
 // NX, G, etc.) to all the hardware pages corresponding to that region. The input address MUST be that of a hardware page base that
-// coincides with the PhysicalStart of a memory region. As this can only apply to physical addresses, this function takes a virtual
-// address corresponding to a hardware page base and uses the PhysicalStart of that entry in the memory map. The PhysicalStart must
-// still be a page base address, just like in set_region_hwpages(), even if the VirtualStart isn't.
+// coincides with the PhysicalStart of a memory region. This function only applies to physical addresses. There is a virtual address
+// variant, vset_region_hwpages(), but what it does is take a virtual address in order to find the address's corresponding
+// PhysicalStart in the system memory map (and that PhysicalStart still needs to be a hardware page base address!).
 //
 // NOTE: This function can be used to couple a malloc region to a hardware page or contiguous set of hardware pages. In this case it
 // is very important that the malloc-allocated address is a page base address (e.g. for 1GB paging, the address needs to be 1GB
 // aligned or else it won't be a page base address) and that the malloc region in question consumes the entire hardware page(s),
 // otherwise this will be setting flags that will impact other memory regions within those hardware page(s) (yikes!).
 //
-// hw_page_base_addr: the base address of the hardware page corresponding to the PhysicalStart of a region in the memory map, in pointer form (e.g. as returned by vmalloc)
+// With BUDDY_ALLOCATOR, malloc4KB(), malloc2MB(), and malloc1GB() usually return buddy blocks, which are inside a bigger memory map
+// region (their arena). Those are handled as regions of their own, with the block's size, but they have no descriptor to store
+// attributes in, so 'attributes' is ignored for them.
+//
+// hw_page_base_addr: the base address of the hardware page corresponding to the PhysicalStart of a region in the memory map, in pointer form (e.g. as returned by malloc)
 // entry_flags: the flags to set (a 64-bit value that is formatted like a page table entry)
 // attributes: attributes that will show up on the memory map
 // flags_or_entry: 0 = only flags & memory map attrbutes be set, 1 = the whole page table entry gets replaced (both flags and address in the 'entry_flags' variable, plus memory map attributes)
 //
-// Returns 0 on success, 1 on failure, 2 on "region too small, some parts of region may have already been set" error
+// Returns 0 on success, 1 on failure, 2 on "region too small, some parts of region may have already been set" error, 3 on wrong alignment
 //
 // If the "PK" bits are not active (CR4.PKE == 0, this is true by default in this framework) then bits 62:59 in 'entry_flags' should
 // be 0.
 //
 
-uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint64_t attributes, uint8_t flags_or_entry)
+uint8_t set_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint64_t attributes, uint8_t flags_or_entry)
 {
   uint64_t page_base_address = (uint64_t)hw_page_base_addr;
   uint8_t isFirstPage = 1;
 
-  EFI_MEMORY_DESCRIPTOR * Piece;
-
-  // Check for page base address in the map, which should always be a PhysicalStart of some region.
-  // This can't just set some random section of EfiConventionalMemory to have certain attributes--that would be bad.
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
   {
-    // Found it
-    if(Piece->VirtualStart == page_base_address)
-    {
-      page_base_address = Piece->PhysicalStart;
-
-      if(page_base_address & 0xFFF) // There are no physical page base addresses < 4kB-aligned
-      {
-        error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nvset_region_hwpages() failed.\r\n");
-        return 3;
-      }
-
-      uint64_t regionpages = Piece->NumberOfPages; // Piece->NumberOfPages contains the size of the region, so it can be compared against the PML level to ensure sizes match up correctly before making changes
+    error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nset_region_hwpages() failed.\r\n");
+    return 3;
+  }
+  else
+  {
+    EFI_MEMORY_DESCRIPTOR * Piece;
+    EFI_MEMORY_DESCRIPTOR * MapStart = Global_Memory_Info.MemMap;
+    EFI_MEMORY_DESCRIPTOR * MapEnd = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize);
+    uint64_t DescriptorSize = Global_Memory_Info.MemMapDescriptorSize;
+
+#ifdef BUDDY_ALLOCATOR
+    // A buddy block doesn't have a descriptor, so search a stand-in for just the block instead of the map (which would only have the
+    // whole arena). Its attributes have nowhere to go.
+    EFI_MEMORY_DESCRIPTOR BuddyBlock = {0};
+    uint64_t block_order = buddy_containing_block(hw_page_base_addr, &BuddyBlock.PhysicalStart);
+    if(block_order)
+    {
+      BuddyBlock.NumberOfPages = 1ULL << (block_order - EFI_PAGE_SHIFT);
 
-      uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
-      uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
+      MapStart = &BuddyBlock;
+      MapEnd = &BuddyBlock + 1;
+      DescriptorSize = sizeof(EFI_MEMORY_DESCRIPTOR);
+    }
+#endif
 
-      uint64_t cr4 = control_register_rw(4, 0, 0);
-      if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
+    // Check for page base address in the map, which should always be a PhysicalStart of some region.
+    // This can't just set some random section of EfiConventionalMemory to have certain attributes--that would be bad.
+    for(Piece = MapStart; Piece < MapEnd; Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + DescriptorSize))
+    {
+      // Found it
+      if(Piece->PhysicalStart == page_base_address)
       {
-        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
-        while(regionpages)
-        {
-          // Need to remove the sign extension
-          uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
-
-          // PML5: 256TB pages
-          if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
-          {
-
-            if(isFirstPage)
-            {
-              // Check to make sure memory region start is hardware page base aligned to this size
-              uint64_t pml_base_address = ((uint64_t*)base_pml_addr)[pml5_part] & PML5_ADDRESS_MASK;
-              if(page_base_address != pml_base_address)
-              {
-                warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                return 3;
-              }
-
-              isFirstPage = 0;
-            }
-
-            if(regionpages < (1ULL << 36))
-            {
-              warning_printf("Error: Region at base address %#qx does not cover entire 256TB page. (5-lvl)\r\n", page_base_address);
-              warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-              warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
-              warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-              warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-              warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-              return 2;
-            }
+        uint64_t regionpages = Piece->NumberOfPages; // Piece->NumberOfPages contains the size of the region, so it can be compared against the PML level to ensure sizes match up correctly before making changes
 
-            if(flags_or_entry)
-            {
-              ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
-            }
-            else
-            {
-              entry_flags &= PAGE_ENTRY_FLAGS_MASK; // Remove any address bits
-              entry_flags |= (((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK);
-              ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
-            }
+        uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
+        uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK; // Bits 63:52 should be 0 anyway when CR3 is set, otherwise there would be crashes.
 
-            regionpages -= 1ULL << 36; // (1ULL << 48) >> 12
-            page_base_address += 1ULL << 48; // Get the next aligned address in the set
-          }
-          else
+        uint64_t cr4 = control_register_rw(4, 0, 0);
+        if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
+        {
+          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+          while(regionpages)
           {
-            // Find the page_base_address entry...
-            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+            // Need to remove the sign extension
+            uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB, physical addressing maxes out at 52-bit, which is only 16 PML5 entries. Page tables must always be located in physical address space.
 
-            // PML4: 512GB
-            if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
+            // PML5: 256TB pages
+            if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
             {
 
               if(isFirstPage)
               {
                 // Check to make sure memory region start is hardware page base aligned to this size
-                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml4_part] & PML4_ADDRESS_MASK;
+                uint64_t pml_base_address = ((uint64_t*)base_pml_addr)[pml5_part] & PML5_ADDRESS_MASK;
                 if(page_base_address != pml_base_address)
                 {
-                  warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                   return 3;
                 }
 
                 isFirstPage = 0;
               }
 
-              if(regionpages < (1ULL << 27))
+              if(regionpages < (1ULL << 36))
               {
-                warning_printf("Error: Region at base address %#qx does not cover entire 512GB page. (5-lvl)\r\n", page_base_address);
-                warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-                warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                warning_printf("Error: Region at base address %#qx does not cover entire 256TB page. (5-lvl)\r\n", page_base_address);
+                warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
                 warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
                 warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
                 warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
@@ -2113,46 +2431,46 @@ uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint
 
               if(flags_or_entry)
               {
-                ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
+                ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
               }
               else
               {
-                entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                entry_flags |= (((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK);
-                ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
+                entry_flags &= PAGE_ENTRY_FLAGS_MASK; // Remove any address bits
+                entry_flags |= (((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK);
+                ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
               }
 
-              regionpages -= 1ULL << 27; // (1ULL << 39) >> 12
-              page_base_address += 1ULL << 39; // Get the next aligned address in the set
+              regionpages -= 1ULL << 36; // (1ULL << 48) >> 12
+              page_base_address += 1ULL << 48; // Get the next aligned address in the set
             }
             else
             {
               // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+              uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
 
-              // PML3: 1GB
-              if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+              // PML4: 512GB
+              if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
               {
 
                 if(isFirstPage)
                 {
                   // Check to make sure memory region start is hardware page base aligned to this size
-                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
+                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml4_part] & PML4_ADDRESS_MASK;
                   if(page_base_address != pml_base_address)
                   {
-                    warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                    warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                     return 3;
                   }
 
                   isFirstPage = 0;
                 }
 
-                if(regionpages < (1ULL << 18))
+                if(regionpages < (1ULL << 27))
                 {
-                  warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (5-lvl)\r\n", page_base_address);
-                  warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-                  warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                  warning_printf("Error: Region at base address %#qx does not cover entire 512GB page. (5-lvl)\r\n", page_base_address);
+                  warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                  warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
                   warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
                   warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
                   warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
@@ -2161,46 +2479,46 @@ uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint
 
                 if(flags_or_entry)
                 {
-                  ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+                  ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
                 }
                 else
                 {
                   entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                  entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
-                  ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+                  entry_flags |= (((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK);
+                  ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
                 }
 
-                regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
-                page_base_address += 1ULL << 30; // Get the next aligned address in the set
+                regionpages -= 1ULL << 27; // (1ULL << 39) >> 12
+                page_base_address += 1ULL << 39; // Get the next aligned address in the set
               }
               else
               {
                 // Find the page_base_address entry...
-                next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-                uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+                next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+                uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
 
-                // PML2: 2MB
-                if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+                // PML3: 1GB
+                if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
                 {
 
                   if(isFirstPage)
                   {
                     // Check to make sure memory region start is hardware page base aligned to this size
-                    uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                    uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
                     if(page_base_address != pml_base_address)
                     {
-                      warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                      warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                       return 3;
                     }
 
                     isFirstPage = 0;
                   }
 
-                  if(regionpages < (1ULL << 9))
+                  if(regionpages < (1ULL << 18))
                   {
-                    warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (5-lvl)\r\n", page_base_address);
-                    warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-                    warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                    warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (5-lvl)\r\n", page_base_address);
+                    warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                    warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
                     warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
                     warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
                     warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
@@ -2209,132 +2527,132 @@ uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint
 
                   if(flags_or_entry)
                   {
-                    ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                    ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
                   }
                   else
                   {
                     entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                    entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
-                    ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                    entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
+                    ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
                   }
 
-                  regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
-                  page_base_address += 1ULL << 21; // Get the next aligned address in the set
+                  regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
+                  page_base_address += 1ULL << 30; // Get the next aligned address in the set
                 }
                 else
                 {
                   // Find the page_base_address entry...
-                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-                  uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
-
-                  // PML1: 4kB
-                  // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
-                  // regionpages cannot be < 1, so no error message here
+                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+                  uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
 
-                  if(flags_or_entry)
+                  // PML2: 2MB
+                  if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
                   {
-                    ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+
+                    if(isFirstPage)
+                    {
+                      // Check to make sure memory region start is hardware page base aligned to this size
+                      uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                      if(page_base_address != pml_base_address)
+                      {
+                        warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                        return 3;
+                      }
+
+                      isFirstPage = 0;
+                    }
+
+                    if(regionpages < (1ULL << 9))
+                    {
+                      warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (5-lvl)\r\n", page_base_address);
+                      warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                      warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
+                      warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                      warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                      warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                      return 2;
+                    }
+
+                    if(flags_or_entry)
+                    {
+                      ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                    }
+                    else
+                    {
+                      entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                      entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
+                      ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                    }
+
+                    regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
+                    page_base_address += 1ULL << 21; // Get the next aligned address in the set
                   }
                   else
                   {
-                    entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
-                    entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
-                    ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-                  }
+                    // Find the page_base_address entry...
+                    next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+                    uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
 
-                  regionpages -= 1ULL; // (1ULL << 12) >> 12
-                  page_base_address += 1ULL << 12; // Get the next aligned address in the set
+                    // PML1: 4kB
+                    // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
+                    // regionpages cannot be < 1, so no error message here
+
+                    if(flags_or_entry)
+                    {
+                      ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                    }
+                    else
+                    {
+                      entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
+                      entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
+                      ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                    }
+
+                    regionpages -= 1ULL; // (1ULL << 12) >> 12
+                    page_base_address += 1ULL << 12; // Get the next aligned address in the set
+                  }
                 }
               }
             }
-          }
-        } // end while
-      } // end 5-level
-      else // 4-level paging
-      {
-        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
-        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
-        while(regionpages)
+          } // end while
+        } // end 5-level
+        else // 4-level paging
         {
-          // Need to remove the sign extension
-          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
-
-          // 4-level paging doesn't have 512GB paging sizes
-
-          // Find the page_base_address entry...
-          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
-          uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
-
-          // PML3/PDP: 1GB
-          if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+          // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+          // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+          while(regionpages)
           {
+            // Need to remove the sign extension
+            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
 
-            if(isFirstPage)
-            {
-              // Check to make sure memory region start is hardware page base aligned to this size
-              uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
-              if(page_base_address != pml_base_address)
-              {
-                warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
-                return 3;
-              }
-
-              isFirstPage = 0;
-            }
-
-            if(regionpages < (1ULL << 18))
-            {
-              warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (4-lvl)\r\n", page_base_address);
-              warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-              warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
-              warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
-              warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
-              warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
-              return 2;
-            }
-
-            if(flags_or_entry)
-            {
-              ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-            }
-            else
-            {
-              entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-              entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
-              ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
-            }
+            // 4-level paging doesn't have 512GB paging sizes
 
-            regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
-            page_base_address += 1ULL << 30; // Get the next aligned address in the set
-          }
-          else
-          {
             // Find the page_base_address entry...
-            next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
-            uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
 
-            // PML2/PD: 2MB
-            if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+            // PML3/PDP: 1GB
+            if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
             {
 
               if(isFirstPage)
               {
                 // Check to make sure memory region start is hardware page base aligned to this size
-                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
                 if(page_base_address != pml_base_address)
                 {
-                  warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
                   return 3;
                 }
 
                 isFirstPage = 0;
               }
 
-              if(regionpages < (1ULL << 9))
+              if(regionpages < (1ULL << 18))
               {
-                warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (4-lvl)\r\n", page_base_address);
-                warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
-                warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (4-lvl)\r\n", page_base_address);
+                warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
                 warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
                 warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
                 warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
@@ -2343,504 +2661,2917 @@ uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint
 
               if(flags_or_entry)
               {
-                ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
               }
               else
               {
                 entry_flags &= PAGE_ENTRY_FLAGS_MASK;
-                entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
-                ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
+                ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
               }
 
-              regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
-              page_base_address += 1ULL << 21; // Get the next aligned address in the set
+              regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
+              page_base_address += 1ULL << 30; // Get the next aligned address in the set
             }
             else
             {
               // Find the page_base_address entry...
-              next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
-              uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
-
-              // PML1/PT: 4kB
-              // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
-              // regionpages cannot be < 1, so no error message here
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
 
-              if(flags_or_entry)
+              // PML2/PD: 2MB
+              if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
               {
-                ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+
+                if(isFirstPage)
+                {
+                  // Check to make sure memory region start is hardware page base aligned to this size
+                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                  if(page_base_address != pml_base_address)
+                  {
+                    warning_printf("set_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                    return 3;
+                  }
+
+                  isFirstPage = 0;
+                }
+
+                if(regionpages < (1ULL << 9))
+                {
+                  warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (4-lvl)\r\n", page_base_address);
+                  warning_printf("Beware that some hardware pages of this region passed to set_region_hwpages() may have\r\n");
+                  warning_printf("already been set. Recommendation is to immediately run set_region_hwpages() again on the\r\n");
+                  warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                  warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                  warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                  return 2;
+                }
+
+                if(flags_or_entry)
+                {
+                  ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                }
+                else
+                {
+                  entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                  entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
+                  ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                }
+
+                regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
+                page_base_address += 1ULL << 21; // Get the next aligned address in the set
               }
               else
               {
-                entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
-                entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
-                ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
-              }
+                // Find the page_base_address entry...
+                next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+                uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
 
-              regionpages -= 1ULL; // (1ULL << 12) >> 12
-              page_base_address += 1ULL << 12; // Get the next aligned address in the set
+                // PML1/PT: 4kB
+                // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
+                // regionpages cannot be < 1, so no error message here
+
+                if(flags_or_entry)
+                {
+                  ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                }
+                else
+                {
+                  entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
+                  entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
+                  ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                }
+
+                regionpages -= 1ULL; // (1ULL << 12) >> 12
+                page_base_address += 1ULL << 12; // Get the next aligned address in the set
+              }
             }
-          }
-        } // end while
-      } // end 4-level
+          } // end while
+        } // end 4-level
 
-      // Finally, set the memory map attributes
-      Piece->Attribute = attributes;
+        // Finally, set the memory map attributes
+        Piece->Attribute = attributes;
 
-      // Whew!
-      break;
+        // Whew!
+        break;
+      }
     }
-  }
 
-  // Loop ended without a discovered address
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-  {
-    error_printf("vset_region_hwpages: Could not find page base address. It may not be aligned or allocated.\r\n");
-    return 1;
+    // Loop ended without a discovered address
+    if(Piece >= MapEnd)
+    {
+      error_printf("set_region_hwpages: Could not find page base address. It may not be aligned or allocated.\r\n");
+      return 1;
+    }
   }
 
   return 0;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  VerifyZeroMem: Verify Memory Is Free
+//  vmalloc: Allocate Virtual Memory with Alignment
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Return 0 if desired section of memory is zeroed (for use in "if" statements)
+// Dynamically allocate virtual memory aligned to the nearest suitable address alignment value
+//
+// See malloc() for a more detailed description. This is the same as malloc, but for virtual addresses in the memory map instead of
+// physical ones.
+//
+// Once Setup_DemandPaging() has run, requests of DEMAND_PAGING_MIN_SIZE or more become vreserve() reservations with the same alignment
+// they'd have gotten here, so no RAM is used until their pages are touched. They fall back to the memory map if that doesn't work out.
+// The vmallocX() functions below always use the memory map.
 //
 
-uint8_t VerifyZeroMem(size_t NumBytes, uint64_t BaseAddr) // BaseAddr is a 64-bit unsigned int whose value is the memory address
+void * vmalloc(size_t numbytes)
 {
-  for(size_t verify_increment = 0; verify_increment < NumBytes; verify_increment++)
+  if(Global_Demand_Paging.Enabled && (numbytes >= DEMAND_PAGING_MIN_SIZE) && (numbytes < (256ULL << 40)))
   {
-    if(*(uint8_t*)(BaseAddr + verify_increment) != 0)
+    uint64_t alignment = (numbytes < (1ULL << 30)) ? (2ULL << 20) : ((numbytes < (512ULL << 30)) ? (1ULL << 30) : (512ULL << 30));
+    void * reservation = vreserve(numbytes, alignment, (uint8_t)Global_Demand_Paging.Promote);
+    if((EFI_VIRTUAL_ADDRESS)reservation != ~0ULL)
     {
-      return 1;
+      return reservation;
     }
   }
-  return 0;
+
+  if(numbytes < (2ULL << 20)) // < 2MB
+  {
+    return vmalloc4KB(numbytes); // 4kB-aligned
+  }
+  else if(numbytes < (1ULL << 30)) // < 1GB
+  {
+    return vmalloc2MB(numbytes); // 2MB-aligned
+  }
+  else if(numbytes < (512ULL << 30)) // < 512GB
+  {
+    return vmalloc1GB(numbytes); // 1GB-aligned
+  }
+  else if(numbytes < (256ULL << 40)) // < 256TB
+  {
+    return vmalloc512GB(numbytes); // 512GB-aligned
+  }
+  else // > 256TB
+  {
+    return vmalloc256TB(numbytes); // 256TB-aligned
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  GetMaxMappedPhysicalAddress: Get the Maximum Physical Address in the Memory Map
+//  vmallocX: Allocate Virtual Memory Aligned to X Bytes
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Returns the highest physical address reported by the UEFI memory map, which is useful when working around memory holes and setting
-// up/working with paging. The returned value is 1 byte over the last usable address, meaning it is the total size of the physical
-// address space. Subtract 1 byte from the returned value to get the maximum usable mapped physical address.
-//
-// 0 will only be returned if there aren't any entries in the map, which should never happen anyways.
+// Each of these allocate bytes at virtual addresses aligned on X-byte boundaries (X in vmallocX). Otherwise, same rules as above.
 //
 
-uint64_t GetMaxMappedPhysicalAddress(void)
+void * vmalloc4KB(size_t numbytes)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  uint64_t current_address = 0, max_address = 0;
+  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
-  // Go through the system memory map, adding the page sizes to PhysicalStart. Returns the largest number found, which should be the maximum addressable memory location based on installed RAM size.
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-  {
-    current_address = Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
-    if(current_address > max_address)
-    {
-      max_address = current_address;
-    }
-  }
+  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (4ULL << 10));
 
-  return max_address;
+  return (void*)new_buffer;
 }
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  GetVisibleSystemRam: Calculate Total Visible System RAM
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// Calculates the total visible (not hardware- or firmware-reserved) system RAM from the UEFI system memory map. This is mainly meant
-// to help identify any memory holes in the installed RAM (e.g. there's often one at 0xA0000 to 0xFFFFF). In other words, this is the
-// amount of installed RAM that an OS can actually work with. Windows' msinfo32 utility calls this same value "Total Physical Memory."
-//
-// Value returned is in bytes.
-//
+void * vmalloc2MB(size_t numbytes)
+{
+  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
-uint64_t GetVisibleSystemRam(void)
+  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (2ULL << 20));
+
+  return (void*)new_buffer;
+}
+
+void * vmalloc1GB(size_t numbytes)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  uint64_t running_total = 0;
+  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-  {
-    if(
-        (Piece->Type != EfiMemoryMappedIO) &&
-        (Piece->Type != EfiMemoryMappedIOPortSpace) &&
-        (Piece->Type != EfiPalCode) &&
-        (Piece->Type != EfiPersistentMemory) &&
-        (Piece->Type != EfiMaxMemoryType)
-      )
-    {
-      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
-    }
-  }
+  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (1ULL << 30));
 
-  return running_total;
+  return (void*)new_buffer;
 }
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  GetFreeSystemRam: Calculate Total Free System RAM
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// Calculates the total EfiConventionalMemory from the UEFI system memory map.
-//
+void * vmalloc512GB(size_t numbytes)
+{
+  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
-uint64_t GetFreeSystemRam(void)
+  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (512ULL << 30));
+
+  return (void*)new_buffer;
+}
+
+void * vmalloc256TB(size_t numbytes)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  uint64_t running_total = 0;
+  EFI_PHYSICAL_ADDRESS new_buffer = 0x1; // Make this 0x100000000 to only operate above 4GB
 
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-  {
-    if(Piece->Type == EfiConventionalMemory)
-    {
-      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
-    }
-  }
+  new_buffer = VAllocateFreeAddress(numbytes, new_buffer, (256ULL << 40));
 
-  return running_total;
+  return (void*)new_buffer;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  GetFreePersistentRam: Calculate Total Free Non-Volatile System RAM
+//  vcalloc: Allocate Virtual Memory with Alignment
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Calculates the total EfiPersistentMemory from the UEFI system memory map.
+// Dynamically allocate virtual memory aligned to the nearest suitable address alignment value
+//
+// This is just an alias for vmalloc that takes the calloc(3) syntax. It's just the virtual memory version of calloc() above.
+//
+// elements: number of elements in array
+// size: size of each element
 //
 
-uint64_t GetFreePersistentRam(void)
+void * vcalloc(size_t elements, size_t size)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  uint64_t running_total = 0;
-
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-  {
-    if(Piece->Type == EfiPersistentMemory)
-    {
-      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
-    }
-  }
+  size_t total_size = elements * size; // This is fine if size_t is 64-bits, which is true of all intended targets of this framework.
+  void * new_buffer = vmalloc(total_size);
 
-  return running_total;
+  return new_buffer;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  GetInstalledSystemRam: Get Total Installed System Ram
+//  vrealloc: Reallocate Virtual Memory with Alignment
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Uses SMBIOS tables to report the installed RAM quantity. The UEFI/BIOS calculates the installed memory by directly reading the SPD
-// EEPROM, but not all system vendors correctly report system configuration information via SMBIOS, which does have a field for memory.
-// So if SMBios doesn't work, this falls back to GuessInstalledSystemRam().
+// Dynamically reallocate memory for an existing pointer from vmalloc, and vfree the old region (if moved)
 //
-// In Windows' msinfo32 utility, the "Installed Physical Memory (RAM)" value is what this number is, and it's really just for
-// informational purposes (the OS itself cares much more about the entire physical address space, not just the RAM part of it).
+// allocated_address: The pointer allocated from vmalloc
+// size: The new desired size
 //
-// Value returned is in bytes.
+// NOTE: Unlike realloc(3), NULL pointer here is actually a valid address at 0x0. Therefore passing in a NULL pointer as
+// allocated_address is the same as passing in address 0x0, which could be an actual allocated region. So don't do it.
+// Passing in a size of 0, however, will cause vfree() to be run and will result in a return address of ~2ULL.
 //
 
-uint64_t GetInstalledSystemRam(EFI_CONFIGURATION_TABLE * ConfigurationTables, UINTN NumConfigTables)
+void * vrealloc(void * allocated_address, size_t size)
 {
-  uint64_t systemram = 0;
-  uint8_t smbiostablefound = 0;
-
-  for(uint64_t configtable_iter = 0; configtable_iter < NumConfigTables; configtable_iter++)
+  if(size == 0)
   {
-    if(!(AVX_memcmp(&ConfigurationTables[configtable_iter].VendorGuid, &Smbios3TableGuid, 16, 0)))
-    {
-      printf("SMBIOS 3.x table found!\r\n");
-      smbiostablefound = 3;
-
-       SMBIOS_TABLE_3_0_ENTRY_POINT * smb3_entry = (SMBIOS_TABLE_3_0_ENTRY_POINT*)ConfigurationTables[configtable_iter].VendorTable;
-       SMBIOS_STRUCTURE * smb_header = (SMBIOS_STRUCTURE*)smb3_entry->TableAddress;
-       uint8_t* smb3_end = (uint8_t *)(smb3_entry->TableAddress + (uint64_t)smb3_entry->TableMaximumSize);
+    vfree(allocated_address);
+    return ((void*) ~2ULL);
+  }
 
-       while((uint8_t*)smb_header < smb3_end)
-       {
-         if(smb_header->Type == 17) // Memory socket/device
-         {
-           uint16_t smb_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->Size;
-           if(smb_socket_size == 0x7FFF) // Need extended size, which is always given in MB units
-           {
-             uint32_t smb_extended_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->ExtendedSize;
-             systemram += (uint64_t)smb_extended_socket_size << 20;
-           }
-           else if(smb_socket_size != 0xFFFF)
-           {
-             if(smb_socket_size & 0x8000) // KB units
-             {
-               systemram += (uint64_t)smb_socket_size << 10;
-             }
-             else // MB units
-             {
-               systemram += (uint64_t)smb_socket_size << 20;
-             }
-           }
-           // Otherwise size is unknown (0xFFFF), don't add it.
-         }
+  // Reservations from vreserve() aren't in the memory map
+  uint64_t region_index = demand_region_find((EFI_VIRTUAL_ADDRESS)allocated_address);
+  if((region_index != ~0ULL) && (Global_Demand_Paging.Region[region_index].VirtualStart == (EFI_VIRTUAL_ADDRESS)allocated_address))
+  {
+    return demand_region_resize(region_index, size);
+  }
 
-         smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + smb_header->Length);
-         while(*(uint16_t*)smb_header != 0x0000) // Check for double null, meaning end of string set
-         {
-           smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 1);
-         }
-         smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 2); // Found end of current structure, move to start of next one
-       }
+  EFI_MEMORY_DESCRIPTOR * Piece;
 
-      break;
-    }
-  }
+  size_t numpages = EFI_SIZE_TO_PAGES(size);
+  size_t orig_numpages = 0;
 
-  if(smbiostablefound != 3)
+  // Check for vmalloc in the map, we need the old size
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    for(uint64_t configtable_iter = 0; configtable_iter < NumConfigTables; configtable_iter++)
+    // Within each compatible vmalloc type, check the address
+    if((Piece->Type == (EfiMaxMemoryType + 2)) && ((uint8_t*)Piece->VirtualStart == (uint8_t*)allocated_address))
     {
-      if(!(AVX_memcmp(&ConfigurationTables[configtable_iter].VendorGuid, &SmbiosTableGuid, 16, 0)))
-      {
-        printf("SMBIOS table found!\r\n");
-        smbiostablefound = 1;
+      // Found it
+      orig_numpages = Piece->NumberOfPages;
 
-        SMBIOS_TABLE_ENTRY_POINT * smb_entry = (SMBIOS_TABLE_ENTRY_POINT*)ConfigurationTables[configtable_iter].VendorTable;
-        SMBIOS_STRUCTURE * smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_entry->TableAddress);
-        uint8_t* smb_end = (uint8_t *)((uint64_t)smb_entry->TableAddress + (uint64_t)smb_entry->TableLength);
+      if(numpages > orig_numpages) // Grow
+      { // Can the vmalloc area be expanded into adjacent EfiConventionalMemory?
+        // Is the next piece an EfiConventionalMemory region?
 
-        while((uint8_t*)smb_header < smb_end)
+        size_t additional_numpages = numpages - orig_numpages;
+        // If the area right after the vmalloc region is EfiConventionalMemory, we might be able to just take some pages from there...
+
+        // Check if there's an EfiConventionalMemory region adjacent in memory to the memmap region
+        EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
+        EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+
+        // Quick check for adjacency that will skip scanning the whole memmap
+        // Can provide a little speed boost for ordered memory maps
+        if(
+            (Next_Piece->VirtualStart != VirtualEnd)
+            ||
+            ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+          ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
         {
-          if(smb_header->Type == 17) // Memory socket/device
+          // See if VirtualEnd matches any VirtualStart for unordered maps
+          for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
           {
-            uint16_t smb_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->Size;
-            if(smb_socket_size == 0x7FFF) // Need extended size, which is always given in MB units
-            {
-              uint32_t smb_extended_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->ExtendedSize;
-              systemram += (uint64_t)smb_extended_socket_size << 20;
-            }
-            else if(smb_socket_size != 0xFFFF)
+            if(VirtualEnd == Next_Piece->VirtualStart)
             {
-              if(smb_socket_size & 0x8000) // KB units
-              {
-                systemram += (uint64_t)smb_socket_size << 10;
-              }
-              else // MB units
-              {
-                systemram += (uint64_t)smb_socket_size << 20;
-              }
+              // Found one
+              break;
             }
-            // Otherwise size is unknown (0xFFFF), don't add it.
-          }
-
-          smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + smb_header->Length);
-          while(*(uint16_t*)smb_header != 0x0000) // Check for double null, meaning end of string set
-          {
-            smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 1);
           }
-          smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 2); // Found end of current structure, move to start of next one
         }
 
-        break;
-      }
-    }
-  }
+        // Is the next piece an EfiConventionalMemory type?
+        if(
+            (Next_Piece->Type == EfiConventionalMemory) && (Next_Piece->NumberOfPages >= additional_numpages)
+            &&
+            ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+          ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
+        {
+          // The bottom of the next piece is about to be taken
+          freeindex_carve(Next_Piece->PhysicalStart, additional_numpages);
+          zeropool_claim(Next_Piece->PhysicalStart, additional_numpages, 0);
 
-  if(systemram < GetVisibleSystemRam())
-  {
-    info_printf("No SMBIOS tables or incorrect SMBIOS data found. Approximating RAM...\r\n");
-    systemram = GuessInstalledSystemRam();
-  }
+          if(Next_Piece->NumberOfPages > additional_numpages)
+          {
+            // Modify MemMap's entry
+            Piece->NumberOfPages = numpages;
 
-  return systemram;
-}
+            // Modify adjacent EfiConventionalMemory's entry
+            Next_Piece->NumberOfPages -= additional_numpages;
+            Next_Piece->PhysicalStart += (additional_numpages << EFI_PAGE_SHIFT);
+            Next_Piece->VirtualStart += (additional_numpages << EFI_PAGE_SHIFT);
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  GuessInstalledSystemRam: Attempt to Infer Total Installed System Ram
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// Infers a value for the total installed system RAM from the UEFI memory map. This is basically an attempt to account for memory
-// holes that aren't remapped by the motherboard chipset. The UEFI/BIOS calculates the installed memory by directly reading the SPD
-// EEPROM, but not all system vendors correctly report system configuration information via SMBIOS, which does have a field for memory.
+            // Done
+          }
+          else if(Next_Piece->NumberOfPages == additional_numpages)
+          { // If the next piece is exactly the number of pages, we can claim it and reclaim a descriptor
+            // This just means that MemMap will have some wiggle room for the next time it needs to be modified.
+
+            // Modify MemMap's entry
+            Piece->NumberOfPages = numpages;
+
+            // Erase the claimed descriptor
+            // Zero out the piece we just claimed
+            AVX_memset(Next_Piece, 0, Global_Memory_Info.MemMapDescriptorSize); // Next_Piece is a pointer
+            AVX_memmove(Next_Piece, (uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize));
+
+            // Update Global_Memory_Info
+            Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+
+            // Zero out the entry that used to be at the end of the map
+            AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+
+            // Done
+          }
+          // There is no else, as there are only > and == cases.
+          else
+          {
+            error_printf("vrealloc: What kind of sorcery is this? Seeing this means there's a bug in vrealloc.\r\n");
+            // And also probably MemMap_Prep()...
+            HaCF();
+          }
+        }
+        else // Nope, need to move it altogether. But that's really easy to do for vmalloc. :)
+        {
+          // Get a new address
+          void * new_address = vmalloc(size);
+          if((EFI_VIRTUAL_ADDRESS)new_address == ~0ULL)
+          {
+            error_printf("vrealloc: Insufficient free memory, could not reallocate increased size.\r\n");
+            return new_address; // Better to return this invalid address than to return allocated_address
+          }
+          //
+          // NOTE: Any function call that includes a call to MemMap_Prep() renders "Piece" unusable afterwards.
+          // This is because it can no longer be guaranteed that the memory map is in the same place as before;
+          // MemMap_Prep() might have changed its location.
+          //
+
+          // Move the old memory to the new area
+          AVX_memmove(new_address, allocated_address, (orig_numpages << EFI_PAGE_SHIFT)); // Need size in bytes
+
+          // Free the old address
+          vfree(allocated_address);
+
+          // Done
+          return new_address; // This is one of the few times an early return is used instead of break outside of an error
+        }
+        // Grow done
+      }
+      else if(numpages < orig_numpages) // Shrink
+      {
+        // Is the next piece an EfiConventionalMemory region?
+        // If the area right after the vmalloc region is EfiConventionalMemory, we might be able to just give it the freed pages
+        size_t freedpages = orig_numpages - numpages;
+
+        // Check if there's an EfiConventionalMemory region adjacent in memory to the vmalloc region
+        EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
+        EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+
+        // Quick check for adjacency that will skip scanning the whole memmap
+        // Can provide a little speed boost for ordered memory maps
+        if(
+            (Next_Piece->VirtualStart != VirtualEnd)
+            ||
+            ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+          ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
+        {
+          // See if VirtualEnd matches any VirtualStart for unordered maps
+          for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
+          {
+            if(VirtualEnd == Next_Piece->VirtualStart)
+            {
+              // Found one
+              break;
+            }
+          }
+        }
+
+        // Is the next piece an EfiConventionalMemory type?
+        if(
+            (Next_Piece->Type == EfiConventionalMemory)
+            &&
+            ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+          ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
+        { // Yes, we can reclaim without requiring a new entry
+
+          // Modify vmalloc area's entry
+          Piece->NumberOfPages = numpages;
+
+          // Modify adjacent EfiConventionalMemory's entry
+          freeindex_remove(Next_Piece->PhysicalStart);
+          Next_Piece->NumberOfPages += freedpages;
+          Next_Piece->PhysicalStart -= (freedpages << EFI_PAGE_SHIFT);
+          Next_Piece->VirtualStart -= (freedpages << EFI_PAGE_SHIFT);
+          freeindex_insert(Next_Piece->PhysicalStart, Next_Piece->NumberOfPages);
+          zeropool_release(Next_Piece->PhysicalStart, freedpages); // The freed pages weren't zeroed
+
+          // Done. Nice.
+        }
+        // No, we need a new memmap entry, which will require a new page if the last entry is on a page edge or would spill over a page edge. Better to be safe then sorry!
+        // First, maybe there's room for another descriptor in the last page
+        else if((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) <= (numpages << EFI_PAGE_SHIFT))
+        { // Yes, we can reclaim and fit in another descriptor
+
+          // Make a temporary descriptor to hold current vmalloc entry's values
+          EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+          new_descriptor_temp.Type = Piece->Type; // Special vmalloc type
+          new_descriptor_temp.Pad = Piece->Pad;
+          new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+          new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+          new_descriptor_temp.NumberOfPages = numpages; // New size of vmalloc entry
+          new_descriptor_temp.Attribute = Piece->Attribute;
+
+          // Modify the descriptor-to-move
+          Piece->Type = EfiConventionalMemory;
+          // No pad change
+          Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+          Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+          Piece->NumberOfPages = freedpages;
+          // No attribute change
+          freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+          zeropool_release(Piece->PhysicalStart, Piece->NumberOfPages); // The freed pages weren't zeroed
+
+          // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+          AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+
+          // Insert the new piece (by overwriting the now-duplicated entry with new values)
+          // I.e. turn this piece into what was stored in the temporary descriptor above
+          Piece->Type = new_descriptor_temp.Type;
+          Piece->Pad = new_descriptor_temp.Pad;
+          Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+          Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+          Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+          Piece->Attribute = new_descriptor_temp.Attribute;
+
+          // Update Global_Memory_Info MemMap size
+          Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+
+          // Done
+        }
+        // No, it would spill over to a new page
+        else
+        {
+          // Do we have more than a descriptor's worth of pages reclaimable?
+          size_t pages_per_memory_descriptor = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapDescriptorSize);
+
+          if((numpages + pages_per_memory_descriptor) < orig_numpages)
+          { // Yes, so we can hang on to one [set] of them and make a new EfiConventionalMemory entry for the rest.
+            freedpages -= pages_per_memory_descriptor;
+
+            // Make a temporary descriptor to hold current vmalloc entry's values
+            EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+            new_descriptor_temp.Type = Piece->Type; // Special vmalloc type
+            new_descriptor_temp.Pad = Piece->Pad;
+            new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+            new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+            new_descriptor_temp.NumberOfPages = numpages + pages_per_memory_descriptor; // New size of vmalloc entry
+            new_descriptor_temp.Attribute = Piece->Attribute;
+
+            // Modify the descriptor-to-move
+            Piece->Type = EfiConventionalMemory;
+            // No pad change
+            Piece->PhysicalStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
+            Piece->VirtualStart += ((numpages + pages_per_memory_descriptor) << EFI_PAGE_SHIFT);
+            Piece->NumberOfPages = freedpages;
+            // No attribute change
+            freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+            zeropool_release(Piece->PhysicalStart, Piece->NumberOfPages); // The freed pages weren't zeroed
+
+            // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+            AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+
+            // Insert the new piece (by overwriting the now-duplicated entry with new values)
+            // I.e. turn this piece into what was stored in the temporary descriptor above
+            Piece->Type = new_descriptor_temp.Type;
+            Piece->Pad = new_descriptor_temp.Pad;
+            Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+            Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+            Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+            Piece->Attribute = new_descriptor_temp.Attribute;
+
+            // Update Global_Memory_Info MemMap size
+            Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+          }
+          // No, only 1 [set of] page(s) was reclaimable and adding another entry would spill over. So don't do anything then and hang on to the extra empty page(s).
+        }
+        // Shrink done
+      }
+      // else:
+      // Nothing to be done if equal.
+
+      break;
+    } // End "found it"
+  } // End for
+
+#ifdef MEMORY_CHECK_INFO
+  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  {
+    error_printf("vrealloc: Piece not found.\r\n");
+    return (void*) ~3ULL;
+  }
+#endif
+
+  return allocated_address;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  vfree: Free A Virtual Memory Address from VAllocateFreeAddress (vmalloc)
+//----------------------------------------------------------------------------------------------------------------------------------
 //
-// This would be useful for systems that don't have a reliable way to get RAM size from the firmware.
+// Frees addresses allocated by VAllocateFreeAddress, as well as reservations from vreserve() along with any RAM mapped into them
 //
-// Value returned is in bytes.
+// allocated_address: pointer from VAllocateFreeAddress or vreserve() (therefore also vmalloc...)
 //
 
-uint64_t GuessInstalledSystemRam(void)
+void vfree(void * allocated_address)
 {
-  uint64_t ram = GetVisibleSystemRam();
-  ram += (63 << 20); // The minimum DDR3 size is 64MB, so it seems like a reasonable offset.
-  return (ram & ~((64 << 20) - 1)); // This method will discard quantities < 64MB, but no one using x86 these days should be so limited.
+  // Reservations from vreserve() aren't in the memory map
+  uint64_t region_index = demand_region_find((EFI_VIRTUAL_ADDRESS)allocated_address);
+  if((region_index != ~0ULL) && (Global_Demand_Paging.Region[region_index].VirtualStart == (EFI_VIRTUAL_ADDRESS)allocated_address))
+  {
+    demand_region_unmap(region_index, 0);
+    demand_region_forget(region_index);
+    return;
+  }
+
+  // Locate area
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
+  for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if((Piece->Type == (EfiMaxMemoryType + 2)) && (Piece->VirtualStart == (uint64_t)allocated_address))
+    { // Found it, Piece holds the spot now.
+      break;
+    }
+  }
+
+  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  {
+#ifdef MEMORY_CHECK_INFO
+    error_printf("vfree: Piece not found.\r\n");
+#endif
+    return;
+  }
+
+  if(Global_Zero_Pool.Enabled)
+  {
+    // Leave the zeroing to ZeroDirtyPages() or to whatever allocates this next
+    zeropool_release(Piece->PhysicalStart, Piece->NumberOfPages);
+  }
+  else
+  {
+    // Zero out the destination
+    AVX_memset_parallel(allocated_address, 0, Piece->NumberOfPages << EFI_PAGE_SHIFT); // allocated_address is already a pointer
+  }
+
+  // Reclaim as EfiConventionalMemory
+  Piece->Type = EfiConventionalMemory;
+  freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+
+  // Merge with free neighbors, if there are any
+  coalesce_conventional(Piece);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  print_system_memmap: The Ultimate Debugging Tool
+//  Setup_DemandPaging: Set Up Address Space for Demand-Paged Reservations
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Get the system memory map, parse it, and print it. Print the whole thing.
+// On their own, vmalloc() and friends hand out memory map pages, and the identity map from Setup_Paging() makes their virtual
+// addresses the same as their physical ones. Reserving a big virtual area that way eats the same amount of RAM up front. Reservations
+// made with vreserve() come out of address space above the identity map instead, where nothing is mapped at all. vmalloc() uses
+// vreserve() for anything DEMAND_PAGING_MIN_SIZE or larger once this has run. The first touch of each 4kB page of a reservation faults,
+// and PF_EXC_handler() calls demand_page_fault() to map a zeroed page there before the faulting instruction runs again. Hundreds of GB
+// can be reserved for a sparse structure this way, and only the pages that actually get touched cost any RAM.
+//
+// The window starts at the first 512GB boundary above the highest mapped physical address, so it never shares a PML4 entry with the
+// identity map. It ends at the top of the lower canonical half (128TB with 4-level paging, 64PB with 5-level paging).
+//
+// With DEMAND_PAGING_PROMOTE defined (the default), vmalloc() reservations also get each 2MB range remapped as a single 2MB page once
+// all 512 of its 4kB pages have been touched, which saves a page table and TLB entries. Every x86-64 CPU can map 2MB pages, so
+// this is purely a choice: leave it off to keep RAM use at exactly what's been touched when ranges are only ever partly freed.
+//
+// This needs to run after Setup_Paging(), since the tables in CR3 from then on are the ones reservations get mapped into.
 //
 
-/* Reminder of EFI_MEMORY_DESCRIPTOR format:
+void Setup_DemandPaging(void)
+{
+  Global_Demand_Paging.PagingLevels = (control_register_rw(4, 0, 0) & (1 << 12)) ? 5 : 4; // CR4.LA57
+  Global_Demand_Paging.WindowStart = (GetMaxMappedPhysicalAddress() + ((512ULL << 30) - 1)) & ~((512ULL << 30) - 1);
+  Global_Demand_Paging.WindowEnd = (Global_Demand_Paging.PagingLevels == 5) ? (1ULL << 56) : (1ULL << 47);
+
+#ifdef DEMAND_PAGING_PROMOTE
+  Global_Demand_Paging.Promote = 1;
+#else
+  Global_Demand_Paging.Promote = 0;
+#endif
 
-typedef UINT64          EFI_PHYSICAL_ADDRESS;
-typedef UINT64          EFI_VIRTUAL_ADDRESS;
+  if(Global_Demand_Paging.WindowStart >= Global_Demand_Paging.WindowEnd)
+  {
+    warning_printf("Setup_DemandPaging: No address space above the identity map. vmalloc() will only use the memory map.\r\n");
+    return;
+  }
 
-#define EFI_MEMORY_DESCRIPTOR_VERSION  1
-typedef struct {
-    UINT32                          Type;           // Field size is 32 bits followed by 32 bit pad
-    UINT32                          Pad;            // There's no pad in the spec...
-    EFI_PHYSICAL_ADDRESS            PhysicalStart;  // Field size is 64 bits
-    EFI_VIRTUAL_ADDRESS             VirtualStart;   // Field size is 64 bits
-    UINT64                          NumberOfPages;  // Field size is 64 bits
-    UINT64                          Attribute;      // Field size is 64 bits
-} EFI_MEMORY_DESCRIPTOR;
-*/
+  Global_Demand_Paging.Enabled = 1;
+}
 
-// This array should match the EFI_MEMORY_TYPE enum in EfiTypes.h. If it doesn't, maybe the spec changed and this needs to be updated.
-// This is a file scope global variable, which lets it be declared static. This prevents a stack overflow that could arise if it were
-// local to its function of use. Static arrays defined like this can actually be made very large, but they cannot be accessed by any
-// functions that are not explicitly defined in this file. It cannot be passed as an argument to outside functions, either.
-static const char mem_types[21][27] = {
-    "EfiReservedMemoryType     ",
-    "EfiLoaderCode             ",
-    "EfiLoaderData             ",
-    "EfiBootServicesCode       ",
-    "EfiBootServicesData       ",
-    "EfiRuntimeServicesCode    ",
-    "EfiRuntimeServicesData    ",
-    "EfiConventionalMemory     ",
-    "EfiUnusableMemory         ",
-    "EfiACPIReclaimMemory      ",
-    "EfiACPIMemoryNVS          ",
-    "EfiMemoryMappedIO         ",
-    "EfiMemoryMappedIOPortSpace",
-    "EfiPalCode                ",
-    "EfiPersistentMemory       ",
-    "EfiMaxMemoryType          ",
-    "malloc                    ", // EfiMaxMemoryType + 1
-    "vmalloc                   ", // EfiMaxMemoryType + 2
-    "Memory Map                ", // EfiMaxMemoryType + 3
-    "Page Tables               ", // EfiMaxMemoryType + 4
-    "Null Area                 "  // EfiMaxMemoryType + 5
-};
+//----------------------------------------------------------------------------------------------------------------------------------
+//  vreserve: Reserve Virtual Address Space to Be Mapped on First Touch
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Sets aside numbytes of address space in the demand paging window (see Setup_DemandPaging()) without mapping any of it. Pages get
+// mapped, zeroed, by demand_page_fault() as they're touched, and vfree() gives back the address space and whatever RAM ended up behind
+// it. vrealloc() works on reservations, too.
+//
+// numbytes: size of the reservation, rounded up to the next 4kB page (touching anything past that is still a real page fault)
+// byte_alignment: power-of-2 alignment of the returned address, 2MB at minimum
+// promote: 1 to have each 2MB range that gets completely touched remapped as one 2MB page, 0 to keep everything in 4kB pages
+//
+// Returns ~0ULL as a pointer if demand paging isn't set up, the window has no room, or DEMAND_PAGING_MAX_REGIONS reservations already
+// exist.
+//
+// NOTE: Like the rest of the vmalloc() family, this assumes only one core uses it at a time.
+//
 
-void print_system_memmap(void)
+void * vreserve(size_t numbytes, uint64_t byte_alignment, uint8_t promote)
 {
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  uint16_t line = 0;
+  if((!Global_Demand_Paging.Enabled) || (numbytes == 0) || (Global_Demand_Paging.NumRegions == DEMAND_PAGING_MAX_REGIONS))
+  {
+    return (void*)~0ULL;
+  }
 
-  printf("MemMap: %#qx, MemMapSize: %qu, MemMapDescriptorSize: %qu, MemMapDescriptorVersion: %u\r\n", Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize, Global_Memory_Info.MemMapDescriptorSize, Global_Memory_Info.MemMapDescriptorVersion);
+  if(byte_alignment < (2ULL << 20))
+  {
+    byte_alignment = 2ULL << 20; // Reservations never share a page table, which keeps unmapping and promotion simple
+  }
 
-  // Multiply NumOfPages by EFI_PAGE_SIZE or do (NumOfPages << EFI_PAGE_SHIFT) to get the end address... which should just be the start of the next section.
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  if(numbytes > (Global_Demand_Paging.WindowEnd - Global_Demand_Paging.WindowStart))
   {
-    if(line%20 == 0)
+    return (void*)~0ULL;
+  }
+
+  uint64_t extent = (numbytes + ((2ULL << 20) - 1)) & ~((2ULL << 20) - 1);
+
+  // First fit between existing reservations, which are sorted by address
+  EFI_VIRTUAL_ADDRESS candidate = (Global_Demand_Paging.WindowStart + (byte_alignment - 1)) & ~(byte_alignment - 1);
+  uint64_t index = 0;
+
+  while((index < Global_Demand_Paging.NumRegions) && ((candidate + extent + DEMAND_PAGING_GUARD_SIZE) > Global_Demand_Paging.Region[index].VirtualStart))
+  {
+    candidate = (demand_region_end(index) + DEMAND_PAGING_GUARD_SIZE + (byte_alignment - 1)) & ~(byte_alignment - 1);
+    index++;
+  }
+
+  if((candidate + extent) > Global_Demand_Paging.WindowEnd)
+  {
+    return (void*)~0ULL;
+  }
+
+  // Make room at index
+  AVX_memmove(&Global_Demand_Paging.Region[index + 1], &Global_Demand_Paging.Region[index], (Global_Demand_Paging.NumRegions - index) * sizeof(DEMAND_PAGING_REGION));
+  Global_Demand_Paging.NumRegions++;
+
+  DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+  Region->VirtualStart = candidate;
+  Region->NumberOfPages = EFI_SIZE_TO_PAGES(numbytes);
+  Region->Alignment = byte_alignment;
+  Region->MappedPages = 0;
+  Region->Promote = promote;
+
+  return (void*)candidate;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_page_fault: Map In a Page of a Reservation on First Touch
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// PF_EXC_handler() calls this for not-present page faults. If fault_address is inside a reservation from vreserve(), a zeroed 4kB page
+// from malloc4KB() gets mapped there, along with any page tables needed to reach it. Returning from the exception then retries the
+// faulting instruction. If the reservation was made with promote = 1 and that filled in the last hole of a 2MB range, the range is
+// copied into one page from malloc2MB() and remapped with a single page directory entry (see demand_promote()).
+//
+// Returns 0 if the fault was handled, 1 if the address isn't in a reservation or there's no RAM left to back it (in which case it's a
+// real page fault).
+//
+// NOTE: The allocator lock is recursive, so a core that faults on a reservation in the middle of malloc() or free() would get into the
+// allocators a second time. Reservations should never be handed to the allocators themselves.
+//
+
+uint8_t demand_page_fault(EFI_VIRTUAL_ADDRESS fault_address)
+{
+  uint64_t index = demand_region_find(fault_address);
+  if(index == ~0ULL)
+  {
+    return 1;
+  }
+
+  DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+
+  uint64_t * pd_entry = demand_pd_entry(fault_address, 1);
+  if(pd_entry == NULL)
+  {
+    return 1;
+  }
+
+  if(!(*pd_entry & 0x1))
+  {
+    void * page_table = malloc4KB(EFI_PAGE_SIZE); // Comes back zeroed, i.e. with nothing present
+    if((EFI_PHYSICAL_ADDRESS)page_table == ~0ULL)
     {
-      printf("#   Memory Type                 Phys Addr Start      Virt Addr Start  Num Of Pages   Attr\r\n");
+      return 1;
+    }
+    *pd_entry = (uint64_t)page_table | 0x3; // Flags: NX[63] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1. Present count in 61:52 starts at 0.
+  }
+  else if(*pd_entry & 0x80)
+  {
+    // Already a 2MB page, so whatever this is, it isn't a missing page
+    return 1;
+  }
+
+  uint64_t * pt_entry = &((uint64_t*)(*pd_entry & PAGE_ENTRY_ADDRESS_MASK))[(fault_address >> 12) & 0x1FF];
+  if(*pt_entry & 0x1)
+  {
+    // Nothing left to do, the access will go through this time
+    return 0;
+  }
+
+  void * frame = malloc4KB(EFI_PAGE_SIZE); // Also comes back zeroed
+  if((EFI_PHYSICAL_ADDRESS)frame == ~0ULL)
+  {
+    return 1;
+  }
+
+  *pt_entry = (uint64_t)frame | 0x3; // Flags: NX[63] = 0, G[8] = 0, PAT[7] = 0, D[6] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1.
+  *pd_entry += (1ULL << DEMAND_PDE_COUNT_SHIFT);
+  Region->MappedPages++;
+  Global_Demand_Paging.Faults++;
+
+  // A range can only fill up if it's entirely inside the reservation, since nothing outside of it ever gets mapped
+  if(Region->Promote && ((*pd_entry & DEMAND_PDE_COUNT_MASK) == (512ULL << DEMAND_PDE_COUNT_SHIFT)))
+  {
+    demand_promote(pd_entry, fault_address & ~((2ULL << 20) - 1));
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_promote: Remap a Fully-Populated 2MB Range as One 2MB Page
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Copies the 512 4kB pages behind pd_entry into one 2MB page and points pd_entry straight at it, which takes 511 entries' worth of
+// pressure off the TLB. The 4kB pages and their page table go back to the allocators afterwards. If there's no 2MB page to be had, the
+// range just stays in 4kB pages.
+//
+// pd_entry: the page directory entry of a full page table in a reservation
+// range_base: 2MB-aligned virtual address that pd_entry maps
+//
+
+static void demand_promote(uint64_t * pd_entry, EFI_VIRTUAL_ADDRESS range_base)
+{
+  void * large_page = malloc2MB(2ULL << 20);
+  if((EFI_PHYSICAL_ADDRESS)large_page == ~0ULL)
+  {
+    return;
+  }
+
+  uint64_t * page_table = (uint64_t*)(*pd_entry & PAGE_ENTRY_ADDRESS_MASK);
+
+  // Copy through the identity map, since the frames are physical addresses
+  for(uint64_t pt_index = 0; pt_index < 512; pt_index++)
+  {
+    AVX_memcpy((uint8_t*)large_page + (pt_index << EFI_PAGE_SHIFT), (void*)(page_table[pt_index] & PAGE_ENTRY_ADDRESS_MASK), EFI_PAGE_SIZE);
+  }
+
+  *pd_entry = (uint64_t)large_page | 0x83; // Flags: NX[63] = 0, PAT[12] = 0, G[8] = 0, 2MB[7] = 1, D[6] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1.
+  demand_flush(range_base, 512);
+
+  // Nothing can reach the old pages anymore
+  for(uint64_t pt_index = 0; pt_index < 512; pt_index++)
+  {
+    free((void*)(page_table[pt_index] & PAGE_ENTRY_ADDRESS_MASK));
+  }
+  free(page_table);
+
+  Global_Demand_Paging.Promotions++;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_pd_entry: Find the Page Directory Entry Covering a Reserved Address
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Walks the page tables in CR3 down to the page directory entry for the 2MB range virtual_address is in. If create is 1, missing tables
+// along the way are allocated with malloc4KB().
+//
+// Returns NULL if a table is missing and create is 0, if a table couldn't be allocated, or if the address is inside a 1GB page (which
+// would mean it isn't in the demand paging window).
+//
+
+static uint64_t * demand_pd_entry(EFI_VIRTUAL_ADDRESS virtual_address, uint8_t create)
+{
+  uint64_t * table = (uint64_t*)(control_register_rw(3, 0, 0) & PAGE_ENTRY_ADDRESS_MASK);
+
+  // PML5 index is bits 56:48, PML4 is 47:39, PDP is 38:30, and PD is 29:21
+  for(uint64_t shift = 9*Global_Demand_Paging.PagingLevels + 3; shift > 21; shift -= 9)
+  {
+    uint64_t * entry = &table[(virtual_address >> shift) & 0x1FF];
+
+    if(!(*entry & 0x1))
+    {
+      if(!create)
+      {
+        return NULL;
+      }
+
+      void * new_table = malloc4KB(EFI_PAGE_SIZE); // Comes back zeroed, i.e. with nothing present
+      if((EFI_PHYSICAL_ADDRESS)new_table == ~0ULL)
+      {
+        return NULL;
+      }
+      *entry = (uint64_t)new_table | 0x3; // Flags: NX[63] = 0, A[5] = 0, PCD[4] = 0, PWT[3] = 0, U/S[2] = 0, R/W[1] = 1, P[0] = 1.
+    }
+    else if(*entry & 0x80) // 1GB page
+    {
+      return NULL;
+    }
+
+    table = (uint64_t*)(*entry & PAGE_ENTRY_ADDRESS_MASK);
+  }
+
+  return &table[(virtual_address >> 21) & 0x1FF];
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_translate: Get the Physical Address Behind a Reserved Address
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the physical address mapped at virtual_address, or ~0ULL if that page of the reservation hasn't been touched yet. Unlike
+// reading through virtual_address, this never faults a page in.
+//
+
+static EFI_PHYSICAL_ADDRESS demand_translate(EFI_VIRTUAL_ADDRESS virtual_address)
+{
+  uint64_t * pd_entry = demand_pd_entry(virtual_address, 0);
+  if((pd_entry == NULL) || !(*pd_entry & 0x1))
+  {
+    return ~0ULL;
+  }
+
+  if(*pd_entry & 0x80) // 2MB page
+  {
+    return (*pd_entry & 0x000FFFFFFFE00000) + (virtual_address & ((2ULL << 20) - 1));
+  }
+
+  uint64_t pt_entry = ((uint64_t*)(*pd_entry & PAGE_ENTRY_ADDRESS_MASK))[(virtual_address >> 12) & 0x1FF];
+  if(!(pt_entry & 0x1))
+  {
+    return ~0ULL;
+  }
+
+  return (pt_entry & PAGE_ENTRY_ADDRESS_MASK) + (virtual_address & (EFI_PAGE_SIZE - 1));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_flush: Drop Stale Translations for Part of a Reservation
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Needed after anything present in a reservation is changed or unmapped (newly present entries don't need it, since the CPU doesn't
+// cache not-present ones). Small ranges get an invlpg per 4kB page; anything over DEMAND_PAGING_FLUSH_PAGES reloads CR3 instead, which
+// works because none of these mappings have the G bit set.
+//
+
+static void demand_flush(EFI_VIRTUAL_ADDRESS virtual_address, uint64_t pages)
+{
+  if(pages > DEMAND_PAGING_FLUSH_PAGES)
+  {
+    control_register_rw(3, control_register_rw(3, 0, 0), 1);
+    return;
+  }
+
+  for(; pages; pages--, virtual_address += EFI_PAGE_SIZE)
+  {
+    asm volatile("invlpg %[page]"
+                 : // No outputs
+                 : [page] "m" (*(uint8_t*)virtual_address) // Inputs
+                 : "memory" // Clobbers
+                );
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_tables_trim: Free Empty Page Tables Left Behind in Part of the Window
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Frees every page directory, and every table above one, that covers part of [start, end) and has nothing present in it. Tables that
+// still map something stay, including the identity map's, so this is safe to call on any range in the demand paging window. Page
+// tables are left to demand_region_unmap(). The caller needs to demand_flush() the range afterwards.
+//
+// table: a table covering 512 << shift bytes of address space, starting at table_base (from CR3: 0 and 9*PagingLevels + 3)
+// shift: log2 of how much address space each of table's entries covers (30 for a page directory pointer table, and so on)
+//
+// Returns 1 if table has nothing present in it afterwards, so the caller can free it too.
+//
+
+static uint8_t demand_tables_trim(uint64_t * table, EFI_VIRTUAL_ADDRESS table_base, uint64_t shift, EFI_VIRTUAL_ADDRESS start, EFI_VIRTUAL_ADDRESS end)
+{
+  uint8_t empty = 1;
+
+  for(uint64_t index = 0; index < 512; index++)
+  {
+    EFI_VIRTUAL_ADDRESS entry_base = table_base + (index << shift);
+
+    if(!(table[index] & 0x1))
+    {
+      continue;
+    }
+
+    // Only descend into tables (not 1GB pages) that overlap the range, and stop at page directories
+    if((shift > 21) && !(table[index] & 0x80) && (entry_base < end) && ((entry_base + (1ULL << shift)) > start))
+    {
+      if(demand_tables_trim((uint64_t*)(table[index] & PAGE_ENTRY_ADDRESS_MASK), entry_base, shift - 9, start, end))
+      {
+        free((void*)(table[index] & PAGE_ENTRY_ADDRESS_MASK));
+        table[index] = 0;
+        continue;
+      }
+    }
+
+    empty = 0;
+  }
+
+  return empty;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_region_find: Find the Reservation Containing an Address
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Binary search of Global_Demand_Paging.Region. Returns the index of the reservation that virtual_address is in, or ~0ULL if there
+// isn't one.
+//
+
+static uint64_t demand_region_find(EFI_VIRTUAL_ADDRESS virtual_address)
+{
+  uint64_t low = 0;
+  uint64_t high = Global_Demand_Paging.NumRegions;
+
+  while(low < high)
+  {
+    uint64_t middle = (low + high) >> 1;
+    DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[middle];
+
+    if(virtual_address < Region->VirtualStart)
+    {
+      high = middle;
+    }
+    else if(virtual_address >= (Region->VirtualStart + (Region->NumberOfPages << EFI_PAGE_SHIFT)))
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      return middle;
     }
+  }
+
+  return ~0ULL;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_region_end: Get the End of a Reservation's Address Space
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// A reservation owns every 2MB range it touches, so this is the end of its last 2MB range rather than the end of its last 4kB page.
+//
+
+static EFI_VIRTUAL_ADDRESS demand_region_end(uint64_t index)
+{
+  DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+
+  return Region->VirtualStart + (((Region->NumberOfPages << EFI_PAGE_SHIFT) + ((2ULL << 20) - 1)) & ~((2ULL << 20) - 1));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_region_unmap: Give Back the RAM Behind the Top of a Reservation
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Unmaps and frees everything in a reservation from page first_page up to the end of its address space, along with any page tables
+// that end up empty. Higher-level tables stay where they are for the next reservation to use. A 2MB page that's only partly above
+// first_page isn't worth splitting back up, so it stays mapped and the part being let go is zeroed instead.
+//
+
+static void demand_region_unmap(uint64_t index, uint64_t first_page)
+{
+  DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+  EFI_VIRTUAL_ADDRESS start = Region->VirtualStart + (first_page << EFI_PAGE_SHIFT);
+  EFI_VIRTUAL_ADDRESS end = demand_region_end(index);
+  EFI_VIRTUAL_ADDRESS virtual_address = start;
+
+  while(virtual_address < end)
+  {
+    EFI_VIRTUAL_ADDRESS range_base = virtual_address & ~((2ULL << 20) - 1);
+    EFI_VIRTUAL_ADDRESS range_end = range_base + (2ULL << 20);
+    uint64_t * pd_entry = demand_pd_entry(virtual_address, 0);
+
+    if((pd_entry != NULL) && (*pd_entry & 0x1))
+    {
+      if(*pd_entry & 0x80) // 2MB page
+      {
+        if(virtual_address == range_base)
+        {
+          free((void*)(*pd_entry & 0x000FFFFFFFE00000));
+          *pd_entry = 0;
+          Region->MappedPages -= 512;
+        }
+        else
+        {
+          AVX_memset((void*)((*pd_entry & 0x000FFFFFFFE00000) + (virtual_address - range_base)), 0, range_end - virtual_address);
+        }
+      }
+      else
+      {
+        uint64_t * page_table = (uint64_t*)(*pd_entry & PAGE_ENTRY_ADDRESS_MASK);
+
+        for(uint64_t pt_index = (virtual_address >> 12) & 0x1FF; pt_index < 512; pt_index++)
+        {
+          if(page_table[pt_index] & 0x1)
+          {
+            free((void*)(page_table[pt_index] & PAGE_ENTRY_ADDRESS_MASK));
+            page_table[pt_index] = 0;
+            *pd_entry -= (1ULL << DEMAND_PDE_COUNT_SHIFT);
+            Region->MappedPages--;
+          }
+        }
+
+        if(!(*pd_entry & DEMAND_PDE_COUNT_MASK))
+        {
+          free(page_table);
+          *pd_entry = 0;
+        }
+      }
+    }
+
+    virtual_address = range_end;
+  }
+
+  // The freed pages can't be handed out again before this, since nothing between here and the frees touches the reservation
+  if(end > start)
+  {
+    demand_flush(start, (end - start) >> EFI_PAGE_SHIFT);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_region_forget: Drop a Reservation's Entry
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Removes index from Global_Demand_Paging.Region, freeing up its address space. Whatever's still mapped there isn't touched, so this is
+// only for reservations that are already unmapped or whose mappings have been handed to another reservation.
+//
+
+static void demand_region_forget(uint64_t index)
+{
+  Global_Demand_Paging.NumRegions--;
+  AVX_memmove(&Global_Demand_Paging.Region[index], &Global_Demand_Paging.Region[index + 1], (Global_Demand_Paging.NumRegions - index) * sizeof(DEMAND_PAGING_REGION));
+  AVX_memset(&Global_Demand_Paging.Region[Global_Demand_Paging.NumRegions], 0, sizeof(DEMAND_PAGING_REGION));
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_region_resize: vrealloc() for Reservations
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Shrinking unmaps the pages past the new size and zeroes the rest of the new last page, if it's mapped. Growing just extends the
+// reservation if the address space after it is free. Otherwise a new reservation is made and the old one's page directory entries are
+// moved over to it, so the data moves without being copied and untouched pages still cost nothing.
+//
+// Returns the (possibly new) address of the reservation, or ~0ULL as a pointer if it had to move and couldn't. The old reservation is
+// still valid in that case, and the new one is gone again, along with any page tables that were made for it.
+//
+
+static void * demand_region_resize(uint64_t index, size_t size)
+{
+  DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+  EFI_VIRTUAL_ADDRESS old_address = Region->VirtualStart;
+  size_t numpages = EFI_SIZE_TO_PAGES(size);
+
+  if(numpages <= Region->NumberOfPages) // Shrink
+  {
+    demand_region_unmap(index, numpages);
+    Region->NumberOfPages = numpages;
+
+    EFI_PHYSICAL_ADDRESS tail = demand_translate(old_address + size);
+    if((size & (EFI_PAGE_SIZE - 1)) && (tail != ~0ULL))
+    {
+      AVX_memset((void*)tail, 0, EFI_PAGE_SIZE - (size & (EFI_PAGE_SIZE - 1)));
+    }
+
+    return (void*)old_address;
+  }
+
+  // Grow in place if the address space up to the new end isn't anyone else's
+  EFI_VIRTUAL_ADDRESS limit = ((index + 1) < Global_Demand_Paging.NumRegions) ? (Global_Demand_Paging.Region[index + 1].VirtualStart - DEMAND_PAGING_GUARD_SIZE) : Global_Demand_Paging.WindowEnd;
+  if((size <= (Global_Demand_Paging.WindowEnd - old_address)) && ((old_address + ((size + ((2ULL << 20) - 1)) & ~((2ULL << 20) - 1))) <= limit))
+  {
+    Region->NumberOfPages = numpages;
+    return (void*)old_address;
+  }
+
+  // Move
+  EFI_VIRTUAL_ADDRESS old_end = demand_region_end(index);
+  EFI_VIRTUAL_ADDRESS new_address = (EFI_VIRTUAL_ADDRESS)vreserve(size, Region->Alignment, (uint8_t)Region->Promote);
+  if(new_address == ~0ULL)
+  {
+    return (void*)new_address;
+  }
+
+  // vreserve() may have shifted the old entry
+  index = demand_region_find(old_address);
+  Region = &Global_Demand_Paging.Region[index];
+
+  // Build the tables the moved entries will go into first, so running out of RAM partway can't leave the data split between the two
+  for(EFI_VIRTUAL_ADDRESS virtual_address = old_address; virtual_address < old_end; virtual_address += (2ULL << 20))
+  {
+    uint64_t * old_pd_entry = demand_pd_entry(virtual_address, 0);
+    if((old_pd_entry != NULL) && (*old_pd_entry & 0x1) && (demand_pd_entry(new_address + (virtual_address - old_address), 1) == NULL))
+    {
+      // Nothing is mapped in the new reservation, so all there is to undo besides the entry is the tables made for it so far
+      uint64_t new_index = demand_region_find(new_address);
+      EFI_VIRTUAL_ADDRESS new_end = demand_region_end(new_index);
+
+      demand_region_forget(new_index);
+      demand_tables_trim((uint64_t*)(control_register_rw(3, 0, 0) & PAGE_ENTRY_ADDRESS_MASK), 0, 9*Global_Demand_Paging.PagingLevels + 3, new_address, new_end);
+      demand_flush(new_address, (new_end - new_address) >> EFI_PAGE_SHIFT);
+
+      return (void*)~0ULL;
+    }
+  }
+
+  // Both are 2MB-aligned, so each entry (2MB page or page table, present count and all) moves as a unit
+  for(EFI_VIRTUAL_ADDRESS virtual_address = old_address; virtual_address < old_end; virtual_address += (2ULL << 20))
+  {
+    uint64_t * old_pd_entry = demand_pd_entry(virtual_address, 0);
+    if((old_pd_entry != NULL) && (*old_pd_entry & 0x1))
+    {
+      *demand_pd_entry(new_address + (virtual_address - old_address), 0) = *old_pd_entry;
+      *old_pd_entry = 0;
+    }
+  }
+  demand_flush(old_address, (old_end - old_address) >> EFI_PAGE_SHIFT);
+
+  uint64_t mapped_pages = Region->MappedPages;
+  demand_region_forget(index);
+  Global_Demand_Paging.Region[demand_region_find(new_address)].MappedPages = mapped_pages;
+
+  return (void*)new_address;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  demand_paging_stats: Print Demand-Paged Reservations
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Shows each reservation with how much of it is actually backed by RAM, and how many page faults and 2MB promotions there have been.
+//
+
+void demand_paging_stats(void)
+{
+  if(!Global_Demand_Paging.Enabled)
+  {
+    printf("Demand paging is not set up.\r\n");
+    return;
+  }
+
+  printf("Demand paging window: %#qx - %#qx, %llu reservations\r\n", Global_Demand_Paging.WindowStart, Global_Demand_Paging.WindowEnd, Global_Demand_Paging.NumRegions);
+  for(uint64_t index = 0; index < Global_Demand_Paging.NumRegions; index++)
+  {
+    DEMAND_PAGING_REGION * Region = &Global_Demand_Paging.Region[index];
+    printf("%#qx: %llu of %llu pages mapped%s\r\n", Region->VirtualStart, Region->MappedPages, Region->NumberOfPages, Region->Promote ? ", promoting" : "");
+  }
+  printf("Faults: %llu, 2MB promotions: %llu\r\n", Global_Demand_Paging.Faults, Global_Demand_Paging.Promotions);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  vget_page: Read the Page Table Entry of a Hardware Page (Virtual Address Version)
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Reads a page table entry corresponding to a hardware page base address, and returns a structure containing the entry's data,
+// the memory map descriptor information of the mapped region in which the page base address is located, and whether or not the
+// entire hardware page fits in the region. This function uses virtual addresses in the memory map to locate corresponding physical
+// ones.
+//
+// hw_page_base_addr: The base address of the hardware page in pointer form (e.g. as returned by vmalloc)
+//
+// The return struct is described as below:
+//
+// typedef struct {
+//   uint64_t               PageTableEntryData;  // The page table entry, which contains the hardware page base address and that page's flags.
+//   uint64_t               HWPageSize;          // The size of the hardware page (4kB, 2MB, 1GB, 512GB, 256TB, etc.)
+//   uint64_t               HWPageShift;         // The shift factor to get the hardware page size (useful to determine how many hardware pages a given region crosses)
+//   uint64_t               HWPageBase;          // If the page exists, the base page address. This will contain ~0ULL if the page does not exist in the memory map.
+//   uint64_t               WholePageInRegion;   // 1 if the whole hardware page fits in the region described by MemoryMapRegionData, 0 otherwise
+//   EFI_MEMORY_DESCRIPTOR  MemoryMapRegionData; // The memory map entry describing the region that contains the page base address
+// } PAGE_ENTRY_INFO_STRUCT;
+//
+// Mask for 2MB-256TB entry's flags: 0xFFF0000000001FFF
+// Mask for 4kB entry's flags: 0xFFF0000000000FFF
+// (These do include PKRU bits 62:59)
+//
+// The address masks depend on the paging level:
+//  256TB: 0x000F000000000000
+//  512GB: 0x000FFF8000000000
+//  1GB:   0x000FFFFFC0000000
+//  2MB:   0x000FFFFFFFE00000
+//  4kB:   0x000FFFFFFFFFF000
+//
+// NOTE: It is true that this function could easily take a non-page-base-address and return info for the corresponding page base.
+// However, implmenenting this instead of the error message on non-page-base-address would risk hiding issues in code and encourage
+// poor programming practice (or at least enable it). Doing it the current way means that users need to be sure they always know what
+// their program is doing and how their memory is laid out, and may even help find some hard-to-spot pointer issues.
+//
+
+PAGE_ENTRY_INFO_STRUCT vget_page(void * hw_page_base_addr)
+{
+  uint64_t page_base_address = (uint64_t)hw_page_base_addr;
+  PAGE_ENTRY_INFO_STRUCT page_data = {0};
+
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    EFI_VIRTUAL_ADDRESS VirtualEnd = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+
+    // Found it
+    if((Piece->VirtualStart <= page_base_address) && (VirtualEnd > page_base_address))
+    {
+
+      uint64_t size_above_page_base_in_region = VirtualEnd - page_base_address;
+
+      // Convert virtual address to physical address
+      if(Piece->VirtualStart >= Piece->PhysicalStart)
+      {
+        page_base_address -= (Piece->VirtualStart - Piece->PhysicalStart);
+      }
+      else
+      {
+        page_base_address += (Piece->PhysicalStart - Piece->VirtualStart);
+      }
+
+      if(page_base_address & 0xFFF) // There are no page base addresses < 4kB-aligned
+      {
+        error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nvget_page() failed.\r\n");
+        return page_data;
+      }
+
+      uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
+      uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
+
+      uint64_t cr4 = control_register_rw(4, 0, 0);
+      if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
+      {
+        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+
+        // Need to remove the sign extension
+        uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
+
+        // PML5: 256TB pages
+        if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
+        {
+          page_data.HWPageSize = (256ULL << 40);
+          page_data.HWPageShift = PML5_SHIFT;
+          page_data.PageTableEntryData = ((uint64_t*)base_pml_addr)[pml5_part];
+
+          uint64_t pml_base_address = page_data.PageTableEntryData & PML5_ADDRESS_MASK;
+          page_data.HWPageBase = pml_base_address;
+          if(page_base_address != pml_base_address)
+          {
+            warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+            return page_data;
+          }
+
+          if(size_above_page_base_in_region >= page_data.HWPageSize)
+          {
+            page_data.WholePageInRegion = 1;
+          }
+
+        }
+        else
+        {
+          // Find the page_base_address entry...
+          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
+          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+
+          // PML4: 512GB
+          if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
+          {
+            page_data.HWPageSize = (512ULL << 30);
+            page_data.HWPageShift = PML4_SHIFT;
+            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml4_part];
+
+            uint64_t pml_base_address = page_data.PageTableEntryData & PML4_ADDRESS_MASK;
+            page_data.HWPageBase = pml_base_address;
+            if(page_base_address != pml_base_address)
+            {
+              warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+              return page_data;
+            }
+
+            if(size_above_page_base_in_region >= page_data.HWPageSize)
+            {
+              page_data.WholePageInRegion = 1;
+            }
+
+          }
+          else
+          {
+            // Find the page_base_address entry...
+            next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+
+            // PML3: 1GB
+            if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+            {
+              page_data.HWPageSize = (1ULL << 30);
+              page_data.HWPageShift = PML3_SHIFT;
+              page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+
+              uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
+              page_data.HWPageBase = pml_base_address;
+              if(page_base_address != pml_base_address)
+              {
+                warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                return page_data;
+              }
+
+              if(size_above_page_base_in_region >= page_data.HWPageSize)
+              {
+                page_data.WholePageInRegion = 1;
+              }
+
+            }
+            else
+            {
+              // Find the page_base_address entry...
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+
+              // PML2: 2MB
+              if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+              {
+                page_data.HWPageSize = (2ULL << 20);
+                page_data.HWPageShift = PML2_SHIFT;
+                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+
+                uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+                page_data.HWPageBase = pml_base_address;
+                if(page_base_address != pml_base_address)
+                {
+                  warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  return page_data;
+                }
+
+                if(size_above_page_base_in_region >= page_data.HWPageSize)
+                {
+                  page_data.WholePageInRegion = 1;
+                }
+
+              }
+              else
+              {
+                // Find the page_base_address entry...
+                next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+                uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+
+                // PML1: 4kB
+                page_data.HWPageSize = (4ULL << 10);
+                page_data.HWPageShift = PML1_SHIFT;
+                page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+
+                uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
+                page_data.HWPageBase = pml_base_address;
+
+                // It's not possible to both get here and trigger a page base address error
+
+                if(size_above_page_base_in_region >= page_data.HWPageSize)
+                {
+                  page_data.WholePageInRegion = 1;
+                }
+
+              }
+            }
+          }
+        }
+      } // end 5-level
+      else // 4-level paging
+      {
+        // Need to remove the sign extension
+        uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+
+        // 4-level paging doesn't have 512GB paging sizes
+
+        // Find the page_base_address entry...
+        uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+        uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+
+        // PML3/PDP: 1GB
+        if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+        {
+          page_data.HWPageSize = (1ULL << 30);
+          page_data.HWPageShift = PML3_SHIFT;
+          page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml3_part];
+
+          uint64_t pml_base_address = page_data.PageTableEntryData & PML3_ADDRESS_MASK;
+          page_data.HWPageBase = pml_base_address;
+          if(page_base_address != pml_base_address)
+          {
+            warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+            return page_data;
+          }
+
+          if(size_above_page_base_in_region >= page_data.HWPageSize)
+          {
+            page_data.WholePageInRegion = 1;
+          }
+
+        }
+        else
+        {
+          // Find the page_base_address entry...
+          next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+          uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+
+          // PML2/PD: 2MB
+          if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+          {
+            page_data.HWPageSize = (2ULL << 20);
+            page_data.HWPageShift = PML2_SHIFT;
+            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml2_part];
+
+            uint64_t pml_base_address = page_data.PageTableEntryData & PML2_ADDRESS_MASK;
+            page_data.HWPageBase = pml_base_address;
+            if(page_base_address != pml_base_address)
+            {
+              warning_printf("vget_page: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+              return page_data;
+            }
+
+            if(size_above_page_base_in_region >= page_data.HWPageSize)
+            {
+              page_data.WholePageInRegion = 1;
+            }
+
+          }
+          else
+          {
+            // Find the page_base_address entry...
+            next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+
+            // PML1/PT: 4kB
+            page_data.HWPageSize = (4ULL << 10);
+            page_data.HWPageShift = PML1_SHIFT;
+            page_data.PageTableEntryData = ((uint64_t*)next_pml_addr)[pml1_part];
+
+            uint64_t pml_base_address = page_data.PageTableEntryData & PML1_ADDRESS_MASK;
+            page_data.HWPageBase = pml_base_address;
+
+            // It's not possible to both get here and trigger a page base address error
+
+            if(size_above_page_base_in_region >= page_data.HWPageSize)
+            {
+              page_data.WholePageInRegion = 1;
+            }
+
+          }
+        }
+      } // end 4-level
+
+      // Finally, get the memory map data
+      page_data.MemoryMapRegionData = *Piece;
+
+      // Whew!
+      break;
+    }
+  }
+
+  // Loop ended without a discovered address
+  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  {
+    error_printf("vget_page: Could not find page base address. It may not be aligned or allocated.\r\n");
+    page_data.HWPageBase = ~0ULL;
+    return page_data;
+  }
+
+  return page_data;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  vset_region_hwpages: Modify the Page Table Entries of All Hardware Pages in a Memory Map Region (Virtual Address Version)
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// This takes a hardware page base address aligned to a memory region in the memory map and applies hardware paging flags (e.g.
+// NX, G, etc.) to all the hardware pages corresponding to that region. The input address MUST be that of a hardware page base that
+// coincides with the PhysicalStart of a memory region. As this can only apply to physical addresses, this function takes a virtual
+// address corresponding to a hardware page base and uses the PhysicalStart of that entry in the memory map. The PhysicalStart must
+// still be a page base address, just like in set_region_hwpages(), even if the VirtualStart isn't.
+//
+// NOTE: This function can be used to couple a malloc region to a hardware page or contiguous set of hardware pages. In this case it
+// is very important that the malloc-allocated address is a page base address (e.g. for 1GB paging, the address needs to be 1GB
+// aligned or else it won't be a page base address) and that the malloc region in question consumes the entire hardware page(s),
+// otherwise this will be setting flags that will impact other memory regions within those hardware page(s) (yikes!).
+//
+// hw_page_base_addr: the base address of the hardware page corresponding to the PhysicalStart of a region in the memory map, in pointer form (e.g. as returned by vmalloc)
+// entry_flags: the flags to set (a 64-bit value that is formatted like a page table entry)
+// attributes: attributes that will show up on the memory map
+// flags_or_entry: 0 = only flags & memory map attrbutes be set, 1 = the whole page table entry gets replaced (both flags and address in the 'entry_flags' variable, plus memory map attributes)
+//
+// Returns 0 on success, 1 on failure, 2 on "region too small, some parts of region may have already been set" error
+//
+// If the "PK" bits are not active (CR4.PKE == 0, this is true by default in this framework) then bits 62:59 in 'entry_flags' should
+// be 0.
+//
+
+uint8_t vset_region_hwpages(void * hw_page_base_addr, uint64_t entry_flags, uint64_t attributes, uint8_t flags_or_entry)
+{
+  uint64_t page_base_address = (uint64_t)hw_page_base_addr;
+  uint8_t isFirstPage = 1;
+
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  // Check for page base address in the map, which should always be a PhysicalStart of some region.
+  // This can't just set some random section of EfiConventionalMemory to have certain attributes--that would be bad.
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    // Found it
+    if(Piece->VirtualStart == page_base_address)
+    {
+      page_base_address = Piece->PhysicalStart;
+
+      if(page_base_address & 0xFFF) // There are no physical page base addresses < 4kB-aligned
+      {
+        error_printf("Hey! That's not a 4kB-aligned hardware page base address!\r\nvset_region_hwpages() failed.\r\n");
+        return 3;
+      }
+
+      uint64_t regionpages = Piece->NumberOfPages; // Piece->NumberOfPages contains the size of the region, so it can be compared against the PML level to ensure sizes match up correctly before making changes
+
+      uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
+      uint64_t base_pml_addr = cr3 & PAGE_ENTRY_ADDRESS_MASK;
+
+      uint64_t cr4 = control_register_rw(4, 0, 0);
+      if(cr4 & (1 << 12)) // Check CR4.LA57 for 5-level paging support
+      {
+        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+        while(regionpages)
+        {
+          // Need to remove the sign extension
+          uint64_t pml5_part = (page_base_address & PML5_MASK) >> 48; // units of 256TB
+
+          // PML5: 256TB pages
+          if(((uint64_t*)base_pml_addr)[pml5_part] & (1ULL << 7)) // Bit 7 is the "no deeper table" bit. Need to check it because the page base address might happen to be, e.g., 256TB aligned but described by a 4kB page table.
+          {
+
+            if(isFirstPage)
+            {
+              // Check to make sure memory region start is hardware page base aligned to this size
+              uint64_t pml_base_address = ((uint64_t*)base_pml_addr)[pml5_part] & PML5_ADDRESS_MASK;
+              if(page_base_address != pml_base_address)
+              {
+                warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                return 3;
+              }
+
+              isFirstPage = 0;
+            }
+
+            if(regionpages < (1ULL << 36))
+            {
+              warning_printf("Error: Region at base address %#qx does not cover entire 256TB page. (5-lvl)\r\n", page_base_address);
+              warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+              warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+              warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+              warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+              warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+              return 2;
+            }
+
+            if(flags_or_entry)
+            {
+              ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
+            }
+            else
+            {
+              entry_flags &= PAGE_ENTRY_FLAGS_MASK; // Remove any address bits
+              entry_flags |= (((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK);
+              ((uint64_t*)base_pml_addr)[pml5_part] = entry_flags;
+            }
+
+            regionpages -= 1ULL << 36; // (1ULL << 48) >> 12
+            page_base_address += 1ULL << 48; // Get the next aligned address in the set
+          }
+          else
+          {
+            // Find the page_base_address entry...
+            uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml5_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+
+            // PML4: 512GB
+            if(((uint64_t*)next_pml_addr)[pml4_part] & (1ULL << 7))
+            {
+
+              if(isFirstPage)
+              {
+                // Check to make sure memory region start is hardware page base aligned to this size
+                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml4_part] & PML4_ADDRESS_MASK;
+                if(page_base_address != pml_base_address)
+                {
+                  warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  return 3;
+                }
+
+                isFirstPage = 0;
+              }
+
+              if(regionpages < (1ULL << 27))
+              {
+                warning_printf("Error: Region at base address %#qx does not cover entire 512GB page. (5-lvl)\r\n", page_base_address);
+                warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+                warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                return 2;
+              }
+
+              if(flags_or_entry)
+              {
+                ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
+              }
+              else
+              {
+                entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                entry_flags |= (((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK);
+                ((uint64_t*)next_pml_addr)[pml4_part] = entry_flags;
+              }
+
+              regionpages -= 1ULL << 27; // (1ULL << 39) >> 12
+              page_base_address += 1ULL << 39; // Get the next aligned address in the set
+            }
+            else
+            {
+              // Find the page_base_address entry...
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+
+              // PML3: 1GB
+              if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+              {
+
+                if(isFirstPage)
+                {
+                  // Check to make sure memory region start is hardware page base aligned to this size
+                  uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
+                  if(page_base_address != pml_base_address)
+                  {
+                    warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                    return 3;
+                  }
+
+                  isFirstPage = 0;
+                }
+
+                if(regionpages < (1ULL << 18))
+                {
+                  warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (5-lvl)\r\n", page_base_address);
+                  warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+                  warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                  warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                  warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                  warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                  return 2;
+                }
+
+                if(flags_or_entry)
+                {
+                  ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+                }
+                else
+                {
+                  entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                  entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
+                  ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+                }
+
+                regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
+                page_base_address += 1ULL << 30; // Get the next aligned address in the set
+              }
+              else
+              {
+                // Find the page_base_address entry...
+                next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+                uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+
+                // PML2: 2MB
+                if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+                {
+
+                  if(isFirstPage)
+                  {
+                    // Check to make sure memory region start is hardware page base aligned to this size
+                    uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                    if(page_base_address != pml_base_address)
+                    {
+                      warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                      return 3;
+                    }
+
+                    isFirstPage = 0;
+                  }
+
+                  if(regionpages < (1ULL << 9))
+                  {
+                    warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (5-lvl)\r\n", page_base_address);
+                    warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+                    warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                    warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                    warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                    warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                    return 2;
+                  }
+
+                  if(flags_or_entry)
+                  {
+                    ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                  }
+                  else
+                  {
+                    entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                    entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
+                    ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+                  }
+
+                  regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
+                  page_base_address += 1ULL << 21; // Get the next aligned address in the set
+                }
+                else
+                {
+                  // Find the page_base_address entry...
+                  next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+                  uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+
+                  // PML1: 4kB
+                  // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
+                  // regionpages cannot be < 1, so no error message here
+
+                  if(flags_or_entry)
+                  {
+                    ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                  }
+                  else
+                  {
+                    entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
+                    entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
+                    ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+                  }
+
+                  regionpages -= 1ULL; // (1ULL << 12) >> 12
+                  page_base_address += 1ULL << 12; // Get the next aligned address in the set
+                }
+              }
+            }
+          }
+        } // end while
+      } // end 5-level
+      else // 4-level paging
+      {
+        // Could this be made into a recursive function? Yes. However this is faster (it's unrolled).
+        // Rolling it up into a function would add a lot more overhead and isn't necessary since the paging format is hardwired into CPUs.
+        while(regionpages)
+        {
+          // Need to remove the sign extension
+          uint64_t pml4_part = (page_base_address & PML4_MASK) >> 39; // units of 512GB
+
+          // 4-level paging doesn't have 512GB paging sizes
+
+          // Find the page_base_address entry...
+          uint64_t next_pml_addr = ((uint64_t*)base_pml_addr)[pml4_part] & PAGE_ENTRY_ADDRESS_MASK;
+          uint64_t pml3_part = (page_base_address & PML3_MASK) >> 30; // units of 1GB
+
+          // PML3/PDP: 1GB
+          if(((uint64_t*)next_pml_addr)[pml3_part] & (1ULL << 7))
+          {
+
+            if(isFirstPage)
+            {
+              // Check to make sure memory region start is hardware page base aligned to this size
+              uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml3_part] & PML3_ADDRESS_MASK;
+              if(page_base_address != pml_base_address)
+              {
+                warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                return 3;
+              }
+
+              isFirstPage = 0;
+            }
+
+            if(regionpages < (1ULL << 18))
+            {
+              warning_printf("Error: Region at base address %#qx does not cover entire 1GB page. (4-lvl)\r\n", page_base_address);
+              warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+              warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+              warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+              warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+              warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+              return 2;
+            }
+
+            if(flags_or_entry)
+            {
+              ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+            }
+            else
+            {
+              entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+              entry_flags |= (((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK);
+              ((uint64_t*)next_pml_addr)[pml3_part] = entry_flags;
+            }
+
+            regionpages -= 1ULL << 18; // (1ULL << 30) >> 12
+            page_base_address += 1ULL << 30; // Get the next aligned address in the set
+          }
+          else
+          {
+            // Find the page_base_address entry...
+            next_pml_addr = ((uint64_t*)next_pml_addr)[pml3_part] & PAGE_ENTRY_ADDRESS_MASK;
+            uint64_t pml2_part = (page_base_address & PML2_MASK) >> 21; // units of 2MB
+
+            // PML2/PD: 2MB
+            if(((uint64_t*)next_pml_addr)[pml2_part] & (1ULL << 7))
+            {
+
+              if(isFirstPage)
+              {
+                // Check to make sure memory region start is hardware page base aligned to this size
+                uint64_t pml_base_address = ((uint64_t*)next_pml_addr)[pml2_part] & PML2_ADDRESS_MASK;
+                if(page_base_address != pml_base_address)
+                {
+                  warning_printf("vset_region_hwpages: %#qx is not the page base address for this page,\r\nthis is: %#qx. Please try again with the correct address.\r\n", page_base_address, pml_base_address);
+                  return 3;
+                }
+
+                isFirstPage = 0;
+              }
+
+              if(regionpages < (1ULL << 9))
+              {
+                warning_printf("Error: Region at base address %#qx does not cover entire 2MB page. (4-lvl)\r\n", page_base_address);
+                warning_printf("Beware that some hardware pages of this region passed to vset_region_hwpages() may have\r\n");
+                warning_printf("already been set. Recommendation is to immediately run vset_region_hwpages() again on the\r\n");
+                warning_printf("same area with its prior values, and then reallocate the region with a size\r\n");
+                warning_printf("that consumes all hardware pages encompassed by the region.\r\n");
+                warning_printf("NOTE: Memory map attributes for the region have also not been updated.\r\n");
+                return 2;
+              }
+
+              if(flags_or_entry)
+              {
+                ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+              }
+              else
+              {
+                entry_flags &= PAGE_ENTRY_FLAGS_MASK;
+                entry_flags |= (((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK);
+                ((uint64_t*)next_pml_addr)[pml2_part] = entry_flags;
+              }
+
+              regionpages -= 1ULL << 9; // (1ULL << 21) >> 12
+              page_base_address += 1ULL << 21; // Get the next aligned address in the set
+            }
+            else
+            {
+              // Find the page_base_address entry...
+              next_pml_addr = ((uint64_t*)next_pml_addr)[pml2_part] & PAGE_ENTRY_ADDRESS_MASK;
+              uint64_t pml1_part = (page_base_address & PML1_MASK) >> 12; // units of 4kB
+
+              // PML1/PT: 4kB
+              // Can't get here if address isn't both 4kB-aligned and PhysicalStart, so no incorrect page base address error here
+              // regionpages cannot be < 1, so no error message here
+
+              if(flags_or_entry)
+              {
+                ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+              }
+              else
+              {
+                entry_flags &= PAGE_ENTRY_FLAGS_MASK - 0x1000;
+                entry_flags |= (((uint64_t*)next_pml_addr)[pml1_part] & PAGE_ENTRY_ADDRESS_MASK);
+                ((uint64_t*)next_pml_addr)[pml1_part] = entry_flags;
+              }
+
+              regionpages -= 1ULL; // (1ULL << 12) >> 12
+              page_base_address += 1ULL << 12; // Get the next aligned address in the set
+            }
+          }
+        } // end while
+      } // end 4-level
+
+      // Finally, set the memory map attributes
+      Piece->Attribute = attributes;
+
+      // Whew!
+      break;
+    }
+  }
+
+  // Loop ended without a discovered address
+  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+  {
+    error_printf("vset_region_hwpages: Could not find page base address. It may not be aligned or allocated.\r\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  VerifyZeroMem: Verify Memory Is Free
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Return 0 if desired section of memory is zeroed (for use in "if" statements)
+//
+
+uint8_t VerifyZeroMem(size_t NumBytes, uint64_t BaseAddr) // BaseAddr is a 64-bit unsigned int whose value is the memory address
+{
+  for(size_t verify_increment = 0; verify_increment < NumBytes; verify_increment++)
+  {
+    if(*(uint8_t*)(BaseAddr + verify_increment) != 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GetMaxMappedPhysicalAddress: Get the Maximum Physical Address in the Memory Map
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the highest physical address reported by the UEFI memory map, which is useful when working around memory holes and setting
+// up/working with paging. The returned value is 1 byte over the last usable address, meaning it is the total size of the physical
+// address space. Subtract 1 byte from the returned value to get the maximum usable mapped physical address.
+//
+// 0 will only be returned if there aren't any entries in the map, which should never happen anyways.
+//
+
+uint64_t GetMaxMappedPhysicalAddress(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  uint64_t current_address = 0, max_address = 0;
+
+  // Go through the system memory map, adding the page sizes to PhysicalStart. Returns the largest number found, which should be the maximum addressable memory location based on installed RAM size.
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    current_address = Piece->PhysicalStart + EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
+    if(current_address > max_address)
+    {
+      max_address = current_address;
+    }
+  }
+
+  return max_address;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GetVisibleSystemRam: Calculate Total Visible System RAM
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Calculates the total visible (not hardware- or firmware-reserved) system RAM from the UEFI system memory map. This is mainly meant
+// to help identify any memory holes in the installed RAM (e.g. there's often one at 0xA0000 to 0xFFFFF). In other words, this is the
+// amount of installed RAM that an OS can actually work with. Windows' msinfo32 utility calls this same value "Total Physical Memory."
+//
+// Value returned is in bytes.
+//
+
+uint64_t GetVisibleSystemRam(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  uint64_t running_total = 0;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(
+        (Piece->Type != EfiMemoryMappedIO) &&
+        (Piece->Type != EfiMemoryMappedIOPortSpace) &&
+        (Piece->Type != EfiPalCode) &&
+        (Piece->Type != EfiPersistentMemory) &&
+        (Piece->Type != EfiMaxMemoryType)
+      )
+    {
+      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
+    }
+  }
+
+  return running_total;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GetFreeSystemRam: Calculate Total Free System RAM
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Calculates the total EfiConventionalMemory from the UEFI system memory map.
+//
+
+uint64_t GetFreeSystemRam(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  uint64_t running_total = 0;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(Piece->Type == EfiConventionalMemory)
+    {
+      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
+    }
+  }
+
+  return running_total;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GetFreePersistentRam: Calculate Total Free Non-Volatile System RAM
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Calculates the total EfiPersistentMemory from the UEFI system memory map.
+//
+
+uint64_t GetFreePersistentRam(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  uint64_t running_total = 0;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(Piece->Type == EfiPersistentMemory)
+    {
+      running_total += EFI_PAGES_TO_SIZE(Piece->NumberOfPages);
+    }
+  }
+
+  return running_total;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GetInstalledSystemRam: Get Total Installed System Ram
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Uses SMBIOS tables to report the installed RAM quantity. The UEFI/BIOS calculates the installed memory by directly reading the SPD
+// EEPROM, but not all system vendors correctly report system configuration information via SMBIOS, which does have a field for memory.
+// So if SMBios doesn't work, this falls back to GuessInstalledSystemRam().
+//
+// In Windows' msinfo32 utility, the "Installed Physical Memory (RAM)" value is what this number is, and it's really just for
+// informational purposes (the OS itself cares much more about the entire physical address space, not just the RAM part of it).
+//
+// Value returned is in bytes.
+//
+
+uint64_t GetInstalledSystemRam(EFI_CONFIGURATION_TABLE * ConfigurationTables, UINTN NumConfigTables)
+{
+  uint64_t systemram = 0;
+  uint8_t smbiostablefound = 0;
+
+  for(uint64_t configtable_iter = 0; configtable_iter < NumConfigTables; configtable_iter++)
+  {
+    if(!(AVX_memcmp(&ConfigurationTables[configtable_iter].VendorGuid, &Smbios3TableGuid, 16, 0)))
+    {
+      printf("SMBIOS 3.x table found!\r\n");
+      smbiostablefound = 3;
+
+       SMBIOS_TABLE_3_0_ENTRY_POINT * smb3_entry = (SMBIOS_TABLE_3_0_ENTRY_POINT*)ConfigurationTables[configtable_iter].VendorTable;
+       SMBIOS_STRUCTURE * smb_header = (SMBIOS_STRUCTURE*)smb3_entry->TableAddress;
+       uint8_t* smb3_end = (uint8_t *)(smb3_entry->TableAddress + (uint64_t)smb3_entry->TableMaximumSize);
+
+       while((uint8_t*)smb_header < smb3_end)
+       {
+         if(smb_header->Type == 17) // Memory socket/device
+         {
+           uint16_t smb_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->Size;
+           if(smb_socket_size == 0x7FFF) // Need extended size, which is always given in MB units
+           {
+             uint32_t smb_extended_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->ExtendedSize;
+             systemram += (uint64_t)smb_extended_socket_size << 20;
+           }
+           else if(smb_socket_size != 0xFFFF)
+           {
+             if(smb_socket_size & 0x8000) // KB units
+             {
+               systemram += (uint64_t)smb_socket_size << 10;
+             }
+             else // MB units
+             {
+               systemram += (uint64_t)smb_socket_size << 20;
+             }
+           }
+           // Otherwise size is unknown (0xFFFF), don't add it.
+         }
+
+         smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + smb_header->Length);
+         while(*(uint16_t*)smb_header != 0x0000) // Check for double null, meaning end of string set
+         {
+           smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 1);
+         }
+         smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 2); // Found end of current structure, move to start of next one
+       }
+
+      break;
+    }
+  }
+
+  if(smbiostablefound != 3)
+  {
+    for(uint64_t configtable_iter = 0; configtable_iter < NumConfigTables; configtable_iter++)
+    {
+      if(!(AVX_memcmp(&ConfigurationTables[configtable_iter].VendorGuid, &SmbiosTableGuid, 16, 0)))
+      {
+        printf("SMBIOS table found!\r\n");
+        smbiostablefound = 1;
+
+        SMBIOS_TABLE_ENTRY_POINT * smb_entry = (SMBIOS_TABLE_ENTRY_POINT*)ConfigurationTables[configtable_iter].VendorTable;
+        SMBIOS_STRUCTURE * smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_entry->TableAddress);
+        uint8_t* smb_end = (uint8_t *)((uint64_t)smb_entry->TableAddress + (uint64_t)smb_entry->TableLength);
+
+        while((uint8_t*)smb_header < smb_end)
+        {
+          if(smb_header->Type == 17) // Memory socket/device
+          {
+            uint16_t smb_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->Size;
+            if(smb_socket_size == 0x7FFF) // Need extended size, which is always given in MB units
+            {
+              uint32_t smb_extended_socket_size = ((SMBIOS_TABLE_TYPE17 *)smb_header)->ExtendedSize;
+              systemram += (uint64_t)smb_extended_socket_size << 20;
+            }
+            else if(smb_socket_size != 0xFFFF)
+            {
+              if(smb_socket_size & 0x8000) // KB units
+              {
+                systemram += (uint64_t)smb_socket_size << 10;
+              }
+              else // MB units
+              {
+                systemram += (uint64_t)smb_socket_size << 20;
+              }
+            }
+            // Otherwise size is unknown (0xFFFF), don't add it.
+          }
+
+          smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + smb_header->Length);
+          while(*(uint16_t*)smb_header != 0x0000) // Check for double null, meaning end of string set
+          {
+            smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 1);
+          }
+          smb_header = (SMBIOS_STRUCTURE*)((uint64_t)smb_header + 2); // Found end of current structure, move to start of next one
+        }
+
+        break;
+      }
+    }
+  }
+
+  if(systemram < GetVisibleSystemRam())
+  {
+    info_printf("No SMBIOS tables or incorrect SMBIOS data found. Approximating RAM...\r\n");
+    systemram = GuessInstalledSystemRam();
+  }
+
+  return systemram;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  GuessInstalledSystemRam: Attempt to Infer Total Installed System Ram
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Infers a value for the total installed system RAM from the UEFI memory map. This is basically an attempt to account for memory
+// holes that aren't remapped by the motherboard chipset. The UEFI/BIOS calculates the installed memory by directly reading the SPD
+// EEPROM, but not all system vendors correctly report system configuration information via SMBIOS, which does have a field for memory.
+//
+// This would be useful for systems that don't have a reliable way to get RAM size from the firmware.
+//
+// Value returned is in bytes.
+//
+
+uint64_t GuessInstalledSystemRam(void)
+{
+  uint64_t ram = GetVisibleSystemRam();
+  ram += (63 << 20); // The minimum DDR3 size is 64MB, so it seems like a reasonable offset.
+  return (ram & ~((64 << 20) - 1)); // This method will discard quantities < 64MB, but no one using x86 these days should be so limited.
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  print_system_memmap: The Ultimate Debugging Tool
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Get the system memory map, parse it, and print it. Print the whole thing.
+//
+
+/* Reminder of EFI_MEMORY_DESCRIPTOR format:
+
+typedef UINT64          EFI_PHYSICAL_ADDRESS;
+typedef UINT64          EFI_VIRTUAL_ADDRESS;
+
+#define EFI_MEMORY_DESCRIPTOR_VERSION  1
+typedef struct {
+    UINT32                          Type;           // Field size is 32 bits followed by 32 bit pad
+    UINT32                          Pad;            // There's no pad in the spec...
+    EFI_PHYSICAL_ADDRESS            PhysicalStart;  // Field size is 64 bits
+    EFI_VIRTUAL_ADDRESS             VirtualStart;   // Field size is 64 bits
+    UINT64                          NumberOfPages;  // Field size is 64 bits
+    UINT64                          Attribute;      // Field size is 64 bits
+} EFI_MEMORY_DESCRIPTOR;
+*/
+
+// This array should match the EFI_MEMORY_TYPE enum in EfiTypes.h. If it doesn't, maybe the spec changed and this needs to be updated.
+// This is a file scope global variable, which lets it be declared static. This prevents a stack overflow that could arise if it were
+// local to its function of use. Static arrays defined like this can actually be made very large, but they cannot be accessed by any
+// functions that are not explicitly defined in this file. It cannot be passed as an argument to outside functions, either.
+static const char mem_types[21][27] = {
+    "EfiReservedMemoryType     ",
+    "EfiLoaderCode             ",
+    "EfiLoaderData             ",
+    "EfiBootServicesCode       ",
+    "EfiBootServicesData       ",
+    "EfiRuntimeServicesCode    ",
+    "EfiRuntimeServicesData    ",
+    "EfiConventionalMemory     ",
+    "EfiUnusableMemory         ",
+    "EfiACPIReclaimMemory      ",
+    "EfiACPIMemoryNVS          ",
+    "EfiMemoryMappedIO         ",
+    "EfiMemoryMappedIOPortSpace",
+    "EfiPalCode                ",
+    "EfiPersistentMemory       ",
+    "EfiMaxMemoryType          ",
+    "malloc                    ", // EfiMaxMemoryType + 1
+    "vmalloc                   ", // EfiMaxMemoryType + 2
+    "Memory Map                ", // EfiMaxMemoryType + 3
+    "Page Tables               ", // EfiMaxMemoryType + 4
+    "Null Area                 "  // EfiMaxMemoryType + 5
+};
+
+void print_system_memmap(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  uint16_t line = 0;
+
+  printf("MemMap: %#qx, MemMapSize: %qu, MemMapDescriptorSize: %qu, MemMapDescriptorVersion: %u\r\n", Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize, Global_Memory_Info.MemMapDescriptorSize, Global_Memory_Info.MemMapDescriptorVersion);
+
+  // Multiply NumOfPages by EFI_PAGE_SIZE or do (NumOfPages << EFI_PAGE_SHIFT) to get the end address... which should just be the start of the next section.
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(line%20 == 0)
+    {
+      printf("#   Memory Type                 Phys Addr Start      Virt Addr Start  Num Of Pages   Attr\r\n");
+    }
+
+    printf("%2hu: %s 0x%016qx   0x%016qx %#qx %#qx\r\n", line, mem_types[Piece->Type], Piece->PhysicalStart, Piece->VirtualStart, Piece->NumberOfPages, Piece->Attribute);
+    line++;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Set_Identity_VMAP: Set Virtual Address Map to Identity Mapping
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Get the system memory map, parse it, identity map it, and set the virtual address map accordingly.
+// Identity mapping means Physical Address == Virtual Address, also called a 1:1 (one-to-one) map
+//
+// Returns ~0ULL as a pointer if a failure is encountered.
+//
+
+__attribute__((target("no-sse"))) EFI_MEMORY_DESCRIPTOR * Set_Identity_VMAP(EFI_RUNTIME_SERVICES * RTServices)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    Piece->VirtualStart = Piece->PhysicalStart;
+  }
+
+  if(EFI_ERROR(RTServices->SetVirtualAddressMap(Global_Memory_Info.MemMapSize, Global_Memory_Info.MemMapDescriptorSize, Global_Memory_Info.MemMapDescriptorVersion, Global_Memory_Info.MemMap)))
+  {
+    // This function gets called too early for print
+    // warning_printf("Error setting VMAP. Returning NULL.\r\n");
+    return (EFI_MEMORY_DESCRIPTOR*)~0ULL;
+  }
+
+  return Global_Memory_Info.MemMap;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Setup_MemMap: Prepare the Memory Map for Use with Allocators
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Take UEFI's memory map and modify it to include the memory map's own location. This prepares it for use with memory management.
+//
+
+void Setup_MemMap(void)
+{
+  // Make a new memory map with the location of the map itself, which is needed to use malloc() and pagetable.
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  size_t numpages = EFI_SIZE_TO_PAGES((Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize) << 1); // Need enough space to contain the map + one additional descriptor (for the map itself), doubled so the first allocations don't have to move it again
+
+  // Map's gettin' evicted, gotta relocate.
+  EFI_PHYSICAL_ADDRESS new_MemMap_base_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
+  if(new_MemMap_base_address == ~0ULL)
+  {
+    error_printf("Setup_MemMap: Can't move MemMap for enlargement: Out of memory, memory subsystem not usable.\r\n");
+    HaCF();
+  }
+  else
+  {
+    EFI_MEMORY_DESCRIPTOR * new_MemMap = (EFI_MEMORY_DESCRIPTOR*)new_MemMap_base_address;
+    // Zero out the new memmap destination
+    AVX_memset(new_MemMap, 0, numpages << EFI_PAGE_SHIFT);
+
+    // Move (copy) the map from MemMap to new_MemMap
+    AVX_memmove(new_MemMap, Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize);
+    // Zero out the old one
+    AVX_memset(Global_Memory_Info.MemMap, 0, Global_Memory_Info.MemMapSize);
+
+    // Update Global_Memory_Info MemMap location with new address
+    Global_Memory_Info.MemMap = new_MemMap;
+    Global_Memory_Info.MemMapCapacity = numpages << EFI_PAGE_SHIFT;
+
+    // Get a pointer for the descriptor corresponding to the new location of the map (scan the map to find it)
+    for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if(Piece->PhysicalStart == new_MemMap_base_address)
+      { // Found it, Piece holds the spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
+        break;
+      }
+    }
+
+    if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+    {
+      error_printf("Setup_MemMap: MemMap not found.\r\n");
+      HaCF();
+    }
+    else
+    {
+      // Mark the new area as memmap (it's currently EfiConventionalMemory)
+      if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+      {
+        Piece->Type = EfiMaxMemoryType + 3; // Special memmap type
+        // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+      }
+      else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the map's new area is at the base of the EfiConventionalMemory descriptor
+      {
+        // Make a temporary descriptor to hold current piece's values, but modified for memmap
+        EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+        new_descriptor_temp.Type = EfiMaxMemoryType + 3; // Special memmap type
+        new_descriptor_temp.Pad = Piece->Pad;
+        new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+        new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+        new_descriptor_temp.NumberOfPages = numpages;
+        new_descriptor_temp.Attribute = Piece->Attribute;
+
+        // Modify this descriptor (shrink it) to reflect its new values
+        Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+        Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+        Piece->NumberOfPages -= numpages;
+
+        // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+        AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+
+        // Insert the new piece (by overwriting the now-duplicated entry with new values)
+        // I.e. turn this piece into what was stored in the temporary descriptor above
+        Piece->Type = new_descriptor_temp.Type;
+        Piece->Pad = new_descriptor_temp.Pad;
+        Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+        Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+        Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+        Piece->Attribute = new_descriptor_temp.Attribute;
+
+        // Update Global_Memory_Info with new MemMap size
+        Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+      }
+      // Done modifying new map.
+
+      // Now set up null area, or at least try to.
+      null_alloc();
+
+      // Now index the free regions so allocators don't need to scan the whole map to find space
+      void * free_index_pool = malloc(FREE_INDEX_MAX_NODES * sizeof(FREE_INDEX_NODE));
+      if((EFI_PHYSICAL_ADDRESS)free_index_pool == ~0ULL)
+      {
+        warning_printf("Setup_MemMap: Not enough memory for the free region index, allocators will scan the memory map.\r\n");
+      }
+      else
+      {
+        Global_Free_Index.Pool = (FREE_INDEX_NODE*)free_index_pool;
+        RebuildFreeIndex();
+      }
+
+#ifdef BUDDY_ALLOCATOR
+      // Seed the buddy allocator with a standard arena
+      if(!buddy_grow(BUDDY_MIN_ORDER))
+      {
+        warning_printf("Setup_MemMap: Could not seed the buddy allocator, it will get arenas on demand.\r\n");
+      }
+#endif
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  MemMap_Prep: Check Memory Map for Space before Modifying It
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Check if the memory map has enough free space in its memory area for additional descriptors. If not, move it somewhere that does.
+// This should be called before doing anything that adds descriptors, as is done in malloc(), vmalloc(), and pagetable_alloc().
+//
+// num_additional_descriptors: The number of extra descriptors space is needed for (usually 1, except [v]malloc, which asks for 2)
+//
+// The map's region grows geometrically, to at least twice its current capacity (see memmap_target_pages()), whether that's by taking
+// pages from the free region right after it or by moving it. Moving it is a full copy of the map, so this keeps that down to O(log n)
+// times over the whole boot rather than once every few pages' worth of new descriptors. Global_Memory_Info counts the moves.
+//
+// Returns 0 on success
+//
+// NOTE: Any function call that includes a call to MemMap_Prep() will render variables holding memory map addresses unusable
+// afterwards. This is simply because it can no longer be guaranteed that the memory map is in the same place as before;
+// MemMap_Prep() might have changed its location. This is very important to keep in mind when creating functions like realloc() and
+// also when working with multiple cores.
+//
+// A list of functions that call MemMap_Prep():
+// - null_alloc()
+// - pagetable_alloc()
+// - AllocateFreeAddress()
+// - VAllocateFreeAddress()
+// - All variants of malloc() (i.e. malloc(), mallocX(), vmalloc(), vmallocX(), calloc(), realloc(), vcalloc(), and vrealloc(), as they call the [V]AllocateFreeAddress() functions)
+//
+
+uint64_t MemMap_Prep(uint64_t num_additional_descriptors)
+{
+  // Need enough space to contain the map + "num_additional_descriptors" additional descriptors
+  size_t needed_bytes = Global_Memory_Info.MemMapSize + (num_additional_descriptors * Global_Memory_Info.MemMapDescriptorSize);
+
+  if(needed_bytes > Global_Memory_Info.MemMapCapacity)
+  { // Need to move the map somewhere with more pages available. Don't want to play any fragmentation games with it.
+    size_t numpages = memmap_target_pages(needed_bytes);
+    size_t orig_numpages = Global_Memory_Info.MemMapCapacity >> EFI_PAGE_SHIFT;
+
+    EFI_MEMORY_DESCRIPTOR * Piece;
+
+    // Find the memmap's descriptor in the memmap
+    for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if(Piece->Type == (EfiMaxMemoryType + 3)) // MemMap type
+      { // Found it, Piece holds the spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
+        break;
+      }
+    }
+
+    if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+    {
+      error_printf("MemMap_Prep: MemMap not found. Has it not been set up yet?\r\n");
+      HaCF();
+    }
+    else // Found memmap, so no issues
+    {
+      size_t additional_numpages = numpages - orig_numpages;
+      size_t min_additional_numpages = EFI_SIZE_TO_PAGES(needed_bytes) - orig_numpages;
+      // If the area right after the memory map is EfiConventionalMemory, we might be able to just take some pages from there...
+
+      // Check if there's an EfiConventionalMemory region adjacent in memory to the memmap region
+      EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
+      EFI_PHYSICAL_ADDRESS PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
+
+      // Quick check for adjacency that will skip scanning the whole memmap
+      // Can provide a little speed boost for ordered memory maps
+      if(
+          (Next_Piece->PhysicalStart != PhysicalEnd)
+          ||
+          ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+        ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
+      {
+        // See if PhysicalEnd matches any PhysicalStart for unordered maps
+        for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
+        {
+          if(PhysicalEnd == Next_Piece->PhysicalStart)
+          {
+            // Found one
+            break;
+          }
+        }
+      }
+
+      // Is the next piece an EfiConventionalMemory type?
+      if(
+          (Next_Piece->Type == EfiConventionalMemory) && (Next_Piece->NumberOfPages >= min_additional_numpages)
+          &&
+          ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
+        ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
+      {
+        // Growing in place is cheap, so take whatever the next piece has if it's short of the full target
+        if(Next_Piece->NumberOfPages < additional_numpages)
+        {
+          additional_numpages = Next_Piece->NumberOfPages;
+          numpages = orig_numpages + additional_numpages;
+        }
+        Global_Memory_Info.MemMapCapacity = numpages << EFI_PAGE_SHIFT;
+
+        // The bottom of the next piece is about to be taken
+        freeindex_carve(Next_Piece->PhysicalStart, additional_numpages);
+        zeropool_claim(Next_Piece->PhysicalStart, additional_numpages, 0);
+
+        if(Next_Piece->NumberOfPages > additional_numpages)
+        {
+          // Modify MemMap's entry
+          Piece->NumberOfPages = numpages;
+
+          // Modify adjacent EfiConventionalMemory's entry
+          Next_Piece->NumberOfPages -= additional_numpages;
+          Next_Piece->PhysicalStart += (additional_numpages << EFI_PAGE_SHIFT);
+          Next_Piece->VirtualStart += (additional_numpages << EFI_PAGE_SHIFT);
+
+          // Done
+        }
+        else if(Next_Piece->NumberOfPages == additional_numpages)
+        { // If the next piece is exactly the number of pages, we can claim it and reclaim a descriptor
+          // This just means that MemMap will have some wiggle room for the next time this function is used.
+
+          // Modify MemMap's entry
+          Piece->NumberOfPages = numpages;
+
+          // Erase the claimed descriptor
+          // Zero out the piece we just claimed
+          AVX_memset(Next_Piece, 0, Global_Memory_Info.MemMapDescriptorSize); // Next_Piece is a pointer
+          AVX_memmove(Next_Piece, (uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize));
+
+          // Update Global_Memory_Info
+          Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+
+          // Zero out the entry that used to be at the end of the map
+          AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+
+          // Done
+        }
+        // There is no else, as there are only > and == cases.
+        else
+        {
+          error_printf("MemMap_Prep: What kind of sorcery is this? Seeing this means there's a bug in MemMap_Prep.\r\n");
+          HaCF();
+        }
+      } // End convenient conditions
+      else // Nope, need to move it altogether
+      {
+        // Map's gettin' evicted, gotta relocate.
+
+        // So re-set numpages because now that the map needs the requested amount of descriptors + 1 more for itself
+        numpages = memmap_target_pages(Global_Memory_Info.MemMapSize + ((num_additional_descriptors + 1)*Global_Memory_Info.MemMapDescriptorSize));
+
+        EFI_PHYSICAL_ADDRESS new_MemMap_base_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
+        if(new_MemMap_base_address == ~0ULL)
+        {
+          error_printf("MemMap_Prep: Can't move memmap for enlargement: Out of memory\r\n");
+          return ~0ULL;
+        }
+        else
+        {
+          EFI_MEMORY_DESCRIPTOR * new_MemMap = (EFI_MEMORY_DESCRIPTOR*)new_MemMap_base_address;
+          // Zero out the new memmap destination
+          zeropool_claim(new_MemMap_base_address, numpages, 1);
+
+          // Mark the old one as EfiConventionalMemory
+          // Do this now because any later Piece is not guaranteed to point to the old memmap descriptor in the new map
+          // It's a lot faster to do it here than to look for it later when there's another memmap entry
+          // For multi-core stuff, all other processors need to be prevented from accessing the map during this whole function
+
+          // TODO: make a "memory map in use" tracker variable that gets checked before map gets read from or written to, and stops other core until it's free
+          // Will need to implement a priority mechnism, as well, to allow other cores first-in, first-out
+          Piece->Type = EfiConventionalMemory;
+          freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+
+          // Move (copy) the map from MemMap to new_MemMap
+          AVX_memmove(new_MemMap, Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize);
+          // Zero out the old one
+          AVX_memset(Global_Memory_Info.MemMap, 0, Global_Memory_Info.MemMapSize);
+
+          Global_Memory_Info.MemMapRelocations++;
+          Global_Memory_Info.MemMapBytesMoved += Global_Memory_Info.MemMapSize;
+
+          // Update Global_Memory_Info MemMap location with new address
+          Global_Memory_Info.MemMap = new_MemMap;
+          Global_Memory_Info.MemMapCapacity = numpages << EFI_PAGE_SHIFT;
+          // MemMapSize is still the same size, though.
+
+          // Get a pointer for the descriptor corresponding to the new location of the map (scan the map to find it)
+          for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+          {
+            if(Piece->PhysicalStart == new_MemMap_base_address)
+            { // Found it, Piece holds the new spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
+              break;
+            }
+          }
+
+          if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+          {
+            // If this ever happens, it's an emergency situation and everything needs to stop now since the map is gone.
+            error_printf("MemMap_Prep: MemMap not found. Something's weird here...\r\n");
+            HaCF();
+          }
+          else
+          {
+            freeindex_carve(new_MemMap_base_address, numpages);
+
+            // Mark the new area as memmap (it's currently EfiConventionalMemory)
+            if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+            {
+              Piece->Type = EfiMaxMemoryType + 3; // Special memmap type
+              // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+            }
+            else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the map's new area is at the base of the EfiConventionalMemory descriptor
+            {
+              // Make a temporary descriptor to hold current piece's values, but modified for memmap
+              EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+              new_descriptor_temp.Type = EfiMaxMemoryType + 3; // Special memmap type
+              new_descriptor_temp.Pad = Piece->Pad;
+              new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+              new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+              new_descriptor_temp.NumberOfPages = numpages;
+              new_descriptor_temp.Attribute = Piece->Attribute;
+
+              // Modify this descriptor (shrink it) to reflect its new values
+              Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+              Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+              Piece->NumberOfPages -= numpages;
+
+              // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+              AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+
+              // Insert the new piece (by overwriting the now-duplicated entry with new values)
+              // I.e. turn this piece into what was stored in the temporary descriptor above
+              Piece->Type = new_descriptor_temp.Type;
+              Piece->Pad = new_descriptor_temp.Pad;
+              Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+              Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+              Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+              Piece->Attribute = new_descriptor_temp.Attribute;
+
+              // Update Global_Memory_Info with new MemMap size
+              Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+            }
+
+            // Done modifying new map.
+            // Don't merge here, because that would undo everything just done.
+          }
+        }
+
+        // Done
+      } // End move map conditions
+    }
+
+  }
+  // Nothing to do otherwise, there's enough space in the last page for another descriptor
+
+  // All done
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memmap_target_pages: How Big to Make the Memory Map's Region
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the number of pages MemMap_Prep() should grow the map's region to when it needs room for needed_bytes: either exactly
+// that, or double the current capacity, whichever is more.
+//
+// needed_bytes: the least the map needs to hold
+//
+
+static size_t memmap_target_pages(size_t needed_bytes)
+{
+  size_t doubled_bytes = Global_Memory_Info.MemMapCapacity << 1;
+
+  return EFI_SIZE_TO_PAGES((needed_bytes > doubled_bytes) ? needed_bytes : doubled_bytes);
+}
 
-    printf("%2hu: %s 0x%016qx   0x%016qx %#qx %#qx\r\n", line, mem_types[Piece->Type], Piece->PhysicalStart, Piece->VirtualStart, Piece->NumberOfPages, Piece->Attribute);
-    line++;
-  }
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memmap_stats: Print Memory Map Capacity and Relocations
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Shows how much of the memory map's region is in use, and how many times (and how many bytes) MemMap_Prep() has had to move it.
+//
+
+void memmap_stats(void)
+{
+  printf("Memory map: %llu descriptors, %llu of %llu bytes used\r\n", Global_Memory_Info.MemMapSize / Global_Memory_Info.MemMapDescriptorSize, Global_Memory_Info.MemMapSize, Global_Memory_Info.MemMapCapacity);
+  printf("Relocations: %llu, bytes moved: %llu\r\n", Global_Memory_Info.MemMapRelocations, Global_Memory_Info.MemMapBytesMoved);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  Set_Identity_VMAP: Set Virtual Address Map to Identity Mapping
+//  null_alloc: Allocate Memory for Page Tables
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Get the system memory map, parse it, identity map it, and set the virtual address map accordingly.
-// Identity mapping means Physical Address == Virtual Address, also called a 1:1 (one-to-one) map
+// This function reserves the first 4kB page at address 0x0 for NULL. This is needed because many libraries depend on 0x0 being
+// invalid, but the malloc implementation here is perfectly happy to return it as a valid address (because it is). By reserving
+// address 0x0, such comparisons are safe and the memory at0x0 can be read to see if anything has been spuriously writing to 0x0.
 //
-// Returns ~0ULL as a pointer if a failure is encountered.
+// Returns the address 0x0 on success.
+//
+// EFI_PHYSICAL_ADDRESS is just a uint64_t.
 //
 
-__attribute__((target("no-sse"))) EFI_MEMORY_DESCRIPTOR * Set_Identity_VMAP(EFI_RUNTIME_SERVICES * RTServices)
+EFI_PHYSICAL_ADDRESS null_alloc(void)
 {
+  // All this does is take some EfiConventionalMemory at 0x0 and add one entry to the map
+
+  // Check if UEFI marked 0x0 as EfiReservedMemoryType, because that would actually be OK.
   EFI_MEMORY_DESCRIPTOR * Piece;
+  size_t numpages = 1; // Only need one page!
+  EFI_PHYSICAL_ADDRESS null_address = 0x0;
 
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
+  for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
-    Piece->VirtualStart = Piece->PhysicalStart;
+    if(Piece->PhysicalStart == null_address)
+    { // Found the 0x0 entry
+      if(Piece->Type == EfiReservedMemoryType)
+      {
+        info_printf("UEFI set 0x0 to EfiReservedMemoryType: No need to explicitly set null area.\r\n");
+
+        // Because EfiReservedMemoryType has the value of 0, this could also indicate that something is wrong with the memory map.
+        if(Piece->NumberOfPages == 0) // Number of pages should never be zero. A zero-size memory map region wouldn't be on the map!
+        { // This could mean a bootloader or firmware issue. Had it happen before, which led to the discovery of a MemoryMapSize calculation error in the bootloader.
+          error_printf("Err, hold on a second. NumberOfPages should never be 0.\r\nSomething's wrong with the memory map. Check it here:\r\n");
+          print_system_memmap();
+          HaCF();
+        }
+
+        return null_address;
+      }
+      else if(Piece->Type != EfiConventionalMemory)
+      {
+        warning_printf("Warning: Something is set at null area (address 0x0).\r\nFree up the first page at address 0x0 and try again.\r\n");
+      }
+      // else we're good.
+
+      break;
+    }
   }
 
-  if(EFI_ERROR(RTServices->SetVirtualAddressMap(Global_Memory_Info.MemMapSize, Global_Memory_Info.MemMapDescriptorSize, Global_Memory_Info.MemMapDescriptorVersion, Global_Memory_Info.MemMap)))
+  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
   {
-    // This function gets called too early for print
-    // warning_printf("Error setting VMAP. Returning NULL.\r\n");
-    return (EFI_MEMORY_DESCRIPTOR*)~0ULL;
+    error_printf("Huh, Address 0x0 not found at PhysicalStart of any region. Unsafe to continue.\r\n");
+    printf("Memory map check:\r\n");
+    print_system_memmap();
+    HaCF();
   }
 
-  return Global_Memory_Info.MemMap;
+  // Ensure memmap has enough space for another descriptor
+  if(MemMap_Prep(1))
+  {
+    error_printf("null_alloc: Could not prep memory map...\r\n");
+    HaCF();
+  }
+
+  // Zero out the destination
+  zeropool_claim(null_address, numpages, 1);
+
+  freeindex_carve(null_address, numpages);
+
+  // Mark the new area as null area (it's currently EfiConventionalMemory)
+  if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+  {
+    Piece->Type = EfiMaxMemoryType + 5; // Special Null type
+    // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+  }
+  else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
+  {
+    // Make a temporary descriptor to hold current piece's values, but modified for null area
+    EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
+    new_descriptor_temp.Type = EfiMaxMemoryType + 5; // Special Null type
+    new_descriptor_temp.Pad = Piece->Pad;
+    new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
+    new_descriptor_temp.VirtualStart = Piece->VirtualStart;
+    new_descriptor_temp.NumberOfPages = numpages;
+    new_descriptor_temp.Attribute = Piece->Attribute;
+
+    // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
+    Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+    Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+    Piece->NumberOfPages -= numpages;
+
+    // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
+    AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+
+    // Insert the new piece (by overwriting the now-duplicated entry with new values)
+    // I.e. turn this piece into what was stored in the temporary descriptor above
+    Piece->Type = new_descriptor_temp.Type;
+    Piece->Pad = new_descriptor_temp.Pad;
+    Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
+    Piece->VirtualStart = new_descriptor_temp.VirtualStart;
+    Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
+    Piece->Attribute = new_descriptor_temp.Attribute;
+
+    // Update Global_Memory_Info with new MemMap size
+    Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+  }
+
+  // Done modifying map.
+
+  return null_address;
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
-//  Setup_MemMap: Prepare the Memory Map for Use with Allocators
+//  pagetable_alloc: Allocate Memory for Page Tables
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Take UEFI's memory map and modify it to include the memory map's own location. This prepares it for use with memory management.
+// Returns a 4k-aligned address of a region of size 'pagetable_size' specified for use by page tables
+//
+// EFI_PHYSICAL_ADDRESS is just a uint64_t.
 //
 
-void Setup_MemMap(void)
+EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size)
 {
-  // Make a new memory map with the location of the map itself, which is needed to use malloc() and pagetable.
+  // All this does is take some EfiConventionalMemory and add one entry to the map
+
+  // First, ensure memmap has enough space for another descriptor
+  if(MemMap_Prep(1))
+  {
+    error_printf("pagetable_alloc: Could not prep memory map...\r\n");
+    HaCF();
+  }
+
   EFI_MEMORY_DESCRIPTOR * Piece;
-  size_t numpages = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapSize + Global_Memory_Info.MemMapDescriptorSize); // Need enough space to contain the map + one additional descriptor (for the map itself)
+  size_t numpages = EFI_SIZE_TO_PAGES(pagetables_size);
 
-  // Map's gettin' evicted, gotta relocate.
-  EFI_PHYSICAL_ADDRESS new_MemMap_base_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
-  if(new_MemMap_base_address == ~0ULL)
+  EFI_PHYSICAL_ADDRESS pagetable_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
+  if(pagetable_address == ~0ULL)
   {
-    error_printf("Setup_MemMap: Can't move MemMap for enlargement: Out of memory, memory subsystem not usable.\r\n");
+    error_printf("Not enough space for page tables. Unsafe to continue.\r\n");
     HaCF();
   }
   else
   {
-    EFI_MEMORY_DESCRIPTOR * new_MemMap = (EFI_MEMORY_DESCRIPTOR*)new_MemMap_base_address;
-    // Zero out the new memmap destination
-    AVX_memset(new_MemMap, 0, numpages << EFI_PAGE_SHIFT);
-
-    // Move (copy) the map from MemMap to new_MemMap
-    AVX_memmove(new_MemMap, Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize);
-    // Zero out the old one
-    AVX_memset(Global_Memory_Info.MemMap, 0, Global_Memory_Info.MemMapSize);
-
-    // Update Global_Memory_Info MemMap location with new address
-    Global_Memory_Info.MemMap = new_MemMap;
+    // Zero out the destination
+    zeropool_claim(pagetable_address, numpages, 1);
 
-    // Get a pointer for the descriptor corresponding to the new location of the map (scan the map to find it)
+    // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
     for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
     {
-      if(Piece->PhysicalStart == new_MemMap_base_address)
-      { // Found it, Piece holds the spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
+      if(Piece->PhysicalStart == pagetable_address)
+      { // Found it, Piece holds the spot now. Also, we know it's at the base of Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
         break;
       }
     }
 
     if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
     {
-      error_printf("Setup_MemMap: MemMap not found.\r\n");
+      error_printf("Pagetable area not found. Unsafe to continue.\r\n");
       HaCF();
     }
     else
     {
-      // Mark the new area as memmap (it's currently EfiConventionalMemory)
+      freeindex_carve(pagetable_address, numpages);
+
+      // Mark the new area as PageTables (it's currently EfiConventionalMemory)
       if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
       {
-        Piece->Type = EfiMaxMemoryType + 3; // Special memmap type
+        Piece->Type = EfiMaxMemoryType + 4; // Special PageTables type
         // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
       }
-      else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the map's new area is at the base of the EfiConventionalMemory descriptor
+      else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
       {
-        // Make a temporary descriptor to hold current piece's values, but modified for memmap
+        // Make a temporary descriptor to hold current piece's values, but modified for PageTables
         EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-        new_descriptor_temp.Type = EfiMaxMemoryType + 3; // Special memmap type
+        new_descriptor_temp.Type = EfiMaxMemoryType + 4; // Special PageTables type
         new_descriptor_temp.Pad = Piece->Pad;
         new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
         new_descriptor_temp.VirtualStart = Piece->VirtualStart;
         new_descriptor_temp.NumberOfPages = numpages;
         new_descriptor_temp.Attribute = Piece->Attribute;
 
-        // Modify this descriptor (shrink it) to reflect its new values
+        // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
         Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
         Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
         Piece->NumberOfPages -= numpages;
@@ -2860,464 +5591,417 @@ void Setup_MemMap(void)
         // Update Global_Memory_Info with new MemMap size
         Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
       }
-      // Done modifying new map.
-
-      // Now set up null area, or at least try to.
-      null_alloc();
+      // Done modifying map.
     }
   }
-}
-
-//----------------------------------------------------------------------------------------------------------------------------------
-//  MemMap_Prep: Check Memory Map for Space before Modifying It
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// Check if the memory map has enough free space in its memory area for additional descriptors. If not, move it somewhere that does.
-// This should be called before doing anything that adds descriptors, as is done in malloc(), vmalloc(), and pagetable_alloc().
-//
-// num_additional_descriptors: The number of extra descriptors space is needed for (usually 1, except [v]malloc, which asks for 2)
-//
-// Returns 0 on success
-//
-// NOTE: Any function call that includes a call to MemMap_Prep() will render variables holding memory map addresses unusable
-// afterwards. This is simply because it can no longer be guaranteed that the memory map is in the same place as before;
-// MemMap_Prep() might have changed its location. This is very important to keep in mind when creating functions like realloc() and
-// also when working with multiple cores.
-//
-// A list of functions that call MemMap_Prep():
-// - null_alloc()
-// - pagetable_alloc()
-// - AllocateFreeAddress()
-// - VAllocateFreeAddress()
-// - All variants of malloc() (i.e. malloc(), mallocX(), vmalloc(), vmallocX(), calloc(), realloc(), vcalloc(), and vrealloc(), as they call the [V]AllocateFreeAddress() functions)
-//
-
-uint64_t MemMap_Prep(uint64_t num_additional_descriptors)
-{
-  // Need enough space to contain the map + "num_additional_descriptors" additional descriptors
-  size_t numpages = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapSize + (num_additional_descriptors * Global_Memory_Info.MemMapDescriptorSize));
-  size_t orig_numpages = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapSize);
-
-  if(numpages > orig_numpages)
-  { // Need to move the map somewhere with more pages available. Don't want to play any fragmentation games with it.
-
-    EFI_MEMORY_DESCRIPTOR * Piece;
-
-    // Find the memmap's descriptor in the memmap
-    for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-    {
-      if(Piece->Type == (EfiMaxMemoryType + 3)) // MemMap type
-      { // Found it, Piece holds the spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
-        break;
-      }
-    }
-
-    if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
-    {
-      error_printf("MemMap_Prep: MemMap not found. Has it not been set up yet?\r\n");
-      HaCF();
-    }
-    else // Found memmap, so no issues
-    {
-      size_t additional_numpages = numpages - orig_numpages;
-      // If the area right after the memory map is EfiConventionalMemory, we might be able to just take some pages from there...
-
-      // Check if there's an EfiConventionalMemory region adjacent in memory to the memmap region
-      EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize); // Remember... sizeof(EFI_MEMORY_DESCRIPTOR) != MemMapDescriptorSize :/
-      EFI_PHYSICAL_ADDRESS PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT); // Get the end of this range, which may be the start of another range
-
-      // Quick check for adjacency that will skip scanning the whole memmap
-      // Can provide a little speed boost for ordered memory maps
-      if(
-          (Next_Piece->PhysicalStart != PhysicalEnd)
-          ||
-          ((uint8_t*)Next_Piece >= ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-        ) // This OR check protects against the obscure case of there being a rogue entry adjacent the end of the memory map that describes a valid EfiConventionalMemory entry
-      {
-        // See if PhysicalEnd matches any PhysicalStart for unordered maps
-        for(Next_Piece = Global_Memory_Info.MemMap; Next_Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize))
-        {
-          if(PhysicalEnd == Next_Piece->PhysicalStart)
-          {
-            // Found one
-            break;
-          }
-        }
-      }
 
-      // Is the next piece an EfiConventionalMemory type?
-      if(
-          (Next_Piece->Type == EfiConventionalMemory) && (Next_Piece->NumberOfPages >= additional_numpages)
-          &&
-          ((uint8_t*)Next_Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize))
-        ) // Check if the loop didn't break (this also covers the case where the memory map is the last valid entry in the map)
-      {
-        if(Next_Piece->NumberOfPages > additional_numpages)
-        {
-          // Modify MemMap's entry
-          Piece->NumberOfPages = numpages;
+  return pagetable_address;
+}
 
-          // Modify adjacent EfiConventionalMemory's entry
-          Next_Piece->NumberOfPages -= additional_numpages;
-          Next_Piece->PhysicalStart += (additional_numpages << EFI_PAGE_SHIFT);
-          Next_Piece->VirtualStart += (additional_numpages << EFI_PAGE_SHIFT);
 
-          // Done
-        }
-        else if(Next_Piece->NumberOfPages == additional_numpages)
-        { // If the next piece is exactly the number of pages, we can claim it and reclaim a descriptor
-          // This just means that MemMap will have some wiggle room for the next time this function is used.
+//----------------------------------------------------------------------------------------------------------------------------------
+//  RebuildFreeIndex: Rebuild the EfiConventionalMemory Index from the Memory Map
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The physical allocators used to find free space by walking every descriptor in the memory map, which gets slow when firmware hands
+// over a map with hundreds of entries (and gets slower as malloc fragments it further). To avoid that, every EfiConventionalMemory
+// descriptor also gets a node in an AVL tree ordered by PhysicalStart. Each node tracks the largest NumberOfPages in its subtree, so
+// "lowest free region >= some address with at least N pages" is an O(log n) walk. That's exactly the bottom-up first-fit query that
+// ActuallyFreeAddress() and ActuallyAlignedFreeAddress() make, so allocation placement doesn't change.
+//
+// The memory map is still the source of truth (ACPI and runtime services don't know or care about this tree). Anything that turns
+// EfiConventionalMemory into something else or vice versa needs to mirror that with freeindex_carve() or freeindex_insert()/
+// freeindex_remove(). If the tree ever falls out of step or runs out of nodes, Valid gets cleared and lookups go back to scanning the
+// map until the next rebuild. MergeContiguousConventionalMemory() rebuilds the tree when it's done, since it can rearrange everything.
+//
 
-          // Modify MemMap's entry
-          Piece->NumberOfPages = numpages;
+void RebuildFreeIndex(void)
+{
+  Global_Free_Index.Valid = 0;
 
-          // Erase the claimed descriptor
-          // Zero out the piece we just claimed
-          AVX_memset(Next_Piece, 0, Global_Memory_Info.MemMapDescriptorSize); // Next_Piece is a pointer
-          AVX_memmove(Next_Piece, (uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)((uint8_t*)Next_Piece + Global_Memory_Info.MemMapDescriptorSize));
+  if(Global_Free_Index.Pool == NULL)
+  {
+    // Setup_MemMap() hasn't allocated the node pool yet
+    return;
+  }
 
-          // Update Global_Memory_Info
-          Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+  // Put every node back on the spare list
+  Global_Free_Index.Root = NULL;
+  Global_Free_Index.Spare = NULL;
+  Global_Free_Index.NumNodes = 0;
+  for(uint64_t node_index = FREE_INDEX_MAX_NODES; node_index > 0; node_index--)
+  {
+    Global_Free_Index.Pool[node_index - 1].Right = Global_Free_Index.Spare;
+    Global_Free_Index.Spare = &Global_Free_Index.Pool[node_index - 1];
+  }
 
-          // Zero out the entry that used to be at the end of the map
-          AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+  Global_Free_Index.Valid = 1;
 
-          // Done
-        }
-        // There is no else, as there are only > and == cases.
-        else
-        {
-          error_printf("MemMap_Prep: What kind of sorcery is this? Seeing this means there's a bug in MemMap_Prep.\r\n");
-          HaCF();
-        }
-      } // End convenient conditions
-      else // Nope, need to move it altogether
-      {
-        // Map's gettin' evicted, gotta relocate.
+  EFI_MEMORY_DESCRIPTOR * Piece;
 
-        // So re-set numpages because now that the map needs the requested amount of descriptors + 1 more for itself
-        numpages = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapSize + ((num_additional_descriptors + 1)*Global_Memory_Info.MemMapDescriptorSize));
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages))
+    {
+      freeindex_insert(Piece->PhysicalStart, Piece->NumberOfPages);
+    }
+  }
 
-        EFI_PHYSICAL_ADDRESS new_MemMap_base_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
-        if(new_MemMap_base_address == ~0ULL)
-        {
-          error_printf("MemMap_Prep: Can't move memmap for enlargement: Out of memory\r\n");
-          return ~0ULL;
-        }
-        else
-        {
-          EFI_MEMORY_DESCRIPTOR * new_MemMap = (EFI_MEMORY_DESCRIPTOR*)new_MemMap_base_address;
-          // Zero out the new memmap destination
-          AVX_memset(new_MemMap, 0, numpages << EFI_PAGE_SHIFT);
+#ifdef MEMORY_CHECK_INFO
+  if(!Global_Free_Index.Valid)
+  {
+    warning_printf("RebuildFreeIndex: More than %llu free regions, falling back to memory map scans.\r\n", (uint64_t)FREE_INDEX_MAX_NODES);
+  }
+#endif
+}
 
-          // Mark the old one as EfiConventionalMemory
-          // Do this now because any later Piece is not guaranteed to point to the old memmap descriptor in the new map
-          // It's a lot faster to do it here than to look for it later when there's another memmap entry
-          // For multi-core stuff, all other processors need to be prevented from accessing the map during this whole function
+//----------------------------------------------------------------------------------------------------------------------------------
+//  freeindex_*: EfiConventionalMemory Index Internals
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// AVL tree plumbing for the index described above RebuildFreeIndex(). The tree is only ever a few dozen levels deep at most, so
+// recursion is fine here.
+//
 
-          // TODO: make a "memory map in use" tracker variable that gets checked before map gets read from or written to, and stops other core until it's free
-          // Will need to implement a priority mechnism, as well, to allow other cores first-in, first-out
-          Piece->Type = EfiConventionalMemory;
+static inline uint64_t freeindex_height(FREE_INDEX_NODE * Node)
+{
+  return (Node == NULL) ? 0 : Node->Height;
+}
 
-          // Move (copy) the map from MemMap to new_MemMap
-          AVX_memmove(new_MemMap, Global_Memory_Info.MemMap, Global_Memory_Info.MemMapSize);
-          // Zero out the old one
-          AVX_memset(Global_Memory_Info.MemMap, 0, Global_Memory_Info.MemMapSize);
+static inline uint64_t freeindex_maxpages(FREE_INDEX_NODE * Node)
+{
+  return (Node == NULL) ? 0 : Node->MaxPages;
+}
 
-          // Update Global_Memory_Info MemMap location with new address
-          Global_Memory_Info.MemMap = new_MemMap;
-          // MemMapSize is still the same size, though.
+// Recompute a node's height and largest subtree region from its children
+static void freeindex_update(FREE_INDEX_NODE * Node)
+{
+  uint64_t left_height = freeindex_height(Node->Left);
+  uint64_t right_height = freeindex_height(Node->Right);
+  Node->Height = 1 + ((left_height > right_height) ? left_height : right_height);
 
-          // Get a pointer for the descriptor corresponding to the new location of the map (scan the map to find it)
-          for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-          {
-            if(Piece->PhysicalStart == new_MemMap_base_address)
-            { // Found it, Piece holds the new spot now. Also, we know the map base is at Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
-              break;
-            }
-          }
+  uint64_t max_pages = Node->NumberOfPages;
+  if(freeindex_maxpages(Node->Left) > max_pages)
+  {
+    max_pages = Node->Left->MaxPages;
+  }
+  if(freeindex_maxpages(Node->Right) > max_pages)
+  {
+    max_pages = Node->Right->MaxPages;
+  }
+  Node->MaxPages = max_pages;
+}
 
-          if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
-          {
-            // If this ever happens, it's an emergency situation and everything needs to stop now since the map is gone.
-            error_printf("MemMap_Prep: MemMap not found. Something's weird here...\r\n");
-            HaCF();
-          }
-          else
-          {
-            // Mark the new area as memmap (it's currently EfiConventionalMemory)
-            if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
-            {
-              Piece->Type = EfiMaxMemoryType + 3; // Special memmap type
-              // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
-            }
-            else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the map's new area is at the base of the EfiConventionalMemory descriptor
-            {
-              // Make a temporary descriptor to hold current piece's values, but modified for memmap
-              EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-              new_descriptor_temp.Type = EfiMaxMemoryType + 3; // Special memmap type
-              new_descriptor_temp.Pad = Piece->Pad;
-              new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-              new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-              new_descriptor_temp.NumberOfPages = numpages;
-              new_descriptor_temp.Attribute = Piece->Attribute;
+static FREE_INDEX_NODE * freeindex_rotate_right(FREE_INDEX_NODE * Node)
+{
+  FREE_INDEX_NODE * NewTop = Node->Left;
+  Node->Left = NewTop->Right;
+  NewTop->Right = Node;
+  freeindex_update(Node);
+  freeindex_update(NewTop);
+  return NewTop;
+}
 
-              // Modify this descriptor (shrink it) to reflect its new values
-              Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-              Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
-              Piece->NumberOfPages -= numpages;
+static FREE_INDEX_NODE * freeindex_rotate_left(FREE_INDEX_NODE * Node)
+{
+  FREE_INDEX_NODE * NewTop = Node->Right;
+  Node->Right = NewTop->Left;
+  NewTop->Left = Node;
+  freeindex_update(Node);
+  freeindex_update(NewTop);
+  return NewTop;
+}
 
-              // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-              AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+// Update a node whose subtrees just changed and rotate it back into balance. Returns the new subtree root.
+static FREE_INDEX_NODE * freeindex_balance(FREE_INDEX_NODE * Node)
+{
+  freeindex_update(Node);
 
-              // Insert the new piece (by overwriting the now-duplicated entry with new values)
-              // I.e. turn this piece into what was stored in the temporary descriptor above
-              Piece->Type = new_descriptor_temp.Type;
-              Piece->Pad = new_descriptor_temp.Pad;
-              Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-              Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-              Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-              Piece->Attribute = new_descriptor_temp.Attribute;
+  if(freeindex_height(Node->Left) > freeindex_height(Node->Right) + 1)
+  {
+    if(freeindex_height(Node->Left->Right) > freeindex_height(Node->Left->Left))
+    {
+      Node->Left = freeindex_rotate_left(Node->Left);
+    }
+    return freeindex_rotate_right(Node);
+  }
+  else if(freeindex_height(Node->Right) > freeindex_height(Node->Left) + 1)
+  {
+    if(freeindex_height(Node->Right->Left) > freeindex_height(Node->Right->Right))
+    {
+      Node->Right = freeindex_rotate_right(Node->Right);
+    }
+    return freeindex_rotate_left(Node);
+  }
 
-              // Update Global_Memory_Info with new MemMap size
-              Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-            }
+  return Node;
+}
 
-            // Done modifying new map.
-            // Don't merge here, because that would undo everything just done.
-          }
-        }
+static FREE_INDEX_NODE * freeindex_insert_node(FREE_INDEX_NODE * Root, FREE_INDEX_NODE * Node)
+{
+  if(Root == NULL)
+  {
+    return Node;
+  }
 
-        // Done
-      } // End move map conditions
-    }
+  if(Node->PhysicalStart < Root->PhysicalStart)
+  {
+    Root->Left = freeindex_insert_node(Root->Left, Node);
+  }
+  else
+  {
+    Root->Right = freeindex_insert_node(Root->Right, Node);
+  }
+
+  return freeindex_balance(Root);
+}
 
+// Detach the lowest-addressed node of a subtree, returning it in *Min
+static FREE_INDEX_NODE * freeindex_remove_min(FREE_INDEX_NODE * Root, FREE_INDEX_NODE ** Min)
+{
+  if(Root->Left == NULL)
+  {
+    *Min = Root;
+    return Root->Right;
   }
-  // Nothing to do otherwise, there's enough space in the last page for another descriptor
 
-  // All done
-  return 0;
+  Root->Left = freeindex_remove_min(Root->Left, Min);
+  return freeindex_balance(Root);
 }
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  null_alloc: Allocate Memory for Page Tables
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// This function reserves the first 4kB page at address 0x0 for NULL. This is needed because many libraries depend on 0x0 being
-// invalid, but the malloc implementation here is perfectly happy to return it as a valid address (because it is). By reserving
-// address 0x0, such comparisons are safe and the memory at0x0 can be read to see if anything has been spuriously writing to 0x0.
-//
-// Returns the address 0x0 on success.
-//
-// EFI_PHYSICAL_ADDRESS is just a uint64_t.
-//
+// Detach the node starting at PhysicalStart, returning it in *Removed (NULL if there isn't one)
+static FREE_INDEX_NODE * freeindex_remove_node(FREE_INDEX_NODE * Root, EFI_PHYSICAL_ADDRESS PhysicalStart, FREE_INDEX_NODE ** Removed)
+{
+  if(Root == NULL)
+  {
+    *Removed = NULL;
+    return NULL;
+  }
 
-EFI_PHYSICAL_ADDRESS null_alloc(void)
+  if(PhysicalStart < Root->PhysicalStart)
+  {
+    Root->Left = freeindex_remove_node(Root->Left, PhysicalStart, Removed);
+  }
+  else if(PhysicalStart > Root->PhysicalStart)
+  {
+    Root->Right = freeindex_remove_node(Root->Right, PhysicalStart, Removed);
+  }
+  else
+  {
+    *Removed = Root;
+
+    if(Root->Left == NULL)
+    {
+      return Root->Right;
+    }
+    else if(Root->Right == NULL)
+    {
+      return Root->Left;
+    }
+
+    // Two children: the in-order successor takes this node's place
+    FREE_INDEX_NODE * Successor;
+    FREE_INDEX_NODE * Right = freeindex_remove_min(Root->Right, &Successor);
+    Successor->Left = Root->Left;
+    Successor->Right = Right;
+    return freeindex_balance(Successor);
+  }
+
+  return freeindex_balance(Root);
+}
+
+// Lowest-addressed region that starts at or above OldAddress and has at least the requested number of pages
+static FREE_INDEX_NODE * freeindex_first_fit(FREE_INDEX_NODE * Root, size_t pages, EFI_PHYSICAL_ADDRESS OldAddress)
 {
-  // All this does is take some EfiConventionalMemory at 0x0 and add one entry to the map
+  if((Root == NULL) || (Root->MaxPages < pages))
+  {
+    return NULL;
+  }
 
-  // Check if UEFI marked 0x0 as EfiReservedMemoryType, because that would actually be OK.
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  size_t numpages = 1; // Only need one page!
-  EFI_PHYSICAL_ADDRESS null_address = 0x0;
+  if(Root->PhysicalStart < OldAddress)
+  {
+    return freeindex_first_fit(Root->Right, pages, OldAddress);
+  }
 
-  // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
-  for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  FREE_INDEX_NODE * Found = freeindex_first_fit(Root->Left, pages, OldAddress);
+  if(Found != NULL)
   {
-    if(Piece->PhysicalStart == null_address)
-    { // Found the 0x0 entry
-      if(Piece->Type == EfiReservedMemoryType)
-      {
-        info_printf("UEFI set 0x0 to EfiReservedMemoryType: No need to explicitly set null area.\r\n");
+    return Found;
+  }
+  else if(Root->NumberOfPages >= pages)
+  {
+    return Root;
+  }
 
-        // Because EfiReservedMemoryType has the value of 0, this could also indicate that something is wrong with the memory map.
-        if(Piece->NumberOfPages == 0) // Number of pages should never be zero. A zero-size memory map region wouldn't be on the map!
-        { // This could mean a bootloader or firmware issue. Had it happen before, which led to the discovery of a MemoryMapSize calculation error in the bootloader.
-          error_printf("Err, hold on a second. NumberOfPages should never be 0.\r\nSomething's wrong with the memory map. Check it here:\r\n");
-          print_system_memmap();
-          HaCF();
-        }
+  return freeindex_first_fit(Root->Right, pages, OldAddress);
+}
 
-        return null_address;
-      }
-      else if(Piece->Type != EfiConventionalMemory)
-      {
-        warning_printf("Warning: Something is set at null area (address 0x0).\r\nFree up the first page at address 0x0 and try again.\r\n");
-      }
-      // else we're good.
+// Lowest address >= OldAddress that's aligned to byte_alignment and has pages free after it, or ~0ULL. Doesn't print anything.
+static EFI_PHYSICAL_ADDRESS freeindex_aligned_fit(uint64_t pages, EFI_PHYSICAL_ADDRESS OldAddress, uintmax_t byte_alignment)
+{
+  // Walk big-enough regions bottom-up until one has room after aligning its base
+  FREE_INDEX_NODE * Node = freeindex_first_fit(Global_Free_Index.Root, pages, OldAddress);
+  while(Node != NULL)
+  {
+    EFI_PHYSICAL_ADDRESS PhysicalEnd = Node->PhysicalStart + (Node->NumberOfPages << EFI_PAGE_SHIFT);
+    EFI_PHYSICAL_ADDRESS NewAddress = (Node->PhysicalStart + byte_alignment - 1) & ~(byte_alignment - 1);
 
-      break;
+    if((NewAddress + (pages << EFI_PAGE_SHIFT)) <= PhysicalEnd)
+    {
+      return NewAddress;
     }
+
+    Node = freeindex_first_fit(Global_Free_Index.Root, pages, Node->PhysicalStart + 1);
   }
 
-  if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
+  return ~0ULL;
+}
+
+// Region containing Address, if any
+static FREE_INDEX_NODE * freeindex_find(EFI_PHYSICAL_ADDRESS Address)
+{
+  FREE_INDEX_NODE * Node = Global_Free_Index.Root;
+  FREE_INDEX_NODE * Candidate = NULL;
+
+  // Find the highest region starting at or below Address
+  while(Node != NULL)
   {
-    error_printf("Huh, Address 0x0 not found at PhysicalStart of any region. Unsafe to continue.\r\n");
-    printf("Memory map check:\r\n");
-    print_system_memmap();
-    HaCF();
+    if(Node->PhysicalStart <= Address)
+    {
+      Candidate = Node;
+      Node = Node->Right;
+    }
+    else
+    {
+      Node = Node->Left;
+    }
   }
 
-  // Ensure memmap has enough space for another descriptor
-  if(MemMap_Prep(1))
+  if((Candidate != NULL) && (Address < Candidate->PhysicalStart + (Candidate->NumberOfPages << EFI_PAGE_SHIFT)))
   {
-    error_printf("null_alloc: Could not prep memory map...\r\n");
-    HaCF();
+    return Candidate;
   }
 
-  // Zero out the destination
-  AVX_memset((void*)null_address, 0, numpages << EFI_PAGE_SHIFT);
+  return NULL;
+}
 
-  // Mark the new area as null area (it's currently EfiConventionalMemory)
-  if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
+// A new EfiConventionalMemory descriptor has shown up in the map
+static void freeindex_insert(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages)
+{
+  if((!Global_Free_Index.Valid) || (NumberOfPages == 0))
   {
-    Piece->Type = EfiMaxMemoryType + 5; // Special Null type
-    // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
+    return;
   }
-  else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
-  {
-    // Make a temporary descriptor to hold current piece's values, but modified for null area
-    EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-    new_descriptor_temp.Type = EfiMaxMemoryType + 5; // Special Null type
-    new_descriptor_temp.Pad = Piece->Pad;
-    new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-    new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-    new_descriptor_temp.NumberOfPages = numpages;
-    new_descriptor_temp.Attribute = Piece->Attribute;
-
-    // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
-    Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-    Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
-    Piece->NumberOfPages -= numpages;
-
-    // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-    AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
-
-    // Insert the new piece (by overwriting the now-duplicated entry with new values)
-    // I.e. turn this piece into what was stored in the temporary descriptor above
-    Piece->Type = new_descriptor_temp.Type;
-    Piece->Pad = new_descriptor_temp.Pad;
-    Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-    Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-    Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-    Piece->Attribute = new_descriptor_temp.Attribute;
 
-    // Update Global_Memory_Info with new MemMap size
-    Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
+  FREE_INDEX_NODE * Node = Global_Free_Index.Spare;
+  if(Node == NULL)
+  {
+    // Out of nodes. Scanning the map still works, so just stop using the tree.
+    Global_Free_Index.Valid = 0;
+    return;
   }
+  Global_Free_Index.Spare = Node->Right;
 
-  // Done modifying map.
+  Node->PhysicalStart = PhysicalStart;
+  Node->NumberOfPages = NumberOfPages;
+  Node->MaxPages = NumberOfPages;
+  Node->Left = NULL;
+  Node->Right = NULL;
+  Node->Height = 1;
 
-  return null_address;
+  Global_Free_Index.Root = freeindex_insert_node(Global_Free_Index.Root, Node);
+  Global_Free_Index.NumNodes++;
 }
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  pagetable_alloc: Allocate Memory for Page Tables
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// Returns a 4k-aligned address of a region of size 'pagetable_size' specified for use by page tables
-//
-// EFI_PHYSICAL_ADDRESS is just a uint64_t.
-//
-
-EFI_PHYSICAL_ADDRESS pagetable_alloc(uint64_t pagetables_size)
+// An EfiConventionalMemory descriptor starting at PhysicalStart has left the map (or is about to be modified)
+static void freeindex_remove(EFI_PHYSICAL_ADDRESS PhysicalStart)
 {
-  // All this does is take some EfiConventionalMemory and add one entry to the map
-
-  // First, ensure memmap has enough space for another descriptor
-  if(MemMap_Prep(1))
+  if(!Global_Free_Index.Valid)
   {
-    error_printf("pagetable_alloc: Could not prep memory map...\r\n");
-    HaCF();
+    return;
   }
 
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  size_t numpages = EFI_SIZE_TO_PAGES(pagetables_size);
+  FREE_INDEX_NODE * Removed;
+  Global_Free_Index.Root = freeindex_remove_node(Global_Free_Index.Root, PhysicalStart, &Removed);
 
-  EFI_PHYSICAL_ADDRESS pagetable_address = ActuallyFreeAddress(numpages, 0x1); // This will only give addresses at the base of a chunk of EfiConventionalMemory, use 0x1 because we don't want address 0x0.
-  if(pagetable_address == ~0ULL)
+  if(Removed == NULL)
   {
-    error_printf("Not enough space for page tables. Unsafe to continue.\r\n");
-    HaCF();
+#ifdef MEMORY_CHECK_INFO
+    error_printf("freeindex_remove: Region %#qx not indexed.\r\n", PhysicalStart);
+#endif
+    Global_Free_Index.Valid = 0;
+    return;
   }
-  else
-  {
-    // Zero out the destination
-    AVX_memset((void*)pagetable_address, 0, numpages << EFI_PAGE_SHIFT);
 
-    // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
-    for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
-    {
-      if(Piece->PhysicalStart == pagetable_address)
-      { // Found it, Piece holds the spot now. Also, we know it's at the base of Piece->PhysicalStart of an EfiConventionalMemory area because we put it there with ActuallyFreeAddress.
-        break;
-      }
-    }
+  Removed->Right = Global_Free_Index.Spare;
+  Global_Free_Index.Spare = Removed;
+  Global_Free_Index.NumNodes--;
+}
 
-    if((uint8_t*)Piece == ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize)) // This will be true if the loop didn't break
-    {
-      error_printf("Pagetable area not found. Unsafe to continue.\r\n");
-      HaCF();
-    }
-    else
-    {
-      // Mark the new area as PageTables (it's currently EfiConventionalMemory)
-      if(Piece->NumberOfPages == numpages) // Trivial case: The new space descriptor is just the right size and needs no splitting; saves a memory descriptor so MemMapSize doesn't need to be increased
-      {
-        Piece->Type = EfiMaxMemoryType + 4; // Special PageTables type
-        // Nothng to do for Pad, PhysicalStart, VirtualStart, NumberOfPages, and Attribute
-      }
-      else // Need to insert a memmap descriptor. Thanks to the way ActuallyFreeAddress works we know the area is at the base of the EfiConventionalMemory descriptor
-      {
-        // Make a temporary descriptor to hold current piece's values, but modified for PageTables
-        EFI_MEMORY_DESCRIPTOR new_descriptor_temp;
-        new_descriptor_temp.Type = EfiMaxMemoryType + 4; // Special PageTables type
-        new_descriptor_temp.Pad = Piece->Pad;
-        new_descriptor_temp.PhysicalStart = Piece->PhysicalStart;
-        new_descriptor_temp.VirtualStart = Piece->VirtualStart;
-        new_descriptor_temp.NumberOfPages = numpages;
-        new_descriptor_temp.Attribute = Piece->Attribute;
+// Pages [Address, Address + NumberOfPages) of an EfiConventionalMemory descriptor have been taken. Whatever is left of the
+// descriptor below and above them stays free, which is the same split the allocators make in the map.
+static void freeindex_carve(EFI_PHYSICAL_ADDRESS Address, uint64_t NumberOfPages)
+{
+  if(!Global_Free_Index.Valid)
+  {
+    return;
+  }
 
-        // Modify this EfiConventionalMemory descriptor (shrink it) to reflect its new values
-        Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->NumberOfPages -= numpages;
+  FREE_INDEX_NODE * Node = freeindex_find(Address);
+  if(Node == NULL)
+  {
+#ifdef MEMORY_CHECK_INFO
+    error_printf("freeindex_carve: Region %#qx not indexed.\r\n", Address);
+#endif
+    Global_Free_Index.Valid = 0;
+    return;
+  }
 
-        // Move (copy) the whole memmap that's above this piece (including this freshly modified piece) from this piece to one MemMapDescriptorSize over
-        AVX_memmove((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize, Piece, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)Piece); // Pointer math to get size
+  EFI_PHYSICAL_ADDRESS RegionStart = Node->PhysicalStart;
+  EFI_PHYSICAL_ADDRESS RegionEnd = RegionStart + (Node->NumberOfPages << EFI_PAGE_SHIFT);
+  EFI_PHYSICAL_ADDRESS CarveEnd = Address + (NumberOfPages << EFI_PAGE_SHIFT);
 
-        // Insert the new piece (by overwriting the now-duplicated entry with new values)
-        // I.e. turn this piece into what was stored in the temporary descriptor above
-        Piece->Type = new_descriptor_temp.Type;
-        Piece->Pad = new_descriptor_temp.Pad;
-        Piece->PhysicalStart = new_descriptor_temp.PhysicalStart;
-        Piece->VirtualStart = new_descriptor_temp.VirtualStart;
-        Piece->NumberOfPages = new_descriptor_temp.NumberOfPages;
-        Piece->Attribute = new_descriptor_temp.Attribute;
+  freeindex_remove(RegionStart);
 
-        // Update Global_Memory_Info with new MemMap size
-        Global_Memory_Info.MemMapSize += Global_Memory_Info.MemMapDescriptorSize;
-      }
-      // Done modifying map.
-    }
+  if(Address > RegionStart)
+  {
+    freeindex_insert(RegionStart, (Address - RegionStart) >> EFI_PAGE_SHIFT);
+  }
+  if(CarveEnd < RegionEnd)
+  {
+    freeindex_insert(CarveEnd, (RegionEnd - CarveEnd) >> EFI_PAGE_SHIFT);
   }
-
-  return pagetable_address;
 }
 
-
 //----------------------------------------------------------------------------------------------------------------------------------
 //  ActuallyFreeAddress: Find A Free Physical Memory Address, Bottom-Up
 //----------------------------------------------------------------------------------------------------------------------------------
 //
 // Returns the next EfiConventionalMemory area that is >= the supplied OldAddress.
 //
+// Uses the EfiConventionalMemory index (see RebuildFreeIndex()) when it's available, so this is O(log n) in the number of free regions.
+//
 // pages: number of pages needed
 // OldAddress: A baseline address to search bottom-up from
 //
 
 EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(size_t pages, EFI_PHYSICAL_ADDRESS OldAddress)
 {
+  if(Global_Free_Index.Valid)
+  {
+    FREE_INDEX_NODE * Node = freeindex_first_fit(Global_Free_Index.Root, pages, OldAddress);
+    if(Node == NULL)
+    {
+#ifdef MEMORY_CHECK_INFO
+      error_printf("No more free physical addresses...\r\n");
+#endif
+      return ~0ULL;
+    }
+
+    return Node->PhysicalStart;
+  }
+
+  // No index (yet), so scan the map
   EFI_MEMORY_DESCRIPTOR * Piece;
 
   // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
@@ -3402,6 +6086,8 @@ EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(size_t pages, EFI_PHYSICAL_ADDRES
 //
 // Returns the next physical address in an EfiConventionalMemory area that is >= the supplied OldAddress and is aligned to a specified boundary.
 //
+// Candidate regions come from the EfiConventionalMemory index (see RebuildFreeIndex()) when it's available.
+//
 // pages: number of pages needed
 // OldAddress: A baseline address to search bottom-up from
 // byte_alignment: a desired alignment value in bytes. Valid sizes are power-of-2 multiples (e.g. 2x, 4x, 8x, 16x, 32x, etc.) of the UEFI page size (4096 bytes (4kB) in UEFI 2.x)
@@ -3433,6 +6119,21 @@ EFI_PHYSICAL_ADDRESS ActuallyAlignedFreeAddress(size_t pages, EFI_PHYSICAL_ADDRE
     NewAddress = OldAddress;
   }
 
+  if(Global_Free_Index.Valid)
+  {
+    DiscoveredAddress = freeindex_aligned_fit(pages, OldAddress, byte_alignment);
+
+#ifdef MEMORY_CHECK_INFO
+    if(DiscoveredAddress == ~0ULL)
+    {
+      error_printf("No more free physical addresses aligned by %llu bytes...\r\n", byte_alignment);
+    }
+#endif
+
+    return DiscoveredAddress;
+  }
+
+  // No index (yet), so scan the map
   // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
   // Check for EfiConventionalMemory in the map
   for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
@@ -3496,9 +6197,11 @@ EFI_PHYSICAL_ADDRESS ActuallyAlignedFreeAddress(size_t pages, EFI_PHYSICAL_ADDRE
 // UEFI memory maps have a page size of 4kB, which is the minimum allocatable size without resorting to further segmentation via
 // memory pooling. This allows dynamically allocated memory to be incorporated right into the main memmap. This has the advantage of
 // only requiring free(pointer)to free the descriptor made by this function. No extra sub-mapping, treeing, branching, binning,
-// bucketing, carving, slicing, or stressing out over such complexity needed. If finer granularity is absolutely required for some
-// reason, just make a struct that describes a 4kB area and typecast or convert the address/pointer returned by
-// AllocateFreeAddress/malloc to it.
+// bucketing, carving, slicing, or stressing out over such complexity needed. Finer granularity is handled one level up: malloc()
+// sends small requests to the slab allocator (see slab_alloc()), which carves 2MB regions from this function into size classes.
+//
+// With deferred zeroing on (see EnableDeferredZeroing()), regions that ZeroDirtyPages() has already zeroed are used before anything
+// else, so the result isn't necessarily the lowest free address >= OldAddress.
 //
 // NOTE: Max size of byte_alignment depends on quantity of installed RAM and how much of it is EfiConventionalMemory. Obviously it
 // doesn't make sense to 512GB-align when there's < 512GB RAM, and something like that will just return ~0ULL (indicating no
@@ -3528,7 +6231,13 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddress(size_t numbytes, EFI_PHYSICAL_ADDRESS O
     numpages++;
   }
 
-  EFI_PHYSICAL_ADDRESS alloc_address = ActuallyAlignedFreeAddress(numpages, OldAddress, byte_alignment);
+  // Memory that's already been zeroed by ZeroDirtyPages() is the cheapest to hand out
+  EFI_PHYSICAL_ADDRESS alloc_address = zeropool_clean_fit(numpages, OldAddress, byte_alignment);
+  if(alloc_address == ~0ULL)
+  {
+    alloc_address = ActuallyAlignedFreeAddress(numpages, OldAddress, byte_alignment);
+  }
+
   if(alloc_address == ~0ULL)
   {
     error_printf("Not enough space for AllocateFreeAddress (malloc). Unsafe to continue.\r\n");
@@ -3540,8 +6249,8 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddress(size_t numbytes, EFI_PHYSICAL_ADDRESS O
     return alloc_address;
   }
 
-  // Zero out the destination
-  AVX_memset((void*)alloc_address, 0, numpages << EFI_PAGE_SHIFT);
+  // Zero out the destination (only the parts that aren't already zero if deferred zeroing is on)
+  zeropool_claim(alloc_address, numpages, 1);
 
   // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
   for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
@@ -3550,6 +6259,9 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddress(size_t numbytes, EFI_PHYSICAL_ADDRESS O
 
     if( (Piece->PhysicalStart <= alloc_address) && ((alloc_address + (numpages << EFI_PAGE_SHIFT)) <= PhysicalEnd) )
     { // Found it, Piece holds the spot now.
+      // Keep the free region index in step with the split below
+      freeindex_carve(alloc_address, numpages);
+
       // Need to account for inserting a descriptor that might be for a region at the start of an EfiConventionalMemory chunk, at the end of an EfiConventionalMemory chunk, or somewhere in the middle of an EfiConventionalMemory chunk (requires 2 new descriptors)
       // ...Unless the trivial case is met, in which case 0 descriptors need to be added.
 
@@ -3606,8 +6318,8 @@ EFI_PHYSICAL_ADDRESS AllocateFreeAddress(size_t numbytes, EFI_PHYSICAL_ADDRESS O
         // Modify this descriptor to reflect its new values (become the new entry)
         Piece->Type = EfiMaxMemoryType + 1; // Special malloc type
         // Nothing for pad
-        Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+        Piece->PhysicalStart += (new_descriptor_temp.NumberOfPages << EFI_PAGE_SHIFT); // The malloc area is the top numpages of the region
+        Piece->VirtualStart += (new_descriptor_temp.NumberOfPages << EFI_PAGE_SHIFT);
         Piece->NumberOfPages = numpages;
         // Nothing for attribute
 
@@ -3934,9 +6646,6 @@ EFI_VIRTUAL_ADDRESS VAllocateFreeAddress(size_t numbytes, EFI_VIRTUAL_ADDRESS Ol
     return alloc_address;
   }
 
-  // Zero out the destination
-  AVX_memset((void*)alloc_address, 0, numpages << EFI_PAGE_SHIFT);
-
   // Get a pointer for the descriptor corresponding to the address (scan the memory map to find it)
   for(Piece = Global_Memory_Info.MemMap; (uint8_t*)Piece < ((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
   {
@@ -3944,6 +6653,11 @@ EFI_VIRTUAL_ADDRESS VAllocateFreeAddress(size_t numbytes, EFI_VIRTUAL_ADDRESS Ol
 
     if( (Piece->VirtualStart <= alloc_address) && ((alloc_address + (numpages << EFI_PAGE_SHIFT)) <= VirtualEnd) )
     { // Found it, Piece holds the spot now.
+      // Keep the free region index (which is by physical address) in step with the split below
+      freeindex_carve(Piece->PhysicalStart + (alloc_address - Piece->VirtualStart), numpages);
+      // Zero out the destination (only the parts that aren't already zero if deferred zeroing is on)
+      zeropool_claim(Piece->PhysicalStart + (alloc_address - Piece->VirtualStart), numpages, 1);
+
       // Need to account for inserting a descriptor that might be for a region at the start of an EfiConventionalMemory chunk, at the end of an EfiConventionalMemory chunk, or somewhere in the middle of an EfiConventionalMemory chunk (requires 2 new descriptors)
       // ...Unless the trivial case is met, in which case 0 descriptors need to be added.
 
@@ -4000,8 +6714,8 @@ EFI_VIRTUAL_ADDRESS VAllocateFreeAddress(size_t numbytes, EFI_VIRTUAL_ADDRESS Ol
         // Modify this descriptor to reflect its new values (become the new entry)
         Piece->Type = EfiMaxMemoryType + 2; // Special vmalloc type
         // Nothing for pad
-        Piece->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
-        Piece->VirtualStart += (numpages << EFI_PAGE_SHIFT);
+        Piece->PhysicalStart += (new_descriptor_temp.NumberOfPages << EFI_PAGE_SHIFT); // The vmalloc area is the top numpages of the region
+        Piece->VirtualStart += (new_descriptor_temp.NumberOfPages << EFI_PAGE_SHIFT);
         Piece->NumberOfPages = numpages;
         // Nothing for attribute
 
@@ -4117,36 +6831,168 @@ void ReclaimEfiBootServicesMemory(void)
       Piece->Type = EfiConventionalMemory; // Convert to EfiConventionalMemory
     }
   }
-  // Done.
+  // Done.
+
+  MergeContiguousConventionalMemory();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  ReclaimEfiLoaderCodeMemory: Convert EfiLoaderCode to EfiConventionalMemory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// After calling ExitBootServices(), it is up to the OS to decide what to do with EfiLoaderCode (and EfiLoaderData, though that's
+// used to store all the Loader Params that this kernel actively uses). This function reclaims that memory as free.
+//
+// Calling this function more than once won't do anything other than just waste some CPU time.
+//
+
+void ReclaimEfiLoaderCodeMemory(void)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  // Check for Loader Code (the boot loader that booted this kernel) leftovers in the map
+  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  {
+    if(Piece->Type == EfiLoaderCode)
+    {
+      Piece->Type = EfiConventionalMemory; // Convert to EfiConventionalMemory
+    }
+  }
+  // Done.
+
+  MergeContiguousConventionalMemory();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  coalesce_conventional: Merge a Freed Region with Its Address Neighbors
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Running MergeContiguousConventionalMemory() on every free would compare every descriptor against every other descriptor and could
+// AVX_memmove the whole map down once per merge, making each free quadratic in the size of the map. A freshly freed region can only
+// ever be adjacent to two other free regions, though: the one ending where it starts and the one starting where it ends. The free
+// region index already knows whether either exists, so in the common no-neighbor case this is just two tree lookups. When there is
+// something to merge, the neighbors' descriptors are found (usually right next to Piece in the map, since the map is ordered) and
+// folded into one, which costs at most two descriptor removals.
+//
+// Piece: an EfiConventionalMemory descriptor that was just freed, and has already been added to the index
+//
+// NOTE: Like anything that removes descriptors, this invalidates pointers into the memory map above Piece.
+//
+
+static void coalesce_conventional(EFI_MEMORY_DESCRIPTOR * Piece)
+{
+  EFI_PHYSICAL_ADDRESS PhysicalStart = Piece->PhysicalStart;
+  EFI_PHYSICAL_ADDRESS PhysicalEnd = PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+  EFI_MEMORY_DESCRIPTOR * MapEnd = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize);
+
+  uint8_t look_below = 1;
+  uint8_t look_above = 1;
+
+  if(Global_Free_Index.Valid)
+  {
+    // Regions don't overlap, so whatever free region holds the byte just below PhysicalStart must end right at PhysicalStart
+    look_below = (PhysicalStart != 0) && (freeindex_find(PhysicalStart - 1) != NULL);
+    look_above = (freeindex_find(PhysicalEnd) != NULL);
+
+    if((!look_below) && (!look_above))
+    {
+      // Nothing to merge with
+      return;
+    }
+  }
+
+  EFI_MEMORY_DESCRIPTOR * Below = NULL;
+  EFI_MEMORY_DESCRIPTOR * Above = NULL;
+
+  // Quick check of the descriptors on either side of Piece in the map, which is where the neighbors are in an ordered map
+  EFI_MEMORY_DESCRIPTOR * Prev_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece - Global_Memory_Info.MemMapDescriptorSize);
+  EFI_MEMORY_DESCRIPTOR * Next_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize);
+
+  if(
+      look_below && (Piece != Global_Memory_Info.MemMap) && (Prev_Piece->Type == EfiConventionalMemory)
+      &&
+      ((Prev_Piece->PhysicalStart + (Prev_Piece->NumberOfPages << EFI_PAGE_SHIFT)) == PhysicalStart)
+    )
+  {
+    Below = Prev_Piece;
+  }
+
+  if(look_above && (Next_Piece < MapEnd) && (Next_Piece->Type == EfiConventionalMemory) && (Next_Piece->PhysicalStart == PhysicalEnd))
+  {
+    Above = Next_Piece;
+  }
+
+  // Fall back to one pass over the map for unordered maps
+  if((look_below && (Below == NULL)) || (look_above && (Above == NULL)))
+  {
+    EFI_MEMORY_DESCRIPTOR * Scan_Piece;
+
+    for(Scan_Piece = Global_Memory_Info.MemMap; Scan_Piece < MapEnd; Scan_Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Scan_Piece + Global_Memory_Info.MemMapDescriptorSize))
+    {
+      if(Scan_Piece->Type == EfiConventionalMemory)
+      {
+        if(look_below && (Below == NULL) && ((Scan_Piece->PhysicalStart + (Scan_Piece->NumberOfPages << EFI_PAGE_SHIFT)) == PhysicalStart))
+        {
+          Below = Scan_Piece;
+        }
+        else if(look_above && (Above == NULL) && (Scan_Piece->PhysicalStart == PhysicalEnd))
+        {
+          Above = Scan_Piece;
+        }
+      }
+    }
+  }
+
+  if((Below == NULL) && (Above == NULL))
+  {
+    // Only possible without a valid index
+    return;
+  }
 
-  MergeContiguousConventionalMemory();
-}
+  // The lowest of the pieces absorbs the others
+  EFI_MEMORY_DESCRIPTOR * Keep = (Below != NULL) ? Below : Piece;
+  uint64_t merged_pages = Piece->NumberOfPages;
 
-//----------------------------------------------------------------------------------------------------------------------------------
-//  ReclaimEfiLoaderCodeMemory: Convert EfiLoaderCode to EfiConventionalMemory
-//----------------------------------------------------------------------------------------------------------------------------------
-//
-// After calling ExitBootServices(), it is up to the OS to decide what to do with EfiLoaderCode (and EfiLoaderData, though that's
-// used to store all the Loader Params that this kernel actively uses). This function reclaims that memory as free.
-//
-// Calling this function more than once won't do anything other than just waste some CPU time.
-//
+  freeindex_remove(PhysicalStart);
+  if(Below != NULL)
+  {
+    freeindex_remove(Below->PhysicalStart);
+    merged_pages += Below->NumberOfPages;
+  }
+  if(Above != NULL)
+  {
+    freeindex_remove(Above->PhysicalStart);
+    merged_pages += Above->NumberOfPages;
+  }
 
-void ReclaimEfiLoaderCodeMemory(void)
-{
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  Keep->NumberOfPages = merged_pages;
+  freeindex_insert(Keep->PhysicalStart, merged_pages);
 
-  // Check for Loader Code (the boot loader that booted this kernel) leftovers in the map
-  for(Piece = Global_Memory_Info.MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)Piece + Global_Memory_Info.MemMapDescriptorSize))
+  // Erase the absorbed descriptors, highest in the map first so the lower pointer stays valid
+  EFI_MEMORY_DESCRIPTOR * Erase[2] = {(Keep != Piece) ? Piece : NULL, Above};
+  if((uint64_t)Erase[0] < (uint64_t)Erase[1])
   {
-    if(Piece->Type == EfiLoaderCode)
+    Erase[0] = Erase[1];
+    Erase[1] = (Keep != Piece) ? Piece : NULL;
+  }
+
+  for(uint64_t erase_index = 0; erase_index < 2; erase_index++)
+  {
+    if(Erase[erase_index] == NULL)
     {
-      Piece->Type = EfiConventionalMemory; // Convert to EfiConventionalMemory
+      continue;
     }
-  }
-  // Done.
 
-  MergeContiguousConventionalMemory();
+    // Zero out the absorbed piece and slide the rest of the map down over it
+    AVX_memset(Erase[erase_index], 0, Global_Memory_Info.MemMapDescriptorSize);
+    AVX_memmove(Erase[erase_index], (uint8_t*)Erase[erase_index] + Global_Memory_Info.MemMapDescriptorSize, (uint64_t)((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize) - (uint64_t)((uint8_t*)Erase[erase_index] + Global_Memory_Info.MemMapDescriptorSize));
+
+    // Update Global_Memory_Info
+    Global_Memory_Info.MemMapSize -= Global_Memory_Info.MemMapDescriptorSize;
+
+    // Zero out the entry that used to be at the end of the map
+    AVX_memset((uint8_t*)Global_Memory_Info.MemMap + Global_Memory_Info.MemMapSize, 0, Global_Memory_Info.MemMapDescriptorSize);
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -4154,7 +7000,9 @@ void ReclaimEfiLoaderCodeMemory(void)
 //----------------------------------------------------------------------------------------------------------------------------------
 //
 // Merge adjacent EfiConventionalMemory locations that are listed as separate entries. This can only work with physical addresses.
-// It's main uses are during calls to free() and Setup_MemMap(), where this function acts to clean up the memory map.
+// This compares every descriptor against every other one, so it's a maintenance call for after bulk changes to the map (like the
+// Reclaim*() functions) rather than something to run on every free. free() and vfree() use coalesce_conventional() instead, which
+// only looks at the freed region's two address neighbors.
 //
 // This function also contains the logic necessary to shrink the memory map's own descriptor's NumberOfPages to reclaim extra space.
 //
@@ -4213,8 +7061,8 @@ void MergeContiguousConventionalMemory(void)
     HaCF();
   }
 
-  // How much space does the new map take?
-  size_t numpages2 = EFI_SIZE_TO_PAGES(Global_Memory_Info.MemMapSize);
+  // How much space does the new map take? Leave it room to grow by half again, or MemMap_Prep() would just have to regrow it
+  size_t numpages2 = EFI_SIZE_TO_PAGES((Global_Memory_Info.MemMapSize * 3) >> 1);
 
   // After all that, maybe some space can be reclaimed. Let's see what we can do...
   if(numpages2 < numpages)
@@ -4259,6 +7107,7 @@ void MergeContiguousConventionalMemory(void)
 
           // Modify MemMap's entry
           Piece->NumberOfPages = numpages2;
+          Global_Memory_Info.MemMapCapacity = numpages2 << EFI_PAGE_SHIFT;
 
           // Modify adjacent EfiConventionalMemory's entry
           Next_Piece->NumberOfPages += freedpages;
@@ -4280,6 +7129,7 @@ void MergeContiguousConventionalMemory(void)
           new_descriptor_temp.VirtualStart = Piece->VirtualStart;
           new_descriptor_temp.NumberOfPages = numpages2; // New size of MemMap entry
           new_descriptor_temp.Attribute = Piece->Attribute;
+          Global_Memory_Info.MemMapCapacity = numpages2 << EFI_PAGE_SHIFT;
 
           // Modify the descriptor-to-move
           Piece->Type = EfiConventionalMemory;
@@ -4324,6 +7174,7 @@ void MergeContiguousConventionalMemory(void)
             new_descriptor_temp.VirtualStart = Piece->VirtualStart;
             new_descriptor_temp.NumberOfPages = numpages2 + pages_per_memory_descriptor; // New size of MemMap entry
             new_descriptor_temp.Attribute = Piece->Attribute;
+            Global_Memory_Info.MemMapCapacity = (numpages2 + pages_per_memory_descriptor) << EFI_PAGE_SHIFT;
 
             // Modify the descriptor-to-move
             Piece->Type = EfiConventionalMemory;
@@ -4356,15 +7207,488 @@ void MergeContiguousConventionalMemory(void)
     } // End search for memmap loop
   } // End space reclaim
 
+  // Descriptors moved around and merged, so re-sync the free region index
+  RebuildFreeIndex();
+
   // Done
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+//  free_latency_benchmark: Time free() as the Memory Map Grows
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fragments the memory map with back-to-back single-page allocations until it holds max_descriptors descriptors, and every 128
+// descriptors along the way measures how long free() takes for the three cases it can hit: a region with no free neighbors, one free
+// neighbor, and two free neighbors. Results are in TSC ticks (see get_tick()), averaged over 16 runs each, and everything is freed
+// again at the end. If the A/B/C pages for a measurement can't be allocated, it stops there and still frees everything.
+//
+// max_descriptors: stop once the map has this many descriptors (e.g. 1024 or more)
+//
+
+void free_latency_benchmark(uint64_t max_descriptors)
+{
+  uint64_t max_fillers = max_descriptors + 1;
+  void ** fillers = (void**)malloc(max_fillers * sizeof(void*));
+  if((EFI_PHYSICAL_ADDRESS)fillers == ~0ULL)
+  {
+    error_printf("free_latency_benchmark: Not enough memory for the benchmark.\r\n");
+    return;
+  }
+
+  uint64_t num_fillers = 0;
+  uint64_t next_checkpoint = 128;
+  uint64_t out_of_memory = 0;
+  EFI_PHYSICAL_ADDRESS frontier = 0x1; // Everything is allocated bottom-up from here so the pages stay back-to-back
+
+  printf("free() latency in ticks, 16-run average:\r\n");
+  printf("Descriptors  No neighbors  1 neighbor  2 neighbors\r\n");
+
+  while((Global_Memory_Info.MemMapSize / Global_Memory_Info.MemMapDescriptorSize) < max_descriptors)
+  {
+    // Each 1-page allocation splits another descriptor off the bottom of a free region
+    EFI_PHYSICAL_ADDRESS filler = AllocateFreeAddress(EFI_PAGE_SIZE, frontier, EFI_PAGE_SIZE);
+    if((filler == ~0ULL) || (num_fillers == max_fillers))
+    {
+      if(filler != ~0ULL)
+      {
+        free((void*)filler);
+      }
+      warning_printf("free_latency_benchmark: Ran out of room for filler allocations.\r\n");
+      break;
+    }
+    fillers[num_fillers++] = (void*)filler;
+    frontier = filler + EFI_PAGE_SIZE;
+
+    uint64_t num_descriptors = Global_Memory_Info.MemMapSize / Global_Memory_Info.MemMapDescriptorSize;
+    if(num_descriptors >= next_checkpoint)
+    {
+      uint64_t ticks_none = 0;
+      uint64_t ticks_one = 0;
+      uint64_t ticks_two = 0;
+
+      for(uint64_t run = 0; run < 16; run++)
+      {
+        // Three back-to-back pages from the bottom of the same free region: A has an allocated page below it, C has the rest of
+        // the free region above it, and B ends up between two free regions once A and C are gone.
+        void * A = (void*)AllocateFreeAddress(EFI_PAGE_SIZE, frontier, EFI_PAGE_SIZE);
+        void * B = (void*)AllocateFreeAddress(EFI_PAGE_SIZE, (EFI_PHYSICAL_ADDRESS)A + EFI_PAGE_SIZE, EFI_PAGE_SIZE);
+        void * C = (void*)AllocateFreeAddress(EFI_PAGE_SIZE, (EFI_PHYSICAL_ADDRESS)B + EFI_PAGE_SIZE, EFI_PAGE_SIZE);
+
+        if(((EFI_PHYSICAL_ADDRESS)A == ~0ULL) || ((EFI_PHYSICAL_ADDRESS)B == ~0ULL) || ((EFI_PHYSICAL_ADDRESS)C == ~0ULL))
+        {
+          if((EFI_PHYSICAL_ADDRESS)A != ~0ULL)
+          {
+            free(A);
+          }
+          if((EFI_PHYSICAL_ADDRESS)B != ~0ULL)
+          {
+            free(B);
+          }
+          if((EFI_PHYSICAL_ADDRESS)C != ~0ULL)
+          {
+            free(C);
+          }
+          error_printf("free_latency_benchmark: Not enough memory to measure at %llu descriptors.\r\n", num_descriptors);
+          out_of_memory = 1;
+          break;
+        }
+
+        uint64_t start_tick = get_tick();
+        free(A);
+        uint64_t mid_tick = get_tick();
+        free(C);
+        uint64_t mid2_tick = get_tick();
+        free(B);
+        uint64_t end_tick = get_tick();
+
+        ticks_none += mid_tick - start_tick;
+        ticks_one += mid2_tick - mid_tick;
+        ticks_two += end_tick - mid2_tick;
+      }
+
+      if(out_of_memory)
+      {
+        break;
+      }
+
+      printf("%11llu  %12llu  %10llu  %11llu\r\n", num_descriptors, ticks_none >> 4, ticks_one >> 4, ticks_two >> 4);
+      next_checkpoint += 128;
+    }
+  }
+
+  while(num_fillers)
+  {
+    free(fillers[--num_fillers]);
+  }
+  free(fillers);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  EnableDeferredZeroing: Stop Zeroing Freed Memory on the Spot
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// By default free() zeroes a region before handing it back as EfiConventionalMemory, and AllocateFreeAddress() zeroes it again when
+// it gets allocated, so a malloc1GB()/free() pair costs two full passes of memory bandwidth in the caller's critical path. With
+// deferred zeroing on, free() just puts the region on the zero pool's dirty list instead (or, for a buddy block, marks the block
+// BUDDY_FRAME_DIRTY, since buddy arenas aren't EfiConventionalMemory). ZeroDirtyPages() moves dirty ranges onto
+// the clean list using non-temporal stores whenever there's time for it, AllocateFreeAddress() prefers clean ranges, and anything
+// an allocation gets that isn't clean is zeroed inline (which is what zero_pool_stats() reports as "zeroed inline").
+//
+// System_Init() turns this on once the memory map and magazines are set up.
+//
+// NOTE: The pool tracks physical addresses and zeroes through them, which relies on physical memory being identity-mapped.
+//
+
+void EnableDeferredZeroing(void)
+{
+  // free() checks this under the lock, so it can't change in the middle of one
+  allocator_lock();
+  Global_Zero_Pool.Enabled = 1;
+  allocator_unlock();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  DisableDeferredZeroing: Go Back to Zeroing Freed Memory on the Spot
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Zeroes everything still on the dirty list and every dirty buddy block, empties both lists, and makes free() zero regions itself
+// again.
+//
+
+void DisableDeferredZeroing(void)
+{
+  allocator_lock();
+
+  for(uint64_t range_index = 0; range_index < Global_Zero_Pool.NumDirty; range_index++)
+  {
+    memset_zeroes_as((void*)Global_Zero_Pool.Dirty[range_index].PhysicalStart, Global_Zero_Pool.Dirty[range_index].NumberOfPages << EFI_PAGE_SHIFT);
+  }
+
+#ifdef BUDDY_ALLOCATOR
+  buddy_zero_dirty(~0ULL);
+#endif
+
+  Global_Zero_Pool.NumDirty = 0;
+  Global_Zero_Pool.DirtyBytes = 0;
+  Global_Zero_Pool.NumClean = 0;
+  Global_Zero_Pool.CleanBytes = 0;
+  Global_Zero_Pool.Enabled = 0;
+
+  allocator_unlock();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  ZeroDirtyPages: Zero Freed Memory Ahead of Time
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Zeroes up to max_bytes (rounded up to whole pages) of the zero pool's dirty list with non-temporal stores, so that it doesn't
+// evict anything useful from the cache, and moves it to the clean list. This is meant to be called whenever there's nothing better
+// to do, e.g. while waiting on something, with a max_bytes that bounds how long it takes. ssleep() and msleep() do this with
+// ZERO_POOL_IDLE_BYTES on every pass of their wait loops. Pass ~0ULL to zero everything. Returns the number of bytes zeroed, which
+// is 0 once nothing dirty is left or if deferred zeroing is off.
+//
+// Stops early if the clean list is full, since zeroing a range that can't be remembered as clean would just be done again by
+// whichever allocation gets it. Whatever is left of max_bytes after the dirty list then goes to dirty buddy blocks, which are zeroed
+// whole, so those can take it over max_bytes by up to one block.
+//
+// max_bytes: the most bytes to zero in this call
+//
+
+uint64_t ZeroDirtyPages(uint64_t max_bytes)
+{
+  // Nothing is dirty with the pool off, and before Setup_Magazines() this core couldn't take the allocator lock anyway
+  if(!Global_Zero_Pool.Enabled)
+  {
+    return 0;
+  }
+
+  uint64_t zeroed_bytes = 0;
+
+  allocator_lock();
+
+  while(Global_Zero_Pool.NumDirty && (zeroed_bytes < max_bytes) && (Global_Zero_Pool.NumClean < ZERO_POOL_MAX_RANGES))
+  {
+    // Work from the end of the list, so finished ranges come off without moving anything
+    ZERO_POOL_RANGE * Range = &Global_Zero_Pool.Dirty[Global_Zero_Pool.NumDirty - 1];
+    EFI_PHYSICAL_ADDRESS RangeStart = Range->PhysicalStart;
+    uint64_t numpages = EFI_SIZE_TO_PAGES(max_bytes - zeroed_bytes);
+
+    if(numpages > Range->NumberOfPages)
+    {
+      numpages = Range->NumberOfPages;
+    }
+
+    memset_zeroes_as((void*)RangeStart, numpages << EFI_PAGE_SHIFT);
+
+    Range->PhysicalStart += (numpages << EFI_PAGE_SHIFT);
+    Range->NumberOfPages -= numpages;
+    if(Range->NumberOfPages == 0)
+    {
+      Global_Zero_Pool.NumDirty--;
+    }
+    Global_Zero_Pool.DirtyBytes -= (numpages << EFI_PAGE_SHIFT);
+
+    zeropool_add(Global_Zero_Pool.Clean, &Global_Zero_Pool.NumClean, RangeStart, numpages);
+    Global_Zero_Pool.CleanBytes += (numpages << EFI_PAGE_SHIFT);
+
+    zeroed_bytes += (numpages << EFI_PAGE_SHIFT);
+  }
+
+#ifdef BUDDY_ALLOCATOR
+  if(zeroed_bytes < max_bytes)
+  {
+    zeroed_bytes += buddy_zero_dirty(max_bytes - zeroed_bytes);
+  }
+#endif
+
+  allocator_unlock();
+
+  return zeroed_bytes;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  zero_pool_stats: Print Deferred Zeroing Counters
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Prints how much free memory is known to be zero (clean), how much is waiting to be zeroed (dirty), and how much the allocators
+// have had to zero inline so far. A large inline total relative to the clean total means ZeroDirtyPages() isn't getting called
+// often enough to keep up.
+//
+
+void zero_pool_stats(void)
+{
+  printf("Deferred zeroing: %s\r\n", Global_Zero_Pool.Enabled ? "on" : "off");
+  printf("  Clean: %llu kB in %llu ranges\r\n", Global_Zero_Pool.CleanBytes >> 10, Global_Zero_Pool.NumClean);
+  printf("  Dirty: %llu kB in %llu ranges\r\n", Global_Zero_Pool.DirtyBytes >> 10, Global_Zero_Pool.NumDirty);
+  printf("  Dirty buddy blocks: %llu kB\r\n", Global_Buddy_Info.DirtyBytes >> 10);
+  printf("  Zeroed inline: %llu kB\r\n", Global_Zero_Pool.ZeroedInlineBytes >> 10);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  zeropool_*: Zero Pool Internals
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The dirty and clean lists are small unordered arrays of page ranges, all of which lie in EfiConventionalMemory. Anything that
+// turns EfiConventionalMemory into something else has to zeropool_claim() it (right next to its freeindex_carve()), which takes
+// the range off both lists, so a clean range can always be handed out as-is.
+//
+// Memory that's on neither list was never freed through the pool, and is treated the way it always was: the allocators zero it.
+//
+
+// Add a range to a list, merging it with a range it touches if there is one. Returns 0 if the list is full.
+static uint8_t zeropool_add(ZERO_POOL_RANGE * List, uint64_t * NumRanges, EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages)
+{
+  EFI_PHYSICAL_ADDRESS PhysicalEnd = PhysicalStart + (NumberOfPages << EFI_PAGE_SHIFT);
+
+  for(uint64_t range_index = 0; range_index < *NumRanges; range_index++)
+  {
+    if(List[range_index].PhysicalStart + (List[range_index].NumberOfPages << EFI_PAGE_SHIFT) == PhysicalStart)
+    {
+      List[range_index].NumberOfPages += NumberOfPages;
+      return 1;
+    }
+    else if(List[range_index].PhysicalStart == PhysicalEnd)
+    {
+      List[range_index].PhysicalStart = PhysicalStart;
+      List[range_index].NumberOfPages += NumberOfPages;
+      return 1;
+    }
+  }
+
+  if(*NumRanges == ZERO_POOL_MAX_RANGES)
+  {
+    return 0;
+  }
+
+  List[*NumRanges].PhysicalStart = PhysicalStart;
+  List[*NumRanges].NumberOfPages = NumberOfPages;
+  (*NumRanges)++;
+
+  return 1;
+}
+
+// Take [PhysicalStart, PhysicalStart + NumberOfPages pages) off a list, zeroing what was on it if zero_taken is 1. Returns the
+// number of bytes that were on it. Leftover pieces of dirty ranges that don't fit back on a full list get zeroed rather than
+// dropped, so the list never forgets that memory needs zeroing. Leftover clean pieces are just forgotten.
+static uint64_t zeropool_take(uint8_t dirty, EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages, uint8_t zero_taken)
+{
+  ZERO_POOL_RANGE * List = dirty ? Global_Zero_Pool.Dirty : Global_Zero_Pool.Clean;
+  uint64_t * NumRanges = dirty ? &Global_Zero_Pool.NumDirty : &Global_Zero_Pool.NumClean;
+  uint64_t * ListBytes = dirty ? &Global_Zero_Pool.DirtyBytes : &Global_Zero_Pool.CleanBytes;
+
+  EFI_PHYSICAL_ADDRESS PhysicalEnd = PhysicalStart + (NumberOfPages << EFI_PAGE_SHIFT);
+  uint64_t taken_bytes = 0;
+  uint64_t range_index = 0;
+
+  while(range_index < *NumRanges)
+  {
+    EFI_PHYSICAL_ADDRESS RangeStart = List[range_index].PhysicalStart;
+    EFI_PHYSICAL_ADDRESS RangeEnd = RangeStart + (List[range_index].NumberOfPages << EFI_PAGE_SHIFT);
+
+    if((RangeEnd <= PhysicalStart) || (RangeStart >= PhysicalEnd))
+    {
+      range_index++;
+      continue;
+    }
+
+    EFI_PHYSICAL_ADDRESS OverlapStart = (RangeStart > PhysicalStart) ? RangeStart : PhysicalStart;
+    EFI_PHYSICAL_ADDRESS OverlapEnd = (RangeEnd < PhysicalEnd) ? RangeEnd : PhysicalEnd;
+    taken_bytes += OverlapEnd - OverlapStart;
+
+    if(zero_taken)
+    {
+      AVX_memset((void*)OverlapStart, 0, OverlapEnd - OverlapStart);
+    }
+    *ListBytes -= (RangeEnd - RangeStart);
+
+    if(RangeStart < OverlapStart)
+    {
+      // Keep the part below in this slot
+      List[range_index].NumberOfPages = (OverlapStart - RangeStart) >> EFI_PAGE_SHIFT;
+      *ListBytes += (OverlapStart - RangeStart);
+      range_index++;
+    }
+    else
+    {
+      // Nothing left below, so fill the slot from the end of the list and look at it again
+      (*NumRanges)--;
+      List[range_index] = List[*NumRanges];
+    }
+
+    if(OverlapEnd < RangeEnd)
+    {
+      if(zeropool_add(List, NumRanges, OverlapEnd, (RangeEnd - OverlapEnd) >> EFI_PAGE_SHIFT))
+      {
+        *ListBytes += (RangeEnd - OverlapEnd);
+      }
+      else if(dirty)
+      {
+        memset_zeroes_as((void*)OverlapEnd, RangeEnd - OverlapEnd);
+      }
+    }
+  }
+
+  return taken_bytes;
+}
+
+// A region just went back to EfiConventionalMemory without being zeroed. Does nothing if deferred zeroing is off.
+static void zeropool_release(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages)
+{
+  if(!Global_Zero_Pool.Enabled)
+  {
+    return;
+  }
+
+  if(zeropool_add(Global_Zero_Pool.Dirty, &Global_Zero_Pool.NumDirty, PhysicalStart, NumberOfPages))
+  {
+    Global_Zero_Pool.DirtyBytes += (NumberOfPages << EFI_PAGE_SHIFT);
+  }
+  else
+  {
+    // No room to defer it, so zero it now like free() normally would
+    AVX_memset_parallel((void*)PhysicalStart, 0, NumberOfPages << EFI_PAGE_SHIFT);
+  }
+}
+
+// A range of EfiConventionalMemory is about to become something else. zero_all: 1 if the new owner expects it zeroed (allocators),
+// 0 if it only expects freed memory to have been zeroed like free() normally does (e.g. realloc() growing in place).
+static void zeropool_claim(EFI_PHYSICAL_ADDRESS PhysicalStart, uint64_t NumberOfPages, uint8_t zero_all)
+{
+  if(!Global_Zero_Pool.Enabled)
+  {
+    if(zero_all)
+    {
+      AVX_memset((void*)PhysicalStart, 0, NumberOfPages << EFI_PAGE_SHIFT);
+    }
+    return;
+  }
+
+  EFI_PHYSICAL_ADDRESS PhysicalEnd = PhysicalStart + (NumberOfPages << EFI_PAGE_SHIFT);
+
+  if(zero_all)
+  {
+    // Zero every gap between clean ranges. This covers both dirty memory and memory that was never tracked.
+    EFI_PHYSICAL_ADDRESS Cursor = PhysicalStart;
+
+    while(Cursor < PhysicalEnd)
+    {
+      EFI_PHYSICAL_ADDRESS GapEnd = PhysicalEnd;
+      EFI_PHYSICAL_ADDRESS CleanEnd = 0;
+
+      for(uint64_t range_index = 0; range_index < Global_Zero_Pool.NumClean; range_index++)
+      {
+        EFI_PHYSICAL_ADDRESS RangeStart = Global_Zero_Pool.Clean[range_index].PhysicalStart;
+        EFI_PHYSICAL_ADDRESS RangeEnd = RangeStart + (Global_Zero_Pool.Clean[range_index].NumberOfPages << EFI_PAGE_SHIFT);
+
+        if((RangeStart <= Cursor) && (Cursor < RangeEnd))
+        {
+          CleanEnd = RangeEnd;
+          break;
+        }
+        else if((RangeStart > Cursor) && (RangeStart < GapEnd))
+        {
+          GapEnd = RangeStart;
+        }
+      }
+
+      if(CleanEnd)
+      {
+        // Already zero
+        Cursor = (CleanEnd < PhysicalEnd) ? CleanEnd : PhysicalEnd;
+      }
+      else
+      {
+        // The caller is about to use this, so zero it through the cache rather than around it
+        AVX_memset((void*)Cursor, 0, GapEnd - Cursor);
+        Global_Zero_Pool.ZeroedInlineBytes += GapEnd - Cursor;
+        Cursor = GapEnd;
+      }
+    }
+
+    zeropool_take(1, PhysicalStart, NumberOfPages, 0);
+  }
+  else
+  {
+    // Only the dirty parts need zeroing
+    Global_Zero_Pool.ZeroedInlineBytes += zeropool_take(1, PhysicalStart, NumberOfPages, 1);
+  }
+
+  zeropool_take(0, PhysicalStart, NumberOfPages, 0);
+}
+
+// Find a clean range that can hold an aligned allocation at or above OldAddress. Returns ~0ULL if there isn't one.
+static EFI_PHYSICAL_ADDRESS zeropool_clean_fit(uint64_t NumberOfPages, EFI_PHYSICAL_ADDRESS OldAddress, uintmax_t byte_alignment)
+{
+  if((!Global_Zero_Pool.Enabled) || (byte_alignment & EFI_PAGE_MASK) || (byte_alignment < EFI_PAGE_SIZE))
+  {
+    // Bad alignments are left for ActuallyAlignedFreeAddress() to complain about
+    return ~0ULL;
+  }
+
+  for(uint64_t range_index = 0; range_index < Global_Zero_Pool.NumClean; range_index++)
+  {
+    EFI_PHYSICAL_ADDRESS RangeStart = Global_Zero_Pool.Clean[range_index].PhysicalStart;
+    EFI_PHYSICAL_ADDRESS RangeEnd = RangeStart + (Global_Zero_Pool.Clean[range_index].NumberOfPages << EFI_PAGE_SHIFT);
+    EFI_PHYSICAL_ADDRESS Candidate = (RangeStart > OldAddress) ? RangeStart : OldAddress;
+
+    Candidate = (Candidate + (byte_alignment - 1)) & ~(byte_alignment - 1);
+
+    if((Candidate >= RangeStart) && (Candidate < RangeEnd) && (((RangeEnd - Candidate) >> EFI_PAGE_SHIFT) >= NumberOfPages))
+    {
+      return Candidate;
+    }
+  }
+
+  return ~0ULL;
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 //  ZeroAllConventionalMemory: Zero Out ALL EfiConventionalMemory
 //----------------------------------------------------------------------------------------------------------------------------------
 //
 // This function goes through the memory map and zeroes out all EfiConventionalMemory areas. Returns 0 on success, else returns the
-// base physical address of the last region that could not be completely zeroed.
+// base physical address of the last region that could not be completely zeroed. Big regions are shared with any APs that are idling
+// in AVXmem_Parallel_Worker().
 //
 // USE WITH CAUTION!!
 // Firmware bugs like the one described here could really cause problems with this function: https://mjg59.dreamwidth.org/11235.html
@@ -4383,7 +7707,7 @@ EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void)
   {
     if(Piece->Type == EfiConventionalMemory)
     {
-      AVX_memset((void *)Piece->PhysicalStart, 0, EFI_PAGES_TO_SIZE(Piece->NumberOfPages));
+      AVX_memset_parallel((void *)Piece->PhysicalStart, 0, EFI_PAGES_TO_SIZE(Piece->NumberOfPages));
 
       if(VerifyZeroMem(EFI_PAGES_TO_SIZE(Piece->NumberOfPages), Piece->PhysicalStart))
       {
@@ -4396,6 +7720,10 @@ EFI_PHYSICAL_ADDRESS ZeroAllConventionalMemory(void)
       }
     }
   }
+  // Nothing is dirty anymore
+  Global_Zero_Pool.NumDirty = 0;
+  Global_Zero_Pool.DirtyBytes = 0;
+
   // Done.
   return exit_value;
 }
@@ -77,7 +77,6 @@
 #define NEW_QUICK_SCROLL
 //
 
-static size_t strlen(const char *s);
 static inline int imax(int a, int b);
 static void  printf_putchar(int ch, void *arg);
 static char *ksprintn(char *nbuf, uintmax_t num, int base, int *len, int upper);
@@ -98,14 +97,6 @@ struct snprintf_arg {
 	size_t	remain;
 };
 
-static size_t strlen(const char *s)
-{
-	size_t l = 0;
-	while (*s++)
-		l++;
-	return l;
-}
-
 static inline int imax(int a, int b)
 {
 	return (a > b ? a : b);
@@ -333,10 +324,9 @@ reswitch:	switch (ch = (unsigned char)*fmt++) {
 			if (p == NULL)
 				p = "(null)";
 			if (!dot)
-				n = strlen (p);
+				n = (int)AVX_strlen (p);
 			else
-				for (n = 0; n < dwidth && p[n]; n++)
-					continue;
+				n = (dwidth > 0) ? (int)AVX_strnlen (p, (size_t)dwidth) : 0;
 
 			width -= n;
 
@@ -596,6 +586,10 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 			arg->index = 0;
 			if((arg->y + arg->height * arg->yscale) > (arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale)) // Vertical wraparound
 			{
+				if(arg->textscrollmode) // Everything but wrapping moves or wipes the whole screen
+				{
+					Shadow_mark_dirty(arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
+				}
 				if(!arg->textscrollmode)
 				{
 					arg->y = 0; // Wrap
@@ -608,7 +602,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					uint64_t min_scroll_size = arg->y + 2*arg->height*arg->yscale - arg->defaultGPU.Info->VerticalResolution;
 					arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale;
 
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -616,7 +610,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 					// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * yscale) == 0 fonts don't have to worry if all text on screen is the same size)
 					// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -640,11 +634,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 					for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 					{
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 						}
+						Shadow_flush(arg->defaultGPU); // Otherwise a shadow framebuffer would only ever show the last step
 					}
 				}
 			}
@@ -674,6 +669,10 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 			{
 				if((arg->y + arg->height * arg->yscale) > (arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale)) // Vertical wraparound
 				{
+					if(arg->textscrollmode) // Everything but wrapping moves or wipes the whole screen
+					{
+						Shadow_mark_dirty(arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
+					}
 					if(!arg->textscrollmode)
 					{
 						arg->y = 0; // Wrap
@@ -686,7 +685,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						uint64_t min_scroll_size = arg->y + 2*arg->height*arg->yscale - arg->defaultGPU.Info->VerticalResolution;
 						arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale;
 
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -694,7 +693,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 						// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * yscale) == 0 fonts don't have to worry if all text on screen is the same size)
 						// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -718,11 +717,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 						for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 						{
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+							memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 							}
+							Shadow_flush(arg->defaultGPU); // Otherwise a shadow framebuffer would only ever show the last step
 						}
 					}
 				}
@@ -735,6 +735,10 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 		case '\n':
 			if((arg->y + arg->height * arg->yscale) > (arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale)) // Vertical wraparound
 			{
+				if(arg->textscrollmode) // Everything but wrapping moves or wipes the whole screen
+				{
+					Shadow_mark_dirty(arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
+				}
 				if(!arg->textscrollmode)
 				{
 					arg->y = 0; // Wrap
@@ -747,7 +751,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					uint64_t min_scroll_size = arg->y + 2*arg->height*arg->yscale - arg->defaultGPU.Info->VerticalResolution;
 					arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale;
 
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -755,7 +759,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 					// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * yscale) == 0 fonts don't have to worry if all text on screen is the same size)
 					// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-					AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+					memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
 					if(arg->background_color != 0xFF000000)
 					{
 						AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -779,11 +783,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 					for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 					{
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 						}
+						Shadow_flush(arg->defaultGPU); // Otherwise a shadow framebuffer would only ever show the last step
 					}
 				}
 			}
@@ -803,6 +808,10 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 					arg->index = 0; // Horizontal wraparound
 					if((arg->y + arg->height * arg->yscale) > (arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale)) // Vertical wraparound if hit the bottom of the screen
 					{
+						if(arg->textscrollmode) // Everything but wrapping moves or wipes the whole screen
+						{
+							Shadow_mark_dirty(arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
+						}
 						if(!arg->textscrollmode)
 						{
 							arg->y = 0; // Wrap
@@ -815,7 +824,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 							uint64_t min_scroll_size = arg->y + 2*arg->height*arg->yscale - arg->defaultGPU.Info->VerticalResolution;
 							arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale;
 
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+							memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -823,7 +832,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 							// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * yscale) == 0 fonts don't have to worry if all text on screen is the same size)
 							// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+							memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -847,11 +856,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 							for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 							{
-								AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+								memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
 								if(arg->background_color != 0xFF000000)
 								{
 									AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 								}
+								Shadow_flush(arg->defaultGPU); // Otherwise a shadow framebuffer would only ever show the last step
 							}
 						}
 					}
@@ -871,6 +881,10 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 				arg->index = 0; // Horizontal wraparound
 				if((arg->y + arg->height * arg->yscale) > (arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale)) // Vertical wraparound if hit the bottom of the screen
 				{
+					if(arg->textscrollmode) // Everything but wrapping moves or wipes the whole screen
+					{
+						Shadow_mark_dirty(arg->defaultGPU, 0, 0, arg->defaultGPU.Info->HorizontalResolution, arg->defaultGPU.Info->VerticalResolution);
+					}
 					if(!arg->textscrollmode)
 					{
 						arg->y = 0; // Wrap
@@ -883,7 +897,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 						uint64_t min_scroll_size = arg->y + 2*arg->height*arg->yscale - arg->defaultGPU.Info->VerticalResolution;
 						arg->y = arg->defaultGPU.Info->VerticalResolution - arg->height * arg->yscale;
 
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * min_scroll_size), (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine*4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - min_scroll_size) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -891,7 +905,7 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 #else
 						// Old way (gap of background color below the bottommost text line, but no partial scroll up top--the topmost line goes away; VerticalResolution % (height * yscale) == 0 fonts don't have to worry if all text on screen is the same size)
 						// Qualitative test results: This can scroll a 4K screen framebuffer (31MB) extremely quickly :D (Interestingly enough, the standard memmove in memmove.c can also do it pretty quickly since GCC vectorizes it.)
-						AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
+						memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->height * arg->yscale), arg->y * arg->defaultGPU.Info->PixelsPerScanLine*4);
 						if(arg->background_color != 0xFF000000)
 						{
 							AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->y * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, (arg->defaultGPU.Info->VerticalResolution - arg->y) * arg->defaultGPU.Info->PixelsPerScanLine);
@@ -915,11 +929,12 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 
 						for(uint64_t smooth = 0; smooth < min_scroll_size; smooth += arg->textscrollmode) // Random: (smooth --> 0) is the same as ((smooth--) > 0); It may not be obvious that they're the same at first glance.
 						{
-							AVX_memmove((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
+							memmove_wc((EFI_PHYSICAL_ADDRESS*)arg->defaultGPU.FrameBufferBase, (EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + arg->defaultGPU.Info->PixelsPerScanLine * 4 * arg->textscrollmode), (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4);
 							if(arg->background_color != 0xFF000000)
 							{
 								AVX_memset_4B((EFI_PHYSICAL_ADDRESS*)(arg->defaultGPU.FrameBufferBase + (arg->defaultGPU.Info->VerticalResolution - arg->textscrollmode - smooth) * arg->defaultGPU.Info->PixelsPerScanLine * 4), arg->background_color, arg->textscrollmode*arg->defaultGPU.Info->PixelsPerScanLine);
 							}
+							Shadow_flush(arg->defaultGPU); // Otherwise a shadow framebuffer would only ever show the last step
 						}
 					}
 				}
@@ -930,6 +945,8 @@ static void printf_putchar(int output_character, void *arglist) // Character is
 			}
 			break;
 	}
+
+	Shadow_tick(); // Does nothing if there's no shadow framebuffer (see Shadow_enable() in Display.c)
 }
 
 // Now we can define a real printf()!
@@ -26,6 +26,9 @@ static void set_NMI_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_DF_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_MC_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
 static void set_BP_interrupt_entry(uint64_t isr_num, uint64_t isr_addr);
+static uint64_t last_level_cache_size(uint8_t * cache_level);
+static uint8_t paging_map_wc(EFI_PHYSICAL_ADDRESS start, EFI_PHYSICAL_ADDRESS end, EFI_PHYSICAL_ADDRESS * table_pool, uint64_t * tables_left);
+static uint64_t framebuffer_write_rate(EFI_PHYSICAL_ADDRESS base, uint64_t numbytes, void * scratch);
 
 //----------------------------------------------------------------------------------------------------------------------------------
 // System_Init: Initial Setup
@@ -101,10 +104,22 @@ __attribute__((target("no-sse"))) void System_Init(LOADER_PARAMS * LP)
   Setup_MemMap();
   printf("MemMap set.\r\n");
 
+  // Give this core its own malloc() caches (see Setup_Magazines() for what each AP will need once they're started)
+  Setup_Magazines();
+  printf("Magazines set.\r\n");
+
+  // Cache for printf's expanded glyphs (requires malloc)
+  Setup_GlyphCache();
+  printf("Glyph cache set.\r\n");
+
   // Set up paging structures (requires memory map to be set up)
-  Setup_Paging();
+  Setup_Paging(LP);
   printf("Paging set.\r\n");
 
+  // Address space above the identity map for vmalloc() reservations that get mapped in on first touch (requires paging to be set up)
+  Setup_DemandPaging();
+  printf("Demand paging set.\r\n");
+
   // Reclaim Efi Boot Services memory now that GDT, IDT, and Paging have been set up
   ReclaimEfiBootServicesMemory();
   printf("EfiBootServices Memory reclaimed.\r\n");
@@ -113,6 +128,10 @@ __attribute__((target("no-sse"))) void System_Init(LOADER_PARAMS * LP)
   ReclaimEfiLoaderCodeMemory();
   printf("EfiLoaderCode Memory reclaimed.\r\n");
 
+  // Let free() leave zeroing to ZeroDirtyPages() and the next allocation (requires the memory map and magazines to be set up)
+  EnableDeferredZeroing();
+  printf("Deferred zeroing enabled.\r\n");
+
   // HWP
   Enable_HWP();
   // It has a printf in it
@@ -139,6 +158,7 @@ __attribute__((target("no-sse"))) void System_Init(LOADER_PARAMS * LP)
   // It has a printf in it
 
   // TODO enabling multicore stuff goes here, before interrupts
+  // (see the NOTE in Setup_Magazines() for what each AP needs before it can do anything)
 
   // Enable Maskable Interrupts
   // Exceptions and Non-Maskable Interrupts are always enabled.
@@ -173,6 +193,9 @@ uint64_t get_tick(void)
 // Check for AVX/AVX512 support and enable it. Needed in order to use AVX functions like AVX_memmove, AVX_memcpy, AVX_memset, and
 // AVX_memcmp
 //
+// This is also the one place where the CPU's features get checked for those functions: once XCR0 is set, the best build of them that
+// the CPU can run is picked with AVXmem_Select(). See avxmem.c.
+//
 
 __attribute__((target("no-sse"))) void Enable_AVX(void)
 {
@@ -549,6 +572,577 @@ __attribute__((target("no-sse"))) void Enable_AVX(void)
       }
     }
   }
+
+  // Now pick the AVX_mem* build. All of the AVX_mem* builds need the OS to save the state they use, so this goes by what actually
+  // ended up in XCR0 rather than by CPUID alone.
+  uint64_t max_leaf = 0x00, leaf1_rcx = 0, leaf7_rbx = 0, leaf7_rcx = 0x00, leaf7_rdx = 0;
+  asm volatile("cpuid"
+               : "+a" (max_leaf) // Outputs
+               : // No other inputs
+               : "%rbx", "%rcx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  uint64_t leaf = 0x01;
+  asm volatile("cpuid"
+               : "+a" (leaf), "=c" (leaf1_rcx) // Outputs
+               : // No other inputs
+               : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+
+  if(max_leaf >= 0x07)
+  {
+    leaf = 0x07;
+    asm volatile("cpuid"
+                 : "+a" (leaf), "=b" (leaf7_rbx), "+c" (leaf7_rcx), "=d" (leaf7_rdx) // Outputs
+                 : // No other inputs
+                 : // CPUID would clobber any of the abcd registers not listed explicitly
+               );
+  }
+
+  uint32_t avxmem_level = AVXMEM_LEVEL_SSE;
+  if((leaf1_rcx & (1 << 27)) && (leaf1_rcx & (1 << 28))) // OSXSAVE and AVX
+  {
+    uint64_t xcr0 = xcr_rw(0, 0, 0);
+
+    if((xcr0 & 0x6) == 0x6) // SSE and AVX state
+    {
+      avxmem_level = AVXMEM_LEVEL_AVX;
+
+      if((leaf7_rbx & (1 << 5)) && (leaf7_rbx & (1 << 8)) && (leaf1_rcx & (1 << 12))) // AVX2, BMI2, and FMA
+      {
+        avxmem_level = AVXMEM_LEVEL_AVX2;
+
+        // AVX512F, AVX512DQ, AVX512CD, AVX512BW, and AVX512VL, plus opmask, ZMM_Hi256, and Hi16_ZMM state
+        uint64_t avx512_bits = (1ULL << 16) | (1ULL << 17) | (1ULL << 28) | (1ULL << 30) | (1ULL << 31);
+        if(((leaf7_rbx & avx512_bits) == avx512_bits) && ((xcr0 & 0xE6) == 0xE6))
+        {
+          avxmem_level = AVXMEM_LEVEL_AVX512;
+        }
+      }
+    }
+  }
+
+  AVXmem_Select(avxmem_level, (leaf7_rbx >> 9) & 0x1, (leaf7_rdx >> 4) & 0x1); // ERMS is EBX bit 9, FSRM is EDX bit 4
+
+  // Non-temporal stores start paying off once a copy stops fitting in cache, and a copy needs room for both its source and its
+  // destination. Only this core is copying anything, so it gets the whole cache, not just its share of it.
+  uint8_t llc_level = 0;
+  uint64_t llc_size = last_level_cache_size(&llc_level);
+  if(llc_size)
+  {
+    AVXmem_Dispatch.NT_Threshold = llc_size / 2;
+  }
+
+  const char * avxmem_names[4] = {"SSE4.2", "AVX", "AVX2", "AVX512"};
+  printf("AVX_mem* functions: %s%s\r\n", avxmem_names[AVXmem_Dispatch.Level], AVXmem_Dispatch.ERMS ? (AVXmem_Dispatch.FSRM ? " with ERMS and FSRM" : " with ERMS") : "");
+  if(llc_size)
+  {
+    printf("Non-temporal threshold: %llu kB (L%hhu cache is %llu kB)\r\n", AVXmem_Dispatch.NT_Threshold >> 10, llc_level, llc_size >> 10);
+  }
+  else
+  {
+    warning_printf("Cache sizes not reported, non-temporal threshold left at %llu kB.\r\n", AVXmem_Dispatch.NT_Threshold >> 10);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// last_level_cache_size: Size of the Biggest Cache This Core Uses
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Walks the deterministic cache parameters in CPUID leaf 0x8000001D (AMD, if TOPOEXT is supported) or leaf 4 (Intel) and returns the
+// size in bytes of the highest-level data or unified cache, which is the whole cache shared with this core's neighbors, not just its
+// share of it. CPUs that have neither fall back to the L2/L3 sizes in leaf 0x80000006.
+//
+// cache_level: set to the level of the returned cache (e.g. 3 for L3)
+//
+// Returns 0 if the CPU doesn't report any of this.
+//
+
+static uint64_t last_level_cache_size(uint8_t * cache_level)
+{
+  uint64_t rax = 0x00, rbx = 0, rcx = 0, rdx = 0;
+  uint64_t size = 0;
+
+  *cache_level = 0;
+
+  asm volatile("cpuid"
+               : "+a" (rax) // Outputs
+               : // No other inputs
+               : "%rbx", "%rcx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint64_t max_leaf = rax;
+
+  rax = 0x80000000;
+  asm volatile("cpuid"
+               : "+a" (rax) // Outputs
+               : // No other inputs
+               : "%rbx", "%rcx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+             );
+  uint64_t max_extended_leaf = rax;
+
+  uint64_t cache_leaf = 0;
+  if(max_extended_leaf >= 0x8000001D)
+  {
+    rax = 0x80000001;
+    asm volatile("cpuid"
+                 : "+a" (rax), "=c" (rcx) // Outputs
+                 : // No other inputs
+                 : "%rbx", "%rdx" // CPUID clobbers all not-explicitly-used abcd registers
+               );
+
+    if(rcx & (1 << 22)) // TOPOEXT
+    {
+      cache_leaf = 0x8000001D;
+    }
+  }
+
+  if((cache_leaf == 0) && (max_leaf >= 0x04))
+  {
+    cache_leaf = 0x04;
+  }
+
+  if(cache_leaf)
+  {
+    // Both leaves use the same format, one subleaf per cache, ending with a null type. AMD CPUs without TOPOEXT return all 0s for
+    // leaf 4, so they just fall through.
+    for(uint64_t subleaf = 0; subleaf < 32; subleaf++)
+    {
+      rax = cache_leaf;
+      rcx = subleaf;
+      asm volatile("cpuid"
+                   : "+a" (rax), "=b" (rbx), "+c" (rcx), "=d" (rdx) // Outputs
+                   : // No other inputs
+                   : // CPUID would clobber any of the abcd registers not listed explicitly
+                 );
+
+      uint8_t type = rax & 0x1F;
+      if(type == 0) // No more caches
+      {
+        break;
+      }
+      else if(type == 2) // Instruction cache
+      {
+        continue;
+      }
+
+      uint8_t level = (rax >> 5) & 0x7;
+      if(level > *cache_level)
+      {
+        // Ways * Partitions * Line Size * Sets
+        *cache_level = level;
+        size = (((rbx >> 22) & 0x3FF) + 1) * (((rbx >> 12) & 0x3FF) + 1) * ((rbx & 0xFFF) + 1) * ((rcx & 0xFFFFFFFF) + 1);
+      }
+    }
+  }
+
+  if((size == 0) && (max_extended_leaf >= 0x80000006))
+  {
+    rax = 0x80000006;
+    asm volatile("cpuid"
+                 : "+a" (rax), "=c" (rcx), "=d" (rdx) // Outputs
+                 : // No other inputs
+                 : "%rbx" // CPUID clobbers all not-explicitly-used abcd registers
+               );
+
+    if((rdx >> 18) & 0x3FFF) // L3 size in 512kB units
+    {
+      *cache_level = 3;
+      size = ((rdx >> 18) & 0x3FFF) << 19;
+    }
+    else if((rcx >> 16) & 0xFFFF) // L2 size in kB
+    {
+      *cache_level = 2;
+      size = ((rcx >> 16) & 0xFFFF) << 10;
+    }
+  }
+
+  return size;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// nt_threshold_calibrate: Time Where Non-Temporal Copies Start to Win
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The threshold Enable_AVX() gets from the cache sizes is a good guess, but how much a streaming copy actually helps depends on the
+// memory subsystem too. This times AVX_memcpy both ways, forcing the path by setting the threshold to 0 or ~0, for sizes from 1/4x
+// to 4x of the current threshold, and then sets the threshold to the biggest size at which the cached copy was still faster.
+// Results are in TSC ticks (see get_tick()), for the fastest of 4 runs each.
+//
+// NOTE: This needs two buffers of 4x the current threshold, so it can take a while on CPUs with big caches.
+//
+
+void nt_threshold_calibrate(void)
+{
+  size_t estimate = AVXmem_Dispatch.NT_Threshold;
+  size_t max_size = estimate << 2;
+
+  void * src = malloc(max_size);
+  if((EFI_PHYSICAL_ADDRESS)src == ~0ULL)
+  {
+    error_printf("nt_threshold_calibrate: Not enough memory for the source buffer.\r\n");
+    return;
+  }
+
+  void * dest = malloc(max_size);
+  if((EFI_PHYSICAL_ADDRESS)dest == ~0ULL)
+  {
+    error_printf("nt_threshold_calibrate: Not enough memory for the destination buffer.\r\n");
+    free(src);
+    return;
+  }
+
+  AVX_memset(src, 0x5A, max_size);
+  AVX_memset(dest, 0, max_size);
+
+  size_t new_threshold = max_size;
+
+  printf("AVX_memcpy ticks, best of 4:\r\n");
+  printf("Size (kB)  Cached      Streaming\r\n");
+
+  for(size_t size = estimate >> 2; size <= max_size; size <<= 1)
+  {
+    uint64_t best[2] = {~0ULL, ~0ULL};
+
+    // 0 is cached, 1 is streaming
+    for(uint64_t path = 0; path < 2; path++)
+    {
+      AVXmem_Dispatch.NT_Threshold = path ? 0 : ~0ULL;
+
+      // The first run is just to warm things up, the same as any copy that comes right after something touched the buffers
+      AVX_memcpy(dest, src, size);
+
+      for(uint64_t run = 0; run < 4; run++)
+      {
+        uint64_t start_tick = get_tick();
+        AVX_memcpy(dest, src, size);
+        uint64_t ticks = get_tick() - start_tick;
+
+        if(ticks < best[path])
+        {
+          best[path] = ticks;
+        }
+      }
+    }
+
+    printf("%9llu  %10llu  %10llu\r\n", size >> 10, best[0], best[1]);
+
+    if((best[1] < best[0]) && (new_threshold == max_size))
+    {
+      // The last size was the biggest one where the cached copy still won
+      new_threshold = size >> 1;
+    }
+  }
+
+  AVXmem_Dispatch.NT_Threshold = new_threshold;
+  printf("Non-temporal threshold: %llu kB (was %llu kB)\r\n", new_threshold >> 10, estimate >> 10);
+
+  free(dest);
+  free(src);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// erms_cutoff_calibrate: Time Where rep movsb/stosb Start to Win
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The rep movsb/stosb size ranges AVXmem_Select() picks come from a table of typical values (see erms_cutoffs in avxmem.c). This
+// times AVX_memcpy and AVX_memset from 64 bytes up to the non-temporal threshold (or 1MB, whichever is smaller) with the rep string
+// path forced on and then forced off, and sets each Min cutoff to the smallest size from which the rep string version was faster at
+// every size tested. If it never won at the top size, that path gets turned off. Results are in TSC ticks (see get_tick()) per 64
+// calls, for the fastest of 4 runs each.
+//
+// Does nothing on CPUs without ERMS, since AVXmem_Dispatch doesn't use the rep string versions there.
+//
+
+void erms_cutoff_calibrate(void)
+{
+  if(!AVXmem_Dispatch.ERMS)
+  {
+    info_printf("erms_cutoff_calibrate: CPU doesn't have ERMS.\r\n");
+    return;
+  }
+
+  AVXMEM_ERMS_CUTOFFS Original = AVXmem_Dispatch.ERMS_Cutoffs;
+  AVXMEM_ERMS_CUTOFFS Rep_On = {0, ~0ULL, 0, ~0ULL};
+  AVXMEM_ERMS_CUTOFFS Rep_Off = {~0ULL, 0, ~0ULL, 0};
+
+  size_t max_size = (AVXmem_Dispatch.NT_Threshold < (1ULL << 20)) ? AVXmem_Dispatch.NT_Threshold : (1ULL << 20);
+
+  // 64 bytes of slack lets the copies start off-alignment, like a lot of real ones do
+  uint8_t * src = (uint8_t*)malloc(max_size + 64);
+  if((EFI_PHYSICAL_ADDRESS)src == ~0ULL)
+  {
+    error_printf("erms_cutoff_calibrate: Not enough memory for the source buffer.\r\n");
+    return;
+  }
+
+  uint8_t * dest = (uint8_t*)malloc(max_size + 64);
+  if((EFI_PHYSICAL_ADDRESS)dest == ~0ULL)
+  {
+    error_printf("erms_cutoff_calibrate: Not enough memory for the destination buffer.\r\n");
+    free(src);
+    return;
+  }
+
+  AVX_memset(src, 0x5A, max_size + 64);
+  AVX_memset(dest, 0, max_size + 64);
+
+  // ~0 means "hasn't won yet"
+  size_t new_copy_min = ~0ULL;
+  size_t new_set_min = ~0ULL;
+
+  printf("Ticks per 64 calls, best of 4:\r\n");
+  printf("Size (B)  Copy: Vector  rep movsb   Set: Vector  rep stosb\r\n");
+
+  for(size_t size = 64; size <= max_size; size <<= 1)
+  {
+    // [0][x] is copy, [1][x] is set; [x][0] is vector, [x][1] is rep string
+    uint64_t best[2][2] = {{~0ULL, ~0ULL}, {~0ULL, ~0ULL}};
+
+    for(uint64_t path = 0; path < 2; path++)
+    {
+      AVXmem_Dispatch.ERMS_Cutoffs = path ? Rep_On : Rep_Off;
+
+      for(uint64_t run = 0; run < 4; run++)
+      {
+        uint64_t start_tick = get_tick();
+        for(uint64_t call = 0; call < 64; call++)
+        {
+          AVX_memcpy(dest + 3, src + 1, size);
+        }
+        uint64_t mid_tick = get_tick();
+        for(uint64_t call = 0; call < 64; call++)
+        {
+          AVX_memset(dest + 3, (uint8_t)call, size);
+        }
+        uint64_t end_tick = get_tick();
+
+        if((mid_tick - start_tick) < best[0][path])
+        {
+          best[0][path] = mid_tick - start_tick;
+        }
+        if((end_tick - mid_tick) < best[1][path])
+        {
+          best[1][path] = end_tick - mid_tick;
+        }
+      }
+    }
+
+    printf("%8llu  %12llu  %9llu  %11llu  %9llu\r\n", size, best[0][0], best[0][1], best[1][0], best[1][1]);
+
+    // A loss resets the cutoff, so it ends up at the start of the last unbroken run of wins
+    if(best[0][1] < best[0][0])
+    {
+      if(new_copy_min == ~0ULL)
+      {
+        new_copy_min = size;
+      }
+    }
+    else
+    {
+      new_copy_min = ~0ULL;
+    }
+
+    if(best[1][1] < best[1][0])
+    {
+      if(new_set_min == ~0ULL)
+      {
+        new_set_min = size;
+      }
+    }
+    else
+    {
+      new_set_min = ~0ULL;
+    }
+  }
+
+  // Everything between the smallest tested size and the first win stays on the vector loops. A path that never won is turned off
+  // entirely (Min > Max); the Max cutoffs themselves are left alone, since anything bigger goes by the non-temporal threshold anyway.
+  AVXmem_Dispatch.ERMS_Cutoffs = Original;
+  AVXmem_Dispatch.ERMS_Cutoffs.Copy_Min = new_copy_min;
+  AVXmem_Dispatch.ERMS_Cutoffs.Set_Min = new_set_min;
+
+  printf("rep movsb from: %llu B (was %llu B), rep stosb from: %llu B (was %llu B)\r\n", new_copy_min, Original.Copy_Min, new_set_min, Original.Set_Min);
+
+  free(dest);
+  free(src);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// memmove_calibrate: Time Descriptor Shifts and Prefetch Distances for AVX_memmove
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Times the move the memory map code makes all the time: shifting everything after a descriptor up by one descriptor to make room
+// for a new one, or down by one to close the gap after removing one. Each result is one shift up plus one shift down, in TSC ticks
+// (see get_tick()), for the fastest of 4 runs after a warm-up.
+//
+// First it does this on ranges 1x, 4x, and 16x the size of the current memory map. Builds that have the aligned small-shift path (see
+// memmove.c) run it with AVXmem_Dispatch.Shift_Path off and then on, and keep whichever was faster at the size of the actual map.
+// Then it shifts half the non-temporal threshold (the biggest moves that still go through the cache) with each prefetch distance from
+// 0 (off) to 16kB, and sets AVXmem_Dispatch.Prefetch_Distance to the fastest one.
+//
+
+void memmove_calibrate(void)
+{
+  size_t shift = Global_Memory_Info.MemMapDescriptorSize;
+  size_t map_size = Global_Memory_Info.MemMapSize;
+  size_t big_size = AVXmem_Dispatch.NT_Threshold >> 1;
+  size_t max_size = ((map_size << 4) > big_size) ? (map_size << 4) : big_size;
+
+  uint8_t * buffer = (uint8_t*)malloc(max_size + shift);
+  if((EFI_PHYSICAL_ADDRESS)buffer == ~0ULL)
+  {
+    error_printf("memmove_calibrate: Not enough memory for the buffer.\r\n");
+    return;
+  }
+
+  AVX_memset(buffer, 0x5A, max_size + shift);
+
+  // The AVX2 and AVX512 builds don't have a shift path, so there's only one way to time
+  uint32_t num_paths = (AVXmem_Dispatch.Level < AVXMEM_LEVEL_AVX2) ? 2 : 1;
+  uint32_t original_shift_path = AVXmem_Dispatch.Shift_Path;
+  uint32_t new_shift_path = original_shift_path;
+
+  printf("Shifting by one %llu-byte descriptor, ticks for up + down, best of 4:\r\n", shift);
+  printf("Size (B)  Shift path off  Shift path on\r\n");
+
+  for(size_t size = map_size; size <= (map_size << 4); size <<= 2)
+  {
+    uint64_t best[2] = {~0ULL, ~0ULL}; // Off, on
+
+    for(uint32_t path = 0; path < num_paths; path++)
+    {
+      if(num_paths == 2)
+      {
+        AVXmem_Dispatch.Shift_Path = path;
+      }
+
+      // The first run is a warm-up and doesn't count
+      for(uint64_t run = 0; run < 5; run++)
+      {
+        uint64_t start_tick = get_tick();
+        AVX_memmove(buffer + shift, buffer, size);
+        AVX_memmove(buffer, buffer + shift, size);
+        uint64_t end_tick = get_tick();
+
+        if(run && ((end_tick - start_tick) < best[path]))
+        {
+          best[path] = end_tick - start_tick;
+        }
+      }
+    }
+
+    if(num_paths == 2)
+    {
+      printf("%8llu  %14llu  %13llu\r\n", size, best[0], best[1]);
+
+      if(size == map_size)
+      {
+        new_shift_path = (best[1] < best[0]);
+      }
+    }
+    else
+    {
+      printf("%8llu  %14llu  %13s\r\n", size, best[0], "-");
+    }
+  }
+
+  AVXmem_Dispatch.Shift_Path = new_shift_path;
+
+  size_t original_distance = AVXmem_Dispatch.Prefetch_Distance;
+  size_t new_distance = original_distance;
+  uint64_t fastest = ~0ULL;
+
+  printf("Shifting %llu bytes by one descriptor, ticks for up + down, best of 4:\r\n", big_size);
+  printf("Prefetch distance (B)  Ticks\r\n");
+
+  for(size_t distance = 0; distance <= 16384; distance = distance ? (distance << 1) : 512)
+  {
+    uint64_t best = ~0ULL;
+
+    AVXmem_Dispatch.Prefetch_Distance = distance;
+
+    for(uint64_t run = 0; run < 5; run++)
+    {
+      uint64_t start_tick = get_tick();
+      AVX_memmove(buffer + shift, buffer, big_size);
+      AVX_memmove(buffer, buffer + shift, big_size);
+      uint64_t end_tick = get_tick();
+
+      if(run && ((end_tick - start_tick) < best))
+      {
+        best = end_tick - start_tick;
+      }
+    }
+
+    printf("%21llu  %llu\r\n", distance, best);
+
+    if(best < fastest)
+    {
+      fastest = best;
+      new_distance = distance;
+    }
+  }
+
+  AVXmem_Dispatch.Prefetch_Distance = new_distance;
+
+  printf("Shift path: %s (was %s), prefetch distance: %llu B (was %llu B)\r\n", new_shift_path ? "on" : "off", original_shift_path ? "on" : "off", new_distance, original_distance);
+
+  free(buffer);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// scroll_benchmark: Time a Text Scroll With and Without Streaming Loads
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Scrolls the top 3840x2160 pixels of the printf framebuffer (or all of it, if it's smaller than 4K) up by one line of text the way
+// printf's quick scroll does, first with AVX_memmove and then with memmove_wc, and prints how long each took. The framebuffer is
+// normally write-combining, where AVX_memmove's ordinary loads are the slow part. Results are in TSC ticks (see get_tick()) and
+// microseconds, for the fastest of 4 runs each.
+//
+// Whatever is on the screen gets scrolled up by 8 lines, so this is best run right before the screen gets cleared anyway.
+//
+
+void scroll_benchmark(void)
+{
+  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE GPU = Global_Print_Info.defaultGPU;
+  uint64_t rows = (GPU.Info->VerticalResolution < 2160) ? GPU.Info->VerticalResolution : 2160;
+  uint64_t columns = (GPU.Info->HorizontalResolution < 3840) ? GPU.Info->HorizontalResolution : 3840;
+  uint64_t line_rows = Global_Print_Info.height * Global_Print_Info.yscale;
+
+  if(line_rows >= rows)
+  {
+    error_printf("scroll_benchmark: Text lines are taller than the screen.\r\n");
+    return;
+  }
+
+  uint64_t numbytes = (rows - line_rows) * GPU.Info->PixelsPerScanLine * 4;
+  uint64_t best[2] = {~0ULL, ~0ULL}; // AVX_memmove, memmove_wc
+
+  for(uint64_t path = 0; path < 2; path++)
+  {
+    for(uint64_t run = 0; run < 4; run++)
+    {
+      uint64_t start_tick = get_tick();
+      if(path)
+      {
+        memmove_wc((void*)GPU.FrameBufferBase, (void*)(GPU.FrameBufferBase + line_rows * GPU.Info->PixelsPerScanLine * 4), numbytes);
+      }
+      else
+      {
+        AVX_memmove((void*)GPU.FrameBufferBase, (void*)(GPU.FrameBufferBase + line_rows * GPU.Info->PixelsPerScanLine * 4), numbytes);
+      }
+      uint64_t end_tick = get_tick();
+
+      if((end_tick - start_tick) < best[path])
+      {
+        best[path] = end_tick - start_tick;
+      }
+    }
+  }
+
+  printf("Scrolling %llux%llu by %llu rows (%llu bytes), best of 4:\r\n", columns, rows, line_rows, numbytes);
+  printf("AVX_memmove: %llu ticks (%llu us)\r\n", best[0], (best[0] * 1000000) / Global_TSC_frequency.CyclesPerSecond);
+  printf("memmove_wc:  %llu ticks (%llu us)\r\n", best[1], (best[1] * 1000000) / Global_TSC_frequency.CyclesPerSecond);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -762,6 +1356,25 @@ void Find_RSDP(LOADER_PARAMS * LP)
 
   Global_RSDP_Address = (EFI_PHYSICAL_ADDRESS)(LP->ConfigTables[RSDP_index].VendorTable);
 
+  // ACPI Specification 6.2A, section 5.2.5.3: the first 20 bytes sum to 0, and for revision 2 and up so does the whole structure
+  RSDP_20_STRUCT * RSDP = (RSDP_20_STRUCT*)Global_RSDP_Address;
+
+  if(AVX_memcmp(RSDP->RSDP_10_Section.Signature, "RSD PTR ", 8, 0))
+  {
+    printf("Invalid system: RSDP signature is wrong.\r\n");
+    HaCF();
+  }
+
+  if(AVX_sum8(RSDP, sizeof(RSDP_10_STRUCT)))
+  {
+    warning_printf("RSDP checksum is bad.\r\n");
+  }
+
+  if((RSDP->RSDP_10_Section.Revision >= 2) && AVX_sum8(RSDP, RSDP->Length))
+  {
+    warning_printf("RSDP extended checksum is bad.\r\n");
+  }
+
   // Done!
 }
 
@@ -830,7 +1443,7 @@ void Initialize_TSC_Freq(void)
 // ssleep: Sleep for Seconds
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Wait for the specified time in Seconds
+// Wait for the specified time in Seconds, zeroing freed memory for the zero pool in the meantime (see ZeroDirtyPages())
 //
 
 void ssleep(uint64_t Seconds)
@@ -841,6 +1454,7 @@ void ssleep(uint64_t Seconds)
     uint64_t cycle_count_start = get_tick();
     while((cycle_count / Global_TSC_frequency.CyclesPerSecond) < Seconds)
     {
+      ZeroDirtyPages(ZERO_POOL_IDLE_BYTES);
       cycle_count = get_tick() - cycle_count_start;
     }
   }
@@ -850,7 +1464,7 @@ void ssleep(uint64_t Seconds)
 // msleep: Sleep for Milliseconds
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Wait for the specified time in milliseconds
+// Wait for the specified time in milliseconds, zeroing freed memory for the zero pool in the meantime (see ZeroDirtyPages())
 //
 
 void msleep(uint64_t Milliseconds)
@@ -861,6 +1475,7 @@ void msleep(uint64_t Milliseconds)
     uint64_t cycle_count_start = get_tick();
     while((cycle_count / Global_TSC_frequency.CyclesPerMillisecond) < Milliseconds)
     {
+      ZeroDirtyPages(ZERO_POOL_IDLE_BYTES);
       cycle_count = get_tick() - cycle_count_start;
     }
   }
@@ -2323,7 +2938,13 @@ static void set_BP_interrupt_entry(uint64_t isr_num, uint64_t isr_addr)
 // really all comes down to users architecting how they want to use their system memory, though, and this is just one way. Also, the
 // malloc() functions provided by this framework are completely decoupled from the paging mechanism: they use the memory map directly,
 // which is why they can allocate 4kB memory even though Setup_Paging() sets up 1GB pages. That's important to keep in mind when making
-// any changes.
+// any changes. The one exception is large vmalloc() requests, which get address space above the identity map that's mapped in 4kB
+// pages on first touch (see Setup_DemandPaging()).
+//
+// The one place the identity map isn't plain write-back is the GOP framebuffers in LP->GPU_Configs, which get mapped write-combining
+// through the PAT (see Setup_PAT() and paging_map_wc()). Whichever 1GB or 2MB pages only partly overlap a framebuffer get split down
+// to 4kB at its edges, so nothing else shares its memory type. This also prints how fast each framebuffer could be written to before
+// and after, since that's the whole point.
 //
 
 // The outermost table (e.g. PML4, PML5) will always take up 4kB, so it can be defined statically like this.
@@ -2337,7 +2958,18 @@ __attribute__((aligned(4096))) static uint64_t outermost_table[512] = {0};
 // Page tables are all the same size...
 #define PAGE_TABLE_SIZE 512*8
 
-void Setup_Paging(void)
+// Page table entry bits that matter for memory types (see Setup_PAT())
+#define PAGE_ENTRY_PWT (1ULL << 3)
+#define PAGE_ENTRY_PCD (1ULL << 4)
+#define PAGE_ENTRY_NX  (1ULL << 63)
+
+// IA32_PAT encoding for write-combining
+#define PAT_MEMORY_TYPE_WC 0x01
+
+// How much of each framebuffer gets written to when measuring fill rates
+#define FRAMEBUFFER_RATE_SIZE (256*1024)
+
+void Setup_Paging(LOADER_PARAMS * LP)
 {
   // Disable global pages since we're going to overhaul the page table and don't want anything lingering from UEFI
   // Disable CR4.PGE
@@ -2353,6 +2985,26 @@ void Setup_Paging(void)
     }
   }
 
+  // How fast the framebuffers can be written to under UEFI's page tables, to compare against once they're write-combining
+  uint64_t num_framebuffers = LP->GPU_Configs->NumberOfFrameBuffers;
+  void * rate_scratch = malloc(FRAMEBUFFER_RATE_SIZE);
+  uint64_t * rate_before = malloc(num_framebuffers * sizeof(uint64_t));
+  uint8_t measure_rates = ((EFI_PHYSICAL_ADDRESS)rate_scratch != ~0ULL) && ((EFI_PHYSICAL_ADDRESS)rate_before != ~0ULL);
+
+  if(measure_rates)
+  {
+    for(uint64_t k = 0; k < num_framebuffers; k++)
+    {
+      EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU = &LP->GPU_Configs->GPUArray[k];
+      uint64_t numbytes = (GPU->FrameBufferSize < FRAMEBUFFER_RATE_SIZE) ? GPU->FrameBufferSize : FRAMEBUFFER_RATE_SIZE;
+      rate_before[k] = framebuffer_write_rate(GPU->FrameBufferBase, numbytes, rate_scratch);
+    }
+  }
+  else
+  {
+    warning_printf("Setup_Paging: Not enough memory to measure framebuffer fill rates.\r\n");
+  }
+
   // Ok, how much mapped memory do we have that needs to be in CPU pages?
 
   // The ACPI standard expects the UEFI memory map to describe *all installed memory* and not any virtual address spaces.
@@ -2637,6 +3289,27 @@ void Setup_Paging(void)
     } // PML4
   }
 
+  // Mark the framebuffers write-combining. Each one needs at most 4 more tables, for splitting pages at its edges.
+  uint64_t tables_left = num_framebuffers << 2;
+  if(tables_left)
+  {
+    EFI_PHYSICAL_ADDRESS table_pool = pagetable_alloc(PAGE_TABLE_SIZE*tables_left); // This zeroes out the area for us
+
+    for(uint64_t k = 0; k < num_framebuffers; k++)
+    {
+      EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU = &LP->GPU_Configs->GPUArray[k];
+      uint8_t wc_status = paging_map_wc(GPU->FrameBufferBase, GPU->FrameBufferBase + GPU->FrameBufferSize, &table_pool, &tables_left);
+      if(wc_status == 1)
+      {
+        warning_printf("Setup_Paging: Framebuffer %llu (%#qx) is outside the identity map, so it can't be made write-combining.\r\n", k, GPU->FrameBufferBase);
+      }
+      else if(wc_status == 2)
+      {
+        warning_printf("Setup_Paging: Ran out of page tables marking framebuffer %llu write-combining.\r\n", k);
+      }
+    }
+  }
+
   control_register_rw(3, (uint64_t)outermost_table, 1);
   // Certain hypervisors like Hyper-V will crash right here if less than 4GB is allocated to the VM. Actually, it appears to be 3968MB or less, as this 4GB number appears to include the entirety of physical address space (including PCI config space, etc.).
   // In Windows Event Viewer, Hyper-V-Worker will throw one of these errors:
@@ -2645,6 +3318,9 @@ void Setup_Paging(void)
   // My guess is that this might be somehow related to Windows giving all applications 4GB virtual address space, combined with the fact that this operation changes the paging tables of a type-1 hypervisor.
   // Or maybe Hyper-V has issues with using 1GB pages with < 4GB RAM? Or something to do with how Skylake has exactly 4 data TLBs for 1GB pages and "mov %cr3" causes TLB invalidation?
 
+  // PAT entry 1 is write-through until this changes it
+  Setup_PAT();
+
   // Enable CR4.PGE
   cr4 = control_register_rw(4, 0, 0);
   if(!(cr4 & (1 << 7))) // If off, turn on, else ignore
@@ -2657,6 +3333,214 @@ void Setup_Paging(void)
       warning_printf("Error setting CR4.PGE bit.\r\n");
     }
   }
+
+  if(measure_rates)
+  {
+    for(uint64_t k = 0; k < num_framebuffers; k++)
+    {
+      EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * GPU = &LP->GPU_Configs->GPUArray[k];
+      uint64_t numbytes = (GPU->FrameBufferSize < FRAMEBUFFER_RATE_SIZE) ? GPU->FrameBufferSize : FRAMEBUFFER_RATE_SIZE;
+      uint64_t rate_after = framebuffer_write_rate(GPU->FrameBufferBase, numbytes, rate_scratch);
+      printf("Framebuffer %llu (%#qx, %llu bytes): %llu MB/s before, %llu MB/s write-combining.\r\n", k, GPU->FrameBufferBase, GPU->FrameBufferSize, rate_before[k], rate_after);
+    }
+  }
+
+  if((EFI_PHYSICAL_ADDRESS)rate_before != ~0ULL)
+  {
+    free(rate_before);
+  }
+  if((EFI_PHYSICAL_ADDRESS)rate_scratch != ~0ULL)
+  {
+    free(rate_scratch);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// Setup_PAT: Make PAT Entry 1 Write-Combining
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The memory type of a page comes from its PAT, PCD, and PWT bits, which pick one of 8 entries in the IA32_PAT MSR. Out of reset,
+// those entries only offer WB, WT, UC-, and UC, so there's no way to ask for write-combining. This changes entry 1 (PWT = 1, PCD = 0,
+// PAT = 0) from WT to WC, the same choice Linux makes. PWT is in the same place at every paging level, unlike the PAT bit, and nothing
+// else here maps anything write-through. WC from the PAT overrides whatever the MTRRs say, which for framebuffers is usually UC.
+//
+// Every core needs the same PAT (see Setup_Magazines() for the rest of what each AP needs). Changing it follows the SDM's procedure
+// for changing memory types: caches off and flushed around the write, and the TLB flushed after it.
+//
+
+void Setup_PAT(void)
+{
+  uint64_t rdx = 0;
+  asm volatile("cpuid"
+               : "=d" (rdx) // Outputs
+               : "a" (0x01) // The value to put into %rax
+               : "%rbx", "%rcx"
+             );
+
+  if(!(rdx & (1 << 16))) // CPUID.01h:EDX[16]
+  {
+    warning_printf("Setup_PAT: CPU doesn't have a PAT. Framebuffers will stay whatever the MTRRs make them.\r\n");
+    return;
+  }
+
+  uint64_t pat = msr_rw(0x277, 0, 0);
+  uint64_t new_pat = (pat & ~(0xFFULL << 8)) | ((uint64_t)PAT_MEMORY_TYPE_WC << 8);
+  if(pat == new_pat)
+  {
+    return;
+  }
+
+  uint64_t cr0 = control_register_rw(0, 0, 0);
+  control_register_rw(0, (cr0 | (1 << 30)) & ~(1ULL << 29), 1); // CR0.CD = 1, CR0.NW = 0
+  asm volatile("wbinvd" : : : "memory");
+
+  msr_rw(0x277, new_pat, 1);
+
+  asm volatile("wbinvd" : : : "memory");
+  control_register_rw(3, control_register_rw(3, 0, 0), 1); // Flush the TLB (none of Setup_Paging()'s pages are global, so this gets everything)
+  control_register_rw(0, cr0, 1);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// paging_map_wc: Point a Physical Range's Identity-Mapped Pages at PAT Entry 1
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Sets PWT (and clears PCD) on every page covering [start, end) in the tables at outermost_table, so once Setup_PAT() has run the
+// whole range is write-combining. 1GB and 2MB pages the range covers completely are marked as they are. Ones it only partly covers,
+// at either end, get split into 512 of the next size down with the same flags, and only the covered ones get marked; that way nothing
+// outside the range changes type, and the range only costs as many extra tables as it has partial ends.
+//
+// New tables come out of *table_pool (a bump pointer into memory from pagetable_alloc()), and *tables_left says how many are left. A
+// range can need at most 4: a 2MB page table and a 4kB page table at each end. Returns 0 on success, 1 if part of the range isn't
+// mapped, or 2 if it ran out of tables.
+//
+
+static uint8_t paging_map_wc(EFI_PHYSICAL_ADDRESS start, EFI_PHYSICAL_ADDRESS end, EFI_PHYSICAL_ADDRESS * table_pool, uint64_t * tables_left)
+{
+  uint64_t la57 = control_register_rw(4, 0, 0) & (1 << 12);
+  EFI_PHYSICAL_ADDRESS address = start & ~0xFFFULL;
+
+  while(address < end)
+  {
+    // Walk down to the PDP entry
+    uint64_t * table = outermost_table;
+    if(la57)
+    {
+      if(!(table[(address >> PML5_SHIFT) & 0x1FF] & 0x1))
+      {
+        return 1;
+      }
+      table = (uint64_t*)(table[(address >> PML5_SHIFT) & 0x1FF] & PAGE_ENTRY_ADDRESS_MASK);
+    }
+    if(!(table[(address >> PML4_SHIFT) & 0x1FF] & 0x1))
+    {
+      return 1;
+    }
+    table = (uint64_t*)(table[(address >> PML4_SHIFT) & 0x1FF] & PAGE_ENTRY_ADDRESS_MASK);
+
+    uint64_t * entry = &table[(address >> PML3_SHIFT) & 0x1FF];
+    if(!(*entry & 0x1))
+    {
+      return 1;
+    }
+
+    if(*entry & (1 << 7)) // 1GB page
+    {
+      if(!(address & ((1ULL << 30) - 1)) && ((end - address) >= (1ULL << 30)))
+      {
+        *entry = (*entry & ~PAGE_ENTRY_PCD) | PAGE_ENTRY_PWT;
+        address += (1ULL << 30);
+        continue;
+      }
+
+      if(!*tables_left)
+      {
+        return 2;
+      }
+
+      // Same flags, including PS and the PAT bit (bit 12 in both)
+      uint64_t * pd = (uint64_t*)*table_pool;
+      uint64_t flags = *entry & (PAGE_ENTRY_NX | 0x1FFF);
+      uint64_t base = *entry & PAGE_ENTRY_ADDRESS_MASK & ~((1ULL << 30) - 1);
+      for(uint64_t pd_entry = 0; pd_entry < 512; pd_entry++)
+      {
+        pd[pd_entry] = (base + (pd_entry << 21)) | flags;
+      }
+
+      *entry = (EFI_PHYSICAL_ADDRESS)pd | 0x3;
+      *table_pool += PAGE_TABLE_SIZE;
+      (*tables_left)--;
+    }
+
+    table = (uint64_t*)(*entry & PAGE_ENTRY_ADDRESS_MASK);
+    entry = &table[(address >> PML2_SHIFT) & 0x1FF];
+
+    if(*entry & (1 << 7)) // 2MB page
+    {
+      if(!(address & ((1ULL << 21) - 1)) && ((end - address) >= (1ULL << 21)))
+      {
+        *entry = (*entry & ~PAGE_ENTRY_PCD) | PAGE_ENTRY_PWT;
+        address += (1ULL << 21);
+        continue;
+      }
+
+      if(!*tables_left)
+      {
+        return 2;
+      }
+
+      // 4kB pages have no PS bit, and their PAT bit is bit 7 instead of bit 12
+      uint64_t * pt = (uint64_t*)*table_pool;
+      uint64_t flags = (*entry & (PAGE_ENTRY_NX | 0x17F)) | ((*entry & (1 << 12)) ? (1 << 7) : 0);
+      uint64_t base = *entry & PAGE_ENTRY_ADDRESS_MASK & ~((1ULL << 21) - 1);
+      for(uint64_t pt_entry = 0; pt_entry < 512; pt_entry++)
+      {
+        pt[pt_entry] = (base + (pt_entry << 12)) | flags;
+      }
+
+      *entry = (EFI_PHYSICAL_ADDRESS)pt | 0x3;
+      *table_pool += PAGE_TABLE_SIZE;
+      (*tables_left)--;
+    }
+
+    table = (uint64_t*)(*entry & PAGE_ENTRY_ADDRESS_MASK);
+    entry = &table[(address >> PML1_SHIFT) & 0x1FF];
+    *entry = (*entry & ~PAGE_ENTRY_PCD) | PAGE_ENTRY_PWT;
+    address += (1ULL << 12);
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+// framebuffer_write_rate: Measure How Fast a Framebuffer Can Be Written To
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Copies numbytes from the start of the framebuffer at base into scratch, then times writing them back with AVX_memcpy, so nothing on
+// screen changes. numbytes should be FRAMEBUFFER_RATE_SIZE or less to keep AVX_memcpy on ordinary stores, which are what the memory
+// type actually affects. Returns MB/s, for the fastest of 4.
+//
+
+static uint64_t framebuffer_write_rate(EFI_PHYSICAL_ADDRESS base, uint64_t numbytes, void * scratch)
+{
+  uint64_t best = ~0ULL;
+
+  memcpy_from_wc(scratch, (void*)base, numbytes);
+
+  for(uint64_t run = 0; run < 4; run++)
+  {
+    uint64_t start_tick = get_tick();
+    AVX_memcpy((void*)base, scratch, numbytes);
+    _mm_sfence();
+    uint64_t ticks = get_tick() - start_tick;
+
+    if(ticks < best)
+    {
+      best = ticks;
+    }
+  }
+
+  return (numbytes * Global_TSC_frequency.CyclesPerSecond) / ((best ? best : 1) << 20);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -3682,20 +4566,26 @@ void PF_EXC_handler(EXCEPTION_FRAME * e_frame) // Fault #PF: Page Fault
               );
 
   uint64_t cr2 = control_register_rw(2, 0, 0); // CR2 has the page fault linear address
-  uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
-  info_printf("Fault #PF: Page Fault! IDT Entry: %#qu, Error Code: %#qx\r\n", e_frame->isr_num, e_frame->error_code);
-  printf("CR2: %#qx\r\n", cr2);
-  printf("CR3: %#qx\r\n", cr3);
-  // This is just a generic template example; page faults are usually not the end of the world. That's why it gets an info_printf
-  switch(e_frame->error_code)
+
+  // Not-present faults (error code bit 0 clear) in a vmalloc() reservation just need a page mapped in, after which returning retries
+  // the faulting instruction
+  if((e_frame->error_code & 0x1) || demand_page_fault(cr2))
   {
-    default:
-      EXC_regdump(e_frame);
-      while(1)
-      {
-        asm volatile("hlt");
-      }
-      break;
+    uint64_t cr3 = control_register_rw(3, 0, 0); // CR3 has the page directory base (bottom 12 bits of address are assumed 0)
+    info_printf("Fault #PF: Page Fault! IDT Entry: %#qu, Error Code: %#qx\r\n", e_frame->isr_num, e_frame->error_code);
+    printf("CR2: %#qx\r\n", cr2);
+    printf("CR3: %#qx\r\n", cr3);
+    // This is just a generic template example; page faults are usually not the end of the world. That's why it gets an info_printf
+    switch(e_frame->error_code)
+    {
+      default:
+        EXC_regdump(e_frame);
+        while(1)
+        {
+          asm volatile("hlt");
+        }
+        break;
+    }
   }
 
   // %rdx: Mask for xcr0 [63:32], %rax: Mask for xcr0 [31:0]
@@ -4086,6 +4976,8 @@ void UEFI_Reset(LOADER_PARAMS * LP, EFI_RESET_TYPE ResetType)
 
 void HaCF(void)
 {
+  Shadow_flush_all(); // Make sure that error message actually made it to the screen
+
   while(1)
   {
     asm volatile("hlt");
@@ -0,0 +1,235 @@
+//==================================================================================================================================
+//  AVX Memory Functions: Runtime Dispatch
+//==================================================================================================================================
+//
+// This file holds AVXmem_Dispatch, the function table that AVX_memmove, AVX_memcpy, AVX_memset, AVX_memcmp, and AVX_memset_4B
+// resolve to outside of the library (see the bottom of avxmem.h), and AVXmem_Select(), which Enable_AVX() calls once to fill it in.
+//
+// There are four builds of the library to pick from: the default one, compiled with the -march of whichever compile script was used,
+// and the AVX, AVX2, and AVX512 ones from avxmem_avx.c, avxmem_avx2.c, and avxmem_avx512.c. A newer build only gets used if the
+// default one was made for something older, since a default build for the same instruction set is also tuned for the right CPU
+// (e.g. -march=znver1) where the variants are tuned for the generic Intel part.
+//
+// On CPUs with ERMS (Enhanced REP MOVSB/STOSB, Ivy Bridge and newer), the copy and set entries are swapped for the rep string
+// versions below, which send the size ranges in erms_cutoffs to rep movsb/rep stosb and everything else to the vector build. Past a
+// couple of kB, ERMS microcode moves whole cache lines and beats 128-bit SSE loops and the split 256-bit accesses of first-generation
+// AVX outright. With wider vectors it takes longer to catch up, though it still wins for page-sized copies on most parts, and on
+// AVX512 it also keeps the core out of the lower AVX512 frequency license. FSRM (Fast Short REP MOV, Ice Lake and newer) gets rid of
+// most of rep movsb's startup cost, so those CPUs can use it for shorter copies as well. Sizes past the non-temporal threshold always
+// go to the vector build, since only it has streaming stores.
+//
+
+#define AVXMEM_LIBRARY
+#include "avxmem.h"
+
+#ifdef __AVX512F__
+#define AVXMEM_DEFAULT_LEVEL AVXMEM_LEVEL_AVX512
+#elif __AVX2__
+#define AVXMEM_DEFAULT_LEVEL AVXMEM_LEVEL_AVX2
+#elif __AVX__
+#define AVXMEM_DEFAULT_LEVEL AVXMEM_LEVEL_AVX
+#else
+#define AVXMEM_DEFAULT_LEVEL AVXMEM_LEVEL_SSE
+#endif
+
+// The entry points of each variant build
+#define AVXMEM_DECLARE_VARIANT(suffix) \
+  void * AVX_memmove##suffix(void *dest, void *src, size_t numbytes); \
+  void * AVX_memcpy##suffix(void *dest, void *src, size_t numbytes); \
+  void * AVX_memset##suffix(void *dest, const uint8_t val, size_t numbytes); \
+  int AVX_memcmp##suffix(const void *str1, const void *str2, size_t numbytes, int equality); \
+  void * AVX_memset_4B##suffix(void *dest, const uint32_t val, size_t numbytes_div_4); \
+  void * memset_large_as##suffix(void *dest, const uint8_t val, size_t numbytes); \
+  void * memcpy_large_as##suffix(void *dest, void *src, size_t numbytes); \
+  size_t AVX_strlen##suffix(const char *str); \
+  size_t AVX_strnlen##suffix(const char *str, size_t maxlen); \
+  void * AVX_memchr##suffix(const void *str, int val, size_t numbytes); \
+  void * AVX_memrchr##suffix(const void *str, int val, size_t numbytes); \
+  int AVX_strcmp##suffix(const char *str1, const char *str2); \
+  int AVX_strncmp##suffix(const char *str1, const char *str2, size_t numbytes); \
+  void * AVX_memmem##suffix(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen);
+
+AVXMEM_DECLARE_VARIANT(_avx)
+AVXMEM_DECLARE_VARIANT(_avx2)
+AVXMEM_DECLARE_VARIANT(_avx512)
+
+// A dispatch table entry for one build, with no ERMS and the default non-temporal threshold and prefetch distance. The suffix is
+// empty for the default build.
+#define AVXMEM_BUILD(suffix, level) \
+  { \
+    AVX_memmove##suffix, AVX_memcpy##suffix, AVX_memset##suffix, AVX_memcmp##suffix, AVX_memset_4B##suffix, \
+    memset_large_as##suffix, memcpy_large_as##suffix, \
+    AVX_strlen##suffix, AVX_strnlen##suffix, AVX_memchr##suffix, AVX_memrchr##suffix, AVX_strcmp##suffix, AVX_strncmp##suffix, \
+    AVX_memmem##suffix, \
+    level, 0, 0, CACHESIZELIMIT, PREFETCHDISTANCE, ((level) < AVXMEM_LEVEL_AVX2), {0, 0, 0, 0} \
+  }
+
+static void * ERMS_memmove(void *dest, void *src, size_t numbytes);
+static void * ERMS_memcpy(void *dest, void *src, size_t numbytes);
+static void * ERMS_memset(void *dest, const uint8_t val, size_t numbytes);
+
+// Where rep movsb/stosb takes over, by AVXMEM_LEVEL_* and then FSRM. These are starting points drawn from published measurements
+// (glibc uses about the same copy cutoffs without FSRM); erms_cutoff_calibrate() can replace them with ones timed on the actual CPU.
+// Stosb doesn't benefit from FSRM, so the Set columns are the same in both halves.
+static const AVXMEM_ERMS_CUTOFFS erms_cutoffs[4][2] = {
+  //  Copy_Min, Copy_Max, Set_Min, Set_Max       With FSRM
+  { {1024, ~0ULL, 1024, ~0ULL},                  {0,    ~0ULL, 1024, ~0ULL} }, // SSE4.2
+  { {1024, ~0ULL, 1024, ~0ULL},                  {0,    ~0ULL, 1024, ~0ULL} }, // AVX
+  { {4096, ~0ULL, 2048, ~0ULL},                  {2112, ~0ULL, 2048, ~0ULL} }, // AVX2
+  { {8192, ~0ULL, 2048, ~0ULL},                  {2112, ~0ULL, 2048, ~0ULL} }  // AVX512
+};
+
+// Starts out on the default build so that anything using these before Enable_AVX() gets what it always did
+AVXMEM_DISPATCH AVXmem_Dispatch = AVXMEM_BUILD(, AVXMEM_DEFAULT_LEVEL);
+
+// Where the ERMS versions send what they don't handle themselves
+static AVXMEM_DISPATCH vector_dispatch = AVXMEM_BUILD(, AVXMEM_DEFAULT_LEVEL);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVXmem_Select: Pick the AVX_mem* Build for This CPU
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Fills in AVXmem_Dispatch. Meant to be called once, by Enable_AVX(), after XCR0 has been set up; it does no feature checks of its
+// own, so the caller has to have made sure the CPU and OS state actually support everything in the requested level.
+//
+// level: the highest AVXMEM_LEVEL_* the CPU can run
+// erms: 1 if CPUID.(EAX=07H, ECX=0H):EBX.ERMS[bit 9] is set, 0 otherwise
+// fsrm: 1 if CPUID.(EAX=07H, ECX=0H):EDX.FSRM[bit 4] is set, 0 otherwise
+//
+
+void AVXmem_Select(uint32_t level, uint32_t erms, uint32_t fsrm)
+{
+  AVXMEM_DISPATCH Selected = AVXMEM_BUILD(, AVXMEM_DEFAULT_LEVEL);
+
+  if(level > AVXMEM_DEFAULT_LEVEL)
+  {
+    if(level == AVXMEM_LEVEL_AVX512)
+    {
+      AVXMEM_DISPATCH AVX512 = AVXMEM_BUILD(_avx512, AVXMEM_LEVEL_AVX512);
+      Selected = AVX512;
+    }
+    else if(level == AVXMEM_LEVEL_AVX2)
+    {
+      AVXMEM_DISPATCH AVX2 = AVXMEM_BUILD(_avx2, AVXMEM_LEVEL_AVX2);
+      Selected = AVX2;
+    }
+    else // AVXMEM_LEVEL_AVX
+    {
+      AVXMEM_DISPATCH AVX = AVXMEM_BUILD(_avx, AVXMEM_LEVEL_AVX);
+      Selected = AVX;
+    }
+  }
+
+  Selected.NT_Threshold = AVXmem_Dispatch.NT_Threshold;
+  Selected.Prefetch_Distance = AVXmem_Dispatch.Prefetch_Distance;
+  vector_dispatch = Selected;
+
+  if(erms)
+  {
+    Selected.Memmove = ERMS_memmove;
+    Selected.Memcpy = ERMS_memcpy;
+    Selected.Memset = ERMS_memset;
+    Selected.ERMS = 1;
+    Selected.FSRM = fsrm ? 1 : 0;
+    Selected.ERMS_Cutoffs = erms_cutoffs[Selected.Level][Selected.FSRM];
+  }
+
+  AVXmem_Dispatch = Selected;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  ERMS_memmove, ERMS_memcpy, ERMS_memset: rep movsb/rep stosb Versions
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same arguments and return values as AVX_memmove, AVX_memcpy, and AVX_memset. Sizes outside of AVXmem_Dispatch.ERMS_Cutoffs or
+// over the non-temporal threshold are passed on to the vector build. Only forward copies are done with rep movsb; a backwards
+// rep movsb (DF = 1) doesn't get the ERMS fast path, so overlapping moves to a higher address always use the vector build.
+//
+
+static void * ERMS_memmove(void *dest, void *src, size_t numbytes)
+{
+  if(((char*)dest > (char*)src) && ((char*)dest < ((char*)src + numbytes)))
+  {
+    return vector_dispatch.Memmove(dest, src, numbytes);
+  }
+
+  return ERMS_memcpy(dest, src, numbytes);
+}
+
+static void * ERMS_memcpy(void *dest, void *src, size_t numbytes)
+{
+  if(
+      (numbytes < AVXmem_Dispatch.ERMS_Cutoffs.Copy_Min) || (numbytes > AVXmem_Dispatch.ERMS_Cutoffs.Copy_Max)
+      ||
+      (numbytes > AVXmem_Dispatch.NT_Threshold)
+    )
+  {
+    return vector_dispatch.Memcpy(dest, src, numbytes);
+  }
+
+  void * returnval = dest;
+
+  asm volatile("rep movsb"
+               : "+D" (dest), "+S" (src), "+c" (numbytes) // Outputs (rdi, rsi, and rcx all get advanced)
+               : // No inputs
+               : "memory" // Clobbers
+              );
+
+  return returnval;
+}
+
+static void * ERMS_memset(void *dest, const uint8_t val, size_t numbytes)
+{
+  if(
+      (numbytes < AVXmem_Dispatch.ERMS_Cutoffs.Set_Min) || (numbytes > AVXmem_Dispatch.ERMS_Cutoffs.Set_Max)
+      ||
+      (numbytes > AVXmem_Dispatch.NT_Threshold)
+    )
+  {
+    return vector_dispatch.Memset(dest, val, numbytes);
+  }
+
+  void * returnval = dest;
+
+  asm volatile("rep stosb"
+               : "+D" (dest), "+c" (numbytes) // Outputs (rdi and rcx both get advanced)
+               : "a" (val) // The byte to store goes in al
+               : "memory" // Clobbers
+              );
+
+  return returnval;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVXmem_strlen, AVXmem_strcmp, AVXmem_strncmp, AVXmem_strchr, AVXmem_strstr: Dispatched String Functions Without the Header
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// For ACPICA, whose acKernel64.h points its strlen, strcmp, strncmp, strchr, and strstr here instead of at the byte-at-a-time ones
+// in its utclib.c. Same arguments and return values as those C library functions.
+//
+
+size_t AVXmem_strlen(const char *str)
+{
+  return AVXmem_Dispatch.Strlen(str);
+}
+
+int AVXmem_strcmp(const char *str1, const char *str2)
+{
+  return AVXmem_Dispatch.Strcmp(str1, str2);
+}
+
+int AVXmem_strncmp(const char *str1, const char *str2, size_t numbytes)
+{
+  return AVXmem_Dispatch.Strncmp(str1, str2, numbytes);
+}
+
+// The terminating NUL counts as part of the string, so strchr(str, 0) finds it
+char * AVXmem_strchr(const char *str, int val)
+{
+  return (char*)AVXmem_Dispatch.Memchr(str, val, AVXmem_Dispatch.Strlen(str) + 1);
+}
+
+char * AVXmem_strstr(const char *str1, const char *str2)
+{
+  return (char*)AVXmem_Dispatch.Memmem(str1, AVXmem_Dispatch.Strlen(str1), str2, AVXmem_Dispatch.Strlen(str2));
+}
@@ -27,10 +27,20 @@
 #include <stdint.h>
 #include <x86intrin.h>
 
+// The avxmem_<isa>.c wrappers rebuild this library for other instruction sets under suffixed names
+#ifdef AVXMEM_VARIANT
+#include "avxmem_variant.h"
+#endif
+
 // Size limit (in bytes) before switching to non-temporal/streaming loads & stores
-// Applies to: AVX_memmove, AVX_memset, and AVX_memcpy
+// Applies to: AVX_memmove, AVX_memset, AVX_memcpy, and AVX_memset_4B
+// This is only the starting value of AVXmem_Dispatch.NT_Threshold, which is what those functions actually check. Enable_AVX() sets
+// that from the CPU's cache sizes, and nt_threshold_calibrate() can refine it further by timing both kinds of copies.
 #define CACHESIZELIMIT 3*1024*1024 // 3 MB
 
+// Starting value of AVXmem_Dispatch.Prefetch_Distance (see memmove.c). memmove_calibrate() can pick one for the actual CPU.
+#define PREFETCHDISTANCE 4096
+
 //-----------------------------------------------------------------------------
 // Main Functions:
 //-----------------------------------------------------------------------------
@@ -45,6 +55,15 @@ int AVX_memcmp(const void *str1, const void *str2, size_t numbytes, int equality
 // Numbytes_div_4 is total number of bytes / 4 (since they only do 4 at a time).
 void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4);
 
+// String & search functions (memstr.c). These work like their C library namesakes.
+size_t AVX_strlen(const char *str);
+size_t AVX_strnlen(const char *str, size_t maxlen);
+void * AVX_memchr(const void *str, int val, size_t numbytes);
+void * AVX_memrchr(const void *str, int val, size_t numbytes);
+int AVX_strcmp(const char *str1, const char *str2);
+int AVX_strncmp(const char *str1, const char *str2, size_t numbytes);
+void * AVX_memmem(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen);
+
 //-----------------------------------------------------------------------------
 // MEMSET:
 //-----------------------------------------------------------------------------
@@ -142,6 +161,14 @@ void * memset_512bit_1kB_as(void *dest, __m512i_u val, size_t len); // 1024 byte
 void * memset_512bit_2kB_as(void *dest, __m512i_u val, size_t len); // 2048 bytes
 void * memset_512bit_4kB_as(void *dest, __m512i_u val, size_t len); // 4096 bytes
 #endif
+
+// AVX512 (Masked tails)
+#ifdef __AVX512BW__
+void * memset_512bit_masked_u(void *dest, __m512i val, size_t len); // 0-63 bytes
+#endif
+#ifdef __AVX512F__
+void * memset_512bit_4B_masked_u(void *dest, __m512i val, size_t len); // 0-15 4-byte values
+#endif
 // END MEMSET
 
 //-----------------------------------------------------------------------------
@@ -253,6 +280,11 @@ void * memmove_512bit_1kB_as(void *dest, const void *src, size_t len); // 1024 b
 void * memmove_512bit_2kB_as(void *dest, const void *src, size_t len); // 2048 bytes
 void * memmove_512bit_4kB_as(void *dest, const void *src, size_t len); // 4096 bytes
 #endif
+
+// AVX512BW (Masked tails)
+#ifdef __AVX512BW__
+void * memmove_512bit_masked_u(void *dest, const void *src, size_t len); // 0-63 bytes
+#endif
 // END MEMMOVE
 
 //-----------------------------------------------------------------------------
@@ -346,6 +378,11 @@ void * memcpy_512bit_1kB_as(void *dest, const void *src, size_t len); // 1024 by
 void * memcpy_512bit_2kB_as(void *dest, const void *src, size_t len); // 2048 bytes
 void * memcpy_512bit_4kB_as(void *dest, const void *src, size_t len); // 4096 bytes
 #endif
+
+// AVX512BW (Masked tails)
+#ifdef __AVX512BW__
+void * memcpy_512bit_masked_u(void *dest, const void *src, size_t len); // 0-63 bytes
+#endif
 // END MEMCPY
 
 //-----------------------------------------------------------------------------
@@ -397,6 +434,124 @@ int memcmp_512bit_eq_u(const void *str1, const void *str2, size_t count);
 int memcmp_512bit_a(const void *str1, const void *str2, size_t count);
 int memcmp_512bit_eq_a(const void *str1, const void *str2, size_t count);
 #endif
+
+// AVX512BW (Masked tails)
+#ifdef __AVX512BW__
+int memcmp_512bit_masked_u(const void *str1, const void *str2, size_t count); // 0-63 bytes
+int memcmp_512bit_eq_masked_u(const void *str1, const void *str2, size_t count); // 0-63 bytes
+#endif
 // END MEMCMP
 
+//-----------------------------------------------------------------------------
+// WRITE-COMBINING MEMORY:
+//-----------------------------------------------------------------------------
+
+// For reading from framebuffers and other WC/UC memory, where only MOVNTDQA
+// loads are fast (see memwc.c). dest can be any kind of memory.
+void * memcpy_from_wc(void *dest, const void *src, size_t numbytes);
+void * memmove_wc(void *dest, const void *src, size_t numbytes); // src and dest may overlap
+
+//-----------------------------------------------------------------------------
+// CHECKSUMS:
+//-----------------------------------------------------------------------------
+
+// See checksum.c. AVX_sum8 is the 8-bit sum ACPI and SMBIOS structures are
+// validated with; AVX_crc32c is the standard CRC-32C, starting from crc = 0.
+uint8_t AVX_sum8(const void *data, size_t numbytes);
+uint32_t AVX_crc32c(uint32_t crc, const void *data, size_t numbytes);
+
+//-----------------------------------------------------------------------------
+// Runtime Dispatch:
+//-----------------------------------------------------------------------------
+
+// Besides the default build made with whatever -march the compile script uses, avxmem_avx.c, avxmem_avx2.c, and avxmem_avx512.c
+// build the whole library again for those instruction sets. AVXmem_Select() is called once by Enable_AVX() to point this table at
+// the best build the CPU can run, and everything outside of the library that calls AVX_memmove, AVX_memcpy, AVX_memset, AVX_memcmp,
+// AVX_memset_4B, or one of the string functions goes through it. That lets one kernel image built for a baseline -march (see Compile-Generic.sh) run at full speed
+// on every machine, without any per-call feature checks.
+//
+// The subfunctions above (memset_zeroes_as, etc.) are not dispatched: calling them directly always gets the default build.
+
+#define AVXMEM_LEVEL_SSE    0 // SSE4.2
+#define AVXMEM_LEVEL_AVX    1 // AVX (Sandy Bridge)
+#define AVXMEM_LEVEL_AVX2   2 // AVX2 + BMI2 + FMA (Haswell)
+#define AVXMEM_LEVEL_AVX512 3 // AVX512F/CD/BW/DQ/VL (Skylake-SP)
+
+// Sizes (in bytes) from Min to Max go to rep movsb (Copy, for AVX_memcpy and forward AVX_memmove) or rep stosb (Set, for AVX_memset)
+// instead of the vector loops, as long as they are also under NT_Threshold. Min > Max turns a path off.
+typedef struct {
+  size_t Copy_Min;
+  size_t Copy_Max;
+  size_t Set_Min;
+  size_t Set_Max;
+} AVXMEM_ERMS_CUTOFFS;
+
+typedef struct {
+  void * (*Memmove)(void *dest, void *src, size_t numbytes);
+  void * (*Memcpy)(void *dest, void *src, size_t numbytes);
+  void * (*Memset)(void *dest, const uint8_t val, size_t numbytes);
+  int (*Memcmp)(const void *str1, const void *str2, size_t numbytes, int equality);
+  void * (*Memset_4B)(void *dest, const uint32_t val, size_t numbytes_div_4);
+  void * (*Memset_Stream)(void *dest, const uint8_t val, size_t numbytes); // memset_large_as of the same build
+  void * (*Memcpy_Stream)(void *dest, void *src, size_t numbytes); // memcpy_large_as of the same build
+  size_t (*Strlen)(const char *str);
+  size_t (*Strnlen)(const char *str, size_t maxlen);
+  void * (*Memchr)(const void *str, int val, size_t numbytes);
+  void * (*Memrchr)(const void *str, int val, size_t numbytes);
+  int (*Strcmp)(const char *str1, const char *str2);
+  int (*Strncmp)(const char *str1, const char *str2, size_t numbytes);
+  void * (*Memmem)(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen);
+  uint32_t Level; // AVXMEM_LEVEL_* of the build in use
+  uint32_t ERMS; // 1 if Memmove/Memcpy/Memset are the rep movsb/stosb versions
+  uint32_t FSRM; // 1 if the CPU has Fast Short REP MOV, which ERMS_Cutoffs was picked for
+  size_t NT_Threshold; // Sizes (in bytes) above this use non-temporal/streaming loads & stores
+  size_t Prefetch_Distance; // How far ahead (in bytes) AVX_memmove's large paths prefetch src, or 0 for not at all
+  uint32_t Shift_Path; // 1 if AVX_memmove uses aligned shuffles for small shifts (only the AVX and SSE4.2 builds have that path)
+  AVXMEM_ERMS_CUTOFFS ERMS_Cutoffs; // Only used if ERMS is 1
+} AVXMEM_DISPATCH;
+
+extern AVXMEM_DISPATCH AVXmem_Dispatch;
+
+void AVXmem_Select(uint32_t level, uint32_t erms, uint32_t fsrm);
+
+// Plain functions that go through AVXmem_Dispatch, for code that can't include this header because it has C library functions of
+// its own with the same names as the ones here (ACPICA's utclib.c, see acKernel64.h)
+size_t AVXmem_strlen(const char *str);
+int AVXmem_strcmp(const char *str1, const char *str2);
+int AVXmem_strncmp(const char *str1, const char *str2, size_t numbytes);
+char * AVXmem_strchr(const char *str, int val);
+char * AVXmem_strstr(const char *str1, const char *str2);
+
+//-----------------------------------------------------------------------------
+// Multi-Core:
+//-----------------------------------------------------------------------------
+
+// Ranges this big or bigger (and over NT_Threshold) get split across any cores sitting in AVXmem_Parallel_Worker(). Chunks are
+// aligned to 2MB in the destination so that each one stays within a single large page (and a single NUMA node, since no firmware
+// interleaves memory more finely than that).
+#define AVXMEM_PARALLEL_CHUNK (2*1024*1024) // 2 MB
+#define AVXMEM_PARALLEL_MIN   (4*AVXMEM_PARALLEL_CHUNK) // 8 MB
+
+void * AVX_memset_parallel(void *dest, const uint8_t val, size_t numbytes);
+void * AVX_memcpy_parallel(void *dest, void *src, size_t numbytes);
+
+// An idle AP calls this to help with the above until *stop becomes nonzero
+void AVXmem_Parallel_Worker(volatile uint32_t *stop);
+
+// The library's own files define AVXMEM_LIBRARY so they see (and define) the real functions
+#ifndef AVXMEM_LIBRARY
+#define AVX_memmove(dest, src, numbytes) AVXmem_Dispatch.Memmove((dest), (src), (numbytes))
+#define AVX_memcpy(dest, src, numbytes) AVXmem_Dispatch.Memcpy((dest), (src), (numbytes))
+#define AVX_memset(dest, val, numbytes) AVXmem_Dispatch.Memset((dest), (val), (numbytes))
+#define AVX_memcmp(str1, str2, numbytes, equality) AVXmem_Dispatch.Memcmp((str1), (str2), (numbytes), (equality))
+#define AVX_memset_4B(dest, val, numbytes_div_4) AVXmem_Dispatch.Memset_4B((dest), (val), (numbytes_div_4))
+#define AVX_strlen(str) AVXmem_Dispatch.Strlen((str))
+#define AVX_strnlen(str, maxlen) AVXmem_Dispatch.Strnlen((str), (maxlen))
+#define AVX_memchr(str, val, numbytes) AVXmem_Dispatch.Memchr((str), (val), (numbytes))
+#define AVX_memrchr(str, val, numbytes) AVXmem_Dispatch.Memrchr((str), (val), (numbytes))
+#define AVX_strcmp(str1, str2) AVXmem_Dispatch.Strcmp((str1), (str2))
+#define AVX_strncmp(str1, str2, numbytes) AVXmem_Dispatch.Strncmp((str1), (str2), (numbytes))
+#define AVX_memmem(haystack, haystacklen, needle, needlelen) AVXmem_Dispatch.Memmem((haystack), (haystacklen), (needle), (needlelen))
+#endif
+
 #endif /* _avxmem_H */
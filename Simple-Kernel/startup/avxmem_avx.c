@@ -0,0 +1,23 @@
+//==================================================================================================================================
+//  AVX Memory Functions: AVX Build
+//==================================================================================================================================
+//
+// Recompiles the whole AVX_mem* library as if with -march=sandybridge, for Sandy Bridge-class CPUs (AVX, but no 256-bit integer ops).
+// avxmem_variant.h renames every function to <name>_avx, and AVXmem_Select() in avxmem.c points AVXmem_Dispatch here when the CPU
+// supports it and the default build was made for something older.
+//
+// The target pragma has to come before anything includes x86intrin.h, so nothing else goes above it.
+//
+
+#pragma GCC target("arch=sandybridge")
+#define AVXMEM_VARIANT _avx
+
+// Each file sets BYTE_ALIGNMENT for itself, and memcmp.c only goes to 32 bytes with AVX2
+#include "memcpy.c"
+#undef BYTE_ALIGNMENT
+#include "memmove.c"
+#undef BYTE_ALIGNMENT
+#include "memset.c"
+#undef BYTE_ALIGNMENT
+#include "memcmp.c"
+#include "memstr.c"
@@ -0,0 +1,23 @@
+//==================================================================================================================================
+//  AVX Memory Functions: AVX2 Build
+//==================================================================================================================================
+//
+// Recompiles the whole AVX_mem* library as if with -march=haswell, for Haswell-class and newer CPUs, AMD Zen included (AVX2, BMI2,
+// and FMA). avxmem_variant.h renames every function to <name>_avx2, and AVXmem_Select() in avxmem.c points AVXmem_Dispatch here when
+// the CPU supports it and the default build was made for something older.
+//
+// The target pragma has to come before anything includes x86intrin.h, so nothing else goes above it.
+//
+
+#pragma GCC target("arch=haswell")
+#define AVXMEM_VARIANT _avx2
+
+// Each file sets BYTE_ALIGNMENT for itself, and memcmp.c only goes to 32 bytes with AVX2
+#include "memcpy.c"
+#undef BYTE_ALIGNMENT
+#include "memmove.c"
+#undef BYTE_ALIGNMENT
+#include "memset.c"
+#undef BYTE_ALIGNMENT
+#include "memcmp.c"
+#include "memstr.c"
@@ -0,0 +1,26 @@
+//==================================================================================================================================
+//  AVX Memory Functions: AVX512 Build
+//==================================================================================================================================
+//
+// Recompiles the whole AVX_mem* library as if with -march=skylake-avx512, for Skylake-SP-class and newer CPUs (AVX512F, CD, BW, DQ,
+// and VL). avxmem_variant.h renames every function to <name>_avx512, and AVXmem_Select() in avxmem.c points AVXmem_Dispatch here when
+// the CPU supports it and the default build was made for something older.
+//
+// The target pragma has to come before anything includes x86intrin.h, so nothing else goes above it.
+//
+
+#pragma GCC target("arch=skylake-avx512")
+#define AVXMEM_VARIANT _avx512
+
+// GCC's _mm512_stream_load_si512() takes a plain void pointer, so every streaming load from a const source would warn otherwise
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+
+// Each file sets BYTE_ALIGNMENT for itself, and memcmp.c only goes to 32 bytes with AVX2
+#include "memcpy.c"
+#undef BYTE_ALIGNMENT
+#include "memmove.c"
+#undef BYTE_ALIGNMENT
+#include "memset.c"
+#undef BYTE_ALIGNMENT
+#include "memcmp.c"
+#include "memstr.c"
@@ -0,0 +1,220 @@
+//==================================================================================================================================
+//  AVX Memory Functions: Multi-Core Memset & Memcpy
+//==================================================================================================================================
+//
+// AVX_memset_parallel() and AVX_memcpy_parallel() are for huge ranges, like zeroing all of conventional memory or a freed 1GB region,
+// where one core can't keep every memory channel busy. They cut the range into AVXMEM_PARALLEL_CHUNK pieces aligned in the
+// destination and post them as a job that idle cores take chunks from one at a time, so a core that falls behind (e.g. one whose
+// chunks are on a remote NUMA node) just ends up doing fewer of them. The calling core works on the job too, then waits at a
+// completion barrier until every chunk is done.
+//
+// Chunks are written with non-temporal stores, which is the point: nobody is about to read all of a range this size, and streaming
+// stores don't make each core read in every line before overwriting it. For memcpy that only works when src and dest are aligned
+// the same way within a cache line, since the streaming copy needs both aligned; otherwise each chunk goes through the regular
+// AVX_memcpy.
+//
+// A core offers to help by sitting in AVXmem_Parallel_Worker(). If there aren't any, another job is already running, or the range is
+// too small to bother, these are just AVX_memset() and AVX_memcpy().
+//
+// NOTE: Unlike the rest of the library, this file uses the dispatched AVX_mem* functions, so it doesn't define AVXMEM_LIBRARY and
+// doesn't get rebuilt by the avxmem_<isa>.c wrappers.
+//
+
+#include "avxmem.h"
+
+#define AVXMEM_PARALLEL_MEMSET 0
+#define AVXMEM_PARALLEL_MEMCPY 1
+
+// The one job that can be running at a time
+typedef struct {
+  volatile uint64_t Busy; // Nonzero while a caller owns the job below, from setting it up until every helper has left
+  volatile uint64_t Posted; // Nonzero while helpers may join
+  volatile uint64_t Workers; // Number of cores sitting in AVXmem_Parallel_Worker()
+  volatile uint64_t Active; // Number of helpers that have joined the job and not yet left
+  uint32_t Op; // AVXMEM_PARALLEL_MEMSET or AVXMEM_PARALLEL_MEMCPY
+  uint8_t Val; // memset only
+  void * Dest;
+  void * Src; // memcpy only
+  uintptr_t Base; // Dest rounded down to AVXMEM_PARALLEL_CHUNK
+  uintptr_t End; // Dest + numbytes
+  size_t Num_Chunks;
+  volatile size_t Next_Chunk; // Next chunk to hand out; goes past Num_Chunks once they've all been taken
+  volatile size_t Chunks_Done;
+} AVXMEM_PARALLEL_JOB;
+
+static AVXMEM_PARALLEL_JOB Parallel_Job = {0};
+
+static void * parallel_run(uint32_t op, void *dest, void *src, const uint8_t val, size_t numbytes);
+static void parallel_do_chunks(void);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVX_memset_parallel, AVX_memcpy_parallel: Memset & Memcpy Spread Across Idle Cores
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same arguments and return values as AVX_memset and AVX_memcpy. Everything has been written (and is visible to other cores) by the
+// time these return. As with AVX_memcpy, src and dest must not overlap.
+//
+
+void * AVX_memset_parallel(void *dest, const uint8_t val, size_t numbytes)
+{
+  return parallel_run(AVXMEM_PARALLEL_MEMSET, dest, NULL, val, numbytes);
+}
+
+void * AVX_memcpy_parallel(void *dest, void *src, size_t numbytes)
+{
+  return parallel_run(AVXMEM_PARALLEL_MEMCPY, dest, src, 0, numbytes);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVXmem_Parallel_Worker: Help With Parallel Memsets and Memcpys
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Meant to be an AP's idle loop: it waits for AVX_memset_parallel() or AVX_memcpy_parallel() to post a job and does chunks of it
+// until there are none left, over and over, and returns once *stop is nonzero. The core needs its AVX state enabled the same way as
+// the BSP's (see Enable_AVX()), since the chunks run whichever build AVXmem_Dispatch points to.
+//
+// stop: set this to nonzero from another core to make the worker return
+//
+
+void AVXmem_Parallel_Worker(volatile uint32_t *stop)
+{
+  __atomic_fetch_add(&Parallel_Job.Workers, 1, __ATOMIC_SEQ_CST);
+
+  while(!*stop)
+  {
+    if(Parallel_Job.Posted)
+    {
+      // Join, then make sure the job is still posted. The caller waits for Active to drop to 0 after unposting, so either this sees
+      // the job is gone or the caller sees this core and waits for it.
+      __atomic_fetch_add(&Parallel_Job.Active, 1, __ATOMIC_SEQ_CST);
+
+      if(__atomic_load_n(&Parallel_Job.Posted, __ATOMIC_SEQ_CST))
+      {
+        parallel_do_chunks();
+      }
+
+      __atomic_fetch_sub(&Parallel_Job.Active, 1, __ATOMIC_SEQ_CST);
+    }
+
+    asm volatile("pause" : : : "memory");
+  }
+
+  __atomic_fetch_sub(&Parallel_Job.Workers, 1, __ATOMIC_SEQ_CST);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  parallel_run: Post a Job, Help With It, and Wait for It
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Does the work of AVX_memset_parallel() and AVX_memcpy_parallel(), falling back to the single-core versions when there's nobody to
+// share with.
+//
+
+static void * parallel_run(uint32_t op, void *dest, void *src, const uint8_t val, size_t numbytes)
+{
+  if(
+      (numbytes < AVXMEM_PARALLEL_MIN) || (numbytes <= AVXmem_Dispatch.NT_Threshold)
+      ||
+      (!__atomic_load_n(&Parallel_Job.Workers, __ATOMIC_SEQ_CST))
+      ||
+      (!__sync_bool_compare_and_swap(&Parallel_Job.Busy, 0, 1))
+    )
+  {
+    if(op == AVXMEM_PARALLEL_MEMSET)
+    {
+      return AVX_memset(dest, val, numbytes);
+    }
+    return AVX_memcpy(dest, src, numbytes);
+  }
+
+  Parallel_Job.Op = op;
+  Parallel_Job.Val = val;
+  Parallel_Job.Dest = dest;
+  Parallel_Job.Src = src;
+  Parallel_Job.Base = (uintptr_t)dest & ~(uintptr_t)(AVXMEM_PARALLEL_CHUNK - 1);
+  Parallel_Job.End = (uintptr_t)dest + numbytes;
+  Parallel_Job.Num_Chunks = (Parallel_Job.End - Parallel_Job.Base + (AVXMEM_PARALLEL_CHUNK - 1)) / AVXMEM_PARALLEL_CHUNK;
+  Parallel_Job.Next_Chunk = 0;
+  Parallel_Job.Chunks_Done = 0;
+
+  __atomic_store_n(&Parallel_Job.Posted, 1, __ATOMIC_SEQ_CST);
+
+  parallel_do_chunks();
+
+  // Completion barrier
+  while(__atomic_load_n(&Parallel_Job.Chunks_Done, __ATOMIC_ACQUIRE) != Parallel_Job.Num_Chunks)
+  {
+    asm volatile("pause" : : : "memory");
+  }
+
+  // Helpers may still be on their way out after finding no chunks left, and they mustn't see the next job's Next_Chunk
+  __atomic_store_n(&Parallel_Job.Posted, 0, __ATOMIC_SEQ_CST);
+  while(__atomic_load_n(&Parallel_Job.Active, __ATOMIC_SEQ_CST))
+  {
+    asm volatile("pause" : : : "memory");
+  }
+
+  __atomic_store_n(&Parallel_Job.Busy, 0, __ATOMIC_RELEASE);
+
+  return dest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  parallel_do_chunks: Take Chunks of the Posted Job Until There Are None Left
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Only the first chunk can start unaligned, and only the last can end short of a chunk boundary. Everything else starts on a 2MB
+// boundary in dest, so it can go straight to the streaming functions.
+//
+
+static void parallel_do_chunks(void)
+{
+  size_t chunk_index;
+
+  while((chunk_index = __atomic_fetch_add(&Parallel_Job.Next_Chunk, 1, __ATOMIC_RELAXED)) < Parallel_Job.Num_Chunks)
+  {
+    uintptr_t chunk_start = Parallel_Job.Base + chunk_index * AVXMEM_PARALLEL_CHUNK;
+    uintptr_t chunk_end = chunk_start + AVXMEM_PARALLEL_CHUNK;
+
+    if(chunk_start < (uintptr_t)Parallel_Job.Dest)
+    {
+      chunk_start = (uintptr_t)Parallel_Job.Dest;
+    }
+    if(chunk_end > Parallel_Job.End)
+    {
+      chunk_end = Parallel_Job.End;
+    }
+
+    size_t offset = chunk_start - (uintptr_t)Parallel_Job.Dest;
+    void * chunk_dest = (char*)Parallel_Job.Dest + offset;
+
+    if(Parallel_Job.Op == AVXMEM_PARALLEL_MEMSET)
+    {
+      if(chunk_start & 63)
+      {
+        AVX_memset(chunk_dest, Parallel_Job.Val, chunk_end - chunk_start);
+      }
+      else
+      {
+        AVXmem_Dispatch.Memset_Stream(chunk_dest, Parallel_Job.Val, chunk_end - chunk_start);
+      }
+    }
+    else
+    {
+      void * chunk_src = (char*)Parallel_Job.Src + offset;
+
+      if((chunk_start | (uintptr_t)chunk_src) & 63)
+      {
+        AVX_memcpy(chunk_dest, chunk_src, chunk_end - chunk_start);
+      }
+      else
+      {
+        AVXmem_Dispatch.Memcpy_Stream(chunk_dest, chunk_src, chunk_end - chunk_start);
+      }
+    }
+
+    // Streaming stores aren't ordered with the counter update otherwise
+    _mm_sfence();
+    __atomic_fetch_add(&Parallel_Job.Chunks_Done, 1, __ATOMIC_RELEASE);
+  }
+}
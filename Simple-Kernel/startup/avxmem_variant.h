@@ -0,0 +1,246 @@
+//==================================================================================================================================
+//  AVX Memory Functions: Variant Renames
+//==================================================================================================================================
+//
+// avxmem.h pulls this in when AVXMEM_VARIANT is defined, which only the avxmem_<isa>.c wrappers do. Each wrapper recompiles memcpy.c,
+// memmove.c, memset.c, memcmp.c, and memstr.c for one instruction set, and these macros append the AVXMEM_VARIANT suffix to every function
+// those files define so that all of the builds can be linked into the same kernel. See avxmem.c for how a build is picked at runtime.
+//
+// Any function added to those files (and avxmem.h) needs a line here, too, or the variant builds will collide with the default
+// one at link time. Files the wrappers don't include, like memwc.c and avxmem_parallel.c, only exist in the default build.
+//
+
+#ifndef _avxmem_variant_H
+#define _avxmem_variant_H
+
+#define AVXMEM_PASTE2(name, suffix) name##suffix
+#define AVXMEM_PASTE(name, suffix) AVXMEM_PASTE2(name, suffix)
+#define AVXMEM_RENAME(name) AVXMEM_PASTE(name, AVXMEM_VARIANT)
+
+#define AVX_memmove               AVXMEM_RENAME(AVX_memmove)
+#define AVX_memcpy                AVXMEM_RENAME(AVX_memcpy)
+#define AVX_memset                AVXMEM_RENAME(AVX_memset)
+#define AVX_memcmp                AVXMEM_RENAME(AVX_memcmp)
+#define AVX_memset_4B             AVXMEM_RENAME(AVX_memset_4B)
+#define AVX_strlen                AVXMEM_RENAME(AVX_strlen)
+#define AVX_strnlen               AVXMEM_RENAME(AVX_strnlen)
+#define AVX_memchr                AVXMEM_RENAME(AVX_memchr)
+#define AVX_memrchr               AVXMEM_RENAME(AVX_memrchr)
+#define AVX_strcmp                AVXMEM_RENAME(AVX_strcmp)
+#define AVX_strncmp               AVXMEM_RENAME(AVX_strncmp)
+#define AVX_memmem                AVXMEM_RENAME(AVX_memmem)
+#define memset_large              AVXMEM_RENAME(memset_large)
+#define memset_large_a            AVXMEM_RENAME(memset_large_a)
+#define memset_large_as           AVXMEM_RENAME(memset_large_as)
+#define memset_zeroes             AVXMEM_RENAME(memset_zeroes)
+#define memset_zeroes_a           AVXMEM_RENAME(memset_zeroes_a)
+#define memset_zeroes_as          AVXMEM_RENAME(memset_zeroes_as)
+#define memset_large_4B           AVXMEM_RENAME(memset_large_4B)
+#define memset_large_4B_a         AVXMEM_RENAME(memset_large_4B_a)
+#define memset_large_4B_as        AVXMEM_RENAME(memset_large_4B_as)
+#define memset                    AVXMEM_RENAME(memset)
+#define memset_16bit              AVXMEM_RENAME(memset_16bit)
+#define memset_32bit              AVXMEM_RENAME(memset_32bit)
+#define memset_64bit              AVXMEM_RENAME(memset_64bit)
+#define memset_128bit_u           AVXMEM_RENAME(memset_128bit_u)
+#define memset_128bit_32B_u       AVXMEM_RENAME(memset_128bit_32B_u)
+#define memset_128bit_64B_u       AVXMEM_RENAME(memset_128bit_64B_u)
+#define memset_128bit_128B_u      AVXMEM_RENAME(memset_128bit_128B_u)
+#define memset_128bit_256B_u      AVXMEM_RENAME(memset_128bit_256B_u)
+#define memset_128bit_a           AVXMEM_RENAME(memset_128bit_a)
+#define memset_128bit_32B_a       AVXMEM_RENAME(memset_128bit_32B_a)
+#define memset_128bit_64B_a       AVXMEM_RENAME(memset_128bit_64B_a)
+#define memset_128bit_128B_a      AVXMEM_RENAME(memset_128bit_128B_a)
+#define memset_128bit_256B_a      AVXMEM_RENAME(memset_128bit_256B_a)
+#define memset_128bit_as          AVXMEM_RENAME(memset_128bit_as)
+#define memset_128bit_32B_as      AVXMEM_RENAME(memset_128bit_32B_as)
+#define memset_128bit_64B_as      AVXMEM_RENAME(memset_128bit_64B_as)
+#define memset_128bit_128B_as     AVXMEM_RENAME(memset_128bit_128B_as)
+#define memset_128bit_256B_as     AVXMEM_RENAME(memset_128bit_256B_as)
+#define memset_256bit_u           AVXMEM_RENAME(memset_256bit_u)
+#define memset_256bit_64B_u       AVXMEM_RENAME(memset_256bit_64B_u)
+#define memset_256bit_128B_u      AVXMEM_RENAME(memset_256bit_128B_u)
+#define memset_256bit_256B_u      AVXMEM_RENAME(memset_256bit_256B_u)
+#define memset_256bit_512B_u      AVXMEM_RENAME(memset_256bit_512B_u)
+#define memset_256bit_a           AVXMEM_RENAME(memset_256bit_a)
+#define memset_256bit_64B_a       AVXMEM_RENAME(memset_256bit_64B_a)
+#define memset_256bit_128B_a      AVXMEM_RENAME(memset_256bit_128B_a)
+#define memset_256bit_256B_a      AVXMEM_RENAME(memset_256bit_256B_a)
+#define memset_256bit_512B_a      AVXMEM_RENAME(memset_256bit_512B_a)
+#define memset_256bit_as          AVXMEM_RENAME(memset_256bit_as)
+#define memset_256bit_64B_as      AVXMEM_RENAME(memset_256bit_64B_as)
+#define memset_256bit_128B_as     AVXMEM_RENAME(memset_256bit_128B_as)
+#define memset_256bit_256B_as     AVXMEM_RENAME(memset_256bit_256B_as)
+#define memset_256bit_512B_as     AVXMEM_RENAME(memset_256bit_512B_as)
+#define memset_512bit_u           AVXMEM_RENAME(memset_512bit_u)
+#define memset_512bit_128B_u      AVXMEM_RENAME(memset_512bit_128B_u)
+#define memset_512bit_256B_u      AVXMEM_RENAME(memset_512bit_256B_u)
+#define memset_512bit_512B_u      AVXMEM_RENAME(memset_512bit_512B_u)
+#define memset_512bit_1kB_u       AVXMEM_RENAME(memset_512bit_1kB_u)
+#define memset_512bit_2kB_u       AVXMEM_RENAME(memset_512bit_2kB_u)
+#define memset_512bit_4kB_u       AVXMEM_RENAME(memset_512bit_4kB_u)
+#define memset_512bit_a           AVXMEM_RENAME(memset_512bit_a)
+#define memset_512bit_128B_a      AVXMEM_RENAME(memset_512bit_128B_a)
+#define memset_512bit_256B_a      AVXMEM_RENAME(memset_512bit_256B_a)
+#define memset_512bit_512B_a      AVXMEM_RENAME(memset_512bit_512B_a)
+#define memset_512bit_1kB_a       AVXMEM_RENAME(memset_512bit_1kB_a)
+#define memset_512bit_2kB_a       AVXMEM_RENAME(memset_512bit_2kB_a)
+#define memset_512bit_4kB_a       AVXMEM_RENAME(memset_512bit_4kB_a)
+#define memset_512bit_as          AVXMEM_RENAME(memset_512bit_as)
+#define memset_512bit_128B_as     AVXMEM_RENAME(memset_512bit_128B_as)
+#define memset_512bit_256B_as     AVXMEM_RENAME(memset_512bit_256B_as)
+#define memset_512bit_512B_as     AVXMEM_RENAME(memset_512bit_512B_as)
+#define memset_512bit_1kB_as      AVXMEM_RENAME(memset_512bit_1kB_as)
+#define memset_512bit_2kB_as      AVXMEM_RENAME(memset_512bit_2kB_as)
+#define memset_512bit_4kB_as      AVXMEM_RENAME(memset_512bit_4kB_as)
+#define memset_512bit_masked_u    AVXMEM_RENAME(memset_512bit_masked_u)
+#define memset_512bit_4B_masked_u AVXMEM_RENAME(memset_512bit_4B_masked_u)
+#define memmove_large             AVXMEM_RENAME(memmove_large)
+#define memmove_large_a           AVXMEM_RENAME(memmove_large_a)
+#define memmove_large_as          AVXMEM_RENAME(memmove_large_as)
+#define memmove_large_reverse     AVXMEM_RENAME(memmove_large_reverse)
+#define memmove_large_reverse_a   AVXMEM_RENAME(memmove_large_reverse_a)
+#define memmove_large_reverse_as  AVXMEM_RENAME(memmove_large_reverse_as)
+#define memmove                   AVXMEM_RENAME(memmove)
+#define memmove_16bit             AVXMEM_RENAME(memmove_16bit)
+#define memmove_32bit             AVXMEM_RENAME(memmove_32bit)
+#define memmove_64bit             AVXMEM_RENAME(memmove_64bit)
+#define memmove_128bit_u          AVXMEM_RENAME(memmove_128bit_u)
+#define memmove_128bit_32B_u      AVXMEM_RENAME(memmove_128bit_32B_u)
+#define memmove_128bit_64B_u      AVXMEM_RENAME(memmove_128bit_64B_u)
+#define memmove_128bit_128B_u     AVXMEM_RENAME(memmove_128bit_128B_u)
+#define memmove_128bit_256B_u     AVXMEM_RENAME(memmove_128bit_256B_u)
+#define memmove_128bit_a          AVXMEM_RENAME(memmove_128bit_a)
+#define memmove_128bit_32B_a      AVXMEM_RENAME(memmove_128bit_32B_a)
+#define memmove_128bit_64B_a      AVXMEM_RENAME(memmove_128bit_64B_a)
+#define memmove_128bit_128B_a     AVXMEM_RENAME(memmove_128bit_128B_a)
+#define memmove_128bit_256B_a     AVXMEM_RENAME(memmove_128bit_256B_a)
+#define memmove_128bit_as         AVXMEM_RENAME(memmove_128bit_as)
+#define memmove_128bit_32B_as     AVXMEM_RENAME(memmove_128bit_32B_as)
+#define memmove_128bit_64B_as     AVXMEM_RENAME(memmove_128bit_64B_as)
+#define memmove_128bit_128B_as    AVXMEM_RENAME(memmove_128bit_128B_as)
+#define memmove_128bit_256B_as    AVXMEM_RENAME(memmove_128bit_256B_as)
+#define memmove_256bit_u          AVXMEM_RENAME(memmove_256bit_u)
+#define memmove_256bit_64B_u      AVXMEM_RENAME(memmove_256bit_64B_u)
+#define memmove_256bit_128B_u     AVXMEM_RENAME(memmove_256bit_128B_u)
+#define memmove_256bit_256B_u     AVXMEM_RENAME(memmove_256bit_256B_u)
+#define memmove_256bit_512B_u     AVXMEM_RENAME(memmove_256bit_512B_u)
+#define memmove_256bit_a          AVXMEM_RENAME(memmove_256bit_a)
+#define memmove_256bit_64B_a      AVXMEM_RENAME(memmove_256bit_64B_a)
+#define memmove_256bit_128B_a     AVXMEM_RENAME(memmove_256bit_128B_a)
+#define memmove_256bit_256B_a     AVXMEM_RENAME(memmove_256bit_256B_a)
+#define memmove_256bit_512B_a     AVXMEM_RENAME(memmove_256bit_512B_a)
+#define memmove_256bit_as         AVXMEM_RENAME(memmove_256bit_as)
+#define memmove_256bit_64B_as     AVXMEM_RENAME(memmove_256bit_64B_as)
+#define memmove_256bit_128B_as    AVXMEM_RENAME(memmove_256bit_128B_as)
+#define memmove_256bit_256B_as    AVXMEM_RENAME(memmove_256bit_256B_as)
+#define memmove_256bit_512B_as    AVXMEM_RENAME(memmove_256bit_512B_as)
+#define memmove_512bit_u          AVXMEM_RENAME(memmove_512bit_u)
+#define memmove_512bit_128B_u     AVXMEM_RENAME(memmove_512bit_128B_u)
+#define memmove_512bit_256B_u     AVXMEM_RENAME(memmove_512bit_256B_u)
+#define memmove_512bit_512B_u     AVXMEM_RENAME(memmove_512bit_512B_u)
+#define memmove_512bit_1kB_u      AVXMEM_RENAME(memmove_512bit_1kB_u)
+#define memmove_512bit_2kB_u      AVXMEM_RENAME(memmove_512bit_2kB_u)
+#define memmove_512bit_4kB_u      AVXMEM_RENAME(memmove_512bit_4kB_u)
+#define memmove_512bit_a          AVXMEM_RENAME(memmove_512bit_a)
+#define memmove_512bit_128B_a     AVXMEM_RENAME(memmove_512bit_128B_a)
+#define memmove_512bit_256B_a     AVXMEM_RENAME(memmove_512bit_256B_a)
+#define memmove_512bit_512B_a     AVXMEM_RENAME(memmove_512bit_512B_a)
+#define memmove_512bit_1kB_a      AVXMEM_RENAME(memmove_512bit_1kB_a)
+#define memmove_512bit_2kB_a      AVXMEM_RENAME(memmove_512bit_2kB_a)
+#define memmove_512bit_4kB_a      AVXMEM_RENAME(memmove_512bit_4kB_a)
+#define memmove_512bit_as         AVXMEM_RENAME(memmove_512bit_as)
+#define memmove_512bit_128B_as    AVXMEM_RENAME(memmove_512bit_128B_as)
+#define memmove_512bit_256B_as    AVXMEM_RENAME(memmove_512bit_256B_as)
+#define memmove_512bit_512B_as    AVXMEM_RENAME(memmove_512bit_512B_as)
+#define memmove_512bit_1kB_as     AVXMEM_RENAME(memmove_512bit_1kB_as)
+#define memmove_512bit_2kB_as     AVXMEM_RENAME(memmove_512bit_2kB_as)
+#define memmove_512bit_4kB_as     AVXMEM_RENAME(memmove_512bit_4kB_as)
+#define memmove_512bit_masked_u   AVXMEM_RENAME(memmove_512bit_masked_u)
+#define memcpy_large              AVXMEM_RENAME(memcpy_large)
+#define memcpy_large_a            AVXMEM_RENAME(memcpy_large_a)
+#define memcpy_large_as           AVXMEM_RENAME(memcpy_large_as)
+#define memcpy                    AVXMEM_RENAME(memcpy)
+#define memcpy_16bit              AVXMEM_RENAME(memcpy_16bit)
+#define memcpy_32bit              AVXMEM_RENAME(memcpy_32bit)
+#define memcpy_64bit              AVXMEM_RENAME(memcpy_64bit)
+#define memcpy_128bit_u           AVXMEM_RENAME(memcpy_128bit_u)
+#define memcpy_128bit_32B_u       AVXMEM_RENAME(memcpy_128bit_32B_u)
+#define memcpy_128bit_64B_u       AVXMEM_RENAME(memcpy_128bit_64B_u)
+#define memcpy_128bit_128B_u      AVXMEM_RENAME(memcpy_128bit_128B_u)
+#define memcpy_128bit_256B_u      AVXMEM_RENAME(memcpy_128bit_256B_u)
+#define memcpy_128bit_a           AVXMEM_RENAME(memcpy_128bit_a)
+#define memcpy_128bit_32B_a       AVXMEM_RENAME(memcpy_128bit_32B_a)
+#define memcpy_128bit_64B_a       AVXMEM_RENAME(memcpy_128bit_64B_a)
+#define memcpy_128bit_128B_a      AVXMEM_RENAME(memcpy_128bit_128B_a)
+#define memcpy_128bit_256B_a      AVXMEM_RENAME(memcpy_128bit_256B_a)
+#define memcpy_128bit_as          AVXMEM_RENAME(memcpy_128bit_as)
+#define memcpy_128bit_32B_as      AVXMEM_RENAME(memcpy_128bit_32B_as)
+#define memcpy_128bit_64B_as      AVXMEM_RENAME(memcpy_128bit_64B_as)
+#define memcpy_128bit_128B_as     AVXMEM_RENAME(memcpy_128bit_128B_as)
+#define memcpy_128bit_256B_as     AVXMEM_RENAME(memcpy_128bit_256B_as)
+#define memcpy_256bit_u           AVXMEM_RENAME(memcpy_256bit_u)
+#define memcpy_256bit_64B_u       AVXMEM_RENAME(memcpy_256bit_64B_u)
+#define memcpy_256bit_128B_u      AVXMEM_RENAME(memcpy_256bit_128B_u)
+#define memcpy_256bit_256B_u      AVXMEM_RENAME(memcpy_256bit_256B_u)
+#define memcpy_256bit_512B_u      AVXMEM_RENAME(memcpy_256bit_512B_u)
+#define memcpy_256bit_a           AVXMEM_RENAME(memcpy_256bit_a)
+#define memcpy_256bit_64B_a       AVXMEM_RENAME(memcpy_256bit_64B_a)
+#define memcpy_256bit_128B_a      AVXMEM_RENAME(memcpy_256bit_128B_a)
+#define memcpy_256bit_256B_a      AVXMEM_RENAME(memcpy_256bit_256B_a)
+#define memcpy_256bit_512B_a      AVXMEM_RENAME(memcpy_256bit_512B_a)
+#define memcpy_256bit_as          AVXMEM_RENAME(memcpy_256bit_as)
+#define memcpy_256bit_64B_as      AVXMEM_RENAME(memcpy_256bit_64B_as)
+#define memcpy_256bit_128B_as     AVXMEM_RENAME(memcpy_256bit_128B_as)
+#define memcpy_256bit_256B_as     AVXMEM_RENAME(memcpy_256bit_256B_as)
+#define memcpy_256bit_512B_as     AVXMEM_RENAME(memcpy_256bit_512B_as)
+#define memcpy_512bit_u           AVXMEM_RENAME(memcpy_512bit_u)
+#define memcpy_512bit_128B_u      AVXMEM_RENAME(memcpy_512bit_128B_u)
+#define memcpy_512bit_256B_u      AVXMEM_RENAME(memcpy_512bit_256B_u)
+#define memcpy_512bit_512B_u      AVXMEM_RENAME(memcpy_512bit_512B_u)
+#define memcpy_512bit_1kB_u       AVXMEM_RENAME(memcpy_512bit_1kB_u)
+#define memcpy_512bit_2kB_u       AVXMEM_RENAME(memcpy_512bit_2kB_u)
+#define memcpy_512bit_4kB_u       AVXMEM_RENAME(memcpy_512bit_4kB_u)
+#define memcpy_512bit_a           AVXMEM_RENAME(memcpy_512bit_a)
+#define memcpy_512bit_128B_a      AVXMEM_RENAME(memcpy_512bit_128B_a)
+#define memcpy_512bit_256B_a      AVXMEM_RENAME(memcpy_512bit_256B_a)
+#define memcpy_512bit_512B_a      AVXMEM_RENAME(memcpy_512bit_512B_a)
+#define memcpy_512bit_1kB_a       AVXMEM_RENAME(memcpy_512bit_1kB_a)
+#define memcpy_512bit_2kB_a       AVXMEM_RENAME(memcpy_512bit_2kB_a)
+#define memcpy_512bit_4kB_a       AVXMEM_RENAME(memcpy_512bit_4kB_a)
+#define memcpy_512bit_as          AVXMEM_RENAME(memcpy_512bit_as)
+#define memcpy_512bit_128B_as     AVXMEM_RENAME(memcpy_512bit_128B_as)
+#define memcpy_512bit_256B_as     AVXMEM_RENAME(memcpy_512bit_256B_as)
+#define memcpy_512bit_512B_as     AVXMEM_RENAME(memcpy_512bit_512B_as)
+#define memcpy_512bit_1kB_as      AVXMEM_RENAME(memcpy_512bit_1kB_as)
+#define memcpy_512bit_2kB_as      AVXMEM_RENAME(memcpy_512bit_2kB_as)
+#define memcpy_512bit_4kB_as      AVXMEM_RENAME(memcpy_512bit_4kB_as)
+#define memcpy_512bit_masked_u    AVXMEM_RENAME(memcpy_512bit_masked_u)
+#define memcmp_large              AVXMEM_RENAME(memcmp_large)
+#define memcmp_large_eq           AVXMEM_RENAME(memcmp_large_eq)
+#define memcmp_large_a            AVXMEM_RENAME(memcmp_large_a)
+#define memcmp_large_eq_a         AVXMEM_RENAME(memcmp_large_eq_a)
+#define memcmp                    AVXMEM_RENAME(memcmp)
+#define memcmp_eq                 AVXMEM_RENAME(memcmp_eq)
+#define memcmp_16bit              AVXMEM_RENAME(memcmp_16bit)
+#define memcmp_16bit_eq           AVXMEM_RENAME(memcmp_16bit_eq)
+#define memcmp_32bit              AVXMEM_RENAME(memcmp_32bit)
+#define memcmp_32bit_eq           AVXMEM_RENAME(memcmp_32bit_eq)
+#define memcmp_64bit              AVXMEM_RENAME(memcmp_64bit)
+#define memcmp_64bit_eq           AVXMEM_RENAME(memcmp_64bit_eq)
+#define memcmp_128bit_u           AVXMEM_RENAME(memcmp_128bit_u)
+#define memcmp_128bit_eq_u        AVXMEM_RENAME(memcmp_128bit_eq_u)
+#define memcmp_128bit_a           AVXMEM_RENAME(memcmp_128bit_a)
+#define memcmp_128bit_eq_a        AVXMEM_RENAME(memcmp_128bit_eq_a)
+#define memcmp_256bit_u           AVXMEM_RENAME(memcmp_256bit_u)
+#define memcmp_256bit_eq_u        AVXMEM_RENAME(memcmp_256bit_eq_u)
+#define memcmp_256bit_a           AVXMEM_RENAME(memcmp_256bit_a)
+#define memcmp_256bit_eq_a        AVXMEM_RENAME(memcmp_256bit_eq_a)
+#define memcmp_512bit_u           AVXMEM_RENAME(memcmp_512bit_u)
+#define memcmp_512bit_eq_u        AVXMEM_RENAME(memcmp_512bit_eq_u)
+#define memcmp_512bit_a           AVXMEM_RENAME(memcmp_512bit_a)
+#define memcmp_512bit_eq_a        AVXMEM_RENAME(memcmp_512bit_eq_a)
+#define memcmp_512bit_masked_u    AVXMEM_RENAME(memcmp_512bit_masked_u)
+#define memcmp_512bit_eq_masked_u AVXMEM_RENAME(memcmp_512bit_eq_masked_u)
+
+#endif /* _avxmem_variant_H */
@@ -0,0 +1,185 @@
+//==================================================================================================================================
+//  AVX Memory Functions: Checksums & CRC32C
+//==================================================================================================================================
+//
+// AVX_sum8() is the 8-bit wraparound sum that ACPI tables, the RSDP, and SMBIOS entry points are validated with (a valid one sums to
+// 0). PSADBW against zero adds up 8 bytes into each 64-bit lane in one instruction, so this goes through 16, 32, or 64 bytes per
+// instruction (SSE2, AVX2, AVX512BW) instead of one. Only the low 8 bits of the total matter, and the 64-bit lanes can't overflow.
+//
+// AVX_crc32c() is for integrity checks on bigger buffers, like ones handed between cores. It uses SSE4.2's CRC32 instruction, which
+// has a latency of 3 cycles but can start a new one every cycle, so a single dependent chain only gets a third of the throughput. This
+// runs three independent chains over three adjacent blocks at once and then stitches them together, the way Intel's whitepaper
+// "Fast CRC Computation for iSCSI Polynomial Using CRC32 Instruction" does. Stitching means advancing a CRC past a block's worth of
+// zeroes, which is a multiplication by a constant mod the CRC polynomial: one PCLMULQDQ plus one CRC32 when the build has PCLMUL,
+// otherwise a short shift-and-xor loop. Either way it's done once per block, not per byte.
+//
+// Like memwc.c, these aren't rebuilt by the avxmem_<isa>.c wrappers and just use whatever the compile script's -march allows. The
+// baseline SSE4.2 is all CRC32C needs, and the tables the 8-bit sum gets used on are rarely more than a few KB.
+//
+
+#define AVXMEM_LIBRARY
+#include "avxmem.h"
+
+// Bytes per chain in each 3-way pass. Long blocks take care of most of a big buffer, short ones most of what's left after that.
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+
+// The CRC-32C (Castagnoli) polynomial, bit-reflected like the CRC32 instruction uses it
+#define CRC32C_POLY 0x82F63B78
+
+#ifdef __PCLMUL__
+// x^(8 * block size - 33) mod P: the extra x^33 comes from the carryless multiply and the CRC32 reduction after it
+#define CRC32C_LONG_SHIFT  0x54A86326
+#define CRC32C_SHORT_SHIFT 0xB9E02B86
+#else
+// x^(8 * block size) mod P, i.e. the effect of running a block's worth of zeroes through the CRC
+#define CRC32C_LONG_SHIFT  0x28461564
+#define CRC32C_SHORT_SHIFT 0x88E56F72
+#endif
+
+static uint32_t crc32c_shift(uint32_t crc, uint32_t shift);
+static const uint8_t * crc32c_3way(uint32_t *crc, const uint8_t *bytes, size_t *numbytes, size_t block, uint32_t shift);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVX_sum8: 8-Bit Checksum
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the sum of numbytes bytes at data, modulo 256. data doesn't need to be aligned.
+//
+
+uint8_t AVX_sum8(const void *data, size_t numbytes)
+{
+  const uint8_t * bytes = (const uint8_t*)data;
+  uint64_t sum = 0;
+
+#ifdef __AVX512BW__
+  __m512i total = _mm512_setzero_si512();
+  for( ; numbytes >= 64; numbytes -= 64, bytes += 64)
+  {
+    total = _mm512_add_epi64(total, _mm512_sad_epu8(_mm512_loadu_si512(bytes), _mm512_setzero_si512()));
+  }
+  sum = (uint64_t)_mm512_reduce_add_epi64(total);
+#elif __AVX2__
+  __m256i total = _mm256_setzero_si256();
+  for( ; numbytes >= 32; numbytes -= 32, bytes += 32)
+  {
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)bytes), _mm256_setzero_si256()));
+  }
+  __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+  sum = (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_extract_epi64(half, 1);
+#else
+  __m128i total = _mm_setzero_si128();
+  for( ; numbytes >= 16; numbytes -= 16, bytes += 16)
+  {
+    total = _mm_add_epi64(total, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)bytes), _mm_setzero_si128()));
+  }
+  sum = (uint64_t)_mm_cvtsi128_si64(total) + (uint64_t)_mm_extract_epi64(total, 1);
+#endif
+
+  while(numbytes--)
+  {
+    sum += *bytes++;
+  }
+
+  return (uint8_t)sum;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  AVX_crc32c: CRC-32C of a Buffer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Returns the standard CRC-32C (iSCSI, ext4, etc.) of numbytes bytes at data. Start with crc = 0; to checksum something in pieces,
+// pass each call the previous call's return value. data doesn't need to be aligned.
+//
+
+uint32_t AVX_crc32c(uint32_t crc, const void *data, size_t numbytes)
+{
+  const uint8_t * bytes = (const uint8_t*)data;
+  uint32_t state = ~crc;
+
+  // Get to 8-byte alignment so none of the 8-byte loads split a cache line
+  while(numbytes && ((uintptr_t)bytes & 7))
+  {
+    state = _mm_crc32_u8(state, *bytes++);
+    numbytes--;
+  }
+
+  bytes = crc32c_3way(&state, bytes, &numbytes, CRC32C_LONG, CRC32C_LONG_SHIFT);
+  bytes = crc32c_3way(&state, bytes, &numbytes, CRC32C_SHORT, CRC32C_SHORT_SHIFT);
+
+  // Whatever's left is less than 3 short blocks
+  uint64_t state64 = state;
+  for( ; numbytes >= 8; numbytes -= 8, bytes += 8)
+  {
+    state64 = _mm_crc32_u64(state64, *(const uint64_t*)bytes);
+  }
+  state = (uint32_t)state64;
+
+  while(numbytes--)
+  {
+    state = _mm_crc32_u8(state, *bytes++);
+  }
+
+  return ~state;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  crc32c_3way: Run Three CRC32 Chains at Once
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Takes as many groups of 3 * block bytes off the front of the buffer as there are, updating *crc, and returns where it stopped.
+// *numbytes is reduced to match. The first block continues *crc, and the other two start from 0; since CRCs are linear, each group's
+// result is then the first CRC advanced past two blocks, xor the second advanced past one, xor the third.
+//
+
+static const uint8_t * crc32c_3way(uint32_t *crc, const uint8_t *bytes, size_t *numbytes, size_t block, uint32_t shift)
+{
+  while(*numbytes >= 3 * block)
+  {
+    uint64_t crc0 = *crc;
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    const uint8_t * end = bytes + block;
+
+    do {
+      crc0 = _mm_crc32_u64(crc0, *(const uint64_t*)bytes);
+      crc1 = _mm_crc32_u64(crc1, *(const uint64_t*)(bytes + block));
+      crc2 = _mm_crc32_u64(crc2, *(const uint64_t*)(bytes + 2*block));
+      bytes += 8;
+    } while(bytes < end);
+
+    *crc = crc32c_shift(crc32c_shift((uint32_t)crc0, shift) ^ (uint32_t)crc1, shift) ^ (uint32_t)crc2;
+
+    bytes += 2*block;
+    *numbytes -= 3 * block;
+  }
+
+  return bytes;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  crc32c_shift: Advance a CRC Past a Block of Zeroes
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// shift is one of the CRC32C_*_SHIFT constants, i.e. the power of x that the block length works out to.
+//
+
+static uint32_t crc32c_shift(uint32_t crc, uint32_t shift)
+{
+#ifdef __PCLMUL__
+  __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), _mm_cvtsi32_si128((int)shift), 0x00);
+  return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(product));
+#else
+  // Multiply mod P, one bit of shift at a time (in the reflected order, the top bit is x^0)
+  uint32_t product = 0;
+  for(uint32_t bit = 0x80000000; bit; bit >>= 1)
+  {
+    if(shift & bit)
+    {
+      product ^= crc;
+    }
+    crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+  }
+  return product;
+#endif
+}
@@ -1,5 +1,6 @@
 // Compile with GCC -O3 for best performance
 // It pretty much entirely negates the need to write these by hand in asm.
+#define AVXMEM_LIBRARY
 #include "avxmem.h"
 
 int memcmp (const void *str1, const void *str2, size_t count)
@@ -719,6 +720,51 @@ int memcmp_512bit_eq_a(const void *str1, const void *str2, size_t count)
 }
 #endif
 
+//-----------------------------------------------------------------------------
+// AVX-512BW Masked Tails:
+//-----------------------------------------------------------------------------
+
+// With AVX512BW, anything under 64 bytes can be compared with one pair of
+// byte-masked loads and one masked compare, so the dispatch functions below use
+// these for their tails instead of stepping down through all of the smaller
+// sizes. Masked-off bytes are never accessed, so this can't fault past the end
+// of a buffer. Unlike the wider compares, the first differing byte decides the
+// result, same as the scalar memcmp.
+// Count is # of bytes, and must be less than 64
+// Requires AVX512BW
+
+#ifdef __AVX512BW__
+int memcmp_512bit_masked_u(const void *str1, const void *str2, size_t count)
+{
+  __mmask64 mask = (1ULL << count) - 1;
+  __m512i item1 = _mm512_maskz_loadu_epi8(mask, str1);
+  __m512i item2 = _mm512_maskz_loadu_epi8(mask, str2);
+  uint64_t result = _mm512_mask_cmpneq_epu8_mask(mask, item1, item2);
+  // All bits == 0 means equal
+
+  if(result)
+  {
+    size_t first = __builtin_ctzll(result); // First differing byte
+    return ((const unsigned char *)str1)[first] < ((const unsigned char *)str2)[first] ? -1 : 1;
+  }
+  return 0;
+}
+
+// Equality-only version
+int memcmp_512bit_eq_masked_u(const void *str1, const void *str2, size_t count)
+{
+  __mmask64 mask = (1ULL << count) - 1;
+  __m512i item1 = _mm512_maskz_loadu_epi8(mask, str1);
+  __m512i item2 = _mm512_maskz_loadu_epi8(mask, str2);
+
+  if(_mm512_mask_cmpneq_epu8_mask(mask, item1, item2))
+  {
+    return -1;
+  }
+  return 0;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Dispatch Functions (Unaligned):
 //-----------------------------------------------------------------------------
@@ -733,6 +779,12 @@ int memcmp_large(const void *str1, const void *str2, size_t numbytes) // Worst-c
   // This loop will, at most, get evaluated 7 times, ending sooner each time.
   // At minimum non-trivial case, once. Each memcmp has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked compare instead of the cascade below
+    {
+      return memcmp_512bit_masked_u(str1, str2, numbytes);
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       returnval = memcmp(str1, str2, numbytes);
@@ -869,6 +921,12 @@ int memcmp_large_eq(const void *str1, const void *str2, size_t numbytes) // Wors
 
   while(numbytes)
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked compare instead of the cascade below
+    {
+      return memcmp_512bit_eq_masked_u(str1, str2, numbytes);
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       returnval = memcmp_eq(str1, str2, numbytes);
@@ -1011,6 +1069,12 @@ int memcmp_large_a(const void *str1, const void *str2, size_t numbytes) // Worst
   // This loop will, at most, get evaulated 7 times, ending sooner each time.
   // At minimum non-trivial case, once. Each memcmp has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked compare instead of the cascade below
+    {
+      return memcmp_512bit_masked_u(str1, str2, numbytes);
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       returnval = memcmp(str1, str2, numbytes);
@@ -1147,6 +1211,12 @@ int memcmp_large_eq_a(const void *str1, const void *str2, size_t numbytes) // Wo
 
   while(numbytes)
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked compare instead of the cascade below
+    {
+      return memcmp_512bit_eq_masked_u(str1, str2, numbytes);
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       returnval = memcmp_eq(str1, str2, numbytes);
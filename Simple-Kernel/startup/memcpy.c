@@ -1,5 +1,6 @@
 // Compile with GCC -O3 for best performance
 // It pretty much entirely negates the need to write these by hand in asm.
+#define AVXMEM_LIBRARY
 #include "avxmem.h"
 
 // Default (8-bit, 1 byte at a time)
@@ -1445,6 +1446,28 @@ void * memcpy_512bit_4kB_as(void *dest, const void *src, size_t len)
 
 #endif
 
+//-----------------------------------------------------------------------------
+// AVX-512BW Masked Tails:
+//-----------------------------------------------------------------------------
+
+// With AVX512BW, anything under 64 bytes can be done with one byte-masked
+// load and store (vmovdqu8), so the dispatch functions below use this for their
+// tails instead of stepping down through all of the smaller sizes. Masked-off
+// bytes are never accessed, so this can't fault past the end of a buffer.
+// Len is # of bytes, and must be less than 64
+// Requires AVX512BW
+
+#ifdef __AVX512BW__
+void * memcpy_512bit_masked_u(void *dest, const void *src, size_t len)
+{
+  __mmask64 mask = (1ULL << len) - 1;
+
+  _mm512_mask_storeu_epi8(dest, mask, _mm512_maskz_loadu_epi8(mask, src));
+
+  return dest;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Dispatch Functions:
 //-----------------------------------------------------------------------------
@@ -1460,6 +1483,13 @@ void * memcpy_large(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memcpy has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memcpy_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memcpy(dest, src, numbytes);
@@ -1673,6 +1703,13 @@ void * memcpy_large_a(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memcpy has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memcpy_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memcpy(dest, src, numbytes);
@@ -1886,6 +1923,13 @@ void * memcpy_large_as(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memcpy has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memcpy_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memcpy(dest, src, numbytes);
@@ -2138,7 +2182,7 @@ void * AVX_memcpy(void *dest, void *src, size_t numbytes)
     ) // Check alignment
   {
     // This is the fastest case: src and dest are both cache line aligned.
-    if(numbytes > CACHESIZELIMIT)
+    if(numbytes > AVXmem_Dispatch.NT_Threshold)
     {
       memcpy_large_as(dest, src, numbytes);
     }
@@ -1,5 +1,6 @@
 // Compile with GCC -O3 for best performance
 // It pretty much entirely negates the need to write these by hand in asm.
+#define AVXMEM_LIBRARY
 #include "avxmem.h"
 
 // Default (8-bit, 1 byte at a time)
@@ -2692,6 +2693,85 @@ void * memmove_512bit_4kB_as(void *dest, const void *src, size_t len)
 
 #endif
 
+//-----------------------------------------------------------------------------
+// AVX-512BW Masked Tails:
+//-----------------------------------------------------------------------------
+
+// With AVX512BW, anything under 64 bytes can be done with one byte-masked
+// load and store (vmovdqu8), so the dispatch functions below use this for their
+// tails instead of stepping down through all of the smaller sizes. The whole
+// load happens before the store, so overlap doesn't matter, and masked-off bytes
+// are never accessed, so this can't fault past the end of a buffer.
+// Len is # of bytes, and must be less than 64
+// Requires AVX512BW
+
+#ifdef __AVX512BW__
+void * memmove_512bit_masked_u(void *dest, const void *src, size_t len)
+{
+  __mmask64 mask = (1ULL << len) - 1;
+
+  _mm512_mask_storeu_epi8(dest, mask, _mm512_maskz_loadu_epi8(mask, src));
+
+  return dest;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Prefetching:
+//-----------------------------------------------------------------------------
+
+// The dispatch functions below move the bulk of a large range with the biggest
+// block function the build has. The hardware prefetchers stop at every 4kB page
+// boundary and are less eager about descending streams than ascending ones, so
+// memmove_blocks() feeds that function one block at a time, and before each one
+// it prefetches the block AVXmem_Dispatch.Prefetch_Distance bytes further along
+// in src (further down, when going in reverse). A distance of 0 turns this off.
+
+// block_move is one of the block functions above, and block_size is how many
+// bytes it moves per block (4096, 512, or 256). The caller passes both, since
+// which one a dispatch branch uses depends on more than the build's widest ISA
+// (e.g. the streaming branches need AVX2 for 256-bit loads). numbytes doesn't
+// need to be a multiple of block_size, but only whole blocks get moved.
+// reverse: 1 to go ends first (src addr < dest addr), 0 otherwise
+// streaming: 1 if block_move uses non-temporal stores, which means src isn't
+// worth keeping in the cache either
+static inline void memmove_blocks(void * (*block_move)(void *, const void *, size_t), size_t block_size, void *dest, const void *src, size_t numbytes, int reverse, int streaming)
+{
+  size_t distance = AVXmem_Dispatch.Prefetch_Distance;
+  size_t num_blocks = numbytes / block_size;
+
+  if((distance == 0) || (distance >= numbytes))
+  {
+    block_move(dest, src, num_blocks);
+    return;
+  }
+
+  for(size_t block = 0; block < num_blocks; block++)
+  {
+    size_t offset = (reverse ? (num_blocks - 1 - block) : block) * block_size;
+
+    // Only prefetch what's still part of this move
+    if(reverse ? (offset >= distance) : ((offset + distance) < numbytes))
+    {
+      const char * ahead = (const char *)src + (reverse ? (offset - distance) : (offset + distance));
+
+      for(size_t line = 0; line < block_size; line += 64)
+      {
+        if(streaming)
+        {
+          _mm_prefetch(ahead + line, _MM_HINT_NTA);
+        }
+        else
+        {
+          _mm_prefetch(ahead + line, _MM_HINT_T0);
+        }
+      }
+    }
+
+    block_move((char *)dest + offset, (const char *)src + offset, 1);
+  }
+}
+
 //-----------------------------------------------------------------------------
 // Dispatch Functions:
 //-----------------------------------------------------------------------------
@@ -2707,6 +2787,13 @@ void * memmove_large(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memmove_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memmove(dest, src, numbytes);
@@ -2806,7 +2893,7 @@ void * memmove_large(void *dest, void *src, size_t numbytes)
     }
     else // 4096 bytes (4 kB)
     {
-      memmove_512bit_4kB_u(dest, src, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_u, 4096, dest, src, numbytes, 0, 0);
       offset = numbytes & -4096;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -2855,7 +2942,7 @@ void * memmove_large(void *dest, void *src, size_t numbytes)
     }
     else // 512 bytes
     {
-      memmove_256bit_512B_u(dest, src, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_u, 512, dest, src, numbytes, 0, 0);
       offset = numbytes & -512;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -2896,7 +2983,7 @@ void * memmove_large(void *dest, void *src, size_t numbytes)
     }
     else // 256 bytes
     {
-      memmove_128bit_256B_u(dest, src, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_u, 256, dest, src, numbytes, 0, 0);
       offset = numbytes & -256;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -2919,6 +3006,13 @@ void * memmove_large_a(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memmove_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memmove(dest, src, numbytes);
@@ -3018,7 +3112,7 @@ void * memmove_large_a(void *dest, void *src, size_t numbytes)
     }
     else // 4096 bytes (4 kB)
     {
-      memmove_512bit_4kB_a(dest, src, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_a, 4096, dest, src, numbytes, 0, 0);
       offset = numbytes & -4096;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3067,7 +3161,7 @@ void * memmove_large_a(void *dest, void *src, size_t numbytes)
     }
     else // 512 bytes
     {
-      memmove_256bit_512B_a(dest, src, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_a, 512, dest, src, numbytes, 0, 0);
       offset = numbytes & -512;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3108,7 +3202,7 @@ void * memmove_large_a(void *dest, void *src, size_t numbytes)
     }
     else // 256 bytes
     {
-      memmove_128bit_256B_a(dest, src, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_a, 256, dest, src, numbytes, 0, 0);
       offset = numbytes & -256;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3131,6 +3225,13 @@ void * memmove_large_as(void *dest, void *src, size_t numbytes)
   // aligned loads over unaligned loads here, so all are unaligned.
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memmove_512bit_masked_u(dest, src, numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memmove(dest, src, numbytes);
@@ -3230,7 +3331,7 @@ void * memmove_large_as(void *dest, void *src, size_t numbytes)
     }
     else // 4096 bytes (4 kB)
     {
-      memmove_512bit_4kB_as(dest, src, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_as, 4096, dest, src, numbytes, 0, 1);
       offset = numbytes & -4096;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3279,7 +3380,7 @@ void * memmove_large_as(void *dest, void *src, size_t numbytes)
     }
     else // 512 bytes
     {
-      memmove_256bit_512B_as(dest, src, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_as, 512, dest, src, numbytes, 0, 1);
       offset = numbytes & -512;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3320,7 +3421,7 @@ void * memmove_large_as(void *dest, void *src, size_t numbytes)
     }
     else // 256 bytes
     {
-      memmove_128bit_256B_as(dest, src, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_as, 256, dest, src, numbytes, 0, 1);
       offset = numbytes & -256;
       dest = (char *)dest + offset;
       src = (char *)src + offset;
@@ -3347,6 +3448,17 @@ void * memmove_large_reverse(void *dest, void *src, size_t numbytes)
   // this to work).
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes & 63) // The 1-63 bytes at the top end: one masked load/store instead of the cascade below
+    {
+      offset = numbytes & 63;
+      nextdest = (char *)nextdest - offset;
+      nextsrc = (char *)nextsrc - offset;
+      memmove_512bit_masked_u(nextdest, nextsrc, offset);
+      numbytes &= -64;
+      continue;
+    }
+#endif
     if(numbytes & 1) // 1 byte
     {
       offset = numbytes & 1;
@@ -3449,7 +3561,7 @@ void * memmove_large_reverse(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_512bit_4kB_u(nextdest, nextsrc, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_u, 4096, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #elif __AVX__
@@ -3498,7 +3610,7 @@ void * memmove_large_reverse(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_256bit_512B_u(nextdest, nextsrc, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_u, 512, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #else // SSE2 only
@@ -3539,7 +3651,7 @@ void * memmove_large_reverse(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_128bit_256B_u(nextdest, nextsrc, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_u, 256, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #endif
@@ -3564,6 +3676,17 @@ void * memmove_large_reverse_a(void *dest, void *src, size_t numbytes)
   // this to work).
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes & 63) // The 1-63 bytes at the top end: one masked load/store instead of the cascade below
+    {
+      offset = numbytes & 63;
+      nextdest = (char *)nextdest - offset;
+      nextsrc = (char *)nextsrc - offset;
+      memmove_512bit_masked_u(nextdest, nextsrc, offset);
+      numbytes &= -64;
+      continue;
+    }
+#endif
     if(numbytes & 1) // 1 byte
     {
       offset = numbytes & 1;
@@ -3666,7 +3789,7 @@ void * memmove_large_reverse_a(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_512bit_4kB_a(nextdest, nextsrc, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_a, 4096, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #elif __AVX__
@@ -3715,7 +3838,7 @@ void * memmove_large_reverse_a(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_256bit_512B_a(nextdest, nextsrc, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_a, 512, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #else // SSE2 only
@@ -3756,7 +3879,7 @@ void * memmove_large_reverse_a(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_128bit_256B_a(nextdest, nextsrc, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_a, 256, nextdest, nextsrc, numbytes, 1, 0);
       numbytes = 0;
     }
 #endif
@@ -3781,6 +3904,17 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
   // this to work).
   // NOTE: Each memmove has its own loop so that any one can be used individually.
   {
+#ifdef __AVX512BW__
+    if(numbytes & 63) // The 1-63 bytes at the top end: one masked load/store instead of the cascade below
+    {
+      offset = numbytes & 63;
+      nextdest = (char *)nextdest - offset;
+      nextsrc = (char *)nextsrc - offset;
+      memmove_512bit_masked_u(nextdest, nextsrc, offset);
+      numbytes &= -64;
+      continue;
+    }
+#endif
     if(numbytes & 1) // 1 byte
     {
       offset = numbytes & 1;
@@ -3883,7 +4017,7 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_512bit_4kB_as(nextdest, nextsrc, numbytes >> 12);
+      memmove_blocks(memmove_512bit_4kB_as, 4096, nextdest, nextsrc, numbytes, 1, 1);
       numbytes = 0;
     }
 #elif __AVX2__
@@ -3932,7 +4066,7 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_256bit_512B_as(nextdest, nextsrc, numbytes >> 9);
+      memmove_blocks(memmove_256bit_512B_as, 512, nextdest, nextsrc, numbytes, 1, 1);
       numbytes = 0;
     }
 #else // SSE4.1 only
@@ -3973,7 +4107,7 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
       offset = numbytes;
       nextdest = (char *)nextdest - offset; // These should match initial src/dest
       nextsrc = (char *)nextsrc - offset;
-      memmove_128bit_256B_as(nextdest, nextsrc, numbytes >> 8);
+      memmove_blocks(memmove_128bit_256B_as, 256, nextdest, nextsrc, numbytes, 1, 1);
       numbytes = 0;
     }
 #endif
@@ -3981,6 +4115,87 @@ void * memmove_large_reverse_as(void *dest, void *src, size_t numbytes)
   return returnval;
 } // END MEMMOVE LARGE REVERSE, ALIGNED, STREAMING
 
+//-----------------------------------------------------------------------------
+// Small Shifts:
+//-----------------------------------------------------------------------------
+
+// Inserting or removing one entry of an array, like a memory map descriptor,
+// shifts everything after it by a few dozen bytes. That leaves src and dest
+// misaligned relative to each other, so every other vector load straddles two
+// cache lines. Haswell and up barely notice (see the top of this file), and
+// even permuting whole ymm/zmm registers into place loses to plain unaligned
+// moves there, but Nehalem through Ivy Bridge pay for every split. So on the
+// builds those run (no AVX2), a shift by a multiple of 4 bytes can instead do
+// only aligned loads and aligned stores: memmove_shift() pieces each dest vector
+// together with PSHUFB from the two aligned src vectors it overlaps, and keeps
+// the one of those loaded the time before rather than reading it again. Both
+// directions only ever load src data that hasn't been overwritten yet.
+//
+// AVXmem_Dispatch.Shift_Path turns this on or off, and memmove_calibrate() can
+// set it from a timed comparison.
+
+#ifndef __AVX2__
+#define SHIFT_VECTOR 16
+
+// Smaller moves aren't worth setting up the shuffles for
+#define SHIFT_MIN (4 * SHIFT_VECTOR)
+
+// dest and src may overlap, and must be a nonzero multiple of 4 bytes apart that
+// isn't a multiple of 16. numbytes must be at least SHIFT_MIN.
+static void * memmove_shift(void *dest, const void *src, size_t numbytes)
+{
+  uintptr_t first = ((uintptr_t)dest + SHIFT_VECTOR - 1) & -(uintptr_t)SHIFT_VECTOR; // First aligned dest vector
+  uintptr_t last = ((uintptr_t)dest + numbytes) & -(uintptr_t)SHIFT_VECTOR; // End of the last one
+  uintptr_t diff = (uintptr_t)src - (uintptr_t)dest; // Wraps around if src is below dest
+  size_t skew = diff & (SHIFT_VECTOR - 1); // Where each dest vector starts within an aligned src vector
+  uintptr_t line = first + diff - skew; // The aligned src vector the first dest vector starts in
+
+  // Each dest vector is the top (16 - skew) bytes of the src vector it starts in,
+  // followed by the bottom skew bytes of the next one. PSHUFB zeroes any byte
+  // whose index has the top bit set, so each index picks from only one of them.
+  __m128i position = _mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm_set1_epi8((char)skew));
+  __m128i index_low = _mm_or_si128(position, _mm_cmpgt_epi8(position, _mm_set1_epi8(15)));
+  __m128i index_high = _mm_sub_epi8(position, _mm_set1_epi8(16));
+
+  // The loads can reach up to 15 bytes outside of src, but an aligned vector
+  // never crosses into another page and those bytes go unused.
+  if((char *)dest < (char *)src)
+  {
+    memmove_large(dest, (void *)src, first - (uintptr_t)dest);
+
+    __m128i low = _mm_load_si128((const __m128i *)line);
+    for(uintptr_t d = first; d != last; d += SHIFT_VECTOR)
+    {
+      line += SHIFT_VECTOR;
+      __m128i high = _mm_load_si128((const __m128i *)line);
+      _mm_store_si128((__m128i *)d, _mm_or_si128(_mm_shuffle_epi8(low, index_low), _mm_shuffle_epi8(high, index_high)));
+      low = high;
+    }
+
+    memmove_large((void *)last, (char *)src + (last - (uintptr_t)dest), (uintptr_t)dest + numbytes - last);
+  }
+  else
+  {
+    memmove_large_reverse((void *)last, (char *)src + (last - (uintptr_t)dest), (uintptr_t)dest + numbytes - last);
+
+    line += last - first;
+    __m128i high = _mm_load_si128((const __m128i *)line);
+    for(uintptr_t d = last; d != first; )
+    {
+      d -= SHIFT_VECTOR;
+      line -= SHIFT_VECTOR;
+      __m128i low = _mm_load_si128((const __m128i *)line);
+      _mm_store_si128((__m128i *)d, _mm_or_si128(_mm_shuffle_epi8(low, index_low), _mm_shuffle_epi8(high, index_high)));
+      high = low;
+    }
+
+    memmove_large_reverse(dest, (void *)src, first - (uintptr_t)dest);
+  }
+
+  return dest;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Main Function:
 //-----------------------------------------------------------------------------
@@ -3995,6 +4210,22 @@ void * AVX_memmove(void *dest, void *src, size_t numbytes)
     return returnval;
   }
 
+#ifndef __AVX2__
+  // Overlapping moves by a multiple of 4 bytes that leave src and dest
+  // misaligned relative to each other, e.g. making room for a table entry
+  size_t delta = ((char*)dest > (char*)src) ? (size_t)((char*)dest - (char*)src) : (size_t)((char*)src - (char*)dest);
+  if(
+      AVXmem_Dispatch.Shift_Path
+      &&
+      (delta < numbytes) && ((delta & 3) == 0) && (delta & (SHIFT_VECTOR - 1))
+      &&
+      (numbytes >= SHIFT_MIN) && (numbytes <= AVXmem_Dispatch.NT_Threshold)
+    )
+  {
+    return memmove_shift(dest, src, numbytes);
+  }
+#endif
+
   if(
       ( ((uintptr_t)src & BYTE_ALIGNMENT) == 0 )
       &&
@@ -4004,7 +4235,7 @@ void * AVX_memmove(void *dest, void *src, size_t numbytes)
     if((char *)dest < (char *)src)
     {
       // This is the fastest case: src and dest are both cache line aligned.
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVXmem_Dispatch.NT_Threshold)
       {
         memmove_large_as(dest, src, numbytes);
       }
@@ -4015,7 +4246,7 @@ void * AVX_memmove(void *dest, void *src, size_t numbytes)
     }
     else // src < dest
     { // Need to move ends first
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVXmem_Dispatch.NT_Threshold)
       {
         memmove_large_reverse_as(dest, src, numbytes);
       }
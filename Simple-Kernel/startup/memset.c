@@ -1,5 +1,6 @@
 // Compile with GCC -O3 for best performance
 // It pretty much entirely negates the need to write these by hand in asm.
+#define AVXMEM_LIBRARY
 #include "avxmem.h"
 
 void * memset (void *dest, const uint8_t val, size_t len)
@@ -1378,6 +1379,39 @@ void * memset_512bit_4kB_as(void *dest, const __m512i val, size_t len)
 
 #endif
 
+//-----------------------------------------------------------------------------
+// AVX-512BW Masked Tails:
+//-----------------------------------------------------------------------------
+
+// With AVX512BW, anything under 64 bytes can be set with one byte-masked store
+// (vmovdqu8), so the dispatch functions below use this for their tails instead
+// of stepping down through all of the smaller sizes. Masked-off bytes are never
+// accessed, so this can't fault past the end of a buffer.
+// Len is # of bytes, and must be less than 64
+// Requires AVX512BW
+
+#ifdef __AVX512BW__
+void * memset_512bit_masked_u(void *dest, __m512i val, size_t len)
+{
+  _mm512_mask_storeu_epi8(dest, (1ULL << len) - 1, val);
+
+  return dest;
+}
+#endif
+
+// The same thing for 4-byte values, which only needs a dword mask (vmovdqu32)
+// Len is # of 4-byte values, and must be less than 16
+// Requires AVX512F
+
+#ifdef __AVX512F__
+void * memset_512bit_4B_masked_u(void *dest, __m512i val, size_t len)
+{
+  _mm512_mask_storeu_epi32(dest, (__mmask16)((1U << len) - 1), val);
+
+  return dest;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Dispatch Functions:
 //-----------------------------------------------------------------------------
@@ -1398,6 +1432,13 @@ void * memset_large(void *dest, const uint8_t val, size_t numbytes)
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_set1_epi8((char)val), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 16) // 1-15 bytes (the other scalars would need to be memset anyways)
     {
       memset(dest, val, numbytes);
@@ -1570,6 +1611,13 @@ void * memset_large_a(void *dest, const uint8_t val, size_t numbytes)
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_set1_epi8((char)val), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 16) // 1-15 bytes (the other scalars would need to be memset anyways)
     {
       memset(dest, val, numbytes);
@@ -1742,6 +1790,13 @@ void * memset_large_as(void *dest, const uint8_t val, size_t numbytes)
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_set1_epi8((char)val), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 16) // 1-15 bytes (the other scalars would need to be memset anyways)
     {
       memset(dest, val, numbytes);
@@ -1906,6 +1961,13 @@ void * memset_zeroes(void *dest, size_t numbytes) // Worst-case scenario: 127 by
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_setzero_si512(), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memset(dest, 0, numbytes);
@@ -2092,6 +2154,13 @@ void * memset_zeroes_a(void *dest, size_t numbytes) // Worst-case scenario: 127
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_setzero_si512(), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memset(dest, 0, numbytes);
@@ -2278,6 +2347,13 @@ void * memset_zeroes_as(void *dest, size_t numbytes) // Worst-case scenario: 127
   while(numbytes)
   // Each memset has its own loop.
   {
+#ifdef __AVX512BW__
+    if(numbytes < 64) // 1-63 bytes: one masked load/store instead of the cascade below
+    {
+      memset_512bit_masked_u(dest, _mm512_setzero_si512(), numbytes);
+      break;
+    }
+#endif
     if(numbytes < 2) // 1 byte
     {
       memset(dest, 0, numbytes);
@@ -2464,6 +2540,13 @@ void * memset_large_4B(void *dest, const uint32_t val, size_t numbytes_div_4)
   while(numbytes_div_4)
   // Each memset has its own loop.
   {
+#ifdef __AVX512F__
+    if(numbytes_div_4 < 16) // 4-60 bytes: one masked store instead of the cascade below
+    {
+      memset_512bit_4B_masked_u(dest, _mm512_set1_epi32((int32_t)val), numbytes_div_4);
+      break;
+    }
+#endif
     if(numbytes_div_4 < 4) // 4, 8, 12 bytes (the other scalars would need to be memset anyways)
     {
       memset_32bit(dest, val, numbytes_div_4);
@@ -2630,6 +2713,13 @@ void * memset_large_4B_a(void *dest, const uint32_t val, size_t numbytes_div_4)
   while(numbytes_div_4)
   // Each memset has its own loop.
   {
+#ifdef __AVX512F__
+    if(numbytes_div_4 < 16) // 4-60 bytes: one masked store instead of the cascade below
+    {
+      memset_512bit_4B_masked_u(dest, _mm512_set1_epi32((int32_t)val), numbytes_div_4);
+      break;
+    }
+#endif
     if(numbytes_div_4 < 4) // 4, 8, 12 bytes (the other scalars would need to be memset anyways)
     {
       memset_32bit(dest, val, numbytes_div_4);
@@ -2796,6 +2886,13 @@ void * memset_large_4B_as(void *dest, const uint32_t val, size_t numbytes_div_4)
   while(numbytes_div_4)
   // Each memset has its own loop.
   {
+#ifdef __AVX512F__
+    if(numbytes_div_4 < 16) // 4-60 bytes: one masked store instead of the cascade below
+    {
+      memset_512bit_4B_masked_u(dest, _mm512_set1_epi32((int32_t)val), numbytes_div_4);
+      break;
+    }
+#endif
     if(numbytes_div_4 < 4) // 4, 8, 12 bytes (the other scalars would need to be memset anyways)
     {
       memset_32bit(dest, val, numbytes_div_4);
@@ -2965,7 +3062,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
   {
     if(val == 0)
     {
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVXmem_Dispatch.NT_Threshold)
       {
         memset_zeroes_as(dest, numbytes);
       }
@@ -2976,7 +3073,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
     }
     else
     {
-      if(numbytes > CACHESIZELIMIT)
+      if(numbytes > AVXmem_Dispatch.NT_Threshold)
       {
         memset_large_as(dest, val, numbytes);
       }
@@ -3002,7 +3099,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
         // this process only needs to be done once per call if dest is unaligned.
         memset_zeroes(dest, numbytes_to_align);
         // Now this should be near the fastest possible since stores are aligned.
-        if((numbytes - numbytes_to_align) > CACHESIZELIMIT)
+        if((numbytes - numbytes_to_align) > AVXmem_Dispatch.NT_Threshold)
         {
           memset_zeroes_as(destoffset, numbytes - numbytes_to_align);
         }
@@ -3026,7 +3123,7 @@ void * AVX_memset(void *dest, const uint8_t val, size_t numbytes)
         // this process only needs to be done once per call if dest is unaligned.
         memset_large(dest, val, numbytes_to_align);
         // Now this should be near the fastest possible since stores are aligned.
-        if((numbytes - numbytes_to_align) > CACHESIZELIMIT)
+        if((numbytes - numbytes_to_align) > AVXmem_Dispatch.NT_Threshold)
         {
           memset_large_as(destoffset, val, numbytes - numbytes_to_align);
         }
@@ -3057,7 +3154,7 @@ void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4)
 
   if( ((uintptr_t)dest & BYTE_ALIGNMENT) == 0 ) // Check alignment
   {
-    if((numbytes_div_4 * 4) > CACHESIZELIMIT)
+    if((numbytes_div_4 * 4) > AVXmem_Dispatch.NT_Threshold)
     {
       memset_large_4B_as(dest, val, numbytes_div_4);
     }
@@ -3084,7 +3181,7 @@ void * AVX_memset_4B(void *dest, const uint32_t val, size_t numbytes_div_4)
       memset_large_4B(dest, val, numbytes_to_align_div_4);
       // Now this should be near the fastest possible since stores are aligned.
       // ...and in memset there are only stores.
-      if((numbytes_div_4 * 4 - numbytes_to_align) > CACHESIZELIMIT)
+      if((numbytes_div_4 * 4 - numbytes_to_align) > AVXmem_Dispatch.NT_Threshold)
       {
         memset_large_4B_as(destoffset, val, numbytes_div_4 - numbytes_to_align_div_4);
       }
@@ -0,0 +1,349 @@
+//==================================================================================================================================
+//  AVX Memory Functions: String & Search Functions
+//==================================================================================================================================
+//
+// Vectorized strlen, strnlen, memchr, memrchr, strcmp, strncmp, and memmem, as AVX_strlen, etc. They check 64 bytes at a time with
+// AVX512BW, 32 with AVX2, and 16 otherwise (first-generation AVX has no 256-bit integer compares, so the AVX build uses SSE2 here).
+//
+// None of these know how long their input is ahead of time, so they can read past the end of a string. That's only safe within the
+// same page, which is why the single-string functions use aligned loads: an aligned vector never crosses a page boundary, and the
+// bytes of it that come before the start or after the end are just masked off. The two-string ones can't align both strings at once,
+// so they go byte by byte whenever either one is within a vector's width of the end of a page.
+//
+// Like the rest of the library, these may read past the end of the data (but never past the end of its page), so they are for normal
+// memory, not MMIO.
+//
+
+#define AVXMEM_LIBRARY
+#include "avxmem.h"
+
+#ifdef __AVX512BW__
+#define STR_VECTOR 64
+#elif __AVX2__
+#define STR_VECTOR 32
+#else
+#define STR_VECTOR 16
+#endif
+
+#define STR_PAGE_SIZE 4096
+
+//-----------------------------------------------------------------------------
+// Helpers:
+//-----------------------------------------------------------------------------
+
+// Returns a mask with bit n set if byte n of the STR_VECTOR bytes at (aligned) address equals val
+static inline uint64_t str_match_a(const void *address, const uint8_t val)
+{
+#ifdef __AVX512BW__
+  return _mm512_cmpeq_epi8_mask(_mm512_load_si512(address), _mm512_set1_epi8((char)val));
+#elif __AVX2__
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)address), _mm256_set1_epi8((char)val)));
+#else
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)address), _mm_set1_epi8((char)val)));
+#endif
+}
+
+// Same as str_match_a(), but address can be unaligned
+static inline uint64_t str_match_u(const void *address, const uint8_t val)
+{
+#ifdef __AVX512BW__
+  return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(address), _mm512_set1_epi8((char)val));
+#elif __AVX2__
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)address), _mm256_set1_epi8((char)val)));
+#else
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)address), _mm_set1_epi8((char)val)));
+#endif
+}
+
+// Returns a mask with bit n set if byte n differs between the (unaligned) addresses, or if it's a NUL in str1
+static inline uint64_t str_diff_or_nul_u(const void *str1, const void *str2)
+{
+#ifdef __AVX512BW__
+  __m512i chunk1 = _mm512_loadu_si512(str1);
+  __m512i chunk2 = _mm512_loadu_si512(str2);
+  return _mm512_cmpneq_epi8_mask(chunk1, chunk2) | _mm512_testn_epi8_mask(chunk1, chunk1);
+#elif __AVX2__
+  __m256i chunk1 = _mm256_loadu_si256((const __m256i*)str1);
+  __m256i chunk2 = _mm256_loadu_si256((const __m256i*)str2);
+  uint32_t equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk1, chunk2));
+  uint32_t nul = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk1, _mm256_setzero_si256()));
+  return (uint32_t)(~equal | nul);
+#else
+  __m128i chunk1 = _mm_loadu_si128((const __m128i*)str1);
+  __m128i chunk2 = _mm_loadu_si128((const __m128i*)str2);
+  uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk1, chunk2));
+  uint32_t nul = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk1, _mm_setzero_si128()));
+  return (~equal | nul) & 0xFFFF;
+#endif
+}
+
+// Mask of the lowest num_bits bits, for 0 <= num_bits <= 64
+static inline uint64_t str_low_bits(size_t num_bits)
+{
+  return (num_bits >= 64) ? ~0ULL : ((1ULL << num_bits) - 1);
+}
+
+// Nonzero if a STR_VECTOR-byte load from address would cross into the next page
+static inline int str_near_page_end(const void *address)
+{
+  return ((uintptr_t)address & (STR_PAGE_SIZE - 1)) > (STR_PAGE_SIZE - STR_VECTOR);
+}
+
+//-----------------------------------------------------------------------------
+// Main Functions:
+//-----------------------------------------------------------------------------
+
+// Same as strlen
+size_t AVX_strlen(const char *str)
+{
+  size_t skew = (uintptr_t)str & (STR_VECTOR - 1);
+  const char * block = str - skew;
+
+  // Bytes before str are shifted out
+  uint64_t mask = str_match_a(block, 0) >> skew;
+  if(mask)
+  {
+    return (size_t)__builtin_ctzll(mask);
+  }
+
+  for(;;)
+  {
+    block += STR_VECTOR;
+    mask = str_match_a(block, 0);
+    if(mask)
+    {
+      return (size_t)(block - str) + (size_t)__builtin_ctzll(mask);
+    }
+  }
+}
+
+// Same as strnlen: the length of str, but at most maxlen
+size_t AVX_strnlen(const char *str, size_t maxlen)
+{
+  if(maxlen == 0)
+  {
+    return 0;
+  }
+
+  size_t skew = (uintptr_t)str & (STR_VECTOR - 1);
+  size_t length = STR_VECTOR - skew; // Bytes checked so far
+
+  uint64_t mask = str_match_a(str - skew, 0) >> skew;
+  if(mask)
+  {
+    length = (size_t)__builtin_ctzll(mask);
+    return (length < maxlen) ? length : maxlen;
+  }
+
+  while(length < maxlen)
+  {
+    mask = str_match_a(str + length, 0);
+    if(mask)
+    {
+      length += (size_t)__builtin_ctzll(mask);
+      return (length < maxlen) ? length : maxlen;
+    }
+    length += STR_VECTOR;
+  }
+
+  return maxlen;
+}
+
+// Same as memchr
+void * AVX_memchr(const void *str, int val, size_t numbytes)
+{
+  if(numbytes == 0)
+  {
+    return NULL;
+  }
+
+  const uint8_t * bytes = (const uint8_t*)str;
+  size_t skew = (uintptr_t)bytes & (STR_VECTOR - 1);
+  size_t offset = STR_VECTOR - skew;
+
+  uint64_t mask = str_match_a(bytes - skew, (uint8_t)val) >> skew;
+  if(mask)
+  {
+    size_t index = (size_t)__builtin_ctzll(mask);
+    return (index < numbytes) ? (void*)(bytes + index) : NULL;
+  }
+
+  while(offset < numbytes)
+  {
+    mask = str_match_a(bytes + offset, (uint8_t)val);
+    if(mask)
+    {
+      size_t index = offset + (size_t)__builtin_ctzll(mask);
+      return (index < numbytes) ? (void*)(bytes + index) : NULL;
+    }
+    offset += STR_VECTOR;
+  }
+
+  return NULL;
+}
+
+// Same as GNU memrchr: memchr, but finds the last match instead of the first
+void * AVX_memrchr(const void *str, int val, size_t numbytes)
+{
+  if(numbytes == 0)
+  {
+    return NULL;
+  }
+
+  const uint8_t * bytes = (const uint8_t*)str;
+  const uint8_t * end = bytes + numbytes;
+  const uint8_t * block = (const uint8_t*)((uintptr_t)(end - 1) & ~(uintptr_t)(STR_VECTOR - 1));
+
+  // Bytes past the end are masked off
+  uint64_t mask = str_match_a(block, (uint8_t)val) & str_low_bits((size_t)(end - block));
+
+  for(;;)
+  {
+    if(block <= bytes)
+    {
+      // This is the first block, so bytes before str are masked off too
+      mask &= ~str_low_bits((size_t)(bytes - block));
+      break;
+    }
+    if(mask)
+    {
+      break;
+    }
+    block -= STR_VECTOR;
+    mask = str_match_a(block, (uint8_t)val);
+  }
+
+  return mask ? (void*)(block + (63 - __builtin_clzll(mask))) : NULL;
+}
+
+// Same as strcmp
+int AVX_strcmp(const char *str1, const char *str2)
+{
+  const uint8_t * bytes1 = (const uint8_t*)str1;
+  const uint8_t * bytes2 = (const uint8_t*)str2;
+
+  for(;;)
+  {
+    if(str_near_page_end(bytes1) || str_near_page_end(bytes2))
+    {
+      // Go byte by byte until both are past the page boundary
+      for(size_t index = 0; index < STR_VECTOR; index++)
+      {
+        if((*bytes1 != *bytes2) || (*bytes1 == 0))
+        {
+          return (int)*bytes1 - (int)*bytes2;
+        }
+        bytes1++;
+        bytes2++;
+      }
+    }
+    else
+    {
+      uint64_t mask = str_diff_or_nul_u(bytes1, bytes2);
+      if(mask)
+      {
+        size_t index = (size_t)__builtin_ctzll(mask);
+        return (int)bytes1[index] - (int)bytes2[index];
+      }
+      bytes1 += STR_VECTOR;
+      bytes2 += STR_VECTOR;
+    }
+  }
+}
+
+// Same as strncmp
+int AVX_strncmp(const char *str1, const char *str2, size_t numbytes)
+{
+  const uint8_t * bytes1 = (const uint8_t*)str1;
+  const uint8_t * bytes2 = (const uint8_t*)str2;
+
+  while(numbytes)
+  {
+    if(str_near_page_end(bytes1) || str_near_page_end(bytes2))
+    {
+      for(size_t index = 0; (index < STR_VECTOR) && numbytes; index++)
+      {
+        if((*bytes1 != *bytes2) || (*bytes1 == 0))
+        {
+          return (int)*bytes1 - (int)*bytes2;
+        }
+        bytes1++;
+        bytes2++;
+        numbytes--;
+      }
+    }
+    else
+    {
+      // Anything past numbytes doesn't count
+      uint64_t mask = str_diff_or_nul_u(bytes1, bytes2) & str_low_bits(numbytes);
+      if(mask)
+      {
+        size_t index = (size_t)__builtin_ctzll(mask);
+        return (int)bytes1[index] - (int)bytes2[index];
+      }
+      if(numbytes <= STR_VECTOR)
+      {
+        break;
+      }
+      bytes1 += STR_VECTOR;
+      bytes2 += STR_VECTOR;
+      numbytes -= STR_VECTOR;
+    }
+  }
+
+  return 0;
+}
+
+// Same as GNU memmem: finds the first place needle shows up in haystack
+void * AVX_memmem(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen)
+{
+  const uint8_t * hay = (const uint8_t*)haystack;
+  const uint8_t * pin = (const uint8_t*)needle;
+
+  if(needlelen == 0)
+  {
+    return (void*)hay;
+  }
+  if(needlelen > haystacklen)
+  {
+    return NULL;
+  }
+
+  size_t last_start = haystacklen - needlelen; // The last place needle could start
+  size_t offset = 0;
+
+  // Find where both the first and last bytes of needle match, and only compare the rest there. Every load stays inside haystack.
+  while(last_start - offset >= (STR_VECTOR - 1))
+  {
+    uint64_t mask = str_match_u(hay + offset, pin[0]) & str_match_u(hay + offset + needlelen - 1, pin[needlelen - 1]);
+
+    while(mask)
+    {
+      size_t index = offset + (size_t)__builtin_ctzll(mask);
+      if((needlelen <= 2) || (AVX_memcmp(hay + index + 1, pin + 1, needlelen - 2, 0) == 0))
+      {
+        return (void*)(hay + index);
+      }
+      mask &= mask - 1;
+    }
+
+    offset += STR_VECTOR;
+    if(offset > last_start)
+    {
+      return NULL;
+    }
+  }
+
+  for( ; offset <= last_start; offset++)
+  {
+    if((hay[offset] == pin[0]) && (hay[offset + needlelen - 1] == pin[needlelen - 1]))
+    {
+      if((needlelen <= 2) || (AVX_memcmp(hay + offset + 1, pin + 1, needlelen - 2, 0) == 0))
+      {
+        return (void*)(hay + offset);
+      }
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,173 @@
+//==================================================================================================================================
+//  AVX Memory Functions: Copies Out of Write-Combining Memory
+//==================================================================================================================================
+//
+// Framebuffers and other MMIO are usually mapped write-combining (WC) or uncacheable, where every ordinary load is a separate,
+// uncached bus read that stalls the core until it comes back. That makes reading back from them (e.g. scrolling text by moving the
+// framebuffer up one line) orders of magnitude slower than writing to them. SSE4.1's MOVNTDQA is the one load that's fast there: on WC
+// memory it pulls in a whole 64-byte line at a time into a streaming load buffer, and the other three 16-byte loads from that line
+// come straight out of it. It's treated like a regular load on write-back memory, so these also work fine (just no faster) if the
+// source happens to be cacheable.
+//
+// The loads only stay fast if nothing else goes to the same memory in between, so like Intel's own guidance for copying out of
+// video memory, these first stream a block of up to WC_BOUNCE_SIZE bytes into a bounce buffer small enough to stay in L1, and only
+// then copy that block on to dest. Staying at 128 bits keeps this to SSE4.1: wider loads don't fetch from the bus any faster.
+//
+
+#define AVXMEM_LIBRARY
+#include "avxmem.h"
+
+#define WC_BOUNCE_SIZE 4096
+
+static void wc_copy_block(void *dest, const void *src, size_t numbytes);
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memcpy_from_wc: Copy Out of WC Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same arguments and return value as AVX_memcpy, meant for when src is in WC or UC memory. dest can be anything, including WC memory.
+// src and dest must not overlap; use memmove_wc for that.
+//
+
+void * memcpy_from_wc(void *dest, const void *src, size_t numbytes)
+{
+  void * returnval = dest;
+
+  // Make sure any of this core's writes still sitting in WC buffers have landed before reading them back
+  _mm_mfence();
+
+  // Cut the first block short so the rest all start 16-byte aligned in src
+  size_t block = WC_BOUNCE_SIZE - ((uintptr_t)src & 15);
+
+  while(numbytes)
+  {
+    if(block > numbytes)
+    {
+      block = numbytes;
+    }
+
+    wc_copy_block(dest, src, block);
+
+    dest = (char*)dest + block;
+    src = (const char*)src + block;
+    numbytes -= block;
+    block = WC_BOUNCE_SIZE;
+  }
+
+  _mm_sfence();
+
+  return returnval;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  memmove_wc: Move Within or Out of WC Memory
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// Same arguments and return value as AVX_memmove, but src and dest may overlap, like when scrolling a framebuffer. Each block is read
+// completely into the bounce buffer before any of it is written, so the only thing that matters is doing the blocks in the right
+// order: from the bottom up when dest is below src, and from the top down otherwise.
+//
+
+void * memmove_wc(void *dest, const void *src, size_t numbytes)
+{
+  if(((char*)dest <= (const char*)src) || ((char*)dest >= ((const char*)src + numbytes)))
+  {
+    return memcpy_from_wc(dest, src, numbytes);
+  }
+
+  void * returnval = dest;
+
+  _mm_mfence();
+
+  // Cut the last block short so the rest all start 16-byte aligned in src
+  size_t block = ((uintptr_t)src + numbytes) & 15;
+  if(block == 0)
+  {
+    block = WC_BOUNCE_SIZE;
+  }
+
+  while(numbytes)
+  {
+    if(block > numbytes)
+    {
+      block = numbytes;
+    }
+
+    numbytes -= block;
+    wc_copy_block((char*)dest + numbytes, (const char*)src + numbytes, block);
+    block = WC_BOUNCE_SIZE;
+  }
+
+  _mm_sfence();
+
+  return returnval;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  wc_copy_block: Copy up to WC_BOUNCE_SIZE Bytes Through the Bounce Buffer
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// The bounce buffer lives on the stack, so this is safe to use from any number of cores at once. Data goes into it at the same
+// offset within 16 bytes as in src, which lets the streaming loads and the stores into the buffer both be aligned; only the parts
+// of src before the first and after the last 16-byte boundary need ordinary loads.
+//
+
+static void wc_copy_block(void *dest, const void *src, size_t numbytes)
+{
+  __attribute__((aligned(64))) uint8_t bounce[WC_BOUNCE_SIZE + 32];
+
+  size_t skew = (uintptr_t)src & 15;
+  uint8_t * buffer = bounce + skew;
+  const uint8_t * src_bytes = (const uint8_t*)src;
+
+  size_t head = skew ? (16 - skew) : 0;
+  if(head > numbytes)
+  {
+    head = numbytes;
+  }
+  size_t body_end = head + ((numbytes - head) & ~(size_t)15);
+
+  // Read the whole block first
+  for(size_t i = 0; i < head; i++)
+  {
+    buffer[i] = src_bytes[i];
+  }
+
+  size_t i = head;
+
+  for( ; (body_end - i) >= 64; i += 64)
+  {
+    // One line from the bus, so all four loads back to back
+    __m128i line0 = _mm_stream_load_si128((__m128i*)(src_bytes + i));
+    __m128i line1 = _mm_stream_load_si128((__m128i*)(src_bytes + i + 16));
+    __m128i line2 = _mm_stream_load_si128((__m128i*)(src_bytes + i + 32));
+    __m128i line3 = _mm_stream_load_si128((__m128i*)(src_bytes + i + 48));
+    _mm_store_si128((__m128i*)(buffer + i), line0);
+    _mm_store_si128((__m128i*)(buffer + i + 16), line1);
+    _mm_store_si128((__m128i*)(buffer + i + 32), line2);
+    _mm_store_si128((__m128i*)(buffer + i + 48), line3);
+  }
+
+  for( ; i < body_end; i += 16)
+  {
+    _mm_store_si128((__m128i*)(buffer + i), _mm_stream_load_si128((__m128i*)(src_bytes + i)));
+  }
+
+  for( ; i < numbytes; i++)
+  {
+    buffer[i] = src_bytes[i];
+  }
+
+  // Then write it out
+  uint8_t * dest_bytes = (uint8_t*)dest;
+
+  for(i = 0; (numbytes - i) >= 16; i += 16)
+  {
+    _mm_storeu_si128((__m128i*)(dest_bytes + i), _mm_loadu_si128((__m128i*)(buffer + i)));
+  }
+
+  for( ; i < numbytes; i++)
+  {
+    dest_bytes[i] = buffer[i];
+  }
+}